@@ -0,0 +1,116 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+#include <vector>
+
+#include "udpecho.h"
+#include "sensor.h"
+
+/*!\brief Protokoll des Steuerkanals zwischen Sender und Bouncer
+ */
+class UDPEchoControlProtocol
+{
+	public:
+		static const int Version=2;
+		static const size_t HeaderSize=8;
+		static const size_t MaxPayloadSize=64*1024*1024;
+
+		enum Command {
+			CMD_START=1,
+			CMD_STOP=2,
+			CMD_RUN=3,
+			CMD_OK=100,
+			CMD_ERROR=101
+		};
+
+		static void sendMessage(ppl7::TCPSocket &socket, int command, const ppl7::AssocArray &data);
+		static int receiveMessage(ppl7::TCPSocket &socket, ppl7::AssocArray &data, int timeout_seconds, ppl7::Thread *watch_thread=NULL);
+};
+
+/*!\brief Vom Bouncer gemessene Werte eines Testlaufs
+ */
+class UDPEchoRemoteResults
+{
+	public:
+		UDPEchoCounter total;
+		SystemStat stat_start;
+		SystemStat stat_end;
+		std::vector<UDPEchoCounter> counter;
+		std::vector<SystemStat> stat;
+		UDPEchoPerfCounter::Values perf;
+
+		UDPEchoRemoteResults();
+		void clear();
+		void addSample(const UDPEchoCounter &counter, const SystemStat &stat);
+		void exportToArray(ppl7::AssocArray &data) const;
+		void importFromArray(const ppl7::AssocArray &data);
+		double getDuration() const;
+		double getCpuUsage() const;
+		double getCpuUsageMax() const;
+};
+
+class UDPEchoControlServer : public ppl7::Thread, private ppl7::TCPSocket
+{
+	private:
+		ppl7::Mutex mutex;
+		UDPEchoBouncer &bouncer;
+		UDPEchoRemoteResults results;
+		UDPEchoPerfCounter::Values perf_start;
+		bool trialActive;
+
+		void startTrial();
+		void stopTrial(ppl7::AssocArray &reply);
+		int receiveConnect(ppl7::TCPSocket *socket, const ppl7::String &host, int port);
+
+	public:
+		UDPEchoControlServer(UDPEchoBouncer &bouncer);
+		~UDPEchoControlServer();
+		void start(const ppl7::String &host_and_port);
+		void stop();
+		void sample(UDPEchoCounter &counter, SystemStat &stat);
+		void run();
+};
+
+class UDPEchoControlClient
+{
+	private:
+		ppl7::TCPSocket socket;
+		int timeout;
+
+		void request(int command, const ppl7::AssocArray &data, ppl7::AssocArray &reply);
+
+	public:
+		UDPEchoControlClient();
+		void connect(const ppl7::String &host_and_port);
+		void disconnect();
+		bool isConnected() const;
+		void setTimeout(int seconds);
+		void startTrial();
+		void stopTrial(UDPEchoRemoteResults &results);
+		void startAgentRun(const ppl7::AssocArray &config);
+		int waitForAgentResults(ppl7::AssocArray &results, int timeout_seconds);
+};
+
+
+#endif /* CONTROL_H_ */
@@ -0,0 +1,118 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DNS_H_
+#define DNS_H_
+
+#include <ppl7.h>
+#include <stdint.h>
+#include <vector>
+
+#define DNS_HEADER_SIZE 12
+
+/*!\brief DNS Response-Codes nach RFC 1035
+ */
+enum DNSRcode {
+	DNS_RCODE_NOERROR=0,
+	DNS_RCODE_FORMERR=1,
+	DNS_RCODE_SERVFAIL=2,
+	DNS_RCODE_NXDOMAIN=3,
+	DNS_RCODE_NOTIMP=4,
+	DNS_RCODE_REFUSED=5
+};
+
+int DNSParseRcode(const ppl7::String &name);
+const char *DNSRcodeName(int rcode);
+int DNSParseType(const ppl7::String &name);
+size_t DNSEncodeName(const ppl7::String &name, unsigned char *buffer, size_t size);
+
+static inline uint16_t DNSGet16(const unsigned char *p)
+{
+	return (uint16_t)((p[0]<<8)|p[1]);
+}
+
+static inline void DNSPut16(unsigned char *p, uint16_t value)
+{
+	p[0]=(unsigned char)(value>>8);
+	p[1]=(unsigned char)(value&0xff);
+}
+
+size_t DNSSkipQuestion(const unsigned char *packet, size_t size);
+
+class DNSResponder
+{
+	public:
+		static const int MaxAnswers=8;
+		static const size_t MaxRRSize=12+256;
+
+		class Answer {
+			public:
+				uint16_t qtype;
+				uint16_t size;
+				unsigned char rr[MaxRRSize];
+		};
+
+	private:
+		Answer answers[MaxAnswers];
+		int numAnswers;
+		int rcode;
+		uint32_t ttl;
+		bool enabled;
+
+		const Answer *findAnswer(uint16_t qtype) const;
+
+	public:
+		DNSResponder();
+		void enable(bool flag);
+		bool isEnabled() const;
+		void setRcode(int rcode);
+		void setTTL(uint32_t ttl);
+		void addAnswer(const ppl7::String &spec);
+		void addAnswers(const ppl7::String &list);
+		size_t respond(unsigned char *packet, size_t size, size_t buffersize) const;
+};
+
+/*!\brief Liste vorkodierter DNS-Anfragen für den Sender
+ */
+class DNSQueryCorpus
+{
+	private:
+		std::vector<unsigned char> wire;
+		std::vector<uint32_t> offsets;
+		size_t maxQuerySize;
+		size_t invalidLines;
+
+		bool addQuery(const char *line, size_t len, int edns_size);
+
+	public:
+		DNSQueryCorpus();
+		void load(const ppl7::String &filename, int edns_size=0);
+		void clear();
+		size_t count() const;
+		size_t getMaxQuerySize() const;
+		size_t getInvalidLines() const;
+
+		//! Anfrage \p index im Wire-Format, die Transaktions-ID ist 0
+		inline const unsigned char *query(size_t index, size_t &size) const {
+			size=offsets[index+1]-offsets[index];
+			return &wire[offsets[index]];
+		}
+};
+
+#endif /* DNS_H_ */
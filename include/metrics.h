@@ -0,0 +1,52 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+
+#include "udpecho.h"
+#include "sensor.h"
+
+/*!\brief HTTP-Endpunkt mit den Zählern des Bouncers im OpenMetrics-Format
+ */
+class UDPEchoMetricsServer : public ppl7::Thread, private ppl7::TCPSocket
+{
+	private:
+		UDPEchoBouncer &bouncer;
+		double startTime;
+
+		int receiveConnect(ppl7::TCPSocket *socket, const ppl7::String &host, int port);
+
+	public:
+		//! Maximale Größe eines HTTP-Requests in Bytes
+		static const size_t MaxRequestSize=8192;
+
+		UDPEchoMetricsServer(UDPEchoBouncer &bouncer);
+		~UDPEchoMetricsServer();
+		void start(const ppl7::String &host_and_port);
+		void stop();
+		void run();
+		void render(ppl7::String &body);
+};
+
+
+#endif /* METRICS_H_ */
@@ -23,6 +23,9 @@
 #include <ppl7.h>
 #include <ppl7-inet.h>
 #include "udpecho.h"
+#include "control.h"
+#include "statslog.h"
+#include <vector>
 
 
 class UDPSender
@@ -35,45 +38,128 @@ class UDPSender
 				int			queryrate;
 				int64_t	counter_send;
 				int64_t	counter_received;
+				int64_t	bytes_send;
 				int64_t	bytes_received;
 				int64_t	counter_errors;
 				int64_t	packages_lost;
 				int64_t   counter_0bytes;
+				int64_t   counter_truncated;
+				int64_t   counter_corrupted;
+				int64_t   counter_length_mismatch;
+				int64_t   counter_dns_unmatched;
+				int64_t   counter_dns_invalid;
+				int64_t   counter_rcodes[16];
 				int64_t   counter_errorcodes[255];
+				int64_t   counter_socket_dropped;
+				SystemStat::Udp	udp;
+				UDPEchoPerfCounter::Values	perf_send;
+				UDPEchoPerfCounter::Values	perf_receive;
 				double		duration;
-				double		rtt_total;
+				double		rtt_avg;
 				double		rtt_min;
 				double		rtt_max;
+				UDPEchoLatencyHistogram	histogram;
+				UDPEchoTargetTable	targets;
+				UDPEchoFlowBuckets	flows;
+				bool		remote_valid;
+				UDPEchoRemoteResults	remote;
+
+				void clear();
+				void merge(const Results &other);
+				void exportToArray(ppl7::AssocArray &data) const;
+				void importFromArray(const ppl7::AssocArray &data);
 		};
 		ppl7::ThreadPool threadpool;
 		ppl7::String Ziel;
 		ppl7::String Quelle;
 		ppl7::File CSVFile;
 		ppl7::Array SourceIpList;
+		UDPEchoTargetTable Targets;
+		DNSQueryCorpus QueryCorpus;
+		UDPEchoControlClient Control;
+		UDPEchoRemoteResults RemoteResults;
+		bool RemoteResultsValid;
+		std::vector<UDPEchoControlClient*> Agents;
+		ppl7::Array AgentNames;
+		UDPEchoStatsLog StatsLog;
+		double LogTime;
+		SystemStat LogStat;
+		UDPEchoCounter LogCounter;
+		UDPEchoLatencyHistogram LogHistogram;
+		int64_t SocketDropsStart;
+		SystemStat::Udp UdpStart;
 		int Packetsize;
+		int MaxResponseSize;
 		int Laufzeit;
 		int Timeout;
 		int ThreadCount;
+		int SocketCount;
+		int SourcePort;
+		int FlowBuckets;
+		ppl7::String RawNetwork;
+		UDPEchoRawPacket RawPacket;
+		bool RunToCompletion;
+		bool LatencyCompare;
+		int SendBurst;
+		int ReceiveBurst;
 		float Zeitscheibe;
 		bool ignoreResponses;
 		bool alwaysRandomize;
+		bool dnsMode;
+		UDPEchoChecksum::Algorithm Checksum;
 
 		void openCSVFile(const ppl7::String Filename);
-		void run(int queryrate);
+		void run(int queryrate, double start_time=0.0);
 		void presentResults(const UDPSender::Results &result);
+		void presentLatencyComparison(const UDPSender::Results &idle, const UDPSender::Results &busy);
+		void presentRemoteResults(const UDPEchoRemoteResults &remote);
+		void presentLossAttribution(const UDPSender::Results &result);
+		void presentTargetResults(const UDPEchoTargetTable &targets);
+		void presentFlowResults(const UDPEchoFlowBuckets &flows);
 		void saveResultsToCsv(const UDPSender::Results &result);
 		void prepareThreads();
 		void getResults(UDPSender::Results &result);
+		void stopRemoteTrial();
+		void writeStatsRecord();
+		void connectAgents(const ppl7::String &list);
+		void disconnectAgents();
+		void runDistributed(int queryrate, UDPSender::Results &result);
+		int runAgent(const ppl7::String &host_and_port);
+		static int splitQueryRate(int queryrate, int parts, int index);
 		ppl7::Array getQueryRates(const ppl7::String &QueryRates);
 		void readSourceIPList(const ppl7::String &filename);
+		void readTargetList(const ppl7::String &list);
+		bool parseBurst(const ppl7::String &ratio);
 		ppl7::SockAddr getSockAddr(const ppl7::String &Hostname, int Port);
 
 		UDPEchoCounter getCounter();
+		int64_t getSocketDrops();
+		void getLatencyHistogram(UDPEchoLatencyHistogram &histogram);
 
 	public:
+		//! Vorlauf in Sekunden zwischen dem Verteilen eines Lastlaufs und dem gemeinsamen Start der Agenten
+		static const int AgentStartDelay=2;
+
 		UDPSender();
+		~UDPSender();
 		void help();
 		int main(int argc, char**argv);
+		void runAgentTrial(const ppl7::AssocArray &config, ppl7::AssocArray &reply);
+};
+
+class UDPSenderAgent : public ppl7::Thread, private ppl7::TCPSocket
+{
+	private:
+		UDPSender &sender;
+
+		int receiveConnect(ppl7::TCPSocket *socket, const ppl7::String &host, int port);
+
+	public:
+		UDPSenderAgent(UDPSender &sender);
+		~UDPSenderAgent();
+		void start(const ppl7::String &host_and_port);
+		void stop();
+		void run();
 };
 
 
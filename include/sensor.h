@@ -22,6 +22,8 @@
 
 #include <ppl7.h>
 #include <map>
+#include <vector>
+#include <stdint.h>
 
 PPL7EXCEPTION(KernelAccessFailed, Exception);
 PPL7EXCEPTION(SystemCallFailed, Exception);
@@ -61,18 +63,42 @@ class SystemStat
 		{
 			public:
 				Cpu() {
-					user=nice=system=idle=iowait=0;
+					user=nice=system=idle=iowait=irq=softirq=0;
 				}
 				int user;
 				int nice;
 				int system;
 				int idle;
 				int iowait;
+				int irq;
+				int softirq;
 
 				static double getUsage(const SystemStat::Cpu &sample1,const SystemStat::Cpu &sample2);
+				static double getIrqUsage(const SystemStat::Cpu &sample1,const SystemStat::Cpu &sample2);
+				static double getSoftirqUsage(const SystemStat::Cpu &sample1,const SystemStat::Cpu &sample2);
 
 		};
 
+		/*!\brief Zähler eines einzelnen CPU-Kerns
+		 *
+		 * Neben den Zeiten aus /proc/stat die Werte aus /proc/net/softnet_stat: vom
+		 * NET_RX-Softirq verarbeitete Pakete, wegen voller Backlog-Queue verworfene Pakete
+		 * und Abbrüche der Verarbeitung wegen erschöpftem Budget (time_squeeze).
+		 */
+		class Core
+		{
+			public:
+				Core() {
+					id=0;
+					processed=dropped=time_squeeze=0;
+				}
+				int id;
+				Cpu cpu;
+				unsigned long processed;
+				unsigned long dropped;
+				unsigned long time_squeeze;
+		};
+
 		class Sysinfo
 		{
 			public:
@@ -90,6 +116,30 @@ class SystemStat
 				int procs;
 		};
 
+		/*!\brief Zähler des UDP-Stacks aus der UDP-MIB (/proc/net/snmp)
+		 *
+		 * Die Zähler gelten für den gesamten Host bzw. Netzwerk-Namespace und enthalten
+		 * auch den UDP-Verkehr aller anderen Prozesse.
+		 */
+		class Udp
+		{
+			public:
+				unsigned long InDatagrams;
+				unsigned long NoPorts;
+				unsigned long InErrors;
+				unsigned long OutDatagrams;
+				unsigned long RcvbufErrors;
+				unsigned long SndbufErrors;
+				Udp() {
+					clear();
+				}
+				void clear() {
+					InDatagrams=NoPorts=InErrors=OutDatagrams=RcvbufErrors=SndbufErrors=0;
+				}
+
+				static Udp getDelta(const Udp &sample1, const Udp &sample2);
+		};
+
 		class Interface
 		{
 		public:
@@ -101,17 +151,88 @@ class SystemStat
 		double sampleTime;
 
 		Cpu		cpu;
+		std::vector<Core> cores;
 		Sysinfo	sysinfo;
 		Interface net_total;
+		Udp		udp;
 		std::map<ppl7::String, Interface> interfaces;
 
 		void exportToArray(ppl7::AssocArray &data) const;
 		void importFromArray(const ppl7::AssocArray &data);
+		static int getHottestCore(const SystemStat &sample1, const SystemStat &sample2, double &usage);
+		size_t binarySize() const;
+		size_t exportBinary(void *buffer, size_t size) const;
+		size_t importBinary(const void *buffer, size_t size);
 		void print() const;
 
 };
 
+/*!\brief Erfassung der Sensordaten mit dauerhaft geöffneten Dateien
+ *
+ * Unter Linux werden /proc/stat und /proc/net/dev beim ersten Aufruf geöffnet und
+ * danach bei jeder Messung per pread() in einen festen Puffer gelesen. Der Parser
+ * arbeitet direkt auf dem Puffer und legt die Interfaces in einem flachen Array
+ * ab. Der Vektor SystemStat::cores wird bei der ersten Messung in ein SystemStat
+ * auf die Anzahl der Kerne gebracht. Jede weitere Messung in dasselbe SystemStat
+ * kommt ohne Speicherallokation aus, solange die Map SystemStat::interfaces nicht
+ * gefüllt werden muss und sich die Anzahl der Kerne nicht ändert.
+ *
+ * Die Zähler der Interfaces werden unter Linux bevorzugt per Netlink (RTM_GETLINK
+ * mit IFLA_STATS64) als 64-Bit-Werte in einem einzigen Dump abgefragt. Steht
+ * Netlink nicht zur Verfügung, wird dauerhaft auf /proc/net/dev ausgewichen.
+ *
+ * Eine Instanz darf nur von einem Thread gleichzeitig verwendet werden.
+ */
+class SensorSampler
+{
+	public:
+		static const int MaxInterfaces=256;
+		static const size_t InterfaceNameSize=16;
+
+		class InterfaceSample
+		{
+			public:
+				char name[InterfaceNameSize];
+				SystemStat::Network receive;
+				SystemStat::Network transmit;
+		};
+
+	private:
+		int fd_stat;
+		int fd_softnet;
+		int fd_netdev;
+		int fd_snmp;
+		int fd_netlink;
+		uint32_t netlink_seq;
+		bool netlink;
+		char *buffer;
+		size_t buffersize;
+		InterfaceSample *iflist;
+		int ifcount;
+
+		size_t readFile(int &fd, const char *filename, bool whole);
+		void sampleCpuUsage(SystemStat::Cpu &cpu, std::vector<SystemStat::Core> &cores);
+		void sampleSoftnet(std::vector<SystemStat::Core> &cores);
+		void sampleUdp(SystemStat::Udp &udp);
+		void sampleNetwork(SystemStat::Interface &total);
+		void sampleProcNetDev(SystemStat::Interface &total);
+		bool sampleNetlink(SystemStat::Interface &total);
+		void closeNetlink();
+
+	public:
+		SensorSampler();
+		~SensorSampler();
+		void sample(SystemStat &stat, bool interfaces=true);
+		void setNetlink(bool enable);
+		bool usesNetlink() const;
+		int interfaceCount() const;
+		const InterfaceSample &interface(int index) const;
+};
+
 void sampleSensorData(SystemStat &stat);
+void sampleSensorTotals(SystemStat &stat);
+void setSensorInterfaceFilter(const ppl7::String &list);
+int64_t getSocketDrops(int sockfd);
 
 
 #endif /* SENSOR_H_ */
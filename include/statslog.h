@@ -0,0 +1,110 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATSLOG_H_
+#define STATSLOG_H_
+
+#include <ppl7.h>
+#include <vector>
+
+#include "udpecho.h"
+#include "sensor.h"
+
+/*!\brief Messwerte eines Intervalls für das Statistik-Log
+ */
+class UDPEchoStatsRecord
+{
+	public:
+		//! Last und Paketempfang eines Kerns im Intervall
+		class Core
+		{
+			public:
+				Core() {
+					id=0;
+					usage=irq=softirq=0.0;
+					processed=dropped=time_squeeze=0;
+				}
+				int id;
+				double usage;
+				double irq;
+				double softirq;
+				uint64_t processed;
+				uint64_t dropped;
+				uint64_t time_squeeze;
+		};
+
+		double sampleTime;
+		double interval;
+		double cpu;
+		UDPEchoCounter counter;
+		SystemStat::Network net_receive;
+		SystemStat::Network net_transmit;
+		uint64_t rtt_count;
+		double rtt_p50;
+		double rtt_p90;
+		double rtt_p99;
+		double rtt_p999;
+		std::vector<Core> cores;
+
+		UDPEchoStatsRecord();
+		void setSystemStat(const SystemStat &previous, const SystemStat &current);
+		void setLatency(const UDPEchoLatencyHistogram &histogram);
+		size_t binarySize() const;
+		size_t exportBinary(void *buffer, size_t size) const;
+		size_t importBinary(const void *buffer, size_t size);
+		void toJSON(ppl7::String &line) const;
+};
+
+/*!\brief Gepuffertes Statistik-Log im JSON-Lines- oder Binärformat
+ */
+class UDPEchoStatsLog : public ppl7::Thread
+{
+	public:
+		enum Format {
+			JSON,
+			BINARY
+		};
+		//! Maximale Anzahl gepufferter Datensätze, darüber hinaus wird verworfen
+		static const size_t MaxPending=100000;
+
+	private:
+		ppl7::Mutex mutex;
+		ppl7::File file;
+		std::vector<UDPEchoStatsRecord> pending;
+		Format format;
+		double interval;
+		uint64_t dropped;
+
+		void flush(std::vector<UDPEchoStatsRecord> &records);
+
+	public:
+		UDPEchoStatsLog();
+		~UDPEchoStatsLog();
+		void open(const ppl7::String &filename, Format format);
+		void close();
+		bool isOpen() const;
+		void setInterval(int milliseconds);
+		double getInterval() const;
+		uint64_t getDropped() const;
+		void write(const UDPEchoStatsRecord &record);
+		void run();
+};
+
+
+#endif /* STATSLOG_H_ */
@@ -26,24 +26,512 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <time.h>
+#include <vector>
+
+#include "dns.h"
+
+/*!\brief Maximale Größe eines UDP-Datagramms über IPv4
+ *
+ * 65535 Bytes IP-Paket abzüglich 20 Bytes IP-Header und 8 Bytes UDP-Header.
+ */
+#define UDPECHO_MAX_DATAGRAM_SIZE 65507
 
 typedef struct {
 		int64_t id;
 		double time;
 } PACKET;
 
+/*!\brief Paket-Header im Prüfsummen-Modus
+ *
+ * Erweitert PACKET um die Länge des Pakets und eine Prüfsumme über das gesamte Paket,
+ * die bei der Berechnung selbst als 0 eingesetzt wird (siehe UDPEchoChecksum).
+ */
+typedef struct {
+		int64_t id;
+		double time;
+		uint32_t length;
+		uint32_t checksum;
+} PACKET_CHECKED;
+
 class UDPEchoCounter {
 	public:
 		int64_t packets_received;
 		int64_t packets_send;
 		int64_t bytes_received;
 		int64_t bytes_send;
+		int64_t packets_truncated;
+		int64_t packets_queue_overflow;
+		int64_t packets_impair_dropped;
+		int64_t packets_impair_duplicated;
+		int64_t packets_impair_corrupted;
+		int64_t packets_impair_reordered;
+		int64_t packets_dns_invalid;
+		int64_t packets_socket_dropped;
+		int64_t packets_send_failed;
 		double sampleTime;
+		/*!\brief Zähler im Worker-Thread erhöhen
+		 *
+		 * Jeder Zähler hat genau einen schreibenden Thread, wird aber während des
+		 * Betriebs von anderen Threads gelesen (z.B. Metrik-Endpunkt). Lesen und
+		 * Schreiben erfolgen deshalb atomar mit relaxed Ordering.
+		 */
+		static inline void increment(int64_t &value, int64_t n=1) {
+			__atomic_store_n(&value, __atomic_load_n(&value, __ATOMIC_RELAXED)+n, __ATOMIC_RELAXED);
+		}
 		void clear();
+		void add(const UDPEchoCounter &other);
+		void subtract(const UDPEchoCounter &other);
 		void exportToArray(ppl7::AssocArray &data) const;
 		void importFromArray(const ppl7::AssocArray &data);
+		size_t binarySize() const;
+		size_t exportBinary(void *buffer, size_t size) const;
+		size_t importBinary(const void *buffer, size_t size);
+};
+
+
+/*!\brief Histogramm der Paketlaufzeiten
+ */
+class UDPEchoLatencyHistogram
+{
+	public:
+		//! Anzahl Unter-Buckets pro Zweierpotenz, bestimmt die Genauigkeit (ca. 3 %)
+		static const int SubBuckets=32;
+		//! Anzahl Buckets, deckt Laufzeiten bis 2^36 Mikrosekunden ab
+		static const int Buckets=1024;
+
+	private:
+		uint64_t bucket[Buckets];
+		uint64_t total;
+
+		static uint64_t lowerBound(int index);
+		static uint64_t bucketWidth(int index);
+
+	public:
+		UDPEchoLatencyHistogram();
+		void clear();
+		void merge(const UDPEchoLatencyHistogram &other);
+		void subtract(const UDPEchoLatencyHistogram &other);
+		uint64_t count() const;
+		double percentile(double p) const;
+		size_t binarySize() const;
+		size_t exportBinary(void *buffer, size_t size) const;
+		size_t importBinary(const void *buffer, size_t size);
+
+		//! Index des Buckets für eine Laufzeit von \p usec Mikrosekunden
+		static inline int index(uint64_t usec) {
+			if (usec<(uint64_t)SubBuckets) return (int)usec;
+			int msb=63-__builtin_clzll(usec);
+			int i=(msb-4)*SubBuckets+(int)((usec>>(msb-5))&(SubBuckets-1));
+			return i<Buckets ? i : Buckets-1;
+		}
+
+		//! Laufzeit \p rtt in Sekunden zählen
+		inline void add(double rtt) {
+			uint64_t usec=rtt>0.0 ? (uint64_t)(rtt*1000000.0+0.5) : 0;
+			bucket[index(usec)]++;
+			total++;
+		}
+};
+
+/*!\brief Kleines Histogramm der Paketlaufzeiten pro Ziel oder Gruppe von Flows
+ */
+class UDPEchoCompactHistogram
+{
+	public:
+		//! Anzahl Unter-Buckets pro Zweierpotenz, bestimmt die Genauigkeit (ca. 12 %)
+		static const int SubBuckets=4;
+		//! Anzahl Buckets, deckt Laufzeiten bis 2^33 Mikrosekunden ab
+		static const int Buckets=128;
+
+	private:
+		uint32_t bucket[Buckets];
+		uint64_t total;
+
+		static uint64_t lowerBound(int index);
+		static uint64_t bucketWidth(int index);
+
+	public:
+		UDPEchoCompactHistogram();
+		void clear();
+		void merge(const UDPEchoCompactHistogram &other);
+		uint64_t count() const;
+		double percentile(double p) const;
+
+		//! Index des Buckets für eine Laufzeit von \p usec Mikrosekunden
+		static inline int index(uint64_t usec) {
+			if (usec<(uint64_t)SubBuckets) return (int)usec;
+			int msb=63-__builtin_clzll(usec);
+			int i=(msb-1)*SubBuckets+(int)((usec>>(msb-2))&(SubBuckets-1));
+			return i<Buckets ? i : Buckets-1;
+		}
+
+		//! Laufzeit \p rtt in Sekunden zählen
+		inline void add(double rtt) {
+			uint64_t usec=rtt>0.0 ? (uint64_t)(rtt*1000000.0+0.5) : 0;
+			int i=index(usec);
+			if (bucket[i]<0xffffffff) bucket[i]++;
+			total++;
+		}
+};
+
+/*!\brief Prüfsumme über den Inhalt eines Pakets
+ */
+class UDPEchoChecksum
+{
+	public:
+		enum Algorithm {
+			NONE=0,
+			CRC32,
+			XXH64,
+			CRC32C
+		};
+		//! Ergebnis von UDPEchoChecksum::verify
+		enum Result {
+			VALID=0,
+			LENGTH_MISMATCH,
+			CORRUPTED
+		};
+
+		static Algorithm getAlgorithm(const ppl7::String &name);
+		static const char *getName(Algorithm algorithm);
+		static uint32_t compute(Algorithm algorithm, const void *data, size_t size);
+		static uint64_t xxh64(const void *data, size_t size, uint64_t seed=0);
+		static void seal(Algorithm algorithm, void *packet, size_t size);
+		static Result verify(Algorithm algorithm, void *packet, size_t size);
+};
+
+/*!\brief Zähler der Performance Monitoring Unit für den aufrufenden Thread
+ */
+class UDPEchoPerfCounter
+{
+	public:
+		enum Event {
+			INSTRUCTIONS=0,
+			CYCLES,
+			CACHE_MISSES,
+			CONTEXT_SWITCHES,
+			TASK_CLOCK,
+			NUM_EVENTS
+		};
+
+		//! Stand der Zähler, nicht verfügbare Ereignisse sind als ungültig markiert
+		class Values
+		{
+			public:
+				uint64_t value[NUM_EVENTS];
+				bool valid[NUM_EVENTS];
+
+				Values();
+				void clear();
+				void add(const Values &other);
+				bool isValid() const;
+				static Values getDelta(const Values &sample1, const Values &sample2);
+				ppl7::String toString() const;
+				void fromString(const ppl7::String &s);
+				void print(const char *label, int64_t packets) const;
+		};
+
+	private:
+		static bool enabled;
+		int fd[NUM_EVENTS];
+
+	public:
+		UDPEchoPerfCounter();
+		~UDPEchoPerfCounter();
+		static void setEnabled(bool flag);
+		static bool isEnabled();
+		bool open();
+		void stop();
+		void close();
+		void read(Values &values) const;
+};
+
+/*!\brief Latenzarmer Betrieb mit Busy-Polling
+ */
+class UDPEchoLowLatency
+{
+	private:
+		static bool enabled;
+		static bool realtime;
+		static int busyPollUsec;
+		static int realtimeFailed;
+
+	public:
+		static const int DefaultBusyPollUsec=50;
+
+		static void setEnabled(bool flag);
+		static bool isEnabled();
+		static void setBusyPollTimeout(int usec);
+		static int getBusyPollTimeout();
+		static void setRealtime(bool flag);
+		static bool isRealtime();
+		static bool configureSocket(int fd);
+		static ppl7::String probe();
+		static void applyScheduling();
+		static int getRealtimeFailures();
+
+		//! Pause in Warteschleifen, entlastet den zweiten Hyperthread des Kerns
+		static inline void relax() {
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#elif defined(__aarch64__)
+			__asm__ __volatile__("yield");
+#endif
+		}
 };
 
+/*!\brief Pool für die Paketpuffer eines Worker-Threads
+ */
+class UDPEchoPacketPool
+{
+	public:
+		//! Füllstand und Zähler des Pools
+		class Stats
+		{
+			public:
+				size_t slots;
+				size_t slotsize;
+				size_t in_use;
+				size_t peak;
+				uint64_t acquired;
+				uint64_t exhausted;
+
+				Stats();
+				void clear();
+				void add(const Stats &other);
+		};
+
+		static const size_t CacheLineSize=64;
+		//! Mindestgröße eines Pools in Bytes, ab der Huge Pages verwendet werden
+		static const size_t HugePageThreshold=1024*1024;
+
+	private:
+		static bool hugePages;
+		ppl7::MemoryHeap *heap;
+		Stats stats;
+
+	public:
+		UDPEchoPacketPool();
+		~UDPEchoPacketPool();
+		static void setHugePages(bool flag);
+		static bool usesHugePages();
+		void allocate(size_t slots, size_t slotsize);
+		void clear();
+		size_t getSlotSize() const;
+		size_t getCapacity() const;
+		Stats getStats() const;
+
+		//! Liefert einen freien Puffer oder NULL, wenn der Pool erschöpft ist
+		inline void *acquire() {
+			if (stats.in_use>=stats.slots) {
+				stats.exhausted++;
+				return NULL;
+			}
+			void *p=heap->malloc();
+			stats.acquired++;
+			if (++stats.in_use>stats.peak) stats.peak=stats.in_use;
+			return p;
+		}
+
+		inline void release(void *buffer) {
+			heap->free(buffer);
+			stats.in_use--;
+		}
+};
+
+/*!\brief Zähler und Laufzeiten eines Ziels oder einer Gruppe von Flows
+ */
+class UDPEchoFlowStats
+{
+	public:
+		int64_t packets_send;
+		int64_t packets_received;
+		int64_t bytes_send;
+		int64_t bytes_received;
+		int64_t errors;
+		double rtt_total;
+		double rtt_min;
+		double rtt_max;
+		UDPEchoCompactHistogram histogram;
+
+		UDPEchoFlowStats();
+		void clear();
+		void merge(const UDPEchoFlowStats &other);
+
+		inline void countSend(ssize_t bytes) {
+			packets_send++;
+			bytes_send+=bytes;
+		}
+
+		inline void countReceived(ssize_t bytes, double rtt) {
+			packets_received++;
+			bytes_received+=bytes;
+			rtt_total+=rtt;
+			if (rtt_min==0.0 || rtt<rtt_min) rtt_min=rtt;
+			if (rtt>rtt_max) rtt_max=rtt;
+			histogram.add(rtt);
+		}
+};
+
+/*!\brief Messwerte pro Gruppe von Flows
+ */
+class UDPEchoFlowBuckets
+{
+	private:
+		std::vector<UDPEchoFlowStats> buckets;
+		size_t flows;
+
+	public:
+		//! Obergrenze für die Anzahl Gruppen
+		static const size_t MaxBuckets=256;
+
+		UDPEchoFlowBuckets();
+		void setup(size_t buckets, size_t flows);
+		void clear();
+		void clearCounter();
+		void merge(const UDPEchoFlowBuckets &other);
+		size_t getFlowCount() const;
+		size_t firstFlow(size_t bucket) const;
+
+		inline size_t size() const {
+			return buckets.size();
+		}
+
+		//! Gruppe des Flows \p flow, die Flows werden in zusammenhängende Bereiche aufgeteilt
+		inline size_t bucketOf(size_t flow) const {
+			return (size_t)((uint64_t)flow*buckets.size()/flows);
+		}
+
+		inline UDPEchoFlowStats &operator[](size_t i) {
+			return buckets[i];
+		}
+
+		inline const UDPEchoFlowStats &operator[](size_t i) const {
+			return buckets[i];
+		}
+};
+
+/*!\brief Liste von Zielen mit Zählern und Laufzeiten pro Ziel
+ */
+class UDPEchoTargetTable
+{
+	public:
+		//! Adresse und Messwerte eines Ziels
+		class Target : public UDPEchoFlowStats
+		{
+			public:
+				struct sockaddr_storage addr;
+				socklen_t addrlen;
+
+				Target();
+				ppl7::String toString() const;
+		};
+
+	private:
+		std::vector<Target> targets;
+		std::vector<int> index;
+		uint32_t indexMask;
+		int64_t unknown;
+
+		static uint32_t hash(const struct sockaddr *addr);
+		static bool equals(const struct sockaddr *addr, const Target &target);
+		void rebuildIndex();
+
+	public:
+		UDPEchoTargetTable();
+		void add(const ppl7::String &destination);
+		void add(const struct sockaddr *addr, socklen_t addrlen);
+		void load(const ppl7::String &filename);
+		void clear();
+		void clearCounter();
+		void merge(const UDPEchoTargetTable &other);
+		int find(const struct sockaddr *addr) const;
+		int64_t getUnknown() const;
+
+		inline size_t size() const {
+			return targets.size();
+		}
+
+		inline Target &operator[](size_t i) {
+			return targets[i];
+		}
+
+		inline const Target &operator[](size_t i) const {
+			return targets[i];
+		}
+
+		//! Antwort mit \p bytes Bytes und Laufzeit \p rtt vom Absender \p addr zählen
+		inline void countReceived(const struct sockaddr *addr, ssize_t bytes, double rtt) {
+			int i=find(addr);
+			if (i<0) {
+				unknown++;
+				return;
+			}
+			targets[i].countReceived(bytes, rtt);
+		}
+};
+
+/*!\brief IP- und UDP-Header für den Raw-Socket-Sender mit wechselnden Quelladressen
+ */
+class UDPEchoRawPacket
+{
+	public:
+		//! Größe der Header bei IPv6, bei IPv4 sind es 28 Byte
+		static const size_t MaxHeaderSize=48;
+
+	private:
+		struct sockaddr_storage destination;
+		socklen_t destlen;
+		uint16_t destinationPort;
+		int family;
+		unsigned char network[16];
+		int prefixlen;
+		uint64_t sourceCount;
+		uint64_t firstHost;
+		uint64_t sourceIndex;
+		uint16_t sourcePort;
+		size_t header;
+		size_t payloadsize;
+		size_t dynamicSize;
+		uint32_t baseSum;
+
+		void putSource(unsigned char *packet, uint64_t index) const;
+		void putLength(unsigned char *packet, size_t payloadsize) const;
+		uint32_t headerSum(const unsigned char *packet, size_t payloadsize) const;
+		size_t complete(unsigned char *packet, size_t payloadsize, uint32_t s);
+		static uint16_t fold(uint32_t sum);
+
+	public:
+		UDPEchoRawPacket();
+		void setDestination(const ppl7::String &destination);
+		void setSources(const ppl7::String &network);
+		void setSourcePort(int port);
+		void seek(uint64_t index);
+		ppl7::String getSources() const;
+		uint64_t getSourceCount() const;
+		int getPathMtu() const;
+		void prepare(unsigned char *packet, size_t payloadsize, size_t dynamicSize);
+		size_t finish(unsigned char *packet);
+		size_t finish(unsigned char *packet, size_t payloadsize);
+		static uint32_t sum(const unsigned char *data, size_t size, uint32_t sum=0);
+
+		inline int getFamily() const {
+			return family;
+		}
+
+		inline size_t getHeaderSize() const {
+			return header;
+		}
+
+		inline const struct sockaddr *getDestination() const {
+			return (const struct sockaddr*)&destination;
+		}
+
+		inline socklen_t getDestinationLength() const {
+			return destlen;
+		}
+};
 
 class UDPSenderResults
 {
@@ -56,6 +544,10 @@ class UDPSenderResults
 		int64_t	counter_errors;
 		int64_t	packages_lost;
 		int64_t   counter_0bytes;
+		int64_t   counter_truncated;
+		int64_t   counter_dns_unmatched;
+		int64_t   counter_dns_invalid;
+		int64_t   counter_rcodes[16];
 		int64_t   counter_errorcodes[255];
 		double		duration;
 		double		rtt_total;
@@ -67,37 +559,84 @@ class UDPEchoReceiverThread : public ppl7::Thread
 {
 	private:
 		int sockfd;
-		ppl7::ByteArray recbuffer;
+		UDPEchoPacketPool pool;
+		unsigned char *recbuffer;
+		size_t buffersize;
+		std::vector<struct mmsghdr> msgs;
+		std::vector<struct iovec> iovecs;
+		std::vector<struct sockaddr_storage> names;
+		UDPEchoTargetTable targets;
+		UDPEchoFlowBuckets flows;
+		int flowBucket;
 		int64_t counter_received;
 		int64_t bytes_received;
+		int64_t counter_truncated;
+		int64_t counter_dns_unmatched;
+		int64_t counter_dns_invalid;
+		int64_t counter_rcodes[16];
+		ppl7::ByteArray querytimes;
+		double *queryTime;
+		bool dnsMode;
+		UDPEchoChecksum::Algorithm checksum;
+		int64_t counter_corrupted;
+		int64_t counter_length_mismatch;
+		UDPEchoLatencyHistogram histogram;
+		UDPEchoPerfCounter perf;
 
 		double rtt_total, rtt_min, rtt_max;
 
-		void countPacket(const PACKET *p, ssize_t bytes);
+		double countPacket(PACKET *p, ssize_t bytes);
+		void countRoundTripTime(double rtt);
+		double countDNSResponse(const unsigned char *p, ssize_t bytes);
+		void countResponse(const unsigned char *p, ssize_t bytes, const struct sockaddr *from, int bucket);
 
 	public:
 		UDPEchoReceiverThread();
 		~UDPEchoReceiverThread();
 		void setSocketDescriptor(int sockfd);
+		void setMaxPacketSize(size_t bytes);
+		void setDNSMode(bool flag);
+		void setChecksum(UDPEchoChecksum::Algorithm algorithm);
+		void setTargets(const UDPEchoTargetTable &targets);
+		void setFlowBuckets(const UDPEchoFlowBuckets &flows, int bucket);
 		void run();
 		void resetCounter();
+		void allocateBuffer(size_t batch=1);
+		size_t receive(int fd, size_t max, int bucket=-1);
+
+		//! Sendezeitpunkt der DNS-Anfrage mit Transaktions-ID \p id merken, wird vom
+		//! SenderThread aufgerufen und daher atomar geschrieben
+		inline void setQueryTime(uint16_t id, double time) {
+			__atomic_store(&queryTime[id], &time, __ATOMIC_RELEASE);
+		}
 		int64_t getPacketsReceived() const;
 		int64_t getBytesReceived() const;
+		int64_t getPacketsTruncated() const;
+		int64_t getPacketsCorrupted() const;
+		int64_t getPacketsLengthMismatch() const;
+		int64_t getDNSUnmatched() const;
+		int64_t getDNSInvalid() const;
+		int64_t getRcodeCounter(int rcode) const;
 		double getRoundTripTimeAverage() const;
 		double getRoundTripTimeMin() const;
 		double getRoundTripTimeMax() const;
+		const UDPEchoLatencyHistogram &getLatencyHistogram() const;
+		void getPerfCounter(UDPEchoPerfCounter::Values &values) const;
+		const UDPEchoTargetTable &getTargets() const;
+		const UDPEchoFlowBuckets &getFlowBuckets() const;
 
 };
 
 class UDPEchoSenderThread : public ppl7::Thread
 {
 	private:
-		ppl7::ByteArray buffer;
+		UDPEchoPacketPool pool;
+		unsigned char *buffer;
 		UDPEchoReceiverThread receiver;
 
 		size_t packetsize;
 		int64_t queryrate;
-		int64_t counter_send, errors, counter_0bytes;
+		int64_t counter_send, bytes_send, errors, counter_0bytes;
 		int64_t counter_errorcodes[255];
 		int runtime;
 		int timeout;
@@ -105,13 +644,65 @@ class UDPEchoSenderThread : public ppl7::Thread
 
 		double duration;
 		int sockfd;
+		std::vector<int> sockets;
+		size_t socketIndex;
+		int epollfd;
+		bool runToCompletion;
+		bool inlineReceive;
+		bool busyPoll;
+		int sendBurst;
+		int receiveBurst;
 		bool ignoreResponses;
 		bool verbose;
 		bool alwaysRandomize;
+		const DNSQueryCorpus *corpus;
+		size_t corpusPosition;
+		uint16_t queryId;
+		UDPEchoChecksum::Algorithm checksum;
+		UDPEchoPerfCounter perf;
+		UDPEchoTargetTable targets;
+		size_t targetIndex;
+		std::vector<struct mmsghdr> batchMsgs;
+		std::vector<struct iovec> batchIovecs;
+		std::vector<uint32_t> batchTargets;
+		size_t pending;
+		int pendingfd;
+		size_t pendingSocket;
+		size_t currentSocket;
+		UDPEchoFlowBuckets flows;
+		std::vector<uint16_t> socketBucket;
+		UDPEchoRawPacket raw;
+		int rawfd;
 
-		void sendPacket();
+		void allocateSendBuffers();
+		size_t preparePacket(unsigned char *b);
+		size_t prepareQuery(unsigned char *b);
+		void countSend(ssize_t n, size_t size);
+		ssize_t sendDatagram(int fd, const void *data, size_t size);
+		void sendPacket(int fd);
+		void sendQuery(int fd);
+		void sendRaw();
+		void queuePacket(int fd);
+		void flushPackets();
+		void send(int fd);
 		void waitForTimeout();
-		bool socketReady();
+		bool socketReady(int fd, long timeout_usec=100);
+		void openEventSet();
+		void closeEventSet();
+		int drainResponses(double timeout);
+
+		//! Liefert die Sockets reihum
+		inline int nextSocket() {
+			currentSocket=socketIndex;
+			int fd=sockets[socketIndex];
+			if (++socketIndex>=sockets.size()) socketIndex=0;
+			return fd;
+		}
+
+		//! Gruppe des Flows von Socket \p socket oder -1
+		inline int flowBucket(size_t socket) const {
+			return socketBucket.empty() ? -1 : (int)socketBucket[socket];
+		}
 
 		void runWithoutRateLimit();
 		void runWithRateLimit();
@@ -123,28 +714,193 @@ class UDPEchoSenderThread : public ppl7::Thread
 		void connect(const ppl7::String &hostname, int port);
 		ppl7::SockAddr getSockAddr() const;
 		void setPacketsize(size_t size);
+		void setMaxResponseSize(size_t size);
 		void setRuntime(int seconds);
 		void setTimeout(int seconds);
 		void setQueryRate(int64_t qps);
 		void setZeitscheibe(float ms);
 		void setIgnoreResponses(bool flag);
 		void setSourceIP(const ppl7::String &ip);
+		void bindSources(const ppl7::Array &ips, size_t offset, int port);
 		void setVerbose(bool verbose);
 		void setAlwaysRandomize(bool flag);
+		void setDNSQueryCorpus(const DNSQueryCorpus *corpus);
+		void setChecksum(UDPEchoChecksum::Algorithm algorithm);
+		void setSocketCount(int count);
+		int getSocketCount() const;
+		void setRunToCompletion(bool flag);
+		void setBurst(int send, int receive);
+		void setTargets(const UDPEchoTargetTable &targets);
+		void setFlowBuckets(const UDPEchoFlowBuckets &flows, size_t firstFlow);
+		void setRawPacket(const UDPEchoRawPacket &raw, uint64_t offset, int port);
 		void run();
 		int64_t getPacketsSend() const;
+		int64_t getBytesSend() const;
 		int64_t getPacketsReceived() const;
 		int64_t getBytesReceived() const;
+		int64_t getPacketsTruncated() const;
+		int64_t getPacketsCorrupted() const;
+		int64_t getPacketsLengthMismatch() const;
 		int64_t getErrors() const;
 		int64_t getCounter0Bytes() const;
 		int64_t getCounterErrorCode(int err) const;
+		int64_t getDNSUnmatched() const;
+		int64_t getDNSInvalid() const;
+		int64_t getRcodeCounter(int rcode) const;
 		double getDuration() const;
 		double getRoundTripTimeAverage() const;
 		double getRoundTripTimeMin() const;
 		double getRoundTripTimeMax() const;
+		const UDPEchoLatencyHistogram &getLatencyHistogram() const;
+		int64_t getSocketDrops() const;
+		void getPerfCounter(UDPEchoPerfCounter::Values &send, UDPEchoPerfCounter::Values &receive) const;
+		void getTargets(UDPEchoTargetTable &result) const;
+		void getFlowBuckets(UDPEchoFlowBuckets &result) const;
+};
+
+
+
+/*!\brief Schneller Pseudo-Zufallszahlengenerator (xorshift128+)
+ *
+ * Jeder Worker-Thread verwendet eine eigene Instanz, so dass im Paketpfad weder
+ * Locks noch Systemaufrufe notwendig sind.
+ */
+class UDPEchoRandom
+{
+	private:
+		uint64_t s[2];
+
+	public:
+		UDPEchoRandom();
+		void seed(uint64_t value);
+
+		inline uint64_t next() {
+			uint64_t s1=s[0];
+			const uint64_t s0=s[1];
+			s[0]=s0;
+			s1^=s1<<23;
+			s[1]=s1^s0^(s1>>17)^(s0>>26);
+			return s[1]+s0;
+		}
+
+		//! Gleichverteilte Zufallszahl im Bereich [0, 1)
+		inline double uniform() {
+			return (double)(next()>>11)*(1.0/9007199254740992.0);
+		}
+};
+
+class UDPEchoDelayModel
+{
+	public:
+		enum Type {
+			NONE,
+			FIXED,
+			UNIFORM,
+			NORMAL,
+			EMPIRICAL
+		};
+
+	private:
+		Type type;
+		double param1;
+		double param2;
+		std::vector<double> samples;
+		bool haveSpare;
+		double spare;
+
+		void loadEmpiricalDistribution(const ppl7::String &filename);
+
+	public:
+		//! Erwartete Paketrate pro Thread, wenn keine angegeben wird
+		static const uint64_t DefaultRate=100000;
+		//! Speicherlimit der Warteschlange pro Thread, wenn keines angegeben wird
+		static const size_t DefaultMemory=64*1024*1024;
+
+		UDPEchoDelayModel();
+		void parse(const ppl7::String &spec);
+		bool isEnabled() const;
+		Type getType() const;
+		int64_t getMaxDelay() const;
+		size_t getQueueSize(uint64_t pps, size_t entrysize, size_t memory) const;
+		int64_t sample(UDPEchoRandom &rng);
+		ppl7::String toString() const;
 };
 
+class UDPEchoImpairment
+{
+	public:
+		enum Action {
+			PASS=0,
+			DROP=1,
+			DUPLICATE=2,
+			CORRUPT=4,
+			REORDER=8
+		};
+
+	private:
+		double loss, duplicate, corrupt, reorder;
+		double ge_p, ge_r, ge_lossBad, ge_lossGood;
+		uint64_t t_loss, t_duplicate, t_corrupt, t_reorder;
+		uint64_t t_ge_p, t_ge_r, t_ge_lossBad, t_ge_lossGood;
+		bool gilbertElliott;
+		bool badState;
+		bool enabled;
 
+	public:
+		UDPEchoImpairment();
+		void parse(const ppl7::String &spec);
+		bool isEnabled() const;
+		bool usesReorder() const;
+		int decide(UDPEchoRandom &rng);
+		static void corruptPayload(void *data, size_t size, UDPEchoRandom &rng);
+		ppl7::String toString() const;
+};
+
+class UDPEchoDelayQueue
+{
+	private:
+		class Entry {
+			public:
+				int64_t due_tick;
+				uint32_t next;
+				uint32_t size;
+				socklen_t addrlen;
+				struct sockaddr_in6 addr;
+		};
+		std::vector<Entry> entries;
+		std::vector<uint32_t> slot_head;
+		std::vector<uint32_t> slot_tail;
+		std::vector<char*> buffers;
+		UDPEchoPacketPool *pool;
+		uint32_t capacity;
+		uint32_t free_head;
+		uint32_t pending;
+		int64_t current_tick;
+
+	public:
+		//! Auflösung des Timer-Wheels in Mikrosekunden
+		static const int64_t TickMicroseconds=32;
+		//! Anzahl Slots im Timer-Wheel (muss eine Zweierpotenz sein)
+		static const uint32_t WheelSlots=16384;
+
+		UDPEchoDelayQueue();
+		~UDPEchoDelayQueue();
+		void allocate(UDPEchoPacketPool &pool, uint32_t capacity);
+		void release();
+		char *reserve();
+		void commit(int64_t now_us, int64_t delay_us, size_t size, const struct sockaddr *addr, socklen_t addrlen);
+		void flush(int64_t now_us, int sockfd, UDPEchoCounter &counter);
+		void clear();
+		uint32_t getPending() const;
+		uint32_t getCapacity() const;
+		static size_t memoryPerEntry(size_t slotsize);
+
+		static inline int64_t now() {
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+		}
+};
 
 class UDPEchoBouncer
 {
@@ -154,6 +910,13 @@ class UDPEchoBouncer
 		ppl7::SockAddr sockaddr;
 		int sockfd;
 		size_t packetSize;
+		size_t maxPacketSize;
+		size_t delayQueueSize;
+		uint64_t delayQueueRate;
+		size_t delayQueueMemory;
+		UDPEchoDelayModel delayModel;
+		UDPEchoImpairment impairment;
+		DNSResponder dns;
 		bool noEcho;
 		bool running;
 		ppl7::SockAddr getSockAddr(const ppl7::String &Hostname, int Port);
@@ -165,12 +928,28 @@ class UDPEchoBouncer
 		UDPEchoBouncer();
 		~UDPEchoBouncer();
 		void setFixedResponsePacketSize(size_t size);
+		void setMaxPacketSize(size_t size);
+		void setResponseDelay(const ppl7::String &spec);
+		void setDelayQueueSize(size_t entries);
+		void setDelayQueueRate(uint64_t pps);
+		void setDelayQueueMemory(size_t bytes);
+		size_t getDelayQueueSize() const;
+		size_t getDelayQueueMemory() const;
+		size_t getDelayQueueMemoryUsage() const;
+		size_t getDelaySlotSize() const;
+		void setImpairment(const ppl7::String &spec);
+		bool hasImpairment() const;
+		void setDNSResponder(const DNSResponder &dns);
+		bool isDNSEnabled() const;
 		void setInterface(const ppl7::String &InterfaceName, int Port);
 		void disableResponses(bool flag);
 		void start(size_t num_threads);
 		void stop();
 		bool isRunning();
 		UDPEchoCounter getCounter();
+		UDPEchoCounter getTotalCounter();
+		void getPerfCounter(UDPEchoPerfCounter::Values &values);
+		size_t getThreadCount();
 };
 
 
@@ -187,25 +966,55 @@ class UDPEchoBouncerThread : public ppl7::Thread
 		int sockfd;
 		struct sockaddr_in servaddr;
 		ppl7::SockAddr out_addr;
-		ppl7::ByteArray buffer;
+		UDPEchoPacketPool pool;
+		UDPEchoPacketPool delayPool;
 		void *pBuffer;
+		size_t buffersize;
 		ppl7::Mutex mutex;
 		bool noEcho;
 		UDPEchoCounter counter;
+		UDPEchoCounter reported;
 		size_t packetSize;
+		size_t maxPacketSize;
+		UDPEchoDelayModel delayModel;
+		UDPEchoDelayQueue delayQueue;
+		size_t delayQueueSize;
+		UDPEchoImpairment impairment;
+		UDPEchoRandom rng;
+		DNSResponder dns;
+		UDPEchoPerfCounter perf;
+		int startupState;
+		ppl7::String startupError;
+
+		void allocateBuffer();
+		size_t delaySlotSize() const;
+		uint32_t delayQueueCapacity() const;
+		void allocatePools();
+		size_t replySize(void *data, size_t size);
+		int impair(void *data, size_t size);
+		void sendResponse(const void *data, size_t size, const struct sockaddr *addr, socklen_t addrlen, int copies=1);
+		void runWithoutDelay();
+		void runWithDelay();
 
-		bool waitForSocketReadable();
+		bool waitForSocketReadable(long timeout_nsec=500*1000000);
 
 	public:
 		UDPEchoBouncerThread();
 		~UDPEchoBouncerThread();
 		void setNoEcho(bool flag);
 		void setPacketSize(size_t bytes);
+		void setMaxPacketSize(size_t bytes);
+		void setDelayModel(const UDPEchoDelayModel &model, size_t queue_size);
+		void setImpairment(const UDPEchoImpairment &impairment);
+		void setDNSResponder(const DNSResponder &dns);
 		void bind(const ppl7::SockAddr &sockaddr);
 		//void setSocketDescriptor(int sockfd);
 		void setSocketAddr(const ppl7::SockAddr &adr);
 		void run();
 		UDPEchoCounter getAndClearCounter();
+		UDPEchoCounter getCounterSnapshot() const;
+		void getPerfCounter(UDPEchoPerfCounter::Values &values) const;
+		bool waitForStartup(ppl7::String &error) const;
 
 };
 
@@ -0,0 +1,222 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WIRE_H_
+#define WIRE_H_
+
+#include <ppl7.h>
+#include <stdint.h>
+#include <string.h>
+
+class UDPEchoCounter;
+class SystemStat;
+
+/*!\brief Binäres Austauschformat für Zähler und Sensordaten
+ */
+class UDPEchoWire
+{
+	public:
+		static const int Version=1;
+		static const size_t HeaderSize=8;
+		static const size_t CounterSize=120;
+		static const size_t CounterMinSize=104;
+		static const size_t SystemStatSize=168;
+		static const size_t InterfaceSize=80;
+		static const size_t InterfaceNameSize=16;
+		static const size_t UdpSize=48;
+		static const size_t CoreHeaderSize=16;
+		static const size_t CoreSize=56;
+		static const size_t HistogramSize=16;
+		static const size_t IntervalSize=224;
+		static const size_t IntervalCoreHeaderSize=8;
+		static const size_t IntervalCoreSize=56;
+
+		enum RecordType {
+			RECORD_COUNTER=1,
+			RECORD_SYSTEMSTAT=2,
+			RECORD_HISTOGRAM=3,
+			RECORD_INTERVAL=4
+		};
+
+		static size_t checkRecord(const void *buffer, size_t size, int type);
+		static int peekRecordType(const void *buffer, size_t size);
+		static void putHeader(unsigned char *p, int type, size_t size);
+
+		static inline uint64_t get64(const unsigned char *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			uint64_t v;
+			memcpy(&v, p, 8);
+			return v;
+#else
+			return (uint64_t)p[0] | ((uint64_t)p[1]<<8) | ((uint64_t)p[2]<<16) | ((uint64_t)p[3]<<24)
+				| ((uint64_t)p[4]<<32) | ((uint64_t)p[5]<<40) | ((uint64_t)p[6]<<48) | ((uint64_t)p[7]<<56);
+#endif
+		}
+
+		static inline void put64(unsigned char *p, uint64_t v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			memcpy(p, &v, 8);
+#else
+			for (int i=0;i<8;i++) p[i]=(unsigned char)(v>>(8*i));
+#endif
+		}
+
+		static inline uint32_t get32(const unsigned char *p) {
+			return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+		}
+
+		static inline void put32(unsigned char *p, uint32_t v) {
+			p[0]=(unsigned char)v;
+			p[1]=(unsigned char)(v>>8);
+			p[2]=(unsigned char)(v>>16);
+			p[3]=(unsigned char)(v>>24);
+		}
+
+		static inline double getDouble(const unsigned char *p) {
+			uint64_t v=get64(p);
+			double d;
+			memcpy(&d, &v, 8);
+			return d;
+		}
+
+		static inline void putDouble(unsigned char *p, double d) {
+			uint64_t v;
+			memcpy(&v, &d, 8);
+			put64(p, v);
+		}
+};
+
+/*!\brief Zugriff auf einen binär kodierten UDPEchoCounter ohne Kopie
+ */
+class UDPEchoCounterView
+{
+	private:
+		const unsigned char *data;
+
+	public:
+		enum Field {
+			PACKETS_RECEIVED=0,
+			PACKETS_SEND,
+			BYTES_RECEIVED,
+			BYTES_SEND,
+			PACKETS_TRUNCATED,
+			PACKETS_QUEUE_OVERFLOW,
+			PACKETS_IMPAIR_DROPPED,
+			PACKETS_IMPAIR_DUPLICATED,
+			PACKETS_IMPAIR_CORRUPTED,
+			PACKETS_IMPAIR_REORDERED,
+			PACKETS_DNS_INVALID,
+			PACKETS_SOCKET_DROPPED,
+			PACKETS_SEND_FAILED,
+			NUM_FIELDS
+		};
+
+		UDPEchoCounterView(const void *buffer, size_t size);
+
+		inline double sampleTime() const {
+			return UDPEchoWire::getDouble(data+UDPEchoWire::HeaderSize);
+		}
+
+		//! Liefert 0 für Felder, die in einem älteren, kürzeren Datensatz fehlen
+		inline int64_t get(Field field) const {
+			if (UDPEchoWire::HeaderSize+16+8*(size_t)field>size()) return 0;
+			return (int64_t)UDPEchoWire::get64(data+UDPEchoWire::HeaderSize+8+8*field);
+		}
+
+		size_t size() const;
+		void decode(UDPEchoCounter &counter) const;
+};
+
+/*!\brief Zugriff auf binär kodierte SystemStat-Daten ohne Kopie
+ */
+class SystemStatView
+{
+	private:
+		const unsigned char *data;
+		size_t interfaces;
+		bool udp;
+		const unsigned char *corelist;
+		size_t cores;
+
+	public:
+		enum NetworkField {
+			RECEIVE_BYTES=0,
+			RECEIVE_PACKETS,
+			RECEIVE_ERRS,
+			RECEIVE_DROP,
+			TRANSMIT_BYTES,
+			TRANSMIT_PACKETS,
+			TRANSMIT_ERRS,
+			TRANSMIT_DROP
+		};
+
+		enum UdpField {
+			UDP_IN_DATAGRAMS=0,
+			UDP_NO_PORTS,
+			UDP_IN_ERRORS,
+			UDP_OUT_DATAGRAMS,
+			UDP_RCVBUF_ERRORS,
+			UDP_SNDBUF_ERRORS
+		};
+
+		SystemStatView(const void *buffer, size_t size);
+
+		inline double sampleTime() const {
+			return UDPEchoWire::getDouble(data+UDPEchoWire::HeaderSize);
+		}
+
+		inline uint64_t netTotal(NetworkField field) const {
+			return UDPEchoWire::get64(data+96+8*field);
+		}
+
+		inline size_t interfaceCount() const {
+			return interfaces;
+		}
+
+		//! Name des Interfaces \p index, mit 0 terminiert
+		inline const char *interfaceName(size_t index) const {
+			return (const char*)(data+UDPEchoWire::SystemStatSize+index*UDPEchoWire::InterfaceSize);
+		}
+
+		inline uint64_t interfaceValue(size_t index, NetworkField field) const {
+			return UDPEchoWire::get64(data+UDPEchoWire::SystemStatSize+index*UDPEchoWire::InterfaceSize
+				+UDPEchoWire::InterfaceNameSize+8*field);
+		}
+
+		//! Liefert \c false bei älteren Datensätzen ohne Zähler der UDP-MIB
+		inline bool hasUdp() const {
+			return udp;
+		}
+
+		inline uint64_t udpValue(UdpField field) const {
+			if (!udp) return 0;
+			return UDPEchoWire::get64(data+UDPEchoWire::SystemStatSize+interfaces*UDPEchoWire::InterfaceSize+8*field);
+		}
+
+		//! Anzahl Kerne, 0 bei älteren Datensätzen ohne Werte pro Kern
+		inline size_t coreCount() const {
+			return cores;
+		}
+
+		size_t size() const;
+		void decode(SystemStat &stat) const;
+};
+
+
+#endif /* WIRE_H_ */
@@ -106,18 +106,28 @@
 namespace ppl7 {
 
 
+class Mutex;
+
 class MemoryHeap
 {
 private:
 	void* blocks;
+	void* partial;
+	Mutex* mutex;
 	size_t		myElementSize, increaseSize;
+	size_t		mySlotSize, myHeaderSize, myAlignment;
 	size_t		myGrowPercent;
 	size_t		blocksAllocated, blocksUsed;
 	size_t		mem_allocated;
 	size_t		mem_used;
 	size_t		freeCount;
+	bool		useHugePages;
 
 	void		increase(size_t num);
+	void*		mallocUnlocked();
+	void		freeUnlocked(void* element);
+	void*		checkElement(void* element) const;
+	void		cleanupUnlocked();
 
 public:
 	PPL7EXCEPTION(NotInitializedException, Exception);
@@ -125,22 +135,46 @@ public:
 	PPL7EXCEPTION(HeapCorruptedException, Exception);
 	PPL7EXCEPTION(ElementNotInHeapException, Exception);
 
+	//! \brief Threadlokaler Zwischenspeicher für Elemente eines MemoryHeap
+	class Cache
+	{
+	private:
+		MemoryHeap* heap;
+		void** slots;
+		size_t	mySize, myCount;
+		size_t	refills, flushes;
 
+	public:
+		Cache(MemoryHeap& heap, size_t size=64);
+		~Cache();
+		void* malloc();
+		void free(void* element);
+		void flush();
+		size_t count() const;
+		size_t refillCount() const;
+		size_t flushCount() const;
+	};
 
 	MemoryHeap();
 	MemoryHeap(size_t elementsize, size_t startnum, size_t increase, size_t growpercent=30);
 	~MemoryHeap();
 	void clear();
 	void init(size_t elementsize, size_t startnum, size_t increase, size_t growpercent=30);
+	void setAlignment(size_t bytes);
+	void setHugePages(bool enable);
+	void setThreadSafe(bool enable);
 	void* malloc();
 	void* calloc();
 	void free(void* element);
+	size_t mallocBatch(void** elements, size_t num);
+	void freeBatch(void** elements, size_t num);
 	size_t memoryUsed() const;
 	size_t memoryAllocated() const;
 	void dump() const;
 	size_t capacity() const;
 	size_t count() const;
 	size_t elementSize() const;
+	size_t alignment() const;
 	void reserve(size_t num);
 	void cleanup();
 };
@@ -201,7 +235,17 @@ void HexDump(const void* address, size_t bytes, bool skipheader);
 void HexDump(const void* address, size_t bytes);
 String ToBase64(const ByteArrayPtr& bin);
 ByteArray FromBase64(const String& str);
+enum CrcImplementation {
+	CRC_AUTO=0,
+	CRC_BYTEWISE,
+	CRC_SLICE8,
+	CRC_HARDWARE
+};
 uint32_t Crc32(const void* buffer, size_t size);
+uint32_t Crc32(const void* buffer, size_t size, CrcImplementation impl);
+uint32_t Crc32c(const void* buffer, size_t size);
+uint32_t Crc32c(const void* buffer, size_t size, CrcImplementation impl);
+bool HaveCrcHardwareSupport(bool castagnoli);
 String Md5(const void* buffer, size_t size);
 double Calc(const String& expression);
 
@@ -461,6 +505,7 @@ public:
 
 
 void ThreadSetPriority(Thread::Priority priority);
+void ThreadSetPriority(Thread::Priority priority, bool realtime);
 Thread::Priority ThreadGetPriority();
 
 
@@ -47,27 +47,121 @@
 #include <stdarg.h>
 #endif
 
+
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #include "ppl7.h"
 
 
 namespace ppl7 {
 
-typedef struct tagHeapElement {
-	struct tagHeapElement	*next, *previous;
-	void					*ptr;
-} HEAPELEMENT;
-
+/*
+ * Jedes Element liegt in einem Slot, dem ein Kopf mit dem Zeiger auf seinen Block
+ * vorangestellt ist. Damit findet MemoryHeap::free den Block in O(1). Das Feld "tag"
+ * enthält für belegte Elemente eine Prüfsumme aus Block, Heap und HEAP_MAGIC, für freie
+ * Elemente 0. Fremde Zeiger und doppelte Freigaben werden so erkannt, bevor der
+ * Block-Zeiger verwendet wird.
+ *
+ * Freie Elemente eines Blocks sind über das erste Wort ihrer Nutzdaten verkettet.
+ * Noch nie verwendete Slots am Ende des Blocks werden erst bei Bedarf angefasst.
+ * Blöcke mit mindestens einem freien Element stehen zusätzlich in der Liste "partial",
+ * aus der MemoryHeap::malloc ohne Suche bedient wird.
+ */
 typedef struct tagHeapBlock {
 	struct tagHeapBlock	*previous, *next;
+	struct tagHeapBlock	*partial_previous, *partial_next;
 	void				*buffer;
 	void				*bufferend;
+	size_t				allocated;
 	size_t				elements;
 	size_t				num_free;
-	HEAPELEMENT			*free;
-	HEAPELEMENT			*elbuffer;
-
+	size_t				num_untouched;
+	void				*free;
+	uint8_t				*untouched;
+	bool				in_partial;
+	bool				mapped;
 } HEAPBLOCK;
 
+typedef struct tagHeapSlot {
+	HEAPBLOCK			*block;
+	uintptr_t			tag;
+} HEAPSLOT;
+
+static const uintptr_t HEAP_MAGIC=(uintptr_t)0x5a3c96e1d2b4f087ULL;
+static const size_t HEAP_HUGEPAGE_SIZE=2*1024*1024;
+
+static inline size_t roundUp(size_t value, size_t alignment)
+{
+	return (value+alignment-1)&~(alignment-1);
+}
+
+static inline uintptr_t slotTag(const HEAPBLOCK *block, const void *heap)
+{
+	return (uintptr_t)block^(uintptr_t)heap^HEAP_MAGIC;
+}
+
+/*
+ * Speicher für einen Block mit Huge Pages anfordern. Zuerst werden explizite Huge Pages
+ * (MAP_HUGETLB) versucht, die der Administrator vorab reserviert haben muss. Schlägt das
+ * fehl, wird ein auf 2 MiB ausgerichteter Bereich angelegt und per MADV_HUGEPAGE für
+ * Transparent Huge Pages markiert. Liefert NULL, wenn mmap nicht verfügbar ist.
+ */
+static void *allocateHugePages(size_t bytes)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+	void *p;
+#ifdef MAP_HUGETLB
+	p=mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (p!=MAP_FAILED) return p;
+#endif
+	size_t size=bytes+HEAP_HUGEPAGE_SIZE;
+	p=mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p==MAP_FAILED) return NULL;
+	uint8_t *start=(uint8_t*)roundUp((size_t)p, HEAP_HUGEPAGE_SIZE);
+	size_t head=start-(uint8_t*)p;
+	if (head) munmap(p, head);
+	if (size-head>bytes) munmap(start+bytes, size-head-bytes);
+#ifdef MADV_HUGEPAGE
+	madvise(start, bytes, MADV_HUGEPAGE);
+#endif
+	return start;
+#else
+	return NULL;
+#endif
+}
+
+static void freeBlockBuffer(HEAPBLOCK *bl)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+	if (bl->mapped) {
+		munmap(bl->buffer, bl->allocated);
+		return;
+	}
+#endif
+	::free(bl->buffer);
+}
+
+static inline void addToPartial(void **partial, HEAPBLOCK *bl)
+{
+	bl->partial_previous=NULL;
+	bl->partial_next=(HEAPBLOCK*)*partial;
+	if (bl->partial_next) bl->partial_next->partial_previous=bl;
+	*partial=bl;
+	bl->in_partial=true;
+}
+
+static inline void removeFromPartial(void **partial, HEAPBLOCK *bl)
+{
+	if (bl->partial_previous) bl->partial_previous->partial_next=bl->partial_next;
+	else *partial=bl->partial_next;
+	if (bl->partial_next) bl->partial_next->partial_previous=bl->partial_previous;
+	bl->partial_previous=bl->partial_next=NULL;
+	bl->in_partial=false;
+}
+
 
 /*!\class MemoryHeap
  * \ingroup PPLGroupMemory
@@ -88,6 +182,15 @@ typedef struct tagHeapBlock {
  *
  * Die Wachstumsgröße selbst wächst bei jeder Vergrößerung um 30%.
  *
+ * MemoryHeap::malloc und MemoryHeap::free arbeiten unabhängig von der Anzahl Blöcke in
+ * konstanter Zeit. Für die Verwendung aus mehreren Threads muss der Heap mit
+ * MemoryHeap::setThreadSafe abgesichert werden. Jeder Thread kann dann zusätzlich einen
+ * eigenen MemoryHeap::Cache verwenden, der Elemente ohne Sperre ausgibt und zurücknimmt
+ * und nur stapelweise auf den Heap zugreift.
+ *
+ * Mit MemoryHeap::setAlignment lassen sich die Elemente z.B. an Cache-Lines ausrichten,
+ * mit MemoryHeap::setHugePages werden die Blöcke auf 2 MiB große Huge Pages gelegt.
+ *
  */
 
 
@@ -101,11 +204,17 @@ typedef struct tagHeapBlock {
 MemoryHeap::MemoryHeap()
 {
 	blocks=NULL;
+	partial=NULL;
+	mutex=NULL;
 	myElementSize=0;
 	increaseSize=0;
+	mySlotSize=0;
+	myHeaderSize=sizeof(HEAPSLOT);
+	myAlignment=sizeof(void*);
 	blocksAllocated=0;
 	blocksUsed=0;
 	freeCount=0;
+	useHugePages=false;
 	myGrowPercent=30;
 	mem_allocated=sizeof(MemoryHeap);
 	mem_used=sizeof(MemoryHeap);
@@ -116,7 +225,7 @@ MemoryHeap::MemoryHeap()
  * \desc
  * Bei Verwendung dieses Konstruktors wird die Klasse gleichzeitig auch initialisiert.
  *
- * @param elementsize Die Größe der Elemente in Bytes (wird auf 4 Byte aufgerundet)
+ * @param elementsize Die Größe der Elemente in Bytes (wird auf 8 Byte aufgerundet)
  * @param startnum Anzahl Elemente, für die sofort Speicher allokiert werden soll
  * @param increase Anzahl Elemente, um die der Heap wachsen soll, wenn keine Elemente mehr
  * frei sind.
@@ -127,15 +236,21 @@ MemoryHeap::MemoryHeap()
 MemoryHeap::MemoryHeap(size_t elementsize, size_t startnum, size_t increase, size_t growpercent)
 {
 	blocks=NULL;
+	partial=NULL;
+	mutex=NULL;
 	myElementSize=0;
 	increaseSize=0;
+	mySlotSize=0;
+	myHeaderSize=sizeof(HEAPSLOT);
+	myAlignment=sizeof(void*);
 	blocksAllocated=0;
 	blocksUsed=0;
 	freeCount=0;
+	useHugePages=false;
 	myGrowPercent=growpercent;
 	mem_allocated=sizeof(MemoryHeap);
 	mem_used=sizeof(MemoryHeap);
-	init(elementsize, startnum, increase);
+	init(elementsize, startnum, increase, growpercent);
 }
 
 /*!\brief Destruktor
@@ -147,6 +262,7 @@ MemoryHeap::MemoryHeap(size_t elementsize, size_t startnum, size_t increase, siz
 MemoryHeap::~MemoryHeap()
 {
 	clear();
+	delete mutex;
 }
 
 /*!\brief Gesamten Speicher freigeben
@@ -154,7 +270,8 @@ MemoryHeap::~MemoryHeap()
  * \desc
  * Sämtlicher durch den Heap belegte Speicher wird freigegeben. Alle durch
  * MemoryHeap::malloc oder Heap:calloc allokierten Speicherblöcke verlieren ihre Gültigkeit und
- * dürfen nicht mehr verwendet werden.
+ * dürfen nicht mehr verwendet werden. Das gilt auch für Elemente, die noch in einem
+ * MemoryHeap::Cache liegen.
  *
  */
 void MemoryHeap::clear()
@@ -162,8 +279,7 @@ void MemoryHeap::clear()
 	HEAPBLOCK *next, *bl=(HEAPBLOCK*)blocks;
 	while (bl) {
 		next=bl->next;
-		::free(bl->elbuffer);
-		::free(bl->buffer);
+		freeBlockBuffer(bl);
 		::free(bl);
 		bl=next;
 	}
@@ -171,6 +287,7 @@ void MemoryHeap::clear()
 	blocksAllocated=0;
 	blocksUsed=0;
 	blocks=NULL;
+	partial=NULL;
 	mem_allocated=sizeof(MemoryHeap);
 	mem_used=sizeof(MemoryHeap);
 }
@@ -193,7 +310,8 @@ size_t MemoryHeap::capacity() const
 /*!\brief Anzahl belegter Elemente
  *
  * \desc
- * Liefert die Anzahl Elemente zurück, die derzeit in Verwendung sind.
+ * Liefert die Anzahl Elemente zurück, die derzeit in Verwendung sind. Elemente, die in
+ * einem MemoryHeap::Cache liegen, gelten als belegt.
  *
  * @return Anzahl Elemente
  */
@@ -214,6 +332,18 @@ size_t MemoryHeap::elementSize() const
 	return myElementSize;
 }
 
+/*!\brief Ausrichtung der Elemente
+ *
+ * \desc
+ * Liefert die Ausrichtung der Elemente im Speicher in Bytes zurück
+ *
+ * @return Ausrichtung in Bytes
+ */
+size_t MemoryHeap::alignment() const
+{
+	return myAlignment;
+}
+
 /*!\brief Speicher reservieren
  *
  * \desc
@@ -229,10 +359,15 @@ size_t MemoryHeap::elementSize() const
  */
 void MemoryHeap::reserve(size_t num)
 {
-	if (num>blocksAllocated) {
-		size_t grow=num-blocksAllocated;
-		increase(grow);
+	if (!myElementSize) throw NotInitializedException();
+	if (mutex) mutex->lock();
+	try {
+		if (num>blocksAllocated) increase(num-blocksAllocated);
+	} catch (...) {
+		if (mutex) mutex->unlock();
+		throw;
 	}
+	if (mutex) mutex->unlock();
 }
 
 /*!\brief Initialisierung der Klasse
@@ -243,7 +378,8 @@ void MemoryHeap::reserve(size_t num)
  * um die der Heap jeweils wachsen soll, wenn kein Speicher mehr frei ist. Initial kann dabei
  * auch schon Speicher allokiert werden.
  *
- * @param elementsize Die Größe der Elemente in Bytes (wird auf 4 Byte aufgerundet)
+ * @param elementsize Die Größe der Elemente in Bytes (wird auf 8 Byte bzw. die mit
+ * MemoryHeap::setAlignment gesetzte Ausrichtung aufgerundet)
  * @param startnum Anzahl Elemente, für die sofort Speicher allokiert werden soll
  * @param increase Anzahl Elemente, um die der Heap wachsen soll, wenn keine Elemente mehr
  * frei sind.
@@ -254,21 +390,79 @@ void MemoryHeap::reserve(size_t num)
 void MemoryHeap::init(size_t elementsize, size_t startnum, size_t increase, size_t growpercent)
 {
 	if (myElementSize) throw AlreadyInitializedException();
-	//Elementsize auf 4 Byte aufrunden
 	if (!elementsize) throw IllegalArgumentException("elementsize");
-	elementsize=(elementsize+3)&0xfffffffc;
+	if (!increase) increase=1;
 
-	this->myElementSize=elementsize;
+	this->myElementSize=roundUp(elementsize, myAlignment);
+	this->mySlotSize=myHeaderSize+myElementSize;
 	this->increaseSize=increase;
 	myGrowPercent=growpercent;
 	if (startnum) this->increase(startnum);
 }
 
+/*!\brief Ausrichtung der Elemente festlegen
+ *
+ * \desc
+ * Legt fest, an welcher Adressgrenze die Elemente beginnen, z.B. 64 für Cache-Lines.
+ * Die Elementgröße wird entsprechend aufgerundet. Die Funktion muss aufgerufen werden,
+ * bevor der Heap Speicher allokiert hat, also vor MemoryHeap::init mit \p startnum>0.
+ *
+ * @param bytes Zweierpotenz zwischen 8 und 4096
+ * \exception IllegalArgumentException Ungültige Ausrichtung
+ * \exception AlreadyInitializedException Der Heap hat bereits Speicher allokiert
+ */
+void MemoryHeap::setAlignment(size_t bytes)
+{
+	if (bytes<sizeof(void*) || bytes>4096 || (bytes&(bytes-1))!=0) throw IllegalArgumentException("alignment");
+	if (blocks) throw AlreadyInitializedException();
+	myAlignment=bytes;
+	myHeaderSize=roundUp(sizeof(HEAPSLOT), myAlignment);
+	if (myElementSize) {
+		myElementSize=roundUp(myElementSize, myAlignment);
+		mySlotSize=myHeaderSize+myElementSize;
+	}
+}
+
+/*!\brief Huge Pages verwenden
+ *
+ * \desc
+ * Ist die Option aktiv, werden neue Blöcke auf ein Vielfaches von 2 MiB aufgerundet und
+ * per mmap mit Huge Pages angelegt. Das reduziert TLB-Misses, wenn viele Elemente in
+ * schneller Folge verwendet werden, z.B. Paketpuffer. Es werden zuerst reservierte Huge
+ * Pages (MAP_HUGETLB) versucht, danach Transparent Huge Pages. Ohne mmap wird normaler
+ * Speicher verwendet.
+ *
+ * @param enable true oder false
+ */
+void MemoryHeap::setHugePages(bool enable)
+{
+	useHugePages=enable;
+}
+
+/*!\brief Heap für die Verwendung aus mehreren Threads absichern
+ *
+ * \desc
+ * Ist die Option aktiv, sind alle Zugriffe auf den Heap durch einen Mutex geschützt.
+ * Die Funktion muss aufgerufen werden, bevor der Heap von mehreren Threads verwendet wird.
+ * Um die Sperre im laufenden Betrieb selten zu benötigen, sollte jeder Thread einen
+ * eigenen MemoryHeap::Cache verwenden.
+ *
+ * @param enable true oder false
+ */
+void MemoryHeap::setThreadSafe(bool enable)
+{
+	if (enable && !mutex) mutex=new Mutex();
+	else if (!enable && mutex) {
+		delete mutex;
+		mutex=NULL;
+	}
+}
+
 /*!\brief Heap vergrößern
  *
  * \desc
  * Interne Funktion, die aufgerufen wird, um den Heap um eine bestimmte Anzahl Elemente zu
- * vergrößern.
+ * vergrößern. Mit Huge Pages kann der Block mehr Elemente aufnehmen als angefordert.
  *
  * @param num Anzahl Elemente, für die neuer Speicher allokiert werden soll
  * \exception OutOfMemoryException: Wird geworfen, wenn nicht genug Speicher verfügbar ist, um den
@@ -279,39 +473,40 @@ void MemoryHeap::increase(size_t num)
 {
 	HEAPBLOCK *bl=(HEAPBLOCK*)::malloc(sizeof(HEAPBLOCK));
 	if (!bl) throw OutOfMemoryException();
+	size_t bytes=num*mySlotSize;
+	bl->buffer=NULL;
+	bl->mapped=false;
+	if (useHugePages) {
+		size_t hugebytes=roundUp(bytes, HEAP_HUGEPAGE_SIZE);
+		bl->buffer=allocateHugePages(hugebytes);
+		if (bl->buffer) {
+			bl->mapped=true;
+			bytes=hugebytes;
+			num=bytes/mySlotSize;
+		}
+	}
+	if (!bl->buffer) {
+		size_t align=myAlignment;
+		if (align<sizeof(void*)*2) align=sizeof(void*)*2;
+		if (posix_memalign(&bl->buffer, align, bytes)!=0) {
+			::free(bl);
+			throw OutOfMemoryException();
+		}
+	}
+	bl->allocated=bytes;
 	bl->elements=num;
-	bl->next=NULL;
 	bl->num_free=num;
+	bl->num_untouched=num;
+	bl->free=NULL;
+	bl->untouched=(uint8_t*)bl->buffer;
+	bl->bufferend=(uint8_t*)bl->buffer+num*mySlotSize;
 	bl->previous=NULL;
-	bl->buffer=::malloc(myElementSize*num);
-	if (!bl->buffer) {
-		::free(bl);
-		throw OutOfMemoryException();
-	}
-	bl->bufferend=(uint8_t*)bl->buffer+myElementSize*num;
-	bl->free=(HEAPELEMENT *)::malloc(sizeof(HEAPELEMENT)*num);
-	if (!bl->free) {
-		::free(bl->buffer);
-		::free(bl);
-		throw OutOfMemoryException();
-	}
-	bl->elbuffer=bl->free;
-	HEAPELEMENT *t,*prev=NULL;
-	uint8_t *buffer=(uint8_t*)bl->buffer;
-	for(size_t i=0;i<num;i++) {
-		t=&bl->free[i];
-		t->previous=prev;
-		t->next=&bl->free[i+1];
-		t->ptr=buffer;
-		buffer+=myElementSize;
-		prev=t;
-	}
-	bl->free[num-1].next=NULL;
 	bl->next=(HEAPBLOCK*)blocks;
 	if (bl->next) bl->next->previous=bl;
 	blocks=bl;
+	addToPartial(&partial, bl);
 	blocksAllocated+=num;
-	mem_allocated+=sizeof(HEAPBLOCK)+myElementSize*num+sizeof(HEAPELEMENT)*num;
+	mem_allocated+=sizeof(HEAPBLOCK)+bytes;
 	mem_used+=sizeof(HEAPBLOCK);
 }
 
@@ -335,6 +530,36 @@ void *MemoryHeap::calloc()
 	return block;
 }
 
+void *MemoryHeap::mallocUnlocked()
+{
+	HEAPBLOCK *bl=(HEAPBLOCK*)partial;
+	if (!bl) {
+		// Speicher muss vergroessert werden
+		increase(increaseSize);
+		increaseSize+=(increaseSize*myGrowPercent/100);
+		bl=(HEAPBLOCK*)partial;
+	}
+	void *element;
+	if (bl->free) {
+		// Element aus der Free-Kette nehmen
+		element=bl->free;
+		bl->free=*(void**)element;
+	} else {
+		// Bisher unbenutzten Slot verwenden
+		HEAPSLOT *slot=(HEAPSLOT*)bl->untouched;
+		slot->block=bl;
+		bl->untouched+=mySlotSize;
+		bl->num_untouched--;
+		element=(uint8_t*)slot+myHeaderSize;
+	}
+	((HEAPSLOT*)((uint8_t*)element-myHeaderSize))->tag=slotTag(bl, this);
+	bl->num_free--;
+	if (!bl->num_free) removeFromPartial(&partial, bl);
+	mem_used+=mySlotSize;
+	blocksUsed++;
+	return element;
+}
+
 /*!\brief Speicher anfordern
  *
  * \desc
@@ -351,27 +576,74 @@ void *MemoryHeap::calloc()
 void *MemoryHeap::malloc()
 {
 	if (!myElementSize) throw NotInitializedException();
-	while (1) {
-		// Den nächsten freien Block suchen
-		HEAPBLOCK *bl=(HEAPBLOCK*)blocks;
-		while (bl) {
-			if (bl->num_free) {
-				HEAPELEMENT *el=bl->free;
-				// Element aus der Free-Kette nehmen
-				bl->free=bl->free->next;
-				if(bl->free) bl->free->previous=NULL;
-				bl->num_free--;
-				mem_used+=myElementSize+sizeof(HEAPELEMENT);
-				blocksUsed++;
-				return el->ptr;
-			}
-			bl=bl->next;
-		}
-		// Speicher muss vergroessert werden
-		increase(increaseSize);
-		increaseSize+=(increaseSize*myGrowPercent/100);
+	if (!mutex) return mallocUnlocked();
+	mutex->lock();
+	try {
+		void *element=mallocUnlocked();
+		mutex->unlock();
+		return element;
+	} catch (...) {
+		mutex->unlock();
+		throw;
 	}
-	return NULL;
+}
+
+/*!\brief Mehrere Elemente auf einmal anfordern
+ *
+ * \desc
+ * Allokiert \p num Elemente mit einer einzigen Sperre des Heaps. Wird von
+ * MemoryHeap::Cache zum Auffüllen verwendet.
+ *
+ * @param elements Array, das die Pointer auf die Elemente aufnimmt
+ * @param num Anzahl Elemente
+ * @return Anzahl allokierter Elemente, immer \p num
+ * \exception OutOfMemoryException: Nicht genug Speicher, es wurden keine Elemente allokiert
+ */
+size_t MemoryHeap::mallocBatch(void **elements, size_t num)
+{
+	if (!myElementSize) throw NotInitializedException();
+	if (mutex) mutex->lock();
+	size_t i=0;
+	try {
+		for (;i<num;i++) elements[i]=mallocUnlocked();
+	} catch (...) {
+		while (i>0) freeUnlocked(elements[--i]);
+		if (mutex) mutex->unlock();
+		throw;
+	}
+	if (mutex) mutex->unlock();
+	return num;
+}
+
+/*
+ * Prüft, ob ein Element zu diesem Heap gehört und belegt ist, und liefert seinen Block
+ */
+void *MemoryHeap::checkElement(void *element) const
+{
+	HEAPSLOT *slot=(HEAPSLOT*)((uint8_t*)element-myHeaderSize);
+	HEAPBLOCK *bl=slot->block;
+	if (slot->tag!=slotTag(bl, this)) throw ElementNotInHeapException();
+	if (element<bl->buffer || element>=bl->bufferend
+			|| ((uint8_t*)slot-(uint8_t*)bl->buffer)%mySlotSize!=0) {
+		// Hier stimmt was nicht!!!!
+		throw HeapCorruptedException();
+	}
+	return bl;
+}
+
+void MemoryHeap::freeUnlocked(void *element)
+{
+	HEAPBLOCK *bl=(HEAPBLOCK*)checkElement(element);
+	((HEAPSLOT*)((uint8_t*)element-myHeaderSize))->tag=0;
+	// Element in die Free-Kette hängen
+	*(void**)element=bl->free;
+	bl->free=element;
+	if (!bl->num_free) addToPartial(&partial, bl);
+	bl->num_free++;
+	mem_used-=mySlotSize;
+	blocksUsed--;
+	freeCount++;
+	if (freeCount>1000) cleanupUnlocked();
 }
 
 /*!\brief Speicher freigeben
@@ -385,38 +657,47 @@ void *MemoryHeap::malloc()
  * \exception MemoryHeap::HeapCorruptedException: könnte auftreten, wenn der interne Speicher des
  * Heaps, in dem die Elemente verwaltet werden, überschrieben wurde.
  * \exception MemoryHeap::ElementNotInHeapException: Der mit \p mem referenzierte Speicherblock
- * wurde nicht über diesen Heap allokiert.
+ * wurde nicht über diesen Heap allokiert oder bereits freigegeben.
  */
 void MemoryHeap::free(void *mem)
 {
 	if (!myElementSize) throw NotInitializedException();
-	HEAPBLOCK *bl=(HEAPBLOCK*)blocks;
-	while (bl) {
-		if (mem>=bl->buffer && mem<=bl->bufferend) {
-			// Nummer des Blocks errechnen
-			HEAPELEMENT *el=bl->elbuffer;
-			int element=(uint32_t)((uint8_t*)mem-(uint8_t*)bl->buffer)/(int)myElementSize;
-			if(el[element].ptr!=mem) {
-				// Hier stimmt was nicht!!!!
-				throw HeapCorruptedException();
-			}
-			// Element in die Free-Kette hängen
-			el[element].next=bl->free;
-			el[element].previous=NULL;
-			if (bl->free) bl->free->previous=&el[element];
-			bl->free=&el[element];
-			bl->num_free++;
-			mem_used-=(myElementSize+sizeof(HEAPELEMENT));
-			//if (bl->num_free==bl->elements) cleanup();
-			blocksUsed--;
-			freeCount++;
-			if (freeCount>1000) cleanup();
-
-			return;
-		}
-		bl=bl->next;
+	if (!mutex) {
+		freeUnlocked(mem);
+		return;
+	}
+	mutex->lock();
+	try {
+		freeUnlocked(mem);
+	} catch (...) {
+		mutex->unlock();
+		throw;
+	}
+	mutex->unlock();
+}
+
+/*!\brief Mehrere Elemente auf einmal freigeben
+ *
+ * \desc
+ * Gibt \p num Elemente mit einer einzigen Sperre des Heaps frei. Wird von
+ * MemoryHeap::Cache zum Zurückgeben überzähliger Elemente verwendet.
+ *
+ * @param elements Array mit den Pointern auf die Elemente
+ * @param num Anzahl Elemente
+ * \exception MemoryHeap::ElementNotInHeapException: Ein Element gehört nicht zu diesem Heap,
+ * die vorhergehenden wurden bereits freigegeben
+ */
+void MemoryHeap::freeBatch(void **elements, size_t num)
+{
+	if (!myElementSize) throw NotInitializedException();
+	if (mutex) mutex->lock();
+	try {
+		for (size_t i=0;i<num;i++) freeUnlocked(elements[i]);
+	} catch (...) {
+		if (mutex) mutex->unlock();
+		throw;
 	}
-	throw ElementNotInHeapException();
+	if (mutex) mutex->unlock();
 }
 
 /*!\brief Aufräumen
@@ -428,6 +709,13 @@ void MemoryHeap::free(void *mem)
  * Ein freier Speicherblock wird in Reserve gehalten.
  */
 void MemoryHeap::cleanup()
+{
+	if (mutex) mutex->lock();
+	cleanupUnlocked();
+	if (mutex) mutex->unlock();
+}
+
+void MemoryHeap::cleanupUnlocked()
 {
 	// Wenn mehr als ein Block komplett leer ist, geben wir ihn frei
 	HEAPBLOCK *next, *bl=(HEAPBLOCK*)blocks;
@@ -439,13 +727,13 @@ void MemoryHeap::cleanup()
 				// Block wird gelöscht
 				blocksAllocated-=bl->elements;
 				if (bl->previous) bl->previous->next=bl->next;
+				else blocks=bl->next;
 				if (bl->next) bl->next->previous=bl->previous;
-				mem_allocated-=sizeof(HEAPBLOCK)+myElementSize*bl->elements+sizeof(HEAPELEMENT)*bl->elements;
+				if (bl->in_partial) removeFromPartial(&partial, bl);
+				mem_allocated-=sizeof(HEAPBLOCK)+bl->allocated;
 				mem_used-=sizeof(HEAPBLOCK);
-				::free(bl->buffer);
-				::free(bl->elbuffer);
+				freeBlockBuffer(bl);
 				::free(bl);
-				if (bl==(HEAPBLOCK*)blocks) blocks=next;
 			}
 			flag=true;
 		}
@@ -490,15 +778,130 @@ void MemoryHeap::dump() const
 {
 	HEAPBLOCK *bl=(HEAPBLOCK*)blocks;
 	PrintDebug ("Dump Heap (0x%tx, ",(std::ptrdiff_t)this);
-	PrintDebug ("Elementsize: %zu):\n", myElementSize);
+	PrintDebug ("Elementsize: %zu, Slotsize: %zu, Alignment: %zu):\n", myElementSize, mySlotSize, myAlignment);
 	PrintDebug ("Memory allocated: %zu Bytes, Memory used: %zu Bytes, Memory free: %zu Bytes\n",
 			mem_allocated, mem_used, (mem_allocated-mem_used));
 	PrintDebug ("Blocks allocated: %zu, Blocks used: %zu, freeCount: %zu\n",
 			blocksAllocated, blocksUsed, freeCount);
 	while (bl) {
-		PrintDebug ("HEAPBLOCK: elements: %zu, free: %zu, Bytes allocated: %zu\n",bl->elements, bl->num_free, bl->elements*myElementSize);
+		PrintDebug ("HEAPBLOCK: elements: %zu, free: %zu, untouched: %zu, Bytes allocated: %zu%s\n",
+				bl->elements, bl->num_free, bl->num_untouched, bl->allocated,
+				bl->mapped ? " (mmap)" : "");
 		bl=bl->next;
 	}
 }
 
+
+/*!\class MemoryHeap::Cache
+ * \ingroup PPLGroupMemory
+ * \brief Threadlokaler Zwischenspeicher für Elemente eines MemoryHeap
+ *
+ * \desc
+ * Ein Cache hält einen kleinen Vorrat an Elementen eines MemoryHeap (Magazin). Solange
+ * der Vorrat reicht, arbeiten Cache::malloc und Cache::free ohne Sperre und ohne Zugriff
+ * auf den Heap. Ist der Cache leer, wird er mit MemoryHeap::mallocBatch zur Hälfte
+ * gefüllt, ist er voll, wird die Hälfte mit MemoryHeap::freeBatch zurückgegeben. Damit
+ * ist der Heap nur noch einmal pro halber Cache-Größe gesperrt.
+ *
+ * Ein Cache gehört genau einem Thread und ist selbst nicht threadsicher. Elemente dürfen
+ * in einem anderen Cache oder direkt über den Heap freigegeben werden als dem, aus dem
+ * sie stammen. Werden mehrere Caches in verschiedenen Threads verwendet, muss der Heap
+ * mit MemoryHeap::setThreadSafe abgesichert sein. Der Destruktor gibt alle Elemente im
+ * Cache an den Heap zurück.
+ */
+
+/*!\brief Konstruktor
+ *
+ * @param heap Der initialisierte Heap, aus dem die Elemente stammen
+ * @param size Anzahl Elemente, die der Cache maximal vorhält (mindestens 2)
+ * \exception OutOfMemoryException Nicht genug Speicher
+ */
+MemoryHeap::Cache::Cache(MemoryHeap &heap, size_t size)
+{
+	this->heap=&heap;
+	if (size<2) size=2;
+	mySize=size;
+	myCount=0;
+	refills=0;
+	flushes=0;
+	slots=(void**)::malloc(sizeof(void*)*mySize);
+	if (!slots) throw OutOfMemoryException();
+}
+
+/*!\brief Destruktor
+ *
+ * \desc
+ * Gibt alle Elemente im Cache an den Heap zurück.
+ */
+MemoryHeap::Cache::~Cache()
+{
+	try {
+		flush();
+	} catch (...) {
+	}
+	::free(slots);
+}
+
+/*!\brief Element anfordern
+ *
+ * \return Pointer auf das Element
+ * \exception OutOfMemoryException Der Heap konnte nicht vergrößert werden
+ */
+void *MemoryHeap::Cache::malloc()
+{
+	if (!myCount) {
+		myCount=heap->mallocBatch(slots, mySize/2);
+		refills++;
+	}
+	return slots[--myCount];
+}
+
+/*!\brief Element freigeben
+ *
+ * @param element Pointer auf ein Element des Heaps
+ * \exception MemoryHeap::ElementNotInHeapException Das Element gehört nicht zum Heap
+ * oder ist nicht belegt
+ */
+void MemoryHeap::Cache::free(void *element)
+{
+	heap->checkElement(element);
+	if (myCount==mySize) {
+		size_t keep=mySize/2;
+		heap->freeBatch(slots+keep, mySize-keep);
+		myCount=keep;
+		flushes++;
+	}
+	slots[myCount++]=element;
+}
+
+/*!\brief Alle Elemente an den Heap zurückgeben
+ */
+void MemoryHeap::Cache::flush()
+{
+	if (!myCount) return;
+	heap->freeBatch(slots, myCount);
+	myCount=0;
+}
+
+/*!\brief Anzahl Elemente im Cache
+ */
+size_t MemoryHeap::Cache::count() const
+{
+	return myCount;
+}
+
+/*!\brief Anzahl Zugriffe auf den Heap zum Auffüllen
+ */
+size_t MemoryHeap::Cache::refillCount() const
+{
+	return refills;
+}
+
+/*!\brief Anzahl Zugriffe auf den Heap zum Zurückgeben
+ */
+size_t MemoryHeap::Cache::flushCount() const
+{
+	return flushes;
+}
+
 }	// EOF namespace ppl7
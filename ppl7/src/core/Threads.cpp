@@ -375,6 +375,62 @@ void ThreadSetPriority(Thread::Priority priority)
 #endif
 }
 
+/*! \brief Priorität und Scheduling-Klasse des aktuellen Threads ändern
+ * \ingroup PPLGroupThreads
+ *
+ * \ingroup PPLGroupThreadsPriority
+ *
+ * Wie ThreadSetPriority(Thread::Priority), wechselt aber zusätzlich die Scheduling-Klasse.
+ * Mit \p realtime=true läuft der Thread unter SCHED_FIFO und wird nur noch von Threads mit
+ * höherer Echtzeit-Priorität verdrängt, mit \p realtime=false wieder unter SCHED_OTHER.
+ * Unter Windows entspricht ein Echtzeit-Thread THREAD_PRIORITY_TIME_CRITICAL.
+ *
+ * @param priority Priorität innerhalb der Scheduling-Klasse
+ * @param realtime Echtzeit-Scheduling ein- oder ausschalten
+ * @exception ThreadOperationFailedException Die Änderung ist nicht erlaubt, unter Linux
+ * fehlt zum Beispiel CAP_SYS_NICE oder ein ausreichendes RLIMIT_RTPRIO
+ */
+void ThreadSetPriority(Thread::Priority priority, bool realtime)
+{
+#ifdef WIN32
+	if (!realtime) {
+		ThreadSetPriority(priority);
+		return;
+	}
+	if (!SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_TIME_CRITICAL)) throw ThreadOperationFailedException();
+#elif defined HAVE_PTHREADS
+	struct sched_param s;
+	pthread_t p=pthread_self();
+	int policy=realtime ? SCHED_FIFO : SCHED_OTHER;
+	int min=sched_get_priority_min(policy);
+	int max=sched_get_priority_max(policy);
+	int normal=(min+max)/2;
+	switch(priority) {
+		case Thread::LOWEST:
+			s.sched_priority=min;
+			break;
+		case Thread::BELOW_NORMAL:
+			s.sched_priority=(min+normal)/2;
+			break;
+		case Thread::NORMAL:
+			s.sched_priority=normal;
+			break;
+		case Thread::ABOVE_NORMAL:
+			s.sched_priority=(normal+max)/2;
+			break;
+		case Thread::HIGHEST:
+			s.sched_priority=max;
+			break;
+		default:
+			throw IllegalArgumentException();
+	}
+	int c=pthread_setschedparam(p,policy,&s);
+	if(c!=0) throw ThreadOperationFailedException();
+#else
+	throw NoThreadSupportException();
+#endif
+}
+
 /*! \brief Priorität des aktuellen Threads abfragen
  * \ingroup PPLGroupThreads
  *
@@ -38,6 +38,12 @@
 #include "prolog_ppl7.h"
 #include "ppl7.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPL7_CRC_X86
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
 namespace ppl7 {
 
 static uint32_t crc32_table[256] = {
@@ -86,13 +92,348 @@ static uint32_t crc32_table[256] = {
 	0xb40bbe37,0xc30c8ea1,0x5a05df1b,0x2d02ef8d
 };
 
+/*!\brief Tabellen für Slicing-by-8
+ *
+ * Tabelle 0 ist die übliche byteweise Tabelle des (reflektierten) Polynoms, Tabelle k
+ * enthält den CRC eines Bytes, dem k Null-Bytes folgen. Damit lassen sich 8 Bytes pro
+ * Iteration mit 8 unabhängigen Tabellenzugriffen verarbeiten statt mit 8 voneinander
+ * abhängigen.
+ */
+class CrcSliceTables
+{
+	public:
+		uint32_t table[8][256];
+		CrcSliceTables(uint32_t poly) {
+			for (uint32_t i=0;i<256;i++) {
+				uint32_t c=i;
+				for (int k=0;k<8;k++) c=(c & 1) ? (c >> 1) ^ poly : c >> 1;
+				table[0][i]=c;
+			}
+			for (int i=0;i<256;i++) {
+				uint32_t c=table[0][i];
+				for (int k=1;k<8;k++) {
+					c=(c >> 8) ^ table[0][c & 0xff];
+					table[k][i]=c;
+				}
+			}
+		}
+};
+
+static inline const CrcSliceTables &crc32SliceTables()
+{
+	static CrcSliceTables tables(0xedb88320);
+	return tables;
+}
+
+static inline const CrcSliceTables &crc32cSliceTables()
+{
+	static CrcSliceTables tables(0x82f63b78);
+	return tables;
+}
+
+/*
+ * Die Kernel arbeiten auf dem internen, invertierten CRC-Zustand. Bei der
+ * Initialisierung mit 0xffffffff und abschließender Invertierung ergibt sich der
+ * übliche CRC-Wert.
+ */
+static uint32_t crcBytewise(uint32_t crc, const unsigned char *b, size_t len, const uint32_t *table)
+{
+	while(len--)
+		crc = (crc >> 8) ^ table[(crc & 0xFF) ^ *b++];
+	return crc;
+}
+
+static uint32_t crcSlice8(uint32_t crc, const unsigned char *b, size_t len, const CrcSliceTables &tables)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	const uint32_t (*t)[256]=tables.table;
+	while (len>=8) {
+		uint32_t lo, hi;
+		memcpy(&lo, b, 4);
+		memcpy(&hi, b+4, 4);
+		lo^=crc;
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+		b+=8;
+		len-=8;
+	}
+#endif
+	return crcBytewise(crc, b, len, tables.table[0]);
+}
+
+#ifdef PPL7_CRC_X86
+
+static bool haveCrc32Pclmul()
+{
+	static bool supported=(__builtin_cpu_init(), __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"));
+	return supported;
+}
+
+static bool haveCrc32cSse42()
+{
+	static bool supported=(__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+	return supported;
+}
+
+/*
+ * Faltung mit PCLMULQDQ nach Gopal et al., "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction" (Intel, 2009). Es werden 64 Bytes pro
+ * Iteration in vier unabhängigen 128-Bit-Registern gefaltet, anschließend auf 128 und
+ * 64 Bit reduziert und per Barrett-Reduktion der 32-Bit-CRC berechnet. Erwartet
+ * mindestens 64 Bytes und verarbeitet nur ganze 16-Byte-Blöcke, den Rest übernimmt
+ * der Aufrufer.
+ */
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32Pclmul(uint32_t crc, const unsigned char *b, size_t len)
+{
+	alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(b + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(b + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(b + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(b + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+	b += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		y5 = _mm_loadu_si128((const __m128i *)(b + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(b + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(b + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(b + 0x30));
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+		b += 64;
+		len -= 64;
+	}
+
+	// Vier Register auf 128 Bit falten
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)b);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		b += 16;
+		len -= 16;
+	}
+
+	// 128 auf 64 Bit
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett-Reduktion auf 32 Bit
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+/*
+ * CRC32C mit dem CRC32-Befehl aus SSE4.2. Die Latenz des Befehls beträgt 3 Takte bei
+ * einem Durchsatz von einem Befehl pro Takt, daher werden große Puffer in drei
+ * unabhängigen Strängen verarbeitet. Die Teilergebnisse werden anschließend über
+ * Tabellen für das Verschieben um die Stranglänge zusammengeführt.
+ */
+static const size_t Crc32cStripe=1024;
+
+class Crc32cShiftTable
+{
+	public:
+		uint32_t table[4][256];
+
+		//! Multiplikation im GF(2) modulo des reflektierten Polynoms
+		static uint32_t multiply(uint32_t a, uint32_t b) {
+			uint32_t product=0;
+			for (int i=0;i<32;i++) {
+				if (a & 0x80000000) product^=b;
+				a<<=1;
+				b=(b & 1) ? (b >> 1) ^ 0x82f63b78 : b >> 1;
+			}
+			return product;
+		}
+
+		Crc32cShiftTable() {
+			// Das Verarbeiten von n Null-Bytes entspricht der Multiplikation mit x^(8n)
+			uint32_t factor=0x80000000;		// x^0
+			uint32_t x8=0x00800000;			// x^8
+			for (size_t i=0;i<Crc32cStripe;i++) factor=multiply(factor, x8);
+			for (int i=0;i<4;i++) {
+				for (uint32_t v=0;v<256;v++) {
+					table[i][v]=multiply(v << (8*i), factor);
+				}
+			}
+		}
+
+		inline uint32_t shift(uint32_t crc) const {
+			return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff]
+				^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+		}
+};
+
+static inline const Crc32cShiftTable &crc32cShiftTable()
+{
+	static Crc32cShiftTable table;
+	return table;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const unsigned char *b, size_t len)
+{
+#ifdef __x86_64__
+	if (len>=3*Crc32cStripe) {
+		const Crc32cShiftTable &shift=crc32cShiftTable();
+		uint64_t c0=crc, c1=0, c2=0;
+		while (len>=3*Crc32cStripe) {
+			const unsigned char *b1=b+Crc32cStripe;
+			const unsigned char *b2=b+2*Crc32cStripe;
+			for (size_t i=0;i<Crc32cStripe;i+=8) {
+				uint64_t v0, v1, v2;
+				memcpy(&v0, b+i, 8);
+				memcpy(&v1, b1+i, 8);
+				memcpy(&v2, b2+i, 8);
+				c0=_mm_crc32_u64(c0, v0);
+				c1=_mm_crc32_u64(c1, v1);
+				c2=_mm_crc32_u64(c2, v2);
+			}
+			c0=shift.shift((uint32_t)c0) ^ c1;
+			c0=shift.shift((uint32_t)c0) ^ c2;
+			c1=0;
+			c2=0;
+			b+=3*Crc32cStripe;
+			len-=3*Crc32cStripe;
+		}
+		crc=(uint32_t)c0;
+	}
+	uint64_t c=crc;
+	while (len>=8) {
+		uint64_t v;
+		memcpy(&v, b, 8);
+		c=_mm_crc32_u64(c, v);
+		b+=8;
+		len-=8;
+	}
+	crc=(uint32_t)c;
+#endif
+	while (len>=4) {
+		uint32_t v;
+		memcpy(&v, b, 4);
+		crc=_mm_crc32_u32(crc, v);
+		b+=4;
+		len-=4;
+	}
+	while (len--) crc=_mm_crc32_u8(crc, *b++);
+	return crc;
+}
+
+#endif
+
+/*!\ingroup PPLGroupMath
+ * \brief Prüft, ob die Hardware-Implementierung eines CRC-Verfahrens verfügbar ist
+ *
+ * \param castagnoli \c false für Crc32 (PCLMULQDQ), \c true für Crc32c (SSE4.2)
+ * \return \c true, wenn die CPU die benötigten Befehle unterstützt
+ */
+bool HaveCrcHardwareSupport(bool castagnoli)
+{
+#ifdef PPL7_CRC_X86
+	if (castagnoli) return haveCrc32cSse42();
+	return haveCrc32Pclmul();
+#else
+	return false;
+#endif
+}
+
+uint32_t Crc32(const void* buffer, size_t size, CrcImplementation impl)
+/*!\ingroup PPLGroupMath
+ * \brief Berechnet den CRC32-Wert mit einer bestimmten Implementierung
+ *
+ * \desc
+ * Wie Crc32(const void*, size_t), verwendet aber die angegebene Implementierung. Alle
+ * Implementierungen liefern dasselbe Ergebnis, die Funktion dient vor allem zum Testen
+ * und Vergleichen.
+ *
+ * \param buffer Pointer auf den Beginn der Daten
+ * \param size Länge der Daten in Byte
+ * \param impl Gewünschte Implementierung
+ * \return Integer mit der Prüfsumme
+ * \exception UnsupportedFeatureException Die CPU unterstützt die Hardware-Implementierung nicht
+ */
+{
+	const unsigned char* b=(const unsigned char*)buffer;
+	uint32_t crc=0xffffffff;
+	switch (impl) {
+		case CRC_BYTEWISE:
+			crc=crcBytewise(crc, b, size, crc32_table);
+			break;
+		case CRC_SLICE8:
+			crc=crcSlice8(crc, b, size, crc32SliceTables());
+			break;
+		case CRC_HARDWARE:
+#ifdef PPL7_CRC_X86
+			if (haveCrc32Pclmul()) {
+				if (size>=64) {
+					size_t blocks=size & ~(size_t)15;
+					crc=crc32Pclmul(crc, b, blocks);
+					b+=blocks;
+					size-=blocks;
+				}
+				crc=crcSlice8(crc, b, size, crc32SliceTables());
+				break;
+			}
+#endif
+			throw UnsupportedFeatureException("Crc32: PCLMULQDQ");
+		default:
+			return Crc32(buffer, size);
+	}
+	return crc ^ 0xffffffff;
+}
 
 uint32_t Crc32(const void* buffer, size_t size)
 /*!\ingroup PPLGroupMath
  * \brief Berechnet den polynomischen CRC32-Wert eines Strings
  *
  * \desc
- * Berechnet die zyklisch redundante polynomische Prüfsumme mit einer Länge von 32-Bit.
+ * Berechnet die zyklisch redundante polynomische Prüfsumme mit einer Länge von 32-Bit
+ * (IEEE 802.3). Unterstützt die CPU PCLMULQDQ, werden Puffer ab 64 Bytes per
+ * Carry-less Multiplication gefaltet, ansonsten werden auf Little-Endian-Systemen 8 Bytes
+ * pro Iteration verarbeitet (Slicing-by-8). Das Ergebnis ist immer identisch mit der
+ * byteweisen Berechnung.
  *
  *
  * \param buffer Pointer auf den Beginn der Daten
@@ -100,12 +441,69 @@ uint32_t Crc32(const void* buffer, size_t size)
  * \return Integer mit der Prüfsumme
  */
 {
-      uint32_t  ulCRC(0xffffffff);
-      unsigned char* b=(unsigned char*)buffer;
-	  size_t len=size;
-      while(len--)
-            ulCRC = (ulCRC >> 8) ^ crc32_table[(ulCRC & 0xFF) ^ *b++];
-      return ulCRC ^ 0xffffffff;
+#ifdef PPL7_CRC_X86
+	if (size>=64 && haveCrc32Pclmul()) return Crc32(buffer, size, CRC_HARDWARE);
+#endif
+	if (size>=16) return Crc32(buffer, size, CRC_SLICE8);
+	return Crc32(buffer, size, CRC_BYTEWISE);
+}
+
+uint32_t Crc32c(const void* buffer, size_t size, CrcImplementation impl)
+/*!\ingroup PPLGroupMath
+ * \brief Berechnet den CRC32C-Wert mit einer bestimmten Implementierung
+ *
+ * \desc
+ * Wie Crc32c(const void*, size_t), verwendet aber die angegebene Implementierung.
+ *
+ * \param buffer Pointer auf den Beginn der Daten
+ * \param size Länge der Daten in Byte
+ * \param impl Gewünschte Implementierung
+ * \return Integer mit der Prüfsumme
+ * \exception UnsupportedFeatureException Die CPU unterstützt SSE4.2 nicht
+ */
+{
+	const unsigned char* b=(const unsigned char*)buffer;
+	uint32_t crc=0xffffffff;
+	switch (impl) {
+		case CRC_BYTEWISE:
+			crc=crcBytewise(crc, b, size, crc32cSliceTables().table[0]);
+			break;
+		case CRC_SLICE8:
+			crc=crcSlice8(crc, b, size, crc32cSliceTables());
+			break;
+		case CRC_HARDWARE:
+#ifdef PPL7_CRC_X86
+			if (haveCrc32cSse42()) {
+				crc=crc32cSse42(crc, b, size);
+				break;
+			}
+#endif
+			throw UnsupportedFeatureException("Crc32c: SSE4.2");
+		default:
+			return Crc32c(buffer, size);
+	}
+	return crc ^ 0xffffffff;
+}
+
+uint32_t Crc32c(const void* buffer, size_t size)
+/*!\ingroup PPLGroupMath
+ * \brief Berechnet den CRC32C-Wert (Castagnoli) eines Speicherbereichs
+ *
+ * \desc
+ * Berechnet die zyklisch redundante Prüfsumme mit dem Polynom von Castagnoli
+ * (0x1EDC6F41), wie sie z.B. iSCSI, SCTP und ext4 verwenden. Unterstützt die CPU SSE4.2,
+ * wird der CRC32-Befehl des Prozessors verwendet, ansonsten Slicing-by-8.
+ *
+ * \param buffer Pointer auf den Beginn der Daten
+ * \param size Länge der Daten in Byte
+ * \return Integer mit der Prüfsumme
+ */
+{
+#ifdef PPL7_CRC_X86
+	if (haveCrc32cSse42()) return Crc32c(buffer, size, CRC_HARDWARE);
+#endif
+	if (size>=16) return Crc32c(buffer, size, CRC_SLICE8);
+	return Crc32c(buffer, size, CRC_BYTEWISE);
 }
 
 
@@ -0,0 +1,166 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dns.h"
+
+/*!@file
+ * \brief Hilfsfunktionen für das DNS-Wire-Format
+ */
+
+static const char *rcode_names[]={
+	"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+	"YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH", "NOTZONE"
+};
+
+/*!\brief Response-Code aus Name oder Zahl ermitteln
+ *
+ * @param name Name des RCODE (z.B. "NXDOMAIN") oder Zahl zwischen 0 und 15
+ * @return RCODE
+ * @exception ppl7::InvalidArgumentsException Unbekannter RCODE
+ */
+int DNSParseRcode(const ppl7::String &name)
+{
+	ppl7::String n=name.trimmed();
+	if (n.isEmpty()) throw ppl7::InvalidArgumentsException("Leerer RCODE");
+	if (n[0]>='0' && n[0]<='9') {
+		int rc=n.toInt();
+		if (rc<0 || rc>15) throw ppl7::InvalidArgumentsException("Ungueltiger RCODE: %s", (const char*)n);
+		return rc;
+	}
+	for (int i=0;i<(int)(sizeof(rcode_names)/sizeof(rcode_names[0]));i++) {
+		if (ppl7::StrCaseCmp(n, rcode_names[i])==0) return i;
+	}
+	throw ppl7::InvalidArgumentsException("Unbekannter RCODE: %s", (const char*)n);
+}
+
+/*!\brief Name eines Response-Codes
+ *
+ * @param rcode RCODE
+ * @return Name oder "RCODEnn" für nicht benannte Werte
+ */
+const char *DNSRcodeName(int rcode)
+{
+	static const char *numbered[]={
+		"RCODE0", "RCODE1", "RCODE2", "RCODE3", "RCODE4", "RCODE5", "RCODE6", "RCODE7",
+		"RCODE8", "RCODE9", "RCODE10", "RCODE11", "RCODE12", "RCODE13", "RCODE14", "RCODE15"
+	};
+	if (rcode>=0 && rcode<(int)(sizeof(rcode_names)/sizeof(rcode_names[0]))) return rcode_names[rcode];
+	if (rcode>=0 && rcode<16) return numbered[rcode];
+	return "UNKNOWN";
+}
+
+/*!\brief Record-Typ aus Name oder Zahl ermitteln
+ *
+ * @param name Name des Typs (z.B. "AAAA"), "TYPEnnn" oder Zahl
+ * @return Numerischer Typ
+ * @exception ppl7::InvalidArgumentsException Unbekannter Typ
+ */
+int DNSParseType(const ppl7::String &name)
+{
+	static const struct {
+		const char *name;
+		int type;
+	} types[]={
+		{ "A", 1 }, { "NS", 2 }, { "CNAME", 5 }, { "SOA", 6 }, { "PTR", 12 },
+		{ "MX", 15 }, { "TXT", 16 }, { "AAAA", 28 }, { "SRV", 33 }, { "NAPTR", 35 },
+		{ "DS", 43 }, { "RRSIG", 46 }, { "NSEC", 47 }, { "DNSKEY", 48 }, { "NSEC3", 50 },
+		{ "HTTPS", 65 }, { "CAA", 257 }, { "ANY", 255 }
+	};
+	ppl7::String n=name.trimmed();
+	if (n.isEmpty()) throw ppl7::InvalidArgumentsException("Leerer Record-Typ");
+	if (n[0]>='0' && n[0]<='9') {
+		int t=n.toInt();
+		if (t<0 || t>65535) throw ppl7::InvalidArgumentsException("Ungueltiger Record-Typ: %s", (const char*)n);
+		return t;
+	}
+	for (size_t i=0;i<sizeof(types)/sizeof(types[0]);i++) {
+		if (ppl7::StrCaseCmp(n, types[i].name)==0) return types[i].type;
+	}
+	if (n.size()>4 && ppl7::StrCaseCmp(n.left(4),"TYPE")==0) {
+		int t=n.mid(4).toInt();
+		if (t>0 && t<=65535) return t;
+	}
+	throw ppl7::InvalidArgumentsException("Unbekannter Record-Typ: %s", (const char*)n);
+}
+
+/*!\brief Domainnamen ins Wire-Format umwandeln
+ *
+ * Ein abschließender Punkt ist optional, der Name "." ergibt die Root-Zone.
+ *
+ * @param name Domainname in Textform
+ * @param buffer Zielpuffer
+ * @param size Größe des Zielpuffers
+ * @return Länge des kodierten Namens in Bytes
+ * @exception ppl7::InvalidArgumentsException Label zu lang, leeres Label oder Name zu lang
+ */
+size_t DNSEncodeName(const ppl7::String &name, unsigned char *buffer, size_t size)
+{
+	const char *s=(const char*)name;
+	size_t len=name.size();
+	if (len>0 && s[len-1]=='.') len--;
+	size_t pos=0;
+	size_t start=0;
+	while (start<len) {
+		const char *dot=(const char*)memchr(s+start,'.',len-start);
+		size_t label=dot ? (size_t)(dot-(s+start)) : len-start;
+		if (label==0 || label>63) throw ppl7::InvalidArgumentsException("Ungueltiges Label in Domainname: %s", s);
+		if (pos+label+2>size || pos+label+2>255) throw ppl7::InvalidArgumentsException("Domainname zu lang: %s", s);
+		buffer[pos++]=(unsigned char)label;
+		memcpy(buffer+pos,s+start,label);
+		pos+=label;
+		start+=label+1;
+	}
+	if (pos+1>size) throw ppl7::InvalidArgumentsException("Domainname zu lang: %s", s);
+	buffer[pos++]=0;
+	return pos;
+}
+
+/*!\brief Question-Section einer DNS-Nachricht überspringen
+ *
+ * Prüft, ob auf den Header genau ein gültiger Question-Eintrag folgt. Komprimierte
+ * Namen sind in Anfragen nicht zulässig.
+ *
+ * @param packet Pointer auf die DNS-Nachricht
+ * @param size Länge der Nachricht
+ * @return Offset hinter QTYPE und QCLASS oder 0, wenn die Question ungültig ist
+ */
+size_t DNSSkipQuestion(const unsigned char *packet, size_t size)
+{
+	size_t pos=DNS_HEADER_SIZE;
+	size_t namelen=0;
+	while (1) {
+		if (pos>=size) return 0;
+		unsigned int l=packet[pos];
+		if (l==0) {
+			pos++;
+			break;
+		}
+		if (l&0xc0) return 0;
+		namelen+=l+1;
+		if (namelen>254) return 0;
+		pos+=l+1;
+	}
+	if (pos+4>size) return 0;
+	return pos+4;
+}
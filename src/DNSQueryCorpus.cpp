@@ -0,0 +1,161 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+
+#include "dns.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class DNSQueryCorpus
+ * \ingroup GroupSender
+ * \brief Liste vorkodierter DNS-Anfragen für den Sender
+ *
+ * Die Query-Datei wird per mmap eingelesen und jede Zeile einmalig beim Start ins
+ * Wire-Format umgewandelt. Alle Anfragen liegen hintereinander in einem Speicherblock,
+ * so dass der Sender pro Paket nur noch die Anfrage kopieren und die Transaktions-ID
+ * eintragen muss.
+ *
+ * Das Format der Datei entspricht dem von dnsperf: pro Zeile ein Domainname, optional
+ * gefolgt vom Record-Typ (Default=A). Leerzeilen und Zeilen, die mit # oder ; beginnen,
+ * werden ignoriert.
+ * \code
+www.example.com A
+example.com MX
+www.example.com AAAA
+\endcode
+ */
+
+DNSQueryCorpus::DNSQueryCorpus()
+{
+	maxQuerySize=0;
+	invalidLines=0;
+	offsets.push_back(0);
+}
+
+/*!\brief Alle Anfragen löschen
+ */
+void DNSQueryCorpus::clear()
+{
+	wire.clear();
+	offsets.clear();
+	offsets.push_back(0);
+	maxQuerySize=0;
+	invalidLines=0;
+}
+
+/*!\brief Query-Datei laden
+ *
+ * @param filename Name der Datei
+ * @param edns_size Ist der Wert größer 0, wird jeder Anfrage ein EDNS0 OPT-Record mit
+ * dieser UDP-Payload-Größe angehängt
+ * @exception ppl7::InvalidArgumentsException Die Datei enthält keine gültige Anfrage
+ * @exception Diverse Die Datei kann nicht geöffnet oder gemapped werden
+ */
+void DNSQueryCorpus::load(const ppl7::String &filename, int edns_size)
+{
+	if (edns_size<0 || edns_size>65535)
+		throw ppl7::InvalidArgumentsException("Ungueltige EDNS-Groesse: %d", edns_size);
+	clear();
+	ppl7::File ff(filename);
+	size_t size=(size_t)ff.size();
+	if (size>0) {
+		const char *data=ff.map(0, size);
+		// Grobe Schätzung: Wire-Format ist nur wenige Bytes größer als die Textzeile
+		wire.reserve(size+size/2);
+		size_t start=0;
+		while (start<size) {
+			const char *nl=(const char*)memchr(data+start, '\n', size-start);
+			size_t len=nl ? (size_t)(nl-(data+start)) : size-start;
+			if (!addQuery(data+start, len, edns_size)) invalidLines++;
+			start+=len+1;
+		}
+		ff.unmap();
+	}
+	ff.close();
+	if (count()==0) throw ppl7::InvalidArgumentsException("Keine gueltigen Anfragen in %s", (const char*)filename);
+}
+
+/*!\brief Einzelne Zeile kodieren
+ *
+ * @return false, wenn die Zeile ungültig war, sonst true (auch bei Kommentaren)
+ */
+bool DNSQueryCorpus::addQuery(const char *line, size_t len, int edns_size)
+{
+	while (len>0 && (line[len-1]=='\r' || line[len-1]==' ' || line[len-1]=='\t')) len--;
+	while (len>0 && (line[0]==' ' || line[0]=='\t')) {
+		line++;
+		len--;
+	}
+	if (len==0 || line[0]=='#' || line[0]==';') return true;
+	ppl7::String l(line, len);
+	l.replace("\t", " ");
+	ppl7::Array tok(l, " ", 0, true);
+	if (tok.size()<1 || tok.size()>2) return false;
+	unsigned char q[DNS_HEADER_SIZE+256+4+11];
+	memset(q, 0, DNS_HEADER_SIZE);
+	q[2]=0x01;	// RD
+	DNSPut16(q+4, 1);
+	size_t pos=DNS_HEADER_SIZE;
+	try {
+		pos+=DNSEncodeName(tok[0], q+pos, 256);
+		DNSPut16(q+pos, (uint16_t)(tok.size()>1 ? DNSParseType(tok[1]) : 1));
+	} catch (const ppl7::InvalidArgumentsException &) {
+		return false;
+	}
+	DNSPut16(q+pos+2, 1);	// Class IN
+	pos+=4;
+	if (edns_size>0) {
+		DNSPut16(q+10, 1);
+		q[pos]=0;
+		DNSPut16(q+pos+1, 41);
+		DNSPut16(q+pos+3, (uint16_t)edns_size);
+		memset(q+pos+5, 0, 6);
+		pos+=11;
+	}
+	wire.insert(wire.end(), q, q+pos);
+	offsets.push_back((uint32_t)wire.size());
+	if (pos>maxQuerySize) maxQuerySize=pos;
+	return true;
+}
+
+/*!\brief Anzahl Anfragen
+ */
+size_t DNSQueryCorpus::count() const
+{
+	return offsets.size()-1;
+}
+
+/*!\brief Größe der längsten Anfrage in Bytes
+ */
+size_t DNSQueryCorpus::getMaxQuerySize() const
+{
+	return maxQuerySize;
+}
+
+/*!\brief Anzahl ungültiger Zeilen der zuletzt geladenen Datei
+ */
+size_t DNSQueryCorpus::getInvalidLines() const
+{
+	return invalidLines;
+}
@@ -0,0 +1,236 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "dns.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class DNSResponder
+ * \ingroup GroupBouncer
+ * \brief Beantwortet DNS-Anfragen direkt im Empfangspuffer
+ *
+ * Im DNS-Modus schickt der Bouncer nicht das empfangene Paket zurück, sondern eine
+ * gültige DNS-Antwort: Header und Question werden im Puffer geprüft, das QR-Bit gesetzt,
+ * RCODE und Zähler angepasst und optional ein vorab kodierter Answer-Record angehängt.
+ * Die Answer-Records werden beim Start ins Wire-Format umgewandelt, so dass im
+ * Paketpfad nur noch kopiert wird und kein Speicher allokiert werden muss.
+ *
+ * Enthält die Anfrage einen EDNS0 OPT-Record, wird auch die Antwort mit einem OPT-Record
+ * versehen und die angegebene UDP-Payload-Größe berücksichtigt. Passt der Answer-Record
+ * nicht in die Antwort, wird das TC-Bit gesetzt.
+ */
+
+/*!\brief Konstruktor
+ *
+ * Standardmäßig antwortet der Responder mit NOERROR ohne Answer-Records (NODATA).
+ */
+DNSResponder::DNSResponder()
+{
+	numAnswers=0;
+	rcode=DNS_RCODE_NOERROR;
+	ttl=300;
+	enabled=false;
+}
+
+void DNSResponder::enable(bool flag)
+{
+	enabled=flag;
+}
+
+bool DNSResponder::isEnabled() const
+{
+	return enabled;
+}
+
+/*!\brief RCODE der Antworten festlegen
+ *
+ * @param rcode Wert zwischen 0 und 15
+ */
+void DNSResponder::setRcode(int rcode)
+{
+	if (rcode<0 || rcode>15) throw ppl7::InvalidArgumentsException("DNSResponder::setRcode");
+	this->rcode=rcode;
+}
+
+/*!\brief TTL der Answer-Records festlegen
+ *
+ * Die TTL wird auch in bereits hinzugefügten Records geändert.
+ *
+ * @param ttl TTL in Sekunden
+ */
+void DNSResponder::setTTL(uint32_t ttl)
+{
+	this->ttl=ttl;
+	for (int i=0;i<numAnswers;i++) {
+		unsigned char *p=answers[i].rr+6;
+		p[0]=(unsigned char)(ttl>>24);
+		p[1]=(unsigned char)(ttl>>16);
+		p[2]=(unsigned char)(ttl>>8);
+		p[3]=(unsigned char)ttl;
+	}
+}
+
+/*!\brief Answer-Record hinzufügen
+ *
+ * Der Record wird auf Anfragen mit dem passenden QTYPE angehängt. Als Owner-Name wird
+ * ein Kompressions-Pointer auf den Namen in der Question verwendet.
+ *
+ * @param spec TYPE:VALUE, unterstützt werden A, AAAA, TXT, CNAME, NS und PTR,
+ * z.B. "A:192.0.2.1" oder "TXT:hello world"
+ * @exception ppl7::InvalidArgumentsException Ungültige Angabe oder zu viele Records
+ */
+void DNSResponder::addAnswer(const ppl7::String &spec)
+{
+	if (numAnswers>=MaxAnswers) throw ppl7::InvalidArgumentsException("Maximal %d DNS-Answers moeglich", MaxAnswers);
+	ssize_t p=spec.instr(":");
+	if (p<1) throw ppl7::InvalidArgumentsException("TYPE:VALUE erwartet: %s", (const char*)spec);
+	int type=DNSParseType(spec.left(p));
+	ppl7::String value=spec.mid(p+1).trimmed();
+	Answer &a=answers[numAnswers];
+	unsigned char *rdata=a.rr+12;
+	size_t rdlen=0;
+	switch (type) {
+		case 1:
+			if (inet_pton(AF_INET, (const char*)value, rdata)!=1)
+				throw ppl7::InvalidArgumentsException("Ungueltige IPv4-Adresse: %s", (const char*)value);
+			rdlen=4;
+			break;
+		case 28:
+			if (inet_pton(AF_INET6, (const char*)value, rdata)!=1)
+				throw ppl7::InvalidArgumentsException("Ungueltige IPv6-Adresse: %s", (const char*)value);
+			rdlen=16;
+			break;
+		case 16:
+			if (value.size()>255) throw ppl7::InvalidArgumentsException("TXT-Record zu lang: %s", (const char*)value);
+			rdata[0]=(unsigned char)value.size();
+			memcpy(rdata+1, (const char*)value, value.size());
+			rdlen=value.size()+1;
+			break;
+		case 2:
+		case 5:
+		case 12:
+			rdlen=DNSEncodeName(value, rdata, MaxRRSize-12);
+			break;
+		default:
+			throw ppl7::InvalidArgumentsException("Record-Typ wird nicht unterstuetzt: %s", (const char*)spec);
+	}
+	a.qtype=(uint16_t)type;
+	a.rr[0]=0xc0;	// Pointer auf den Namen in der Question
+	a.rr[1]=DNS_HEADER_SIZE;
+	DNSPut16(a.rr+2, (uint16_t)type);
+	DNSPut16(a.rr+4, 1);	// Class IN
+	DNSPut16(a.rr+10, (uint16_t)rdlen);
+	a.size=(uint16_t)(12+rdlen);
+	numAnswers++;
+	setTTL(ttl);
+}
+
+/*!\brief Mehrere Answer-Records hinzufügen
+ *
+ * @param list Kommaseparierte Liste von TYPE:VALUE-Angaben, siehe DNSResponder::addAnswer
+ */
+void DNSResponder::addAnswers(const ppl7::String &list)
+{
+	ppl7::Array a(list, ",");
+	for (size_t i=0;i<a.size();i++) {
+		ppl7::String spec=a[i].trimmed();
+		if (spec.notEmpty()) addAnswer(spec);
+	}
+}
+
+const DNSResponder::Answer *DNSResponder::findAnswer(uint16_t qtype) const
+{
+	for (int i=0;i<numAnswers;i++) {
+		if (answers[i].qtype==qtype) return &answers[i];
+	}
+	return NULL;
+}
+
+/*!\brief Anfrage im Puffer in eine Antwort umwandeln
+ *
+ * @param packet Puffer mit der empfangenen Anfrage, wird mit der Antwort überschrieben
+ * @param size Länge der Anfrage
+ * @param buffersize Größe des Puffers
+ * @return Länge der Antwort oder 0, wenn das Paket keine DNS-Anfrage ist und nicht
+ * beantwortet werden soll
+ */
+size_t DNSResponder::respond(unsigned char *packet, size_t size, size_t buffersize) const
+{
+	if (size<DNS_HEADER_SIZE) return 0;
+	if (packet[2]&0x80) return 0;	// QR gesetzt, keine Anfrage
+	int opcode=(packet[2]>>3)&0x0f;
+	int rc=rcode;
+	size_t qend=0;
+	if (opcode!=0) {
+		rc=DNS_RCODE_NOTIMP;
+	} else if (DNSGet16(packet+4)!=1) {
+		rc=DNS_RCODE_FORMERR;
+	} else {
+		qend=DNSSkipQuestion(packet, size);
+		if (!qend) rc=DNS_RCODE_FORMERR;
+	}
+	// EDNS0 OPT-Record in der Additional-Section der Anfrage?
+	bool edns=false;
+	size_t limit=512;
+	if (qend && DNSGet16(packet+10)==1 && size>=qend+11 && packet[qend]==0 && DNSGet16(packet+qend+1)==41) {
+		edns=true;
+		uint16_t udpsize=DNSGet16(packet+qend+3);
+		if (udpsize>limit) limit=udpsize;
+	}
+	if (limit>buffersize) limit=buffersize;
+
+	size_t len=qend ? qend : DNS_HEADER_SIZE;
+	size_t opt_size=edns ? 11 : 0;
+	packet[2]=(unsigned char)(0x80 | (opcode<<3) | 0x04 | (packet[2]&0x01));	// QR, AA, RD übernehmen
+	packet[3]=(unsigned char)(rc&0x0f);
+	DNSPut16(packet+4, qend ? 1 : 0);
+	DNSPut16(packet+6, 0);
+	DNSPut16(packet+8, 0);
+	DNSPut16(packet+10, 0);
+	if (rc==DNS_RCODE_NOERROR && qend) {
+		uint16_t qclass=DNSGet16(packet+qend-2);
+		const Answer *a=(qclass==1 || qclass==255) ? findAnswer(DNSGet16(packet+qend-4)) : NULL;
+		if (a) {
+			if (len+a->size+opt_size<=limit) {
+				memcpy(packet+len, a->rr, a->size);
+				len+=a->size;
+				DNSPut16(packet+6, 1);
+			} else {
+				packet[2]|=0x02;	// TC
+			}
+		}
+	}
+	if (edns && len+opt_size<=buffersize) {
+		unsigned char *opt=packet+len;
+		opt[0]=0;	// Root
+		DNSPut16(opt+1, 41);
+		DNSPut16(opt+3, (uint16_t)(buffersize<4096 ? buffersize : 4096));
+		memset(opt+5, 0, 6);	// Extended RCODE, Version, Flags, RDLEN
+		len+=opt_size;
+		DNSPut16(packet+10, 1);
+	}
+	return len;
+}
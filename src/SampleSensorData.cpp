@@ -36,27 +36,78 @@
 #include <kvm.h>
 #include <ifaddrs.h>
 #include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip_var.h>
+#include <netinet/udp.h>
+#include <netinet/udp_var.h>
 
 #elif defined __linux__
 #include <sys/sysinfo.h>
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/sock_diag.h>
 #endif
 
 #include <limits.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "sensor.h"
+#include "wire.h"
 
-// ########################################################### Linux specific ####################################
-#ifdef __linux__
-static void sampleCpuUsage(SystemStat::Cpu &stat)
+static inline void addNetwork(SystemStat::Interface &total, const SensorSampler::InterfaceSample &nif)
 {
-    FILE *fp = fopen("/proc/stat","r");
-    if (5 != fscanf(fp,"%*s %d %d %d %d %d",&stat.user, &stat.nice, &stat.system, &stat.idle, &stat.iowait)) {
+	total.receive.bytes+=nif.receive.bytes;
+	total.receive.packets+=nif.receive.packets;
+	total.receive.errs+=nif.receive.errs;
+	total.receive.drop+=nif.receive.drop;
 
-    	fclose(fp);
-    }
-    fclose(fp);
+	total.transmit.bytes+=nif.transmit.bytes;
+	total.transmit.packets+=nif.transmit.packets;
+	total.transmit.errs+=nif.transmit.errs;
+	total.transmit.drop+=nif.transmit.drop;
+}
+
+static const int MaxFilterInterfaces=32;
+static char FilterNames[MaxFilterInterfaces][SensorSampler::InterfaceNameSize];
+static int FilterCount=0;
+
+/*!\brief Auswahl der Interfaces festlegen
+ *
+ * Danach werden nur noch die angegebenen Interfaces erfasst, auch die Summe
+ * SystemStat::net_total bezieht sich nur auf diese. Die Funktion muss aufgerufen
+ * werden, bevor Threads Sensordaten erfassen.
+ *
+ * @param list Kommaseparierte Liste von Interface-Namen, ein leerer String
+ * hebt den Filter auf
+ * @exception ppl7::IllegalArgumentException Zu viele oder zu lange Namen
+ */
+void setSensorInterfaceFilter(const ppl7::String &list)
+{
+	FilterCount=0;
+	ppl7::Array names=ppl7::StrTok(list, ",");
+	for (size_t i=0;i<names.size();i++) {
+		ppl7::String name=ppl7::Trim(names[i]);
+		if (name.isEmpty()) continue;
+		if (FilterCount>=MaxFilterInterfaces || name.size()>=SensorSampler::InterfaceNameSize)
+			throw ppl7::IllegalArgumentException("invalid interface list: %s", (const char*)list);
+		strcpy(FilterNames[FilterCount++], (const char*)name);
+	}
+}
+
+static inline bool interfaceSelected(const char *name)
+{
+	if (!FilterCount) return true;
+	for (int i=0;i<FilterCount;i++) {
+		if (strcmp(FilterNames[i], name)==0) return true;
+	}
+	return false;
 }
 
+// ########################################################### Linux specific ####################################
+#ifdef __linux__
 static void sampleSysinfo(SystemStat::Sysinfo &stat)
 {
     struct sysinfo info;
@@ -73,44 +124,50 @@ static void sampleSysinfo(SystemStat::Sysinfo &stat)
     stat.procs=info.procs;
 }
 
-static void sampleNetwork(std::map<ppl7::String, SystemStat::Interface> &interfaces, SystemStat::Interface &total)
+static inline const char *skipBlanks(const char *p)
 {
-	total.receive.clear();
-	total.transmit.clear();
+	while (*p==' ' || *p=='\t') p++;
+	return p;
+}
 
-	ppl7::String buffer;
-	ppl7::File ff("/proc/net/dev");
-	while (!ff.eof()) {
-		ff.gets(buffer,2048);
-		buffer.trim();
-		ssize_t t=buffer.instr(":");
-		if (t>1) {
-			SystemStat::Interface nif;
-			nif.Name.set(buffer,t);
-			buffer.replace("\t"," ");
-			ppl7::Array tok=ppl7::StrTok(buffer," ");
-			nif.receive.bytes=tok[1].toUnsignedLong();
-			nif.receive.packets=tok[2].toUnsignedLong();
-			nif.receive.errs=tok[3].toUnsignedLong();
-			nif.receive.drop=tok[4].toUnsignedLong();
-
-			nif.transmit.bytes=tok[9].toUnsignedLong();
-			nif.transmit.packets=tok[10].toUnsignedLong();
-			nif.transmit.errs=tok[11].toUnsignedLong();
-			nif.transmit.drop=tok[12].toUnsignedLong();
-
-			total.receive.bytes+=nif.receive.bytes;
-			total.receive.packets+=nif.receive.packets;
-			total.receive.errs+=nif.receive.errs;
-			total.receive.drop+=nif.receive.drop;
-
-			total.transmit.bytes+=nif.transmit.bytes;
-			total.transmit.packets+=nif.transmit.packets;
-			total.transmit.errs+=nif.transmit.errs;
-			total.transmit.drop+=nif.transmit.drop;
-			interfaces.insert(std::pair<ppl7::String,SystemStat::Interface>(nif.Name,nif));
-		}
+static inline const char *skipLine(const char *p)
+{
+	while (*p && *p!='\n') p++;
+	if (*p) p++;
+	return p;
+}
+
+/*!\brief Dezimalzahl ohne Vorzeichen einlesen
+ *
+ * Führende Leerzeichen werden übersprungen.
+ *
+ * @return Pointer auf das erste Zeichen hinter der Zahl
+ */
+static inline const char *parseNumber(const char *p, unsigned long &value)
+{
+	p=skipBlanks(p);
+	unsigned long v=0;
+	while (*p>='0' && *p<='9') {
+		v=v*10+(unsigned long)(*p-'0');
+		p++;
 	}
+	value=v;
+	return p;
+}
+
+//! Wie parseNumber, aber hexadezimal
+static inline const char *parseHex(const char *p, unsigned long &value)
+{
+	p=skipBlanks(p);
+	unsigned long v=0;
+	while (1) {
+		if (*p>='0' && *p<='9') v=(v<<4)+(unsigned long)(*p-'0');
+		else if (*p>='a' && *p<='f') v=(v<<4)+(unsigned long)(*p-'a'+10);
+		else break;
+		p++;
+	}
+	value=v;
+	return p;
 }
 
 #elif defined __FreeBSD__
@@ -134,19 +191,60 @@ getsysctl(const char *name, void *ptr, size_t len)
 
 static void sampleCpuUsage(SystemStat::Cpu &stat)
 {
-    size_t cp_size = sizeof(long) * CPUSTATES*8;
-    long *cp_times = (long*)malloc(cp_size);
-    if (sysctlbyname("kern.cp_time", cp_times, &cp_size, NULL, 0) < 0) {
-       perror("sysctlbyname");
-       free(cp_times);
-    }
-    stat.user=(int)cp_times[0];
-    stat.nice=(int)cp_times[1];
-    stat.system=(int)cp_times[2];
-    stat.iowait=(int)cp_times[3];
-    stat.idle=(int)cp_times[4];
+	long cp_times[CPUSTATES];
+	size_t cp_size=sizeof(cp_times);
+	if (sysctlbyname("kern.cp_time", cp_times, &cp_size, NULL, 0) < 0) {
+		perror("sysctlbyname");
+		return;
+	}
+	stat.user=(int)cp_times[CP_USER];
+	stat.nice=(int)cp_times[CP_NICE];
+	stat.system=(int)cp_times[CP_SYS];
+	stat.irq=(int)cp_times[CP_INTR];
+	stat.idle=(int)cp_times[CP_IDLE];
+}
 
+/*!\brief CPU-Zeiten pro Kern per sysctl kern.cp_times
+ *
+ * Verwendet \p buffer des SensorSampler und vergrößert ihn nur, falls er für die
+ * Anzahl der Kerne nicht ausreicht.
+ */
+static void sampleCoreUsage(std::vector<SystemStat::Core> &cores, char *&buffer, size_t &buffersize)
+{
+	size_t cp_size=buffersize;
+	while (sysctlbyname("kern.cp_times", buffer, &cp_size, NULL, 0)<0) {
+		if (errno!=ENOMEM) return;
+		char *newbuffer=(char*)realloc(buffer, buffersize*2);
+		if (!newbuffer) throw ppl7::OutOfMemoryException();
+		buffer=newbuffer;
+		buffersize*=2;
+		cp_size=buffersize;
+	}
+	const long *cp_times=(const long*)buffer;
+	size_t n=cp_size/(sizeof(long)*CPUSTATES);
+	if (cores.size()!=n) cores.resize(n);
+	for (size_t i=0;i<n;i++) {
+		SystemStat::Cpu &cpu=cores[i].cpu;
+		const long *t=cp_times+i*CPUSTATES;
+		cores[i].id=(int)i;
+		cpu.user=(int)t[CP_USER];
+		cpu.nice=(int)t[CP_NICE];
+		cpu.system=(int)t[CP_SYS];
+		cpu.irq=(int)t[CP_INTR];
+		cpu.idle=(int)t[CP_IDLE];
+	}
+}
 
+static void sampleUdp(SystemStat::Udp &udp)
+{
+	struct udpstat st;
+	GETSYSCTL("net.inet.udp.stats", st);
+	udp.InDatagrams=st.udps_ipackets;
+	udp.NoPorts=st.udps_noport+st.udps_noportbcast;
+	udp.InErrors=st.udps_hdrops+st.udps_badsum+st.udps_badlen+st.udps_fullsock;
+	udp.OutDatagrams=st.udps_opackets;
+	udp.RcvbufErrors=st.udps_fullsock;
+	udp.SndbufErrors=0;
 }
 
 static int
@@ -189,10 +287,11 @@ static void sampleSysinfo(SystemStat::Sysinfo &stat)
 
 }
 
-static void sampleNetwork(std::map<ppl7::String, SystemStat::Interface> &interfaces, SystemStat::Interface &total)
+static void sampleNetwork(SensorSampler::InterfaceSample *iflist, int &ifcount, SystemStat::Interface &total)
 {
 	total.receive.clear();
 	total.transmit.clear();
+	ifcount=0;
 
 #define IFA_STAT(s)     (((struct if_data *)ifa->ifa_data)->ifi_ ## s)
 
@@ -202,8 +301,11 @@ static void sampleNetwork(std::map<ppl7::String, SystemStat::Interface> &interfa
 	}
 	for (struct ifaddrs *ifa=ifap; ifa; ifa = ifa->ifa_next) {
 		if (ifa->ifa_addr->sa_family != AF_LINK) continue;
-		SystemStat::Interface nif;
-		nif.Name.setf("%s",ifa->ifa_name);
+		if (!interfaceSelected(ifa->ifa_name)) continue;
+		if (ifcount>=SensorSampler::MaxInterfaces) break;
+		SensorSampler::InterfaceSample &nif=iflist[ifcount++];
+		strncpy(nif.name, ifa->ifa_name, SensorSampler::InterfaceNameSize-1);
+		nif.name[SensorSampler::InterfaceNameSize-1]=0;
 
 		nif.receive.bytes=IFA_STAT(ibytes);
 		nif.receive.packets=IFA_STAT(ipackets);
@@ -215,16 +317,7 @@ static void sampleNetwork(std::map<ppl7::String, SystemStat::Interface> &interfa
 		nif.transmit.errs=IFA_STAT(oerrors);
 		nif.transmit.drop=IFA_STAT(oqdrops);
 
-		total.receive.bytes+=nif.receive.bytes;
-		total.receive.packets+=nif.receive.packets;
-		total.receive.errs+=nif.receive.errs;
-		total.receive.drop+=nif.receive.drop;
-
-		total.transmit.bytes+=nif.transmit.bytes;
-		total.transmit.packets+=nif.transmit.packets;
-		total.transmit.errs+=nif.transmit.errs;
-		total.transmit.drop+=nif.transmit.drop;
-		interfaces.insert(std::pair<ppl7::String,SystemStat::Interface>(nif.Name,nif));
+		addNetwork(total, nif);
 	}
 	freeifaddrs(ifap);
 }
@@ -236,7 +329,409 @@ static void exit_kvm()
 
 #endif
 
-void sampleSensorData(SystemStat &stat)
+SensorSampler::SensorSampler()
+{
+	fd_stat=-1;
+	fd_softnet=-1;
+	fd_netdev=-1;
+	fd_snmp=-1;
+	fd_netlink=-1;
+	netlink_seq=0;
+	netlink=true;
+	buffersize=65536;
+	buffer=(char*)malloc(buffersize);
+	iflist=new InterfaceSample[MaxInterfaces];
+	ifcount=0;
+	if (!buffer) {
+		delete [] iflist;
+		throw ppl7::OutOfMemoryException();
+	}
+}
+
+SensorSampler::~SensorSampler()
+{
+	if (fd_stat>=0) ::close(fd_stat);
+	if (fd_softnet>=0) ::close(fd_softnet);
+	if (fd_netdev>=0) ::close(fd_netdev);
+	if (fd_snmp>=0) ::close(fd_snmp);
+	closeNetlink();
+	free(buffer);
+	delete [] iflist;
+}
+
+/*!\brief Datei aus /proc in den internen Puffer lesen
+ *
+ * Die Datei wird beim ersten Aufruf geöffnet und bleibt danach offen. Jede Messung
+ * liest sie per pread() ab Offset 0, wodurch der Kernel den Inhalt neu erzeugt.
+ *
+ * @param fd Dateideskriptor, -1 falls die Datei noch nicht geöffnet ist
+ * @param filename Name der Datei
+ * @param whole Bei \c false genügt ein einzelner Lesevorgang für die ersten Zeilen,
+ * sonst wird bis zum Dateiende gelesen und der Puffer bei Bedarf vergrößert
+ * @return Anzahl gelesener Bytes, der Puffer ist mit 0 terminiert
+ * @exception SystemCallFailed Die Datei konnte nicht geöffnet oder gelesen werden
+ */
+size_t SensorSampler::readFile(int &fd, const char *filename, bool whole)
+{
+	if (fd<0) {
+		fd=::open(filename, O_RDONLY|O_CLOEXEC);
+		if (fd<0) throw SystemCallFailed("open(%s): %s", filename, strerror(errno));
+	}
+	size_t len=0;
+	while (1) {
+		if (len>=buffersize-1) {
+			char *newbuffer=(char*)realloc(buffer, buffersize*2);
+			if (!newbuffer) throw ppl7::OutOfMemoryException();
+			buffer=newbuffer;
+			buffersize*=2;
+		}
+		ssize_t r=::pread(fd, buffer+len, buffersize-1-len, (off_t)len);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			throw SystemCallFailed("pread(%s): %s", filename, strerror(errno));
+		}
+		if (r==0) break;
+		len+=(size_t)r;
+		if (!whole) break;
+	}
+	buffer[len]=0;
+	return len;
+}
+
+/*!\brief CPU-Zeiten gesamt und pro Kern erfassen
+ *
+ * Der Vektor \p cores wird bei der ersten Messung in ein SystemStat auf die Anzahl
+ * der Kerne gebracht und danach nur dann in der Größe verändert, wenn sich diese
+ * ändert, etwa weil ein Kern offline genommen wurde.
+ */
+void SensorSampler::sampleCpuUsage(SystemStat::Cpu &cpu, std::vector<SystemStat::Core> &cores)
+{
+#ifdef __linux__
+	readFile(fd_stat, "/proc/stat", true);
+	// "cpu  user nice system idle iowait irq softirq ...", danach eine Zeile "cpuN ..." pro Kern
+	const char *p=buffer;
+	size_t n=0;
+	while (p[0]=='c' && p[1]=='p' && p[2]=='u') {
+		bool total=(p[3]==' ');
+		unsigned long id=0;
+		p+=3;
+		if (!total) p=parseNumber(p, id);
+		unsigned long v[7];
+		for (int i=0;i<7;i++) p=parseNumber(p, v[i]);
+		p=skipLine(p);
+		SystemStat::Cpu *c=&cpu;
+		if (!total) {
+			if (n>=cores.size()) cores.resize(n+1);
+			cores[n].id=(int)id;
+			c=&cores[n].cpu;
+			n++;
+		}
+		c->user=(int)v[0];
+		c->nice=(int)v[1];
+		c->system=(int)v[2];
+		c->idle=(int)v[3];
+		c->iowait=(int)v[4];
+		c->irq=(int)v[5];
+		c->softirq=(int)v[6];
+	}
+	if (cores.size()!=n) cores.resize(n);
+#elif defined __FreeBSD__
+	::sampleCpuUsage(cpu);
+	::sampleCoreUsage(cores, buffer, buffersize);
+#endif
+}
+
+/*!\brief Zähler des Paketempfangs pro Kern erfassen
+ *
+ * /proc/net/softnet_stat enthält pro Kern eine Zeile mit hexadezimalen Werten,
+ * die ersten drei sind processed, dropped und time_squeeze. Neuere Kernel liefern
+ * in Spalte 13 die Nummer des Kerns, ältere nur die Zeilen der Kerne, die online
+ * sind, in derselben Reihenfolge wie /proc/stat.
+ */
+void SensorSampler::sampleSoftnet(std::vector<SystemStat::Core> &cores)
+{
+#ifdef __linux__
+	readFile(fd_softnet, "/proc/net/softnet_stat", true);
+	const char *p=buffer;
+	size_t line=0;
+	while (*p) {
+		unsigned long v[13];
+		int columns=0;
+		while (columns<13) {
+			const char *start=skipBlanks(p);
+			p=parseHex(start, v[columns]);
+			if (p==start) break;
+			columns++;
+		}
+		p=skipLine(p);
+		if (columns<3) continue;
+		size_t index=line++;
+		if (columns>=13) {
+			// Kern anhand seiner Nummer suchen, die Reihenfolge ist meist identisch
+			if (index>=cores.size() || cores[index].id!=(int)v[12]) {
+				for (index=0;index<cores.size();index++) {
+					if (cores[index].id==(int)v[12]) break;
+				}
+			}
+		}
+		if (index>=cores.size()) continue;
+		cores[index].processed=v[0];
+		cores[index].dropped=v[1];
+		cores[index].time_squeeze=v[2];
+	}
+#else
+	(void)cores;
+#endif
+}
+
+#ifdef __linux__
+static inline const char *findUdpLine(const char *p)
+{
+	while (*p) {
+		if (p[0]=='U' && p[1]=='d' && p[2]=='p' && p[3]==':') return p+4;
+		p=skipLine(p);
+	}
+	return NULL;
+}
+
+static inline bool tokenEquals(const char *token, const char *name)
+{
+	while (*name) {
+		if (*token!=*name) return false;
+		token++;
+		name++;
+	}
+	return *token==' ' || *token=='\t' || *token=='\n' || *token==0;
+}
+#endif
+
+/*!\brief Zähler der UDP-MIB erfassen
+ *
+ * In /proc/net/snmp folgt auf eine Zeile "Udp:" mit den Namen der Zähler eine
+ * zweite mit den Werten. Die Spalten werden anhand der Namen zugeordnet, da
+ * neuere Kernel weitere Zähler anhängen.
+ */
+void SensorSampler::sampleUdp(SystemStat::Udp &udp)
+{
+#ifdef __linux__
+	readFile(fd_snmp, "/proc/net/snmp", true);
+	const char *names=findUdpLine(buffer);
+	if (!names) return;
+	const char *values=findUdpLine(skipLine(names));
+	if (!values) return;
+	udp.clear();
+	while (1) {
+		names=skipBlanks(names);
+		if (*names=='\n' || *names==0) break;
+		unsigned long v;
+		values=parseNumber(values, v);
+		if (tokenEquals(names, "InDatagrams")) udp.InDatagrams=v;
+		else if (tokenEquals(names, "NoPorts")) udp.NoPorts=v;
+		else if (tokenEquals(names, "InErrors")) udp.InErrors=v;
+		else if (tokenEquals(names, "OutDatagrams")) udp.OutDatagrams=v;
+		else if (tokenEquals(names, "RcvbufErrors")) udp.RcvbufErrors=v;
+		else if (tokenEquals(names, "SndbufErrors")) udp.SndbufErrors=v;
+		while (*names && *names!=' ' && *names!='\t' && *names!='\n') names++;
+	}
+#elif defined __FreeBSD__
+	::sampleUdp(udp);
+#endif
+}
+
+void SensorSampler::sampleNetwork(SystemStat::Interface &total)
+{
+#ifdef __linux__
+	if (netlink) {
+		if (sampleNetlink(total)) return;
+		// Netlink steht nicht zur Verfügung, ab jetzt nur noch /proc verwenden
+		closeNetlink();
+		netlink=false;
+	}
+	sampleProcNetDev(total);
+#elif defined __FreeBSD__
+	::sampleNetwork(iflist, ifcount, total);
+#endif
+}
+
+void SensorSampler::sampleProcNetDev(SystemStat::Interface &total)
+{
+#ifdef __linux__
+	total.receive.clear();
+	total.transmit.clear();
+	ifcount=0;
+	readFile(fd_netdev, "/proc/net/dev", true);
+	// Zwei Kopfzeilen, danach je Interface "  name: rx[8] tx[8]"
+	const char *p=buffer;
+	while (*p) {
+		const char *name=skipBlanks(p);
+		const char *colon=name;
+		while (*colon && *colon!=':' && *colon!='\n') colon++;
+		if (*colon!=':' || colon==name || ifcount>=MaxInterfaces) {
+			p=skipLine(colon);
+			continue;
+		}
+		InterfaceSample &nif=iflist[ifcount];
+		size_t namelen=(size_t)(colon-name);
+		if (namelen>InterfaceNameSize-1) namelen=InterfaceNameSize-1;
+		memcpy(nif.name, name, namelen);
+		nif.name[namelen]=0;
+		p=colon+1;
+		if (!interfaceSelected(nif.name)) {
+			p=skipLine(p);
+			continue;
+		}
+		unsigned long v[16];
+		for (int i=0;i<16;i++) p=parseNumber(p, v[i]);
+		nif.receive.bytes=v[0];
+		nif.receive.packets=v[1];
+		nif.receive.errs=v[2];
+		nif.receive.drop=v[3];
+		nif.transmit.bytes=v[8];
+		nif.transmit.packets=v[9];
+		nif.transmit.errs=v[10];
+		nif.transmit.drop=v[11];
+		addNetwork(total, nif);
+		ifcount++;
+		p=skipLine(p);
+	}
+#endif
+}
+
+/*!\brief Interface-Zähler per Netlink abfragen
+ *
+ * Schickt einen RTM_GETLINK-Dump über alle Interfaces und übernimmt aus den
+ * Antworten IFLA_IFNAME und IFLA_STATS64. Wie in /proc/net/dev enthält "drop"
+ * beim Empfang auch rx_missed_errors.
+ *
+ * @return \c false, falls Netlink nicht verwendet werden kann
+ */
+bool SensorSampler::sampleNetlink(SystemStat::Interface &total)
+{
+#ifdef __linux__
+	if (fd_netlink<0) {
+		fd_netlink=::socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+		if (fd_netlink<0) return false;
+		struct sockaddr_nl local;
+		memset(&local, 0, sizeof(local));
+		local.nl_family=AF_NETLINK;
+		if (::bind(fd_netlink, (struct sockaddr*)&local, sizeof(local))<0) return false;
+	}
+	struct {
+		struct nlmsghdr nh;
+		struct ifinfomsg ifi;
+	} req;
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len=NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req.nh.nlmsg_type=RTM_GETLINK;
+	req.nh.nlmsg_flags=NLM_F_REQUEST|NLM_F_DUMP;
+	req.nh.nlmsg_seq=++netlink_seq;
+	req.ifi.ifi_family=AF_UNSPEC;
+	if (::send(fd_netlink, &req, req.nh.nlmsg_len, 0)<0) return false;
+
+	total.receive.clear();
+	total.transmit.clear();
+	ifcount=0;
+	while (1) {
+		struct iovec iov;
+		iov.iov_base=buffer;
+		iov.iov_len=buffersize;
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov=&iov;
+		msg.msg_iovlen=1;
+		ssize_t r=::recvmsg(fd_netlink, &msg, 0);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			return false;
+		}
+		if (r==0) return false;
+		if (msg.msg_flags&MSG_TRUNC) {
+			// Die Nachricht passte nicht in den Puffer, es fehlen Interfaces. Das Schließen
+			// des Sockets verwirft den Rest des Dumps, danach wird er mit größerem Puffer
+			// neu angefordert.
+			closeNetlink();
+			if (buffersize>=16*1024*1024) return false;
+			char *newbuffer=(char*)realloc(buffer, buffersize*2);
+			if (!newbuffer) throw ppl7::OutOfMemoryException();
+			buffer=newbuffer;
+			buffersize*=2;
+			return sampleNetlink(total);
+		}
+		int len=(int)r;
+		for (struct nlmsghdr *nh=(struct nlmsghdr*)buffer; NLMSG_OK(nh, len); nh=NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_seq!=netlink_seq) continue;
+			if (nh->nlmsg_type==NLMSG_DONE) return true;
+			if (nh->nlmsg_type==NLMSG_ERROR) return false;
+			if (nh->nlmsg_type!=RTM_NEWLINK) continue;
+			struct ifinfomsg *ifi=(struct ifinfomsg*)NLMSG_DATA(nh);
+			int attrlen=(int)nh->nlmsg_len-(int)NLMSG_LENGTH(sizeof(struct ifinfomsg));
+			const char *name=NULL;
+			const struct rtattr *stats=NULL;
+			for (struct rtattr *rta=IFLA_RTA(ifi); RTA_OK(rta, attrlen); rta=RTA_NEXT(rta, attrlen)) {
+				if (rta->rta_type==IFLA_IFNAME) name=(const char*)RTA_DATA(rta);
+				else if (rta->rta_type==IFLA_STATS64) stats=rta;
+			}
+			if (!name || !stats || ifcount>=MaxInterfaces) continue;
+			if (!interfaceSelected(name)) continue;
+			// Die Attribute sind nur auf 4 Byte ausgerichtet, ältere Kernel liefern weniger Felder
+			struct rtnl_link_stats64 st;
+			size_t stlen=RTA_PAYLOAD(stats);
+			if (stlen>sizeof(st)) stlen=sizeof(st);
+			memset(&st, 0, sizeof(st));
+			memcpy(&st, RTA_DATA(stats), stlen);
+			InterfaceSample &nif=iflist[ifcount++];
+			strncpy(nif.name, name, InterfaceNameSize-1);
+			nif.name[InterfaceNameSize-1]=0;
+			nif.receive.bytes=st.rx_bytes;
+			nif.receive.packets=st.rx_packets;
+			nif.receive.errs=st.rx_errors;
+			nif.receive.drop=st.rx_dropped+st.rx_missed_errors;
+			nif.transmit.bytes=st.tx_bytes;
+			nif.transmit.packets=st.tx_packets;
+			nif.transmit.errs=st.tx_errors;
+			nif.transmit.drop=st.tx_dropped;
+			addNetwork(total, nif);
+		}
+	}
+#else
+	return false;
+#endif
+}
+
+void SensorSampler::closeNetlink()
+{
+	if (fd_netlink>=0) ::close(fd_netlink);
+	fd_netlink=-1;
+}
+
+/*!\brief Netlink verwenden oder /proc/net/dev erzwingen
+ *
+ * @param enable Bei \c true wird Netlink versucht (Voreinstellung)
+ */
+void SensorSampler::setNetlink(bool enable)
+{
+	if (!enable) closeNetlink();
+	netlink=enable;
+}
+
+//! Liefert \c true, solange die Interfaces per Netlink abgefragt werden
+bool SensorSampler::usesNetlink() const
+{
+#ifdef __linux__
+	return netlink;
+#else
+	return false;
+#endif
+}
+
+/*!\brief Sensordaten erfassen
+ *
+ * @param stat Nimmt die Sensordaten auf
+ * @param interfaces Bei \c true wird zusätzlich die Map SystemStat::interfaces
+ * neu aufgebaut, was Speicher allokiert. Bei \c false bleibt sie unverändert und
+ * es werden nur die Summen über alle Interfaces gesetzt.
+ */
+void SensorSampler::sample(SystemStat &stat, bool interfaces)
 {
 #ifdef __FreeBSD__
     if (!kd) {
@@ -246,11 +741,97 @@ void sampleSensorData(SystemStat &stat)
     }
 #endif
 	stat.sampleTime=ppl7::GetMicrotime();
-	sampleCpuUsage(stat.cpu);
+	sampleCpuUsage(stat.cpu, stat.cores);
+	sampleSoftnet(stat.cores);
 	sampleSysinfo(stat.sysinfo);
-	sampleNetwork(stat.interfaces, stat.net_total);
+	sampleUdp(stat.udp);
+	sampleNetwork(stat.net_total);
+	if (!interfaces) return;
+	stat.interfaces.clear();
+	for (int i=0;i<ifcount;i++) {
+		SystemStat::Interface nif;
+		nif.Name.set(iflist[i].name);
+		nif.receive=iflist[i].receive;
+		nif.transmit=iflist[i].transmit;
+		stat.interfaces.insert(std::pair<ppl7::String,SystemStat::Interface>(nif.Name,nif));
+	}
+}
+
+//! Anzahl Interfaces der letzten Messung
+int SensorSampler::interfaceCount() const
+{
+	return ifcount;
+}
+
+//! Werte des Interfaces \p index aus der letzten Messung
+const SensorSampler::InterfaceSample &SensorSampler::interface(int index) const
+{
+	if (index<0 || index>=ifcount) throw ppl7::OutOfBoundsEception();
+	return iflist[index];
+}
+
+//! Jeder Thread verwendet seinen eigenen SensorSampler, die Dateien bleiben pro Thread geöffnet
+static SensorSampler &threadSampler()
+{
+	static thread_local SensorSampler sampler;
+	return sampler;
 }
 
+/*!\brief Sensordaten mit allen Interfaces erfassen
+ */
+void sampleSensorData(SystemStat &stat)
+{
+	threadSampler().sample(stat, true);
+}
+
+/*!\brief Sensordaten ohne einzelne Interfaces erfassen
+ *
+ * Wie sampleSensorData, setzt aber nur SystemStat::net_total und kommt daher ohne
+ * Speicherallokation aus. Für Messungen in kurzen Intervallen gedacht.
+ */
+void sampleSensorTotals(SystemStat &stat)
+{
+	threadSampler().sample(stat, false);
+}
+
+/*!\brief Vom Kernel verworfene Pakete eines Sockets
+ *
+ * Liefert den Zähler sk_drops des Sockets, also Pakete, die wegen eines vollen
+ * Empfangspuffers verworfen wurden. Es ist derselbe Zähler, den SO_RXQ_OVFL als
+ * Control-Message an jedes empfangene Paket hängt. Er wird hier per SO_MEMINFO
+ * abgefragt, damit die Empfangsschleifen unverändert bei recv bleiben können.
+ *
+ * @param sockfd Socket
+ * @return Anzahl verworfener Pakete seit Erzeugen des Sockets (32 Bit, mit Überlauf),
+ * oder -1, wenn der Zähler nicht zur Verfügung steht
+ */
+int64_t getSocketDrops(int sockfd)
+{
+#if defined(__linux__) && defined(SO_MEMINFO)
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len=sizeof(meminfo);
+	memset(meminfo, 0, sizeof(meminfo));
+	if (sockfd<=0 || getsockopt(sockfd, SOL_SOCKET, SO_MEMINFO, meminfo, &len)<0) return -1;
+	if (len<=SK_MEMINFO_DROPS*sizeof(uint32_t)) return -1;
+	return meminfo[SK_MEMINFO_DROPS];
+#else
+	(void)sockfd;
+	return -1;
+#endif
+}
+
+static inline int cpuTotal(const SystemStat::Cpu &cpu)
+{
+	return cpu.user+cpu.nice+cpu.system+cpu.irq+cpu.softirq+cpu.idle;
+}
+
+/*!\brief Auslastung zwischen zwei Messungen in Prozent
+ *
+ * Anteil von user, nice und system an user, nice, system und idle. Die Zeit in
+ * Interrupts und Softirqs ist nicht enthalten und wird getrennt über
+ * SystemStat::Cpu::getIrqUsage und SystemStat::Cpu::getSoftirqUsage ermittelt.
+ * Sind die Zähler zwischen den Messungen unverändert, ist das Ergebnis NaN.
+ */
 double SystemStat::Cpu::getUsage(const SystemStat::Cpu &sample1,const SystemStat::Cpu &sample2)
 {
 	double usage=100.0 * (double)((sample2.user+sample2.nice+sample2.system) -
@@ -260,11 +841,76 @@ double SystemStat::Cpu::getUsage(const SystemStat::Cpu &sample1,const SystemStat
 	return fabs(usage);
 }
 
+//! Anteil der Zeit in Hardware-Interrupts zwischen zwei Messungen in Prozent
+double SystemStat::Cpu::getIrqUsage(const SystemStat::Cpu &sample1,const SystemStat::Cpu &sample2)
+{
+	int total=cpuTotal(sample2)-cpuTotal(sample1);
+	return fabs(100.0*(double)(sample2.irq-sample1.irq)/(double)total);
+}
+
+//! Anteil der Zeit in Softirqs zwischen zwei Messungen in Prozent
+double SystemStat::Cpu::getSoftirqUsage(const SystemStat::Cpu &sample1,const SystemStat::Cpu &sample2)
+{
+	int total=cpuTotal(sample2)-cpuTotal(sample1);
+	return fabs(100.0*(double)(sample2.softirq-sample1.softirq)/(double)total);
+}
+
+/*!\brief Am stärksten ausgelasteten Kern ermitteln
+ *
+ * Für die Auswahl zählt auch die Zeit in Interrupts und Softirqs, da unter hoher
+ * Paketrate ein großer Teil der Arbeit im NET_RX-Softirq anfällt.
+ *
+ * @param sample1 Erste Messung
+ * @param sample2 Zweite Messung
+ * @param usage Nimmt die Auslastung des Kerns nach SystemStat::Cpu::getUsage auf
+ * @return Index des Kerns in SystemStat::cores, oder -1, wenn beide Messungen keine
+ * oder eine unterschiedliche Anzahl Kerne enthalten
+ */
+int SystemStat::getHottestCore(const SystemStat &sample1, const SystemStat &sample2, double &usage)
+{
+	int hottest=-1;
+	usage=0.0;
+	if (sample1.cores.size()!=sample2.cores.size()) return -1;
+	double busiest=0.0;
+	for (size_t i=0;i<sample2.cores.size();i++) {
+		const SystemStat::Cpu &c1=sample1.cores[i].cpu;
+		const SystemStat::Cpu &c2=sample2.cores[i].cpu;
+		int total=cpuTotal(c2)-cpuTotal(c1);
+		if (total<=0) continue;
+		double busy=(double)(cpuTotal(c2)-c2.idle-cpuTotal(c1)+c1.idle)/(double)total;
+		if (hottest<0 || busy>busiest) {
+			hottest=(int)i;
+			busiest=busy;
+		}
+	}
+	if (hottest>=0) usage=SystemStat::Cpu::getUsage(sample1.cores[hottest].cpu, sample2.cores[hottest].cpu);
+	return hottest;
+}
+
+/*!\brief Differenz zweier Zählerstände mit Überlauf
+ *
+ * Nicht jeder Zähler ist 64 Bit breit: /proc/net/dev und /proc/net/snmp geben bei
+ * 32-Bit-Kerneln und manchen Treibern Werte aus, die schon bei 2^32 überlaufen. Ist
+ * der alte Wert noch im 32-Bit-Bereich, wird daher ein Überlauf bei 2^32
+ * angenommen, sonst bei 2^64.
+ */
 static unsigned long delta_with_overflow(unsigned long sample1, unsigned long sample2)
 {
 	if (sample2>=sample1) return sample2-sample1;
-	return ULONG_MAX - sample1 + sample2;
+	if (sample1<=UINT32_MAX) return (uint32_t)(sample2-sample1);
+	return sample2-sample1;
+}
 
+SystemStat::Udp SystemStat::Udp::getDelta(const SystemStat::Udp &sample1,const SystemStat::Udp &sample2)
+{
+	SystemStat::Udp d;
+	d.InDatagrams=delta_with_overflow(sample1.InDatagrams, sample2.InDatagrams);
+	d.NoPorts=delta_with_overflow(sample1.NoPorts, sample2.NoPorts);
+	d.InErrors=delta_with_overflow(sample1.InErrors, sample2.InErrors);
+	d.OutDatagrams=delta_with_overflow(sample1.OutDatagrams, sample2.OutDatagrams);
+	d.RcvbufErrors=delta_with_overflow(sample1.RcvbufErrors, sample2.RcvbufErrors);
+	d.SndbufErrors=delta_with_overflow(sample1.SndbufErrors, sample2.SndbufErrors);
+	return d;
 }
 
 SystemStat::Network SystemStat::Network::getDelta(const SystemStat::Network &sample1,const SystemStat::Network &sample2)
@@ -310,6 +956,26 @@ void SystemStat::exportToArray(ppl7::AssocArray &data) const
 	data.setf("cpu/system","%d",cpu.system);
 	data.setf("cpu/idle","%d",cpu.idle);
 	data.setf("cpu/iowait","%d",cpu.iowait);
+	data.setf("cpu/irq","%d",cpu.irq);
+	data.setf("cpu/softirq","%d",cpu.softirq);
+	for (size_t i=0;i<cores.size();i++) {
+		ppl7::AssocArray d;
+		const SystemStat::Core &core=cores[i];
+		d.setf("id","%d",core.id);
+		d.setf("user","%d",core.cpu.user);
+		d.setf("nice","%d",core.cpu.nice);
+		d.setf("system","%d",core.cpu.system);
+		d.setf("idle","%d",core.cpu.idle);
+		d.setf("iowait","%d",core.cpu.iowait);
+		d.setf("irq","%d",core.cpu.irq);
+		d.setf("softirq","%d",core.cpu.softirq);
+		d.setf("processed","%lu",core.processed);
+		d.setf("dropped","%lu",core.dropped);
+		d.setf("time_squeeze","%lu",core.time_squeeze);
+		ppl7::String key;
+		key.setf("core/%zu",i);
+		data.set(key,d);
+	}
 
 	data.setf("sysinfo/uptime","%ld",sysinfo.uptime);
 	data.setf("sysinfo/freeswap","%ld",sysinfo.freeswap);
@@ -319,6 +985,13 @@ void SystemStat::exportToArray(ppl7::AssocArray &data) const
 	data.setf("sysinfo/totalram","%ld",sysinfo.totalram);
 	data.setf("sysinfo/sharedram","%ld",sysinfo.sharedram);
 	data.setf("sysinfo/procs","%d",sysinfo.procs);
+
+	data.setf("udp/InDatagrams","%lu",udp.InDatagrams);
+	data.setf("udp/NoPorts","%lu",udp.NoPorts);
+	data.setf("udp/InErrors","%lu",udp.InErrors);
+	data.setf("udp/OutDatagrams","%lu",udp.OutDatagrams);
+	data.setf("udp/RcvbufErrors","%lu",udp.RcvbufErrors);
+	data.setf("udp/SndbufErrors","%lu",udp.SndbufErrors);
 }
 
 void SystemStat::importFromArray(const ppl7::AssocArray &data)
@@ -355,6 +1028,31 @@ void SystemStat::importFromArray(const ppl7::AssocArray &data)
 	cpu.system=data.getString("cpu/system").toInt();
 	cpu.idle=data.getString("cpu/idle").toInt();
 	cpu.iowait=data.getString("cpu/iowait").toInt();
+	cpu.irq=data.getString("cpu/irq").toInt();
+	cpu.softirq=data.getString("cpu/softirq").toInt();
+	cores.clear();
+	if (data.exists("core")) {
+		const ppl7::AssocArray &data_core_list=data.getAssocArray("core");
+		cores.resize(data_core_list.count());
+		for (size_t i=0;i<cores.size();i++) {
+			ppl7::String key;
+			key.setf("%zu",i);
+			if (!data_core_list.exists(key)) continue;
+			const ppl7::AssocArray &d=data_core_list.getAssocArray(key);
+			SystemStat::Core &core=cores[i];
+			core.id=d.getString("id").toInt();
+			core.cpu.user=d.getString("user").toInt();
+			core.cpu.nice=d.getString("nice").toInt();
+			core.cpu.system=d.getString("system").toInt();
+			core.cpu.idle=d.getString("idle").toInt();
+			core.cpu.iowait=d.getString("iowait").toInt();
+			core.cpu.irq=d.getString("irq").toInt();
+			core.cpu.softirq=d.getString("softirq").toInt();
+			core.processed=d.getString("processed").toUnsignedLong();
+			core.dropped=d.getString("dropped").toUnsignedLong();
+			core.time_squeeze=d.getString("time_squeeze").toUnsignedLong();
+		}
+	}
 
 	sysinfo.uptime=data.getString("sysinfo/uptime").toLong();
 	sysinfo.freeswap=data.getString("sysinfo/freeswap").toLong();
@@ -364,6 +1062,123 @@ void SystemStat::importFromArray(const ppl7::AssocArray &data)
 	sysinfo.totalram=data.getString("sysinfo/totalram").toLong();
 	sysinfo.sharedram=data.getString("sysinfo/sharedram").toLong();
 	sysinfo.procs=data.getString("sysinfo/procs").toInt();
+
+	udp.InDatagrams=data.getString("udp/InDatagrams").toUnsignedLong();
+	udp.NoPorts=data.getString("udp/NoPorts").toUnsignedLong();
+	udp.InErrors=data.getString("udp/InErrors").toUnsignedLong();
+	udp.OutDatagrams=data.getString("udp/OutDatagrams").toUnsignedLong();
+	udp.RcvbufErrors=data.getString("udp/RcvbufErrors").toUnsignedLong();
+	udp.SndbufErrors=data.getString("udp/SndbufErrors").toUnsignedLong();
+}
+
+/*!\brief Größe der binären Darstellung
+ *
+ * @return Anzahl Bytes, die SystemStat::exportBinary benötigt
+ */
+size_t SystemStat::binarySize() const
+{
+	return UDPEchoWire::SystemStatSize+interfaces.size()*UDPEchoWire::InterfaceSize+UDPEchoWire::UdpSize
+			+UDPEchoWire::CoreHeaderSize+cores.size()*UDPEchoWire::CoreSize;
+}
+
+static void encodeNetwork(unsigned char *p, const SystemStat::Network &receive, const SystemStat::Network &transmit)
+{
+	UDPEchoWire::put64(p, receive.bytes);
+	UDPEchoWire::put64(p+8, receive.packets);
+	UDPEchoWire::put64(p+16, receive.errs);
+	UDPEchoWire::put64(p+24, receive.drop);
+	UDPEchoWire::put64(p+32, transmit.bytes);
+	UDPEchoWire::put64(p+40, transmit.packets);
+	UDPEchoWire::put64(p+48, transmit.errs);
+	UDPEchoWire::put64(p+56, transmit.drop);
+}
+
+/*!\brief Sensordaten im binären Format exportieren
+ *
+ * Schreibt die Sensordaten im Format von UDPEchoWire in den Puffer. Namen von
+ * Interfaces werden auf 15 Zeichen gekürzt.
+ *
+ * @param buffer Zielpuffer
+ * @param size Größe des Zielpuffers
+ * @return Anzahl geschriebener Bytes
+ * @exception ppl7::BufferTooSmallException Der Puffer ist zu klein
+ */
+size_t SystemStat::exportBinary(void *buffer, size_t size) const
+{
+	size_t len=binarySize();
+	if (size<len) throw ppl7::BufferTooSmallException("SystemStat::exportBinary");
+	unsigned char *p=(unsigned char*)buffer;
+	UDPEchoWire::putHeader(p, UDPEchoWire::RECORD_SYSTEMSTAT, len);
+	UDPEchoWire::putDouble(p+8, sampleTime);
+	UDPEchoWire::put32(p+16, (uint32_t)cpu.user);
+	UDPEchoWire::put32(p+20, (uint32_t)cpu.nice);
+	UDPEchoWire::put32(p+24, (uint32_t)cpu.system);
+	UDPEchoWire::put32(p+28, (uint32_t)cpu.idle);
+	UDPEchoWire::put32(p+32, (uint32_t)cpu.iowait);
+	UDPEchoWire::put32(p+36, (uint32_t)sysinfo.procs);
+	UDPEchoWire::put64(p+40, (uint64_t)sysinfo.uptime);
+	UDPEchoWire::put64(p+48, (uint64_t)sysinfo.freeswap);
+	UDPEchoWire::put64(p+56, (uint64_t)sysinfo.totalswap);
+	UDPEchoWire::put64(p+64, (uint64_t)sysinfo.freeram);
+	UDPEchoWire::put64(p+72, (uint64_t)sysinfo.bufferram);
+	UDPEchoWire::put64(p+80, (uint64_t)sysinfo.totalram);
+	UDPEchoWire::put64(p+88, (uint64_t)sysinfo.sharedram);
+	encodeNetwork(p+96, net_total.receive, net_total.transmit);
+	UDPEchoWire::put32(p+160, (uint32_t)interfaces.size());
+	UDPEchoWire::put32(p+164, 0);
+	p+=UDPEchoWire::SystemStatSize;
+	std::map<ppl7::String, Interface>::const_iterator it;
+	for (it=interfaces.begin();it!=interfaces.end();++it) {
+		const SystemStat::Interface &nif=it->second;
+		size_t namelen=nif.Name.size();
+		if (namelen>UDPEchoWire::InterfaceNameSize-1) namelen=UDPEchoWire::InterfaceNameSize-1;
+		memset(p, 0, UDPEchoWire::InterfaceNameSize);
+		memcpy(p, (const char*)nif.Name, namelen);
+		encodeNetwork(p+UDPEchoWire::InterfaceNameSize, nif.receive, nif.transmit);
+		p+=UDPEchoWire::InterfaceSize;
+	}
+	UDPEchoWire::put64(p, udp.InDatagrams);
+	UDPEchoWire::put64(p+8, udp.NoPorts);
+	UDPEchoWire::put64(p+16, udp.InErrors);
+	UDPEchoWire::put64(p+24, udp.OutDatagrams);
+	UDPEchoWire::put64(p+32, udp.RcvbufErrors);
+	UDPEchoWire::put64(p+40, udp.SndbufErrors);
+	p+=UDPEchoWire::UdpSize;
+	UDPEchoWire::put32(p, (uint32_t)cpu.irq);
+	UDPEchoWire::put32(p+4, (uint32_t)cpu.softirq);
+	UDPEchoWire::put32(p+8, (uint32_t)cores.size());
+	UDPEchoWire::put32(p+12, 0);
+	p+=UDPEchoWire::CoreHeaderSize;
+	for (size_t i=0;i<cores.size();i++) {
+		const SystemStat::Core &core=cores[i];
+		UDPEchoWire::put32(p, (uint32_t)core.id);
+		UDPEchoWire::put32(p+4, (uint32_t)core.cpu.user);
+		UDPEchoWire::put32(p+8, (uint32_t)core.cpu.nice);
+		UDPEchoWire::put32(p+12, (uint32_t)core.cpu.system);
+		UDPEchoWire::put32(p+16, (uint32_t)core.cpu.idle);
+		UDPEchoWire::put32(p+20, (uint32_t)core.cpu.iowait);
+		UDPEchoWire::put32(p+24, (uint32_t)core.cpu.irq);
+		UDPEchoWire::put32(p+28, (uint32_t)core.cpu.softirq);
+		UDPEchoWire::put64(p+32, core.processed);
+		UDPEchoWire::put64(p+40, core.dropped);
+		UDPEchoWire::put64(p+48, core.time_squeeze);
+		p+=UDPEchoWire::CoreSize;
+	}
+	return len;
+}
+
+/*!\brief Sensordaten aus dem binären Format importieren
+ *
+ * @param buffer Pointer auf den Datensatz
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @return Länge des Datensatzes in Bytes
+ * @exception ppl7::InvalidFormatException Kein gültiger Datensatz
+ */
+size_t SystemStat::importBinary(const void *buffer, size_t size)
+{
+	SystemStatView view(buffer, size);
+	view.decode(*this);
+	return view.size();
 }
 
 void SystemStat::print() const
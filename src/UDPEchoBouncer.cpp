@@ -49,6 +49,10 @@ UDPEchoBouncer::UDPEchoBouncer()
 	running=false;
 	sockfd=0;
 	packetSize=0;
+	maxPacketSize=UDPECHO_MAX_DATAGRAM_SIZE;
+	delayQueueSize=0;
+	delayQueueRate=UDPEchoDelayModel::DefaultRate;
+	delayQueueMemory=UDPEchoDelayModel::DefaultMemory;
 }
 
 
@@ -124,9 +128,12 @@ void UDPEchoBouncer::bind(const ppl7::SockAddr &sockaddr)
 /*!\brief Worker-Threads erstellen und starten
  *
  * Erstellt die gewünschte Anzahl Worker-Threads, stellt sie in den Pool
- * UDPEchoBouncer::threadpool und startet sie.
+ * UDPEchoBouncer::threadpool und startet sie. Kehrt erst zurück, wenn alle Threads
+ * ihre Paketpuffer angelegt haben.
  *
  * @param ThreadCount Anzahl Worker-Threads
+ * @exception ppl7::OutOfMemoryException Ein Thread konnte seine Puffer nicht anlegen,
+ * alle Threads wurden wieder beendet
  */
 void UDPEchoBouncer::startBouncerThreads(size_t ThreadCount, const ppl7::SockAddr &sockaddr)
 {
@@ -134,10 +141,28 @@ void UDPEchoBouncer::startBouncerThreads(size_t ThreadCount, const ppl7::SockAdd
 		UDPEchoBouncerThread* thread = new UDPEchoBouncerThread();
 		thread->setNoEcho(noEcho);
 		thread->bind(sockaddr);
+		thread->setMaxPacketSize(maxPacketSize);
 		thread->setPacketSize(packetSize);
+		thread->setDelayModel(delayModel, getDelayQueueSize());
+		thread->setImpairment(impairment);
+		thread->setDNSResponder(dns);
 		threadpool.addThread(thread);
 	}
 	threadpool.startThreads();
+	// Die Threads legen ihre Puffer selbst an, schlägt das fehl, wird der Bouncer gestoppt
+	ppl7::ThreadPool::const_iterator it;
+	ppl7::String error;
+	bool started=true;
+	threadpool.lock();
+	for (it = threadpool.begin(); it != threadpool.end() && started; ++it) {
+		started=((UDPEchoBouncerThread*) (*it))->waitForStartup(error);
+	}
+	threadpool.unlock();
+	if (!started) {
+		threadpool.destroyAllThreads();
+		throw ppl7::OutOfMemoryException("UDPEchoBouncer: Worker-Thread konnte seine Puffer nicht anlegen: %s",
+				(const char*)error);
+	}
 	//ppl7::MSleep(500);
 }
 
@@ -174,13 +199,148 @@ void UDPEchoBouncer::run()
 void UDPEchoBouncer::setFixedResponsePacketSize(size_t size)
 {
 	if (size>0) {
-		if (size<32 || size>4096) {
+		if (size<32 || size>UDPECHO_MAX_DATAGRAM_SIZE) {
 			throw ppl7::InvalidArgumentsException("UDPEchoBouncer::setFixedResponsePacketSize");
 		}
 	}
 	packetSize=size;
 }
 
+/*!\brief Maximale Größe eingehender Pakete festlegen
+ *
+ * Legt die Größe der Empfangspuffer in den Worker-Threads fest. Größere Pakete werden
+ * abgeschnitten und gesondert gezählt.
+ *
+ * @param size Wert zwischen 32 und UDPECHO_MAX_DATAGRAM_SIZE
+ */
+void UDPEchoBouncer::setMaxPacketSize(size_t size)
+{
+	if (size<32 || size>UDPECHO_MAX_DATAGRAM_SIZE) {
+		throw ppl7::InvalidArgumentsException("UDPEchoBouncer::setMaxPacketSize");
+	}
+	maxPacketSize=size;
+}
+
+/*!\brief Antworten verzögern
+ *
+ * Die Antwortpakete werden mit einer künstlichen Verzögerung verschickt, um langsame
+ * Upstream-Server zu simulieren.
+ *
+ * @param spec Beschreibung der Verzögerung, siehe UDPEchoDelayModel::parse
+ */
+void UDPEchoBouncer::setResponseDelay(const ppl7::String &spec)
+{
+	delayModel.parse(spec);
+}
+
+/*!\brief Größe der Warteschlange für verzögerte Antworten festlegen
+ *
+ * @param entries Maximale Anzahl wartender Pakete pro Worker-Thread, 0=automatisch
+ */
+void UDPEchoBouncer::setDelayQueueSize(size_t entries)
+{
+	if (entries>=0xffffffff) throw ppl7::InvalidArgumentsException("UDPEchoBouncer::setDelayQueueSize");
+	delayQueueSize=entries;
+}
+
+/*!\brief Erwartete Paketrate für die automatische Größe der Warteschlange festlegen
+ *
+ * @param pps Paketrate pro Worker-Thread, 0=UDPEchoDelayModel::DefaultRate
+ */
+void UDPEchoBouncer::setDelayQueueRate(uint64_t pps)
+{
+	delayQueueRate=pps ? pps : UDPEchoDelayModel::DefaultRate;
+}
+
+/*!\brief Speicherlimit der Warteschlange für verzögerte Antworten festlegen
+ *
+ * @param bytes Speicher pro Worker-Thread, 0=UDPEchoDelayModel::DefaultMemory
+ */
+void UDPEchoBouncer::setDelayQueueMemory(size_t bytes)
+{
+	delayQueueMemory=bytes ? bytes : UDPEchoDelayModel::DefaultMemory;
+}
+
+/*!\brief Anzahl Plätze der Warteschlange für verzögerte Antworten pro Worker-Thread
+ *
+ * Ohne Vorgabe durch UDPEchoBouncer::setDelayQueueSize wird die Größe über
+ * UDPEchoDelayModel::getQueueSize aus der erwarteten Paketrate und der maximalen
+ * Verzögerung berechnet und durch das Speicherlimit begrenzt. Eine Vorgabe wird nicht
+ * begrenzt, siehe UDPEchoBouncer::getDelayQueueMemoryUsage.
+ */
+size_t UDPEchoBouncer::getDelayQueueSize() const
+{
+	if (delayQueueSize) return delayQueueSize;
+	return delayModel.getQueueSize(delayQueueRate,
+			UDPEchoDelayQueue::memoryPerEntry(getDelaySlotSize()), delayQueueMemory);
+}
+
+/*!\brief Speicherlimit der Warteschlange pro Worker-Thread in Bytes
+ */
+size_t UDPEchoBouncer::getDelayQueueMemory() const
+{
+	return delayQueueMemory;
+}
+
+/*!\brief Speicherbedarf der Warteschlange pro Worker-Thread in Bytes
+ */
+size_t UDPEchoBouncer::getDelayQueueMemoryUsage() const
+{
+	return getDelayQueueSize()*UDPEchoDelayQueue::memoryPerEntry(getDelaySlotSize());
+}
+
+/*!\brief Größe eines Puffers der Warteschlange für verzögerte Antworten in Bytes
+ *
+ * Ein Puffer muss nur die Antwort aufnehmen. Bei fester Antwortgröße genügt diese,
+ * bei Echo- und DNS-Antworten wird die Größe des Empfangspuffers benötigt.
+ */
+size_t UDPEchoBouncer::getDelaySlotSize() const
+{
+	if (packetSize && !dns.isEnabled()) return packetSize;
+	return packetSize>maxPacketSize ? packetSize : maxPacketSize;
+}
+
+/*!\brief Störungen der Antwortpakete festlegen
+ *
+ * @param spec Liste der Störungen, siehe UDPEchoImpairment::parse
+ *
+ * @exception ppl7::InvalidArgumentsException Wird bei einer ungültigen Angabe geworfen,
+ * oder wenn Umsortierung ohne Verzögerung konfiguriert wird
+ */
+void UDPEchoBouncer::setImpairment(const ppl7::String &spec)
+{
+	impairment.parse(spec);
+	if (impairment.usesReorder() && !delayModel.isEnabled())
+		throw ppl7::InvalidArgumentsException("reorder erfordert eine Verzoegerung (-d)");
+}
+
+/*!\brief Sind Störungen konfiguriert?
+ */
+bool UDPEchoBouncer::hasImpairment() const
+{
+	return impairment.isEnabled();
+}
+
+/*!\brief DNS-Modus konfigurieren
+ *
+ * Ist der DNSResponder aktiv, beantworten die Worker-Threads eingehende Pakete mit
+ * gültigen DNS-Antworten statt mit einem Echo. Pakete, die keine DNS-Anfrage sind,
+ * werden verworfen und als "dns invalid" gezählt.
+ *
+ * @param dns Konfiguration des DNSResponder
+ */
+void UDPEchoBouncer::setDNSResponder(const DNSResponder &dns)
+{
+	this->dns=dns;
+}
+
+/*!\brief Ist der DNS-Modus aktiv?
+ */
+bool UDPEchoBouncer::isDNSEnabled() const
+{
+	return dns.isEnabled();
+}
+
 void UDPEchoBouncer::setInterface(const ppl7::String &InterfaceName, int Port)
 {
 	sockaddr=getSockAddr(InterfaceName,Port);
@@ -234,7 +394,59 @@ UDPEchoCounter UDPEchoBouncer::getCounter()
 		counter.packets_send += c.packets_send;
 		counter.bytes_received += c.bytes_received;
 		counter.bytes_send += c.bytes_send;
+		counter.packets_truncated += c.packets_truncated;
+		counter.packets_queue_overflow += c.packets_queue_overflow;
+		counter.packets_impair_dropped += c.packets_impair_dropped;
+		counter.packets_impair_duplicated += c.packets_impair_duplicated;
+		counter.packets_impair_corrupted += c.packets_impair_corrupted;
+		counter.packets_impair_reordered += c.packets_impair_reordered;
+		counter.packets_dns_invalid += c.packets_dns_invalid;
+		counter.packets_socket_dropped += c.packets_socket_dropped;
+		counter.packets_send_failed += c.packets_send_failed;
 	}
 	threadpool.unlock();
 	return counter;
 }
+
+/*!\brief Kumulierte Zähler aller Worker-Threads seit dem Start auslesen
+ *
+ * Im Gegensatz zu UDPEchoBouncer::getCounter werden die Zähler nicht zurückgesetzt und
+ * ohne Lock auf die Worker-Threads gelesen (siehe UDPEchoBouncerThread::getCounterSnapshot).
+ */
+UDPEchoCounter UDPEchoBouncer::getTotalCounter()
+{
+	UDPEchoCounter counter;
+	ppl7::ThreadPool::const_iterator it;
+	counter.clear();
+	counter.sampleTime=ppl7::GetMicrotime();
+	threadpool.lock();
+	for (it = threadpool.begin(); it != threadpool.end(); ++it) {
+		counter.add(((UDPEchoBouncerThread*) (*it))->getCounterSnapshot());
+	}
+	threadpool.unlock();
+	return counter;
+}
+
+/*!\brief Summe der PMU-Zähler aller Worker-Threads
+ *
+ * Die Zähler laufen bis zum Ende der Threads weiter und können jederzeit gelesen werden.
+ */
+void UDPEchoBouncer::getPerfCounter(UDPEchoPerfCounter::Values &values)
+{
+	ppl7::ThreadPool::const_iterator it;
+	values.clear();
+	threadpool.lock();
+	for (it = threadpool.begin(); it != threadpool.end(); ++it) {
+		UDPEchoPerfCounter::Values v;
+		((UDPEchoBouncerThread*) (*it))->getPerfCounter(v);
+		values.add(v);
+	}
+	threadpool.unlock();
+}
+
+/*!\brief Anzahl laufender Worker-Threads
+ */
+size_t UDPEchoBouncer::getThreadCount()
+{
+	return threadpool.count();
+}
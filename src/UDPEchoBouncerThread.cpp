@@ -29,8 +29,10 @@
 #include <fcntl.h>
 #include <sys/select.h>
 #include <time.h>
+#include <new>
 
 #include "udpecho.h"
+#include "sensor.h"
 
 
 /*!@file
@@ -61,14 +63,15 @@ UDPEchoBouncerThread::UDPEchoBouncerThread()
 {
 	noEcho=false;
 	sockfd=0;
-	counter.packets_received=0;
-	counter.packets_send=0;
-	counter.bytes_received=0;
-	counter.bytes_send=0;
-	buffer.malloc(4096);
-	pBuffer=(void*)buffer.adr();
+	counter.clear();
+	reported.clear();
 	sockfd=0;
 	packetSize=0;
+	maxPacketSize=UDPECHO_MAX_DATAGRAM_SIZE;
+	delayQueueSize=0;
+	pBuffer=NULL;
+	startupState=0;
+	allocateBuffer();
 }
 
 /*!\brief Destruktor
@@ -92,20 +95,142 @@ void UDPEchoBouncerThread::setNoEcho(bool flag)
 }
 
 
+/*!\brief Größe der Paketpuffer berechnen
+ *
+ * Ein Puffer muss sowohl das größte eingehende Paket, als auch ein Antwortpaket mit
+ * fester Größe aufnehmen können. Die Puffer selbst werden erst in
+ * UDPEchoBouncerThread::run aus dem UDPEchoPacketPool des Threads geholt.
+ */
+void UDPEchoBouncerThread::allocateBuffer()
+{
+	buffersize=maxPacketSize;
+	if (packetSize>buffersize) buffersize=packetSize;
+}
+
+/*!\brief Größe eines Puffers in der Verzögerungs-Queue
+ *
+ * Die Queue nimmt nur Antworten auf. Bei fester Antwortgröße genügt diese, bei Echo-
+ * und DNS-Antworten wird ein Puffer in Größe des Empfangspuffers benötigt.
+ */
+size_t UDPEchoBouncerThread::delaySlotSize() const
+{
+	if (packetSize && !dns.isEnabled()) return packetSize;
+	return buffersize;
+}
+
+/*!\brief Anzahl Plätze in der Verzögerungs-Queue
+ *
+ * Ohne Vorgabe über UDPEchoBouncerThread::setDelayModel wird die Größe mit
+ * UDPEchoDelayModel::getQueueSize für UDPEchoDelayModel::DefaultRate und
+ * UDPEchoDelayModel::DefaultMemory berechnet.
+ */
+uint32_t UDPEchoBouncerThread::delayQueueCapacity() const
+{
+	if (delayQueueSize) return (uint32_t)delayQueueSize;
+	return (uint32_t)delayModel.getQueueSize(UDPEchoDelayModel::DefaultRate,
+			UDPEchoDelayQueue::memoryPerEntry(delaySlotSize()), UDPEchoDelayModel::DefaultMemory);
+}
+
+/*!\brief Empfangspuffer und Verzögerungs-Queue anlegen
+ *
+ * Wird im eigenen Thread aufgerufen, damit der Speicher auf dessen NUMA-Knoten liegt.
+ *
+ * @exception ppl7::OutOfMemoryException Nicht genug Speicher
+ */
+void UDPEchoBouncerThread::allocatePools()
+{
+	pool.allocate(1, buffersize);
+	pBuffer=pool.acquire();
+	if (!pBuffer) throw ppl7::OutOfMemoryException("UDPEchoBouncerThread: Empfangspuffer");
+	memset(pBuffer, 0, buffersize);
+	if (delayModel.isEnabled() && !noEcho) {
+		uint32_t capacity=delayQueueCapacity();
+		delayPool.allocate(capacity, delaySlotSize());
+		delayQueue.allocate(delayPool, capacity);
+	}
+}
+
+/*!\brief Warten, bis der Thread seine Puffer angelegt hat
+ *
+ * @param error Nimmt die Fehlermeldung auf, wenn die Puffer nicht angelegt werden konnten
+ * @return \c true, wenn der Thread Pakete verarbeitet, \c false, wenn er sich wegen
+ * fehlender Puffer beendet hat
+ */
+bool UDPEchoBouncerThread::waitForStartup(ppl7::String &error) const
+{
+	int state;
+	while ((state=__atomic_load_n(&startupState, __ATOMIC_ACQUIRE))==0) ppl7::MSleep(1);
+	if (state>0) return true;
+	error=startupError;
+	return false;
+}
+
 /*!\brief Paketgröße für Antwortpakete festlegen
  *
  * Legt die Große der Antwortpakete fest.
- * @param bytes Wert zwischen 32 und 4096. Bei Angabe von 0 sind die Antwortpakete
- * genauso groß, wie die eingehenden Pakete.
+ * @param bytes Wert zwischen 32 und UDPECHO_MAX_DATAGRAM_SIZE. Bei Angabe von 0 sind
+ * die Antwortpakete genauso groß, wie die eingehenden Pakete.
  */
 void UDPEchoBouncerThread::setPacketSize(size_t bytes)
 {
-	if ((bytes<=4096 && bytes>=32) || bytes==0)
+	if ((bytes<=UDPECHO_MAX_DATAGRAM_SIZE && bytes>=32) || bytes==0) {
 		packetSize=bytes;
+		allocateBuffer();
+	}
 }
 
+/*!\brief Maximale Größe eingehender Pakete festlegen
+ *
+ * Legt die Größe des Empfangspuffers fest. Größere Pakete werden abgeschnitten und
+ * zusätzlich als "truncated" gezählt.
+ * @param bytes Wert zwischen 32 und UDPECHO_MAX_DATAGRAM_SIZE
+ */
+void UDPEchoBouncerThread::setMaxPacketSize(size_t bytes)
+{
+	if (bytes<=UDPECHO_MAX_DATAGRAM_SIZE && bytes>=32) {
+		maxPacketSize=bytes;
+		allocateBuffer();
+	}
+}
 
 
+/*!\brief Verzögerung der Antwortpakete festlegen
+ *
+ * Ist das Modell aktiv, werden Antworten nicht sofort verschickt, sondern in einer
+ * UDPEchoDelayQueue zwischengespeichert, bis ihre Verzögerung abgelaufen ist.
+ *
+ * @param model Verteilung der Verzögerung
+ * @param queue_size Maximale Anzahl gleichzeitig wartender Pakete. Bei Angabe von 0
+ * wird die Anzahl aus der maximalen Verzögerung und UDPEchoDelayModel::DefaultRate
+ * berechnet (siehe UDPEchoDelayModel::getQueueSize).
+ */
+void UDPEchoBouncerThread::setDelayModel(const UDPEchoDelayModel &model, size_t queue_size)
+{
+	delayModel=model;
+	delayQueueSize=queue_size;
+}
+
+/*!\brief Störungen der Antwortpakete festlegen
+ *
+ * @param impairment Konfiguration der Störungen. Der Thread arbeitet mit einer
+ * eigenen Kopie, so dass der Zustand des Gilbert-Elliott-Modells pro Thread geführt wird.
+ */
+void UDPEchoBouncerThread::setImpairment(const UDPEchoImpairment &impairment)
+{
+	this->impairment=impairment;
+}
+
+/*!\brief DNS-Modus konfigurieren
+ *
+ * @param dns Konfiguration des DNSResponder. Ist dieser aktiv, werden eingehende Pakete
+ * als DNS-Anfragen interpretiert und mit einer DNS-Antwort beantwortet, eine feste
+ * Antwortgröße wird dann ignoriert.
+ */
+void UDPEchoBouncerThread::setDNSResponder(const DNSResponder &dns)
+{
+	this->dns=dns;
+}
+
 void UDPEchoBouncerThread::bind(const ppl7::SockAddr &sockaddr)
 {
 	if (sockfd) ::close(sockfd);
@@ -150,29 +275,69 @@ void UDPEchoBouncerThread::bind(const ppl7::SockAddr &sockaddr)
 
 /*!\brief Aktuelle Zähler auslesen und auf 0 setzen
  *
- * Die aktuellen Zähler für Anzahl Pakete und Bytes werden ausgelesen und auf 0 zurückgesetzt.
+ * Liefert die Zähler seit dem letzten Aufruf. Die Zähler des Threads selbst laufen
+ * dabei weiter und werden nie zurückgesetzt, siehe UDPEchoBouncerThread::getCounterSnapshot.
  *
- * @return Datenstruktur UDPEchoBouncerThread::Counter
+ * @return Zähler seit dem letzten Aufruf
  */
 UDPEchoCounter UDPEchoBouncerThread::getAndClearCounter()
 {
-	UDPEchoCounter ret;
 	mutex.lock();
-	ret=counter;
-	counter.packets_received=0;
-	counter.packets_send=0;
-	counter.bytes_received=0;
-	counter.bytes_send=0;
+	UDPEchoCounter ret=getCounterSnapshot();
+	UDPEchoCounter current=ret;
+	ret.subtract(reported);
+	reported=current;
 	mutex.unlock();
-	//printf ("Thread %llu: %llu\n",this->threadGetID(),ret.count);
 	return ret;
 }
 
-bool UDPEchoBouncerThread::waitForSocketReadable()
+/*!\brief Kumulierte Zähler seit Start des Threads auslesen
+ *
+ * Jeder Zähler wird nur vom Worker-Thread selbst geschrieben. Das Auslesen erfolgt
+ * ohne Lock mit atomaren Lesezugriffen auf die einzelnen 64-Bit-Werte und beeinflusst
+ * den Worker-Thread daher nicht. Die Werte untereinander sind nicht exakt zum selben
+ * Zeitpunkt gelesen, jeder einzelne Wert ist aber konsistent und monoton steigend.
+ * packets_socket_dropped ist der Zähler verworfener Pakete des Sockets im Kernel
+ * (siehe getSocketDrops).
+ *
+ * @return Kopie der Zähler
+ */
+UDPEchoCounter UDPEchoBouncerThread::getCounterSnapshot() const
+{
+	UDPEchoCounter c;
+	c.sampleTime=ppl7::GetMicrotime();
+	c.packets_received=__atomic_load_n(&counter.packets_received, __ATOMIC_RELAXED);
+	c.packets_send=__atomic_load_n(&counter.packets_send, __ATOMIC_RELAXED);
+	c.bytes_received=__atomic_load_n(&counter.bytes_received, __ATOMIC_RELAXED);
+	c.bytes_send=__atomic_load_n(&counter.bytes_send, __ATOMIC_RELAXED);
+	c.packets_truncated=__atomic_load_n(&counter.packets_truncated, __ATOMIC_RELAXED);
+	c.packets_queue_overflow=__atomic_load_n(&counter.packets_queue_overflow, __ATOMIC_RELAXED);
+	c.packets_impair_dropped=__atomic_load_n(&counter.packets_impair_dropped, __ATOMIC_RELAXED);
+	c.packets_impair_duplicated=__atomic_load_n(&counter.packets_impair_duplicated, __ATOMIC_RELAXED);
+	c.packets_impair_corrupted=__atomic_load_n(&counter.packets_impair_corrupted, __ATOMIC_RELAXED);
+	c.packets_impair_reordered=__atomic_load_n(&counter.packets_impair_reordered, __ATOMIC_RELAXED);
+	c.packets_dns_invalid=__atomic_load_n(&counter.packets_dns_invalid, __ATOMIC_RELAXED);
+	c.packets_send_failed=__atomic_load_n(&counter.packets_send_failed, __ATOMIC_RELAXED);
+	int64_t drops=getSocketDrops(sockfd);
+	c.packets_socket_dropped=drops>0 ? drops : 0;
+	return c;
+}
+
+/*!\brief Zähler der PMU für die Empfangsschleife auslesen
+ *
+ * Kann wie UDPEchoBouncerThread::getCounterSnapshot während des Betriebs aus einem
+ * anderen Thread aufgerufen werden.
+ */
+void UDPEchoBouncerThread::getPerfCounter(UDPEchoPerfCounter::Values &values) const
+{
+	perf.read(values);
+}
+
+bool UDPEchoBouncerThread::waitForSocketReadable(long timeout_nsec)
 {
 	struct timespec timeout;
 	timeout.tv_sec=0;
-	timeout.tv_nsec=500*1000000;
+	timeout.tv_nsec=timeout_nsec;
 	fd_set rset;
 	FD_ZERO(&rset);
 	FD_SET(sockfd,&rset);
@@ -182,39 +347,144 @@ bool UDPEchoBouncerThread::waitForSocketReadable()
 	return false;
 }
 
+/*!\brief Störungen auf ein Antwortpaket anwenden
+ *
+ * Würfelt die Störungen für ein Paket aus, kippt gegebenenfalls ein Bit und zählt
+ * die Störungen.
+ *
+ * @param data Pointer auf das Antwortpaket
+ * @param size Größe des Antwortpakets
+ * @return Bitmaske aus UDPEchoImpairment::Action
+ */
+int UDPEchoBouncerThread::impair(void *data, size_t size)
+{
+	int action=impairment.decide(rng);
+	if (action&UDPEchoImpairment::DROP) {
+		UDPEchoCounter::increment(counter.packets_impair_dropped);
+		return action;
+	}
+	if (action&UDPEchoImpairment::CORRUPT) {
+		UDPEchoImpairment::corruptPayload(data, size, rng);
+		UDPEchoCounter::increment(counter.packets_impair_corrupted);
+	}
+	if (action&UDPEchoImpairment::DUPLICATE) UDPEchoCounter::increment(counter.packets_impair_duplicated);
+	if (action&UDPEchoImpairment::REORDER) UDPEchoCounter::increment(counter.packets_impair_reordered);
+	return action;
+}
+
+/*!\brief Größe des Antwortpakets bestimmen
+ *
+ * Im DNS-Modus wird die Anfrage im Puffer durch DNSResponder::respond in eine Antwort
+ * umgewandelt, ansonsten wird das Paket unverändert oder mit fester Größe zurückgeschickt.
+ *
+ * @param data Pointer auf das empfangene Paket, muss UDPEchoBouncerThread::buffersize Bytes groß sein
+ * @param size Anzahl empfangener Bytes im Puffer
+ * @return Größe der Antwort oder 0, wenn das Paket nicht beantwortet werden soll
+ */
+size_t UDPEchoBouncerThread::replySize(void *data, size_t size)
+{
+	if (dns.isEnabled()) {
+		size_t reply_size=dns.respond((unsigned char*)data, size, buffersize);
+		if (!reply_size) UDPEchoCounter::increment(counter.packets_dns_invalid);
+		return reply_size;
+	}
+	return packetSize ? packetSize : size;
+}
+
+/*!\brief Antwortpaket verschicken
+ *
+ * @param data Pointer auf das Antwortpaket
+ * @param size Größe des Antwortpakets
+ * @param addr Adresse des Empfängers
+ * @param addrlen Länge der Adresse
+ * @param copies Wie oft das Paket verschickt werden soll
+ */
+void UDPEchoBouncerThread::sendResponse(const void *data, size_t size, const struct sockaddr *addr, socklen_t addrlen, int copies)
+{
+	for (int i=0;i<copies;i++) {
+		ssize_t n=::sendto(sockfd, data, size, 0, addr, addrlen);
+		if (n>=0) {
+			UDPEchoCounter::increment(counter.packets_send);
+			UDPEchoCounter::increment(counter.bytes_send, n);
+		} else {
+			UDPEchoCounter::increment(counter.packets_send_failed);
+		}
+	}
+}
+
 /*!\brief Thread des Workerthreads
  *
  * Diese Methode wird in einem separaten Thread gestartet und wartet in einer Endlos-
  * schleife auf eingehende Pakete. Sobald ein Paket eingeht, wird es an den Absender
  * zurückgeschickt, sofern dies nicht vorher mit UDPEchoBouncerThread::setNoEcho abgeschaltet wurde.
+ *
+ * Pakete, die größer als der Empfangspuffer sind, werden anhand von MSG_TRUNC erkannt
+ * und nur in abgeschnittener Form zurückgeschickt.
  */
 void UDPEchoBouncerThread::run()
+{
+	bool delayed=(delayModel.isEnabled() && !noEcho);
+	// Ein Fehler wird über waitForStartup gemeldet, statt den Prozess zu beenden
+	try {
+		allocatePools();
+	} catch (const ppl7::Exception &e) {
+		startupError=e.what();
+		if (e.text()[0]) startupError.appendf(": %s", e.text());
+		__atomic_store_n(&startupState, -1, __ATOMIC_RELEASE);
+		return;
+	} catch (const std::bad_alloc &) {
+		startupError="std::bad_alloc";
+		__atomic_store_n(&startupState, -1, __ATOMIC_RELEASE);
+		return;
+	}
+	__atomic_store_n(&startupState, 1, __ATOMIC_RELEASE);
+	UDPEchoLowLatency::configureSocket(sockfd);
+	UDPEchoLowLatency::applyScheduling();
+	if (UDPEchoPerfCounter::isEnabled()) perf.open();
+	if (delayed) runWithDelay();
+	else runWithoutDelay();
+	perf.stop();
+}
+
+/*!\brief Empfangsschleife ohne Verzögerung der Antworten
+ *
+ * Im latenzarmen Modus (siehe UDPEchoLowLatency) wartet der Thread nicht in pselect,
+ * sondern fragt den Socket ununterbrochen ab. Mit Verzögerungsmodell bleibt es beim
+ * Warten, dessen Zeiten liegen ohnehin im Millisekundenbereich.
+ */
+void UDPEchoBouncerThread::runWithoutDelay()
 {
 	struct sockaddr_in cliaddr;
+	bool spin=UDPEchoLowLatency::isEnabled();
 	time_t start = time(NULL);
 	time_t next_check = start +1;
 	//int socksend=::dup(sockfd);
 	while (1) {
 		socklen_t clilen = sizeof(cliaddr);
-		ssize_t n = ::recvfrom(sockfd, pBuffer, 4096, 0, (struct sockaddr*) (&cliaddr), &clilen);
-		ssize_t bytes_send=0;
+		ssize_t n = ::recvfrom(sockfd, pBuffer, maxPacketSize, MSG_TRUNC, (struct sockaddr*) (&cliaddr), &clilen);
 		if (n >= 0) {
+			ssize_t bytes_in_buffer=n;
+			if ((size_t)n>maxPacketSize) {
+				bytes_in_buffer=maxPacketSize;
+				UDPEchoCounter::increment(counter.packets_truncated);
+			}
 			// Paket zurueck an Absender schicken
 			if (!noEcho) {
-				if (!packetSize) {
-					bytes_send+=n;
-					::sendto(sockfd, (void*) pBuffer, n, 0, (struct sockaddr*) (&cliaddr), clilen);
-				} else {
-					bytes_send=packetSize;
-					::sendto(sockfd, (void*) pBuffer, packetSize, 0, (struct sockaddr*) (&cliaddr), clilen);
+				size_t reply_size=replySize(pBuffer, (size_t)bytes_in_buffer);
+				int copies=reply_size ? 1 : 0;
+				if (copies && impairment.isEnabled()) {
+					int action=impair(pBuffer, reply_size);
+					if (action&UDPEchoImpairment::DROP) copies=0;
+					else if (action&UDPEchoImpairment::DUPLICATE) copies=2;
 				}
+				if (copies) sendResponse(pBuffer, reply_size, (struct sockaddr*) (&cliaddr), clilen, copies);
 			}
 			//mutex.lock();
-			counter.bytes_send+=n;
-			if (!noEcho) counter.packets_send++;
-			counter.bytes_received+=n;
-			counter.packets_received++;
+			UDPEchoCounter::increment(counter.bytes_received, n);
+			UDPEchoCounter::increment(counter.packets_received);
 			//mutex.unlock();
+		} else if (spin) {
+			UDPEchoLowLatency::relax();
 		} else {
 			waitForSocketReadable();
 		}
@@ -228,3 +498,79 @@ void UDPEchoBouncerThread::run()
 	}
 	//::close(socksend);
 }
+
+/*!\brief Workerthread mit verzögerten Antworten
+ *
+ * Variante von UDPEchoBouncerThread::run, die jede Antwort mit einer aus dem
+ * UDPEchoDelayModel gezogenen Verzögerung verschickt. Die Pakete werden direkt in
+ * einen Puffer der UDPEchoDelayQueue empfangen. Ist die Warteschlange voll, wird das
+ * Paket nicht beantwortet und als "queue overflow" gezählt.
+ *
+ * Pakete, die durch UDPEchoImpairment zum Umsortieren ausgewählt wurden, werden ohne
+ * Verzögerung sofort verschickt und überholen damit die wartenden Pakete.
+ */
+void UDPEchoBouncerThread::runWithDelay()
+{
+	struct sockaddr_in cliaddr;
+	// Mit fester Antwortgröße wird nur deren Anfang in den Puffer der Queue gelesen
+	size_t slotsize=delaySlotSize();
+	size_t queuedsize=slotsize<maxPacketSize ? slotsize : maxPacketSize;
+	time_t start = time(NULL);
+	time_t next_check = start +1;
+	while (1) {
+		int64_t now=UDPEchoDelayQueue::now();
+		delayQueue.flush(now, sockfd, counter);
+		char *buf=delayQueue.reserve();
+		bool queued=(buf!=NULL);
+		if (!queued) buf=(char*)pBuffer;
+		size_t len=queued ? queuedsize : maxPacketSize;
+		socklen_t clilen = sizeof(cliaddr);
+		ssize_t n = ::recvfrom(sockfd, buf, len, MSG_TRUNC, (struct sockaddr*) (&cliaddr), &clilen);
+		if (n >= 0) {
+			ssize_t bytes_in_buffer=n;
+			if ((size_t)n>maxPacketSize) {
+				bytes_in_buffer=maxPacketSize;
+				UDPEchoCounter::increment(counter.packets_truncated);
+			}
+			if ((size_t)bytes_in_buffer>len) bytes_in_buffer=len;
+			UDPEchoCounter::increment(counter.bytes_received, n);
+			UDPEchoCounter::increment(counter.packets_received);
+			size_t reply_size=replySize(buf, (size_t)bytes_in_buffer);
+			int action=UDPEchoImpairment::PASS;
+			if (!reply_size) action=UDPEchoImpairment::DROP;
+			else if (impairment.isEnabled()) action=impair(buf, reply_size);
+			if (action&UDPEchoImpairment::DROP) {
+				// Paket wird nicht beantwortet
+			} else if (action&UDPEchoImpairment::REORDER) {
+				// Überholt alle wartenden Pakete
+				sendResponse(buf, reply_size, (const struct sockaddr*) (&cliaddr), clilen,
+						(action&UDPEchoImpairment::DUPLICATE) ? 2 : 1);
+			} else if (queued) {
+				int64_t delay=delayModel.sample(rng);
+				delayQueue.commit(now, delay, reply_size, (const struct sockaddr*) (&cliaddr), clilen);
+				if (action&UDPEchoImpairment::DUPLICATE) {
+					char *dup=delayQueue.reserve();
+					if (dup) {
+						memcpy(dup, buf, reply_size);
+						delayQueue.commit(now, delay, reply_size, (const struct sockaddr*) (&cliaddr), clilen);
+					} else {
+						UDPEchoCounter::increment(counter.packets_queue_overflow);
+					}
+				}
+			} else {
+				UDPEchoCounter::increment(counter.packets_queue_overflow);
+			}
+		} else if (delayQueue.getPending()) {
+			waitForSocketReadable(UDPEchoDelayQueue::TickMicroseconds*1000);
+		} else {
+			waitForSocketReadable();
+		}
+
+		if (time(NULL) >= next_check) {
+			next_check += 1;
+			if (this->threadShouldStop())
+				break;
+		}
+	}
+	delayQueue.clear();
+}
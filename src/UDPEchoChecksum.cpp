@@ -0,0 +1,217 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \brief Prüfsummen für die Kontrolle der Nutzdaten
+ */
+
+/*!\class UDPEchoChecksum
+ * \brief Prüfsumme über den Inhalt eines Pakets
+ *
+ * Im Prüfsummen-Modus beginnt jedes Paket mit PACKET_CHECKED. Der Sender trägt die
+ * Länge des Pakets und eine Prüfsumme über das ganze Paket ein, der Empfänger rechnet
+ * sie nach und erkennt so Antworten, die unterwegs verändert wurden.
+ *
+ * Zur Auswahl stehen CRC32 (ppl7::Crc32), CRC32C (ppl7::Crc32c) und eine zu XXH64
+ * kompatible Hashfunktion, die auf die unteren 32 Bit gekürzt wird. Die CRC-Verfahren
+ * nutzen PCLMULQDQ bzw. SSE4.2, sofern die CPU es unterstützt, ansonsten Slicing-by-8.
+ * XXH64 verarbeitet 32 Bytes pro Iteration mit Multiplikationen statt
+ * Tabellenzugriffen und ist ohne Hardware-Unterstützung die schnellste Variante.
+ */
+
+/*!\brief Algorithmus anhand seines Namens ermitteln
+ *
+ * @param name "crc32", "crc32c", "xxh64" oder "none"
+ * @exception ppl7::IllegalArgumentException Unbekannter Algorithmus
+ */
+UDPEchoChecksum::Algorithm UDPEchoChecksum::getAlgorithm(const ppl7::String &name)
+{
+	ppl7::String n=ppl7::LowerCase(ppl7::Trim(name));
+	if (n=="none") return NONE;
+	if (n=="crc32") return CRC32;
+	if (n=="crc32c") return CRC32C;
+	if (n=="xxh64") return XXH64;
+	throw ppl7::IllegalArgumentException("unknown checksum algorithm: %s", (const char*)name);
+}
+
+const char *UDPEchoChecksum::getName(Algorithm algorithm)
+{
+	switch (algorithm) {
+		case CRC32: return "crc32";
+		case CRC32C: return "crc32c";
+		case XXH64: return "xxh64";
+		default: return "none";
+	}
+}
+
+/*!\brief Prüfsumme über einen Speicherbereich berechnen
+ */
+uint32_t UDPEchoChecksum::compute(Algorithm algorithm, const void *data, size_t size)
+{
+	switch (algorithm) {
+		case CRC32: return ppl7::Crc32(data, size);
+		case CRC32C: return ppl7::Crc32c(data, size);
+		case XXH64: return (uint32_t)xxh64(data, size);
+		default: return 0;
+	}
+}
+
+static const uint64_t PRIME64_1=0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2=0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3=0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4=0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5=0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64-r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v=__builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v=__builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+	acc+=input*PRIME64_2;
+	acc=rotl64(acc, 31);
+	return acc*PRIME64_1;
+}
+
+static inline uint64_t xxhMergeRound(uint64_t acc, uint64_t val)
+{
+	acc^=xxhRound(0, val);
+	return acc*PRIME64_1+PRIME64_4;
+}
+
+/*!\brief 64-Bit-Hash, kompatibel zu XXH64
+ *
+ * @param data Pointer auf die Daten
+ * @param size Länge der Daten in Bytes
+ * @param seed Startwert
+ */
+uint64_t UDPEchoChecksum::xxh64(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p=(const unsigned char*)data;
+	const unsigned char *end=p+size;
+	uint64_t h;
+	if (size>=32) {
+		const unsigned char *limit=end-32;
+		uint64_t v1=seed+PRIME64_1+PRIME64_2;
+		uint64_t v2=seed+PRIME64_2;
+		uint64_t v3=seed;
+		uint64_t v4=seed-PRIME64_1;
+		do {
+			v1=xxhRound(v1, read64(p));
+			v2=xxhRound(v2, read64(p+8));
+			v3=xxhRound(v3, read64(p+16));
+			v4=xxhRound(v4, read64(p+24));
+			p+=32;
+		} while (p<=limit);
+		h=rotl64(v1, 1)+rotl64(v2, 7)+rotl64(v3, 12)+rotl64(v4, 18);
+		h=xxhMergeRound(h, v1);
+		h=xxhMergeRound(h, v2);
+		h=xxhMergeRound(h, v3);
+		h=xxhMergeRound(h, v4);
+	} else {
+		h=seed+PRIME64_5;
+	}
+	h+=(uint64_t)size;
+	while (p+8<=end) {
+		h^=xxhRound(0, read64(p));
+		h=rotl64(h, 27)*PRIME64_1+PRIME64_4;
+		p+=8;
+	}
+	if (p+4<=end) {
+		h^=(uint64_t)read32(p)*PRIME64_1;
+		h=rotl64(h, 23)*PRIME64_2+PRIME64_3;
+		p+=4;
+	}
+	while (p<end) {
+		h^=(uint64_t)(*p)*PRIME64_5;
+		h=rotl64(h, 11)*PRIME64_1;
+		p++;
+	}
+	h^=h >> 33;
+	h*=PRIME64_2;
+	h^=h >> 29;
+	h*=PRIME64_3;
+	h^=h >> 32;
+	return h;
+}
+
+/*!\brief Länge und Prüfsumme in ein Paket eintragen
+ *
+ * @param algorithm Algorithmus
+ * @param packet Paket, beginnt mit PACKET_CHECKED
+ * @param size Länge des Pakets, mindestens sizeof(PACKET_CHECKED)
+ */
+void UDPEchoChecksum::seal(Algorithm algorithm, void *packet, size_t size)
+{
+	PACKET_CHECKED *p=(PACKET_CHECKED*)packet;
+	p->length=(uint32_t)size;
+	p->checksum=0;
+	p->checksum=compute(algorithm, packet, size);
+}
+
+/*!\brief Prüfsumme eines empfangenen Pakets kontrollieren
+ *
+ * Das Feld \c checksum wird für die Berechnung im Paket auf 0 gesetzt und danach
+ * wiederhergestellt.
+ *
+ * @param algorithm Algorithmus
+ * @param packet Empfangenes Paket
+ * @param size Anzahl empfangener Bytes
+ * @return UDPEchoChecksum::LENGTH_MISMATCH, wenn das Paket zu kurz ist oder seine Länge
+ * nicht mit der eingetragenen übereinstimmt (etwa weil es unterwegs gekürzt wurde),
+ * UDPEchoChecksum::CORRUPTED, wenn die Prüfsumme abweicht, sonst UDPEchoChecksum::VALID
+ */
+UDPEchoChecksum::Result UDPEchoChecksum::verify(Algorithm algorithm, void *packet, size_t size)
+{
+	if (size<sizeof(PACKET_CHECKED)) return LENGTH_MISMATCH;
+	PACKET_CHECKED *p=(PACKET_CHECKED*)packet;
+	if (p->length!=size) return LENGTH_MISMATCH;
+	uint32_t checksum=p->checksum;
+	p->checksum=0;
+	uint32_t c=compute(algorithm, packet, size);
+	p->checksum=checksum;
+	return c==checksum ? VALID : CORRUPTED;
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+
+#include "control.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoControlClient
+ * \ingroup GroupSender
+ * \brief Steuerkanal des Senders zum Bouncer
+ *
+ * Startet und stoppt über den UDPEchoControlServer des Bouncers einen Testlauf und
+ * holt anschließend die vom Bouncer gemessenen Werte ab.
+ *
+ * Im Koordinator-Modus des Senders wird dieselbe Klasse verwendet, um Lastläufe auf
+ * den Agenten (pingpong_sender --agent-listen) zu starten und deren Ergebnisse abzuholen.
+ */
+
+UDPEchoControlClient::UDPEchoControlClient()
+{
+	timeout=10;
+}
+
+/*!\brief Verbindung zum Bouncer aufbauen
+ *
+ * @param host_and_port Adresse und Port des Steuerkanals
+ */
+void UDPEchoControlClient::connect(const ppl7::String &host_and_port)
+{
+	socket.setTimeoutConnect(timeout, 0);
+	socket.connect(host_and_port);
+}
+
+void UDPEchoControlClient::disconnect()
+{
+	if (socket.isConnected()) socket.disconnect();
+}
+
+bool UDPEchoControlClient::isConnected() const
+{
+	return socket.isConnected();
+}
+
+/*!\brief Wartezeit auf Antworten des Bouncers festlegen
+ *
+ * @param seconds Timeout in Sekunden (Default=10)
+ */
+void UDPEchoControlClient::setTimeout(int seconds)
+{
+	timeout=seconds;
+}
+
+void UDPEchoControlClient::request(int command, const ppl7::AssocArray &data, ppl7::AssocArray &reply)
+{
+	UDPEchoControlProtocol::sendMessage(socket, command, data);
+	int rc=UDPEchoControlProtocol::receiveMessage(socket, reply, timeout);
+	if (rc==0) throw ppl7::TimeoutException("Keine Antwort vom Bouncer auf dem Steuerkanal");
+	if (rc!=UDPEchoControlProtocol::CMD_OK)
+		throw ppl7::OperationFailedException("Bouncer: %s", (const char*)reply.getString("error"));
+}
+
+/*!\brief Testlauf auf dem Bouncer starten
+ *
+ * Der Bouncer setzt seine Zähler zurück und beginnt, sekündliche Messungen zu sammeln.
+ */
+void UDPEchoControlClient::startTrial()
+{
+	ppl7::AssocArray data, reply;
+	request(UDPEchoControlProtocol::CMD_START, data, reply);
+}
+
+/*!\brief Testlauf auf dem Bouncer beenden
+ *
+ * @param results Nimmt die vom Bouncer gemessenen Werte auf
+ */
+void UDPEchoControlClient::stopTrial(UDPEchoRemoteResults &results)
+{
+	ppl7::AssocArray data, reply;
+	request(UDPEchoControlProtocol::CMD_STOP, data, reply);
+	results.importFromArray(reply);
+}
+
+/*!\brief Lastlauf auf einem Agenten starten
+ *
+ * Verschickt die Konfiguration des Lastlaufs, ohne auf eine Antwort zu warten. Der Agent
+ * antwortet erst nach Ende des Lastlaufs, siehe UDPEchoControlClient::waitForAgentResults.
+ * Dadurch können mehrere Agenten nacheinander angestoßen werden, ohne dass sich die
+ * Startzeitpunkte verschieben.
+ *
+ * @param config Konfiguration des Lastlaufs
+ */
+void UDPEchoControlClient::startAgentRun(const ppl7::AssocArray &config)
+{
+	UDPEchoControlProtocol::sendMessage(socket, UDPEchoControlProtocol::CMD_RUN, config);
+}
+
+/*!\brief Auf das Ergebnis eines Agenten warten
+ *
+ * @param results Nimmt die Ergebnisse des Agenten auf
+ * @param timeout_seconds Maximale Wartezeit in Sekunden
+ * @return 1, wenn das Ergebnis vorliegt, 0 wenn innerhalb der Wartezeit keine Antwort kam
+ * @exception ppl7::OperationFailedException Der Agent hat einen Fehler gemeldet
+ */
+int UDPEchoControlClient::waitForAgentResults(ppl7::AssocArray &results, int timeout_seconds)
+{
+	int rc=UDPEchoControlProtocol::receiveMessage(socket, results, timeout_seconds);
+	if (rc==0) return 0;
+	if (rc!=UDPEchoControlProtocol::CMD_OK)
+		throw ppl7::OperationFailedException("Agent: %s", (const char*)results.getString("error"));
+	return 1;
+}
@@ -0,0 +1,108 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+
+#include "control.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoControlProtocol
+ * \ingroup GroupSender
+ * \brief Nachrichten auf dem Steuerkanal zwischen Sender und Bouncer
+ *
+ * Über den Steuerkanal startet und stoppt der Sender einen Testlauf auf dem Bouncer und
+ * holt anschließend dessen Zähler und Sensordaten ab. Jede Nachricht besteht aus einem
+ * 8 Byte großen Header und einem ppl7::AssocArray im Binärformat als Payload:
+ *
+ * \code
+ * Byte 0-1: "UP"
+ * Byte 2:   Version des Protokolls
+ * Byte 3:   Kommando, siehe UDPEchoControlProtocol::Command
+ * Byte 4-7: Länge der Payload in Network-Byte-Order
+ * \endcode
+ *
+ * Jede Anfrage des Senders wird vom Bouncer mit CMD_OK oder CMD_ERROR beantwortet.
+ * Im Fehlerfall enthält die Payload unter "error" eine Fehlerbeschreibung.
+ *
+ * Im Koordinator-Modus des Senders verschickt der Koordinator mit CMD_RUN die
+ * Konfiguration eines Lastlaufs an die Agenten, die erst nach Ende des Lastlaufs mit
+ * dem Ergebnis antworten.
+ *
+ * Seit Version 2 werden Zähler und Sensordaten innerhalb der Payload im binären
+ * Format von UDPEchoWire übertragen.
+ */
+
+/*!\brief Nachricht verschicken
+ *
+ * @param socket Verbundener Socket
+ * @param command Kommando
+ * @param data Payload
+ */
+void UDPEchoControlProtocol::sendMessage(ppl7::TCPSocket &socket, int command, const ppl7::AssocArray &data)
+{
+	ppl7::ByteArray payload;
+	data.exportBinary(payload);
+	unsigned char header[HeaderSize];
+	header[0]='U';
+	header[1]='P';
+	header[2]=(unsigned char)Version;
+	header[3]=(unsigned char)command;
+	ppl7::PokeN32(header+4, (uint32_t)payload.size());
+	socket.write(header, HeaderSize);
+	if (payload.size()) socket.write(payload);
+}
+
+/*!\brief Auf eine Nachricht warten
+ *
+ * @param socket Verbundener Socket
+ * @param data Nimmt die Payload auf
+ * @param timeout_seconds Maximale Wartezeit in Sekunden, 0=unbegrenzt
+ * @param watch_thread Optionaler Thread, dessen Stop-Flag beim Warten beachtet wird
+ * @return Kommando oder 0, wenn innerhalb der Wartezeit keine Nachricht eingegangen ist
+ * @exception ppl7::InvalidFormatException Ungültiger Header oder falsche Protokollversion
+ * @exception Diverse Die Verbindung wurde getrennt oder es ist ein Lesefehler aufgetreten
+ */
+int UDPEchoControlProtocol::receiveMessage(ppl7::TCPSocket &socket, ppl7::AssocArray &data, int timeout_seconds, ppl7::Thread *watch_thread)
+{
+	double end=ppl7::GetMicrotime()+(double)timeout_seconds;
+	while (!socket.waitForIncomingData(0, 100000)) {
+		if (watch_thread && watch_thread->threadShouldStop()) return 0;
+		if (timeout_seconds>0 && ppl7::GetMicrotime()>=end) return 0;
+	}
+	unsigned char header[HeaderSize];
+	socket.readLoop(header, HeaderSize, timeout_seconds, watch_thread);
+	if (header[0]!='U' || header[1]!='P' || header[2]!=Version)
+		throw ppl7::InvalidFormatException("UDPEchoControlProtocol: ungueltiger Header");
+	size_t size=ppl7::PeekN32(header+4);
+	if (size>MaxPayloadSize)
+		throw ppl7::InvalidFormatException("UDPEchoControlProtocol: Payload zu gross [%zu]", size);
+	data.clear();
+	if (size) {
+		ppl7::ByteArray payload;
+		payload.malloc(size);
+		socket.readLoop((void*)payload.adr(), size, timeout_seconds, watch_thread);
+		data.importBinary(payload);
+	}
+	return header[3];
+}
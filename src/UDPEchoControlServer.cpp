@@ -0,0 +1,162 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+
+#include "control.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class UDPEchoControlServer
+ * \ingroup GroupBouncer
+ * \brief Steuerkanal des Bouncers
+ *
+ * Nimmt in einem eigenen Thread TCP-Verbindungen vom Sender entgegen. Mit CMD_START
+ * beginnt ein Testlauf, ab dann werden die sekündlichen Messungen des Bouncers
+ * gesammelt. CMD_STOP beendet den Testlauf und liefert die gesammelten Werte als
+ * UDPEchoRemoteResults zurück.
+ *
+ * Damit keine Pakete zwischen den sekündlichen Messungen und Start/Stop verloren gehen,
+ * läuft jedes Auslesen der Zähler über UDPEchoControlServer::sample.
+ * Verbindungen werden nacheinander abgearbeitet.
+ */
+
+UDPEchoControlServer::UDPEchoControlServer(UDPEchoBouncer &bouncer)
+	: bouncer(bouncer)
+{
+	trialActive=false;
+}
+
+UDPEchoControlServer::~UDPEchoControlServer()
+{
+	stop();
+}
+
+/*!\brief Steuerkanal starten
+ *
+ * @param host_and_port Adresse und Port, an die sich der Steuerkanal binden soll
+ */
+void UDPEchoControlServer::start(const ppl7::String &host_and_port)
+{
+	ppl7::Array a(host_and_port, ":");
+	if (a.size()!=2 || a[1].toInt()<=0)
+		throw ppl7::InvalidArgumentsException("Ungueltige Adresse fuer den Steuerkanal: %s", (const char*)host_and_port);
+	bind(a[0], a[1].toInt());
+	threadStart();
+}
+
+/*!\brief Steuerkanal beenden
+ */
+void UDPEchoControlServer::stop()
+{
+	if (threadIsRunning()) {
+		signalStopListen();
+		threadStop();
+	}
+}
+
+void UDPEchoControlServer::run()
+{
+	threadSetName("UDPEchoControlServer");
+	listen(4, 100);
+}
+
+/*!\brief Zähler und Sensordaten auslesen
+ *
+ * Liest die Zähler des Bouncers aus und setzt sie dabei zurück. Läuft gerade ein
+ * Testlauf, wird die Messung gespeichert.
+ *
+ * @param counter Zähler, die seit der letzten Messung bereits ausgelesen wurden (z.B. für
+ * das Statistik-Log), die aktuellen Zähler werden hinzuaddiert
+ * @param stat Nimmt die aktuellen Sensordaten auf
+ */
+void UDPEchoControlServer::sample(UDPEchoCounter &counter, SystemStat &stat)
+{
+	mutex.lock();
+	counter.add(bouncer.getCounter());
+	sampleSensorData(stat);
+	if (trialActive) results.addSample(counter, stat);
+	mutex.unlock();
+}
+
+void UDPEchoControlServer::startTrial()
+{
+	mutex.lock();
+	// Zähler vor dem Start gehören nicht zum Testlauf
+	bouncer.getCounter();
+	results.clear();
+	sampleSensorData(results.stat_start);
+	results.stat_end=results.stat_start;
+	results.total.sampleTime=results.stat_start.sampleTime;
+	bouncer.getPerfCounter(perf_start);
+	trialActive=true;
+	mutex.unlock();
+}
+
+void UDPEchoControlServer::stopTrial(ppl7::AssocArray &reply)
+{
+	mutex.lock();
+	if (trialActive) {
+		UDPEchoCounter counter=bouncer.getCounter();
+		SystemStat stat;
+		sampleSensorData(stat);
+		results.addSample(counter, stat);
+		UDPEchoPerfCounter::Values perf_end;
+		bouncer.getPerfCounter(perf_end);
+		results.perf=UDPEchoPerfCounter::Values::getDelta(perf_start, perf_end);
+	}
+	trialActive=false;
+	results.exportToArray(reply);
+	mutex.unlock();
+}
+
+/*!\brief Verbindung des Senders abarbeiten
+ *
+ * Wird von ppl7::TCPSocket::listen für jede neue Verbindung aufgerufen und bearbeitet
+ * Kommandos, bis die Verbindung getrennt oder der Thread gestoppt wird.
+ *
+ * @return 0, der Socket wird anschließend von ppl7::TCPSocket::listen gelöscht
+ */
+int UDPEchoControlServer::receiveConnect(ppl7::TCPSocket *socket, const ppl7::String &host, int port)
+{
+	try {
+		while (!threadShouldStop()) {
+			ppl7::AssocArray data, reply;
+			int command=UDPEchoControlProtocol::receiveMessage(*socket, data, 0, this);
+			if (command==0) continue;
+			if (command==UDPEchoControlProtocol::CMD_START) {
+				startTrial();
+				UDPEchoControlProtocol::sendMessage(*socket, UDPEchoControlProtocol::CMD_OK, reply);
+			} else if (command==UDPEchoControlProtocol::CMD_STOP) {
+				stopTrial(reply);
+				UDPEchoControlProtocol::sendMessage(*socket, UDPEchoControlProtocol::CMD_OK, reply);
+			} else {
+				reply.setf("error", "Unbekanntes Kommando %d", command);
+				UDPEchoControlProtocol::sendMessage(*socket, UDPEchoControlProtocol::CMD_ERROR, reply);
+			}
+		}
+	} catch (const ppl7::Exception &) {
+		// Verbindung getrennt oder ungültige Nachricht
+	}
+	return 0;
+}
@@ -27,6 +27,7 @@
 #include <limits.h>
 
 #include "udpecho.h"
+#include "wire.h"
 
 void UDPEchoCounter::clear()
 {
@@ -34,6 +35,59 @@ void UDPEchoCounter::clear()
 	packets_send=0;
 	bytes_received=0;
 	bytes_send=0;
+	packets_truncated=0;
+	packets_queue_overflow=0;
+	packets_impair_dropped=0;
+	packets_impair_duplicated=0;
+	packets_impair_corrupted=0;
+	packets_impair_reordered=0;
+	packets_dns_invalid=0;
+	packets_socket_dropped=0;
+	packets_send_failed=0;
+}
+
+/*!\brief Zähler einer weiteren Messung hinzuaddieren
+ *
+ * Der Zeitpunkt der Messung wird von \p other übernommen.
+ */
+void UDPEchoCounter::add(const UDPEchoCounter &other)
+{
+	packets_received+=other.packets_received;
+	packets_send+=other.packets_send;
+	bytes_received+=other.bytes_received;
+	bytes_send+=other.bytes_send;
+	packets_truncated+=other.packets_truncated;
+	packets_queue_overflow+=other.packets_queue_overflow;
+	packets_impair_dropped+=other.packets_impair_dropped;
+	packets_impair_duplicated+=other.packets_impair_duplicated;
+	packets_impair_corrupted+=other.packets_impair_corrupted;
+	packets_impair_reordered+=other.packets_impair_reordered;
+	packets_dns_invalid+=other.packets_dns_invalid;
+	packets_socket_dropped+=other.packets_socket_dropped;
+	packets_send_failed+=other.packets_send_failed;
+	sampleTime=other.sampleTime;
+}
+
+/*!\brief Zähler einer früheren Messung abziehen
+ *
+ * Aus zwei Ständen kumulierter Zähler wird so die Differenz gebildet.
+ */
+void UDPEchoCounter::subtract(const UDPEchoCounter &other)
+{
+	packets_received-=other.packets_received;
+	packets_send-=other.packets_send;
+	bytes_received-=other.bytes_received;
+	bytes_send-=other.bytes_send;
+	packets_truncated-=other.packets_truncated;
+	packets_queue_overflow-=other.packets_queue_overflow;
+	packets_impair_dropped-=other.packets_impair_dropped;
+	packets_impair_duplicated-=other.packets_impair_duplicated;
+	packets_impair_corrupted-=other.packets_impair_corrupted;
+	packets_impair_reordered-=other.packets_impair_reordered;
+	packets_dns_invalid-=other.packets_dns_invalid;
+	// Der Zähler des Kernels ist pro Socket 32 Bit breit und läuft über
+	packets_socket_dropped=(uint32_t)(packets_socket_dropped-other.packets_socket_dropped);
+	packets_send_failed-=other.packets_send_failed;
 }
 
 void UDPEchoCounter::exportToArray(ppl7::AssocArray &data) const
@@ -43,6 +97,15 @@ void UDPEchoCounter::exportToArray(ppl7::AssocArray &data) const
 	data.setf("packets_send","%lu",packets_send);
 	data.setf("bytes_received","%lu",bytes_received);
 	data.setf("bytes_send","%lu",bytes_send);
+	data.setf("packets_truncated","%lu",packets_truncated);
+	data.setf("packets_queue_overflow","%lu",packets_queue_overflow);
+	data.setf("packets_impair_dropped","%lu",packets_impair_dropped);
+	data.setf("packets_impair_duplicated","%lu",packets_impair_duplicated);
+	data.setf("packets_impair_corrupted","%lu",packets_impair_corrupted);
+	data.setf("packets_impair_reordered","%lu",packets_impair_reordered);
+	data.setf("packets_dns_invalid","%lu",packets_dns_invalid);
+	data.setf("packets_socket_dropped","%lu",packets_socket_dropped);
+	data.setf("packets_send_failed","%lu",packets_send_failed);
 
 }
 
@@ -53,4 +116,70 @@ void UDPEchoCounter::importFromArray(const ppl7::AssocArray &data)
 	packets_send=data.getString("packets_send").toUnsignedInt64();
 	bytes_received=data.getString("bytes_received").toUnsignedInt64();
 	bytes_send=data.getString("bytes_send").toUnsignedInt64();
+	packets_truncated=data.getString("packets_truncated").toUnsignedInt64();
+	packets_queue_overflow=data.getString("packets_queue_overflow").toUnsignedInt64();
+	packets_impair_dropped=data.getString("packets_impair_dropped").toUnsignedInt64();
+	packets_impair_duplicated=data.getString("packets_impair_duplicated").toUnsignedInt64();
+	packets_impair_corrupted=data.getString("packets_impair_corrupted").toUnsignedInt64();
+	packets_impair_reordered=data.getString("packets_impair_reordered").toUnsignedInt64();
+	packets_dns_invalid=data.getString("packets_dns_invalid").toUnsignedInt64();
+	packets_socket_dropped=data.getString("packets_socket_dropped").toUnsignedInt64();
+	packets_send_failed=0;
+	if (data.exists("packets_send_failed"))
+		packets_send_failed=data.getString("packets_send_failed").toUnsignedInt64();
+}
+
+/*!\brief Größe der binären Darstellung
+ *
+ * @return Anzahl Bytes, die UDPEchoCounter::exportBinary benötigt
+ */
+size_t UDPEchoCounter::binarySize() const
+{
+	return UDPEchoWire::CounterSize;
+}
+
+/*!\brief Zähler im binären Format exportieren
+ *
+ * Schreibt die Zähler im Format von UDPEchoWire in den Puffer.
+ *
+ * @param buffer Zielpuffer
+ * @param size Größe des Zielpuffers
+ * @return Anzahl geschriebener Bytes
+ * @exception ppl7::BufferTooSmallException Der Puffer ist zu klein
+ */
+size_t UDPEchoCounter::exportBinary(void *buffer, size_t size) const
+{
+	if (size<UDPEchoWire::CounterSize) throw ppl7::BufferTooSmallException("UDPEchoCounter::exportBinary");
+	unsigned char *p=(unsigned char*)buffer;
+	UDPEchoWire::putHeader(p, UDPEchoWire::RECORD_COUNTER, UDPEchoWire::CounterSize);
+	UDPEchoWire::putDouble(p+8, sampleTime);
+	p+=16;
+	UDPEchoWire::put64(p, packets_received);
+	UDPEchoWire::put64(p+8, packets_send);
+	UDPEchoWire::put64(p+16, bytes_received);
+	UDPEchoWire::put64(p+24, bytes_send);
+	UDPEchoWire::put64(p+32, packets_truncated);
+	UDPEchoWire::put64(p+40, packets_queue_overflow);
+	UDPEchoWire::put64(p+48, packets_impair_dropped);
+	UDPEchoWire::put64(p+56, packets_impair_duplicated);
+	UDPEchoWire::put64(p+64, packets_impair_corrupted);
+	UDPEchoWire::put64(p+72, packets_impair_reordered);
+	UDPEchoWire::put64(p+80, packets_dns_invalid);
+	UDPEchoWire::put64(p+88, packets_socket_dropped);
+	UDPEchoWire::put64(p+96, packets_send_failed);
+	return UDPEchoWire::CounterSize;
+}
+
+/*!\brief Zähler aus dem binären Format importieren
+ *
+ * @param buffer Pointer auf den Datensatz
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @return Länge des Datensatzes in Bytes
+ * @exception ppl7::InvalidFormatException Kein gültiger Datensatz
+ */
+size_t UDPEchoCounter::importBinary(const void *buffer, size_t size)
+{
+	UDPEchoCounterView view(buffer, size);
+	view.decode(*this);
+	return view.size();
 }
@@ -0,0 +1,257 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <math.h>
+#include <algorithm>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class UDPEchoDelayModel
+ * \ingroup GroupBouncer
+ * \brief Verteilung der künstlichen Verzögerung von Antwortpaketen
+ *
+ * Die Verzögerung wird über einen String konfiguriert, alle Zeitangaben erfolgen in
+ * Millisekunden:
+ * - \c fixed:MS oder nur \c MS: konstante Verzögerung
+ * - \c uniform:MIN,MAX: gleichverteilt zwischen MIN und MAX
+ * - \c normal:MEAN,STDDEV: normalverteilt, negative Werte werden auf 0 gesetzt
+ * - \c file:FILENAME: empirische Verteilung aus einer Datei mit einem Messwert pro Zeile
+ *
+ * Jeder Worker-Thread erhält eine eigene Kopie, da UDPEchoDelayModel::sample nicht
+ * thread-sicher ist.
+ */
+
+/*!\brief Konstruktor
+ *
+ * Standardmäßig ist keine Verzögerung aktiv.
+ */
+UDPEchoDelayModel::UDPEchoDelayModel()
+{
+	type=NONE;
+	param1=0.0;
+	param2=0.0;
+	haveSpare=false;
+	spare=0.0;
+}
+
+static double parseMilliseconds(const ppl7::String &value, const ppl7::String &spec)
+{
+	ppl7::String v=value.trimmed();
+	if (v.isEmpty()) throw ppl7::InvalidArgumentsException("Ungueltige Verzoegerung: %s", (const char*)spec);
+	double ms=v.toDouble();
+	if (ms<0.0) throw ppl7::InvalidArgumentsException("Verzoegerung darf nicht negativ sein: %s", (const char*)spec);
+	return ms*1000.0;
+}
+
+/*!\brief Verzögerungsmodell aus String einlesen
+ *
+ * @param spec Beschreibung der Verteilung, siehe UDPEchoDelayModel
+ *
+ * @exception ppl7::InvalidArgumentsException Wird bei einer ungültigen Beschreibung geworfen
+ */
+void UDPEchoDelayModel::parse(const ppl7::String &spec)
+{
+	type=NONE;
+	param1=param2=0.0;
+	samples.clear();
+	haveSpare=false;
+	if (spec.isEmpty()) return;
+	ssize_t p=spec.instr(":");
+	ppl7::String name, args;
+	if (p<0) {
+		name="fixed";
+		args=spec;
+	} else {
+		name=spec.left(p).toLowerCase();
+		args=spec.mid(p+1);
+	}
+	if (name=="file") {
+		loadEmpiricalDistribution(args);
+		type=EMPIRICAL;
+		return;
+	}
+	ppl7::Array a(args,",");
+	if (name=="fixed" && a.size()==1) {
+		type=FIXED;
+		param1=parseMilliseconds(a[0],spec);
+	} else if (name=="uniform" && a.size()==2) {
+		type=UNIFORM;
+		param1=parseMilliseconds(a[0],spec);
+		param2=parseMilliseconds(a[1],spec);
+		if (param2<param1) throw ppl7::InvalidArgumentsException("uniform: MAX ist kleiner als MIN [%s]", (const char*)spec);
+	} else if (name=="normal" && a.size()==2) {
+		type=NORMAL;
+		param1=parseMilliseconds(a[0],spec);
+		param2=parseMilliseconds(a[1],spec);
+	} else {
+		throw ppl7::InvalidArgumentsException("Ungueltige Verzoegerung: %s", (const char*)spec);
+	}
+}
+
+/*!\brief Empirische Verteilung aus einer Datei laden
+ *
+ * Die Datei enthält pro Zeile einen Messwert in Millisekunden, Leerzeilen und Zeilen,
+ * die mit "#" beginnen, werden ignoriert. Die Messwerte werden sortiert, so dass
+ * UDPEchoDelayModel::sample über die inverse Verteilungsfunktion ziehen kann.
+ *
+ * @param filename Name der Datei
+ */
+void UDPEchoDelayModel::loadEmpiricalDistribution(const ppl7::String &filename)
+{
+	ppl7::File ff(filename);
+	try {
+		while (!ff.eof()) {
+			ppl7::String line=ff.gets().trimmed();
+			if (line.notEmpty()==true && line[0]!='#')
+				samples.push_back(parseMilliseconds(line,filename));
+		}
+	} catch (ppl7::EndOfFileException &) {
+
+	}
+	if (samples.empty()) throw ppl7::InvalidArgumentsException("Keine Messwerte in Datei: %s", (const char*)filename);
+	std::sort(samples.begin(),samples.end());
+}
+
+/*!\brief Ist eine Verzögerung konfiguriert?
+ *
+ * @return Gibt \c true zurück, wenn Antworten verzögert werden sollen
+ */
+bool UDPEchoDelayModel::isEnabled() const
+{
+	return type!=NONE;
+}
+
+UDPEchoDelayModel::Type UDPEchoDelayModel::getType() const
+{
+	return type;
+}
+
+/*!\brief Größte Verzögerung, die das Modell liefern kann
+ *
+ * Bei der Normalverteilung wird der Mittelwert plus vier Standardabweichungen
+ * angenommen, größere Werte sind so selten, dass sie für die Größe der Warteschlange
+ * keine Rolle spielen.
+ *
+ * @return Verzögerung in Mikrosekunden
+ */
+int64_t UDPEchoDelayModel::getMaxDelay() const
+{
+	switch (type) {
+		case FIXED: return (int64_t)param1;
+		case UNIFORM: return (int64_t)param2;
+		case NORMAL: return (int64_t)(param1+4.0*param2);
+		case EMPIRICAL: return (int64_t)samples.back();
+		default: return 0;
+	}
+}
+
+/*!\brief Benötigte Plätze in der Warteschlange für eine Paketrate
+ *
+ * Bei \p pps Paketen pro Sekunde warten höchstens \p pps mal die maximale Verzögerung
+ * gleichzeitig in der Warteschlange. Dazu kommen 25 % Reserve für Lastspitzen,
+ * mindestens aber 1024 Plätze. Da alle Plätze beim Start angelegt werden, wird die
+ * Anzahl auf so viele begrenzt, wie in \p memory Bytes passen, die Untergrenze von
+ * 1024 gilt dabei nicht. Ist die Warteschlange zu klein, werden Antworten verworfen und
+ * als "queue overflow" gezählt.
+ *
+ * @param pps Erwartete Paketrate pro Worker-Thread
+ * @param entrysize Speicherbedarf eines Platzes, siehe UDPEchoDelayQueue::memoryPerEntry
+ * @param memory Speicherlimit pro Worker-Thread in Bytes
+ * @return Anzahl Plätze, mindestens 1
+ */
+size_t UDPEchoDelayModel::getQueueSize(uint64_t pps, size_t entrysize, size_t memory) const
+{
+	double entries=(double)pps*(double)getMaxDelay()/1000000.0*1.25;
+	if (entries<1024.0) entries=1024.0;
+	if (entrysize && entries>(double)(memory/entrysize)) entries=(double)(memory/entrysize);
+	if (entries<1.0) return 1;
+	if (entries>=(double)0xfffffffe) return 0xfffffffe;
+	return (size_t)entries;
+}
+
+/*!\brief Verzögerung für ein Paket ziehen
+ *
+ * @param rng Zufallszahlengenerator des aufrufenden Threads
+ * @return Verzögerung in Mikrosekunden
+ */
+int64_t UDPEchoDelayModel::sample(UDPEchoRandom &rng)
+{
+	double us=0.0;
+	switch (type) {
+		case FIXED:
+			us=param1;
+			break;
+		case UNIFORM:
+			us=param1+(param2-param1)*rng.uniform();
+			break;
+		case NORMAL:
+			// Box-Muller, der zweite Wert wird für den nächsten Aufruf aufgehoben
+			if (haveSpare) {
+				haveSpare=false;
+				us=param1+param2*spare;
+			} else {
+				double u1, u2=rng.uniform();
+				do {
+					u1=rng.uniform();
+				} while (u1<=0.0);
+				double r=sqrt(-2.0*log(u1));
+				spare=r*sin(2.0*M_PI*u2);
+				haveSpare=true;
+				us=param1+param2*r*cos(2.0*M_PI*u2);
+			}
+			break;
+		case EMPIRICAL:
+		{
+			// Inverse Verteilungsfunktion mit linearer Interpolation zwischen den Messwerten
+			double pos=rng.uniform()*(double)(samples.size()-1);
+			size_t i=(size_t)pos;
+			if (i+1<samples.size()) us=samples[i]+(samples[i+1]-samples[i])*(pos-(double)i);
+			else us=samples[i];
+			break;
+		}
+		default:
+			return 0;
+	}
+	if (us<0.0) return 0;
+	return (int64_t)us;
+}
+
+/*!\brief Beschreibung des Modells für die Ausgabe
+ *
+ * @return String mit Art und Parametern der Verteilung
+ */
+ppl7::String UDPEchoDelayModel::toString() const
+{
+	ppl7::String s;
+	switch (type) {
+		case FIXED: s.setf("fixed %0.3f ms",param1/1000.0); break;
+		case UNIFORM: s.setf("uniform %0.3f - %0.3f ms",param1/1000.0,param2/1000.0); break;
+		case NORMAL: s.setf("normal mean=%0.3f ms, stddev=%0.3f ms",param1/1000.0,param2/1000.0); break;
+		case EMPIRICAL: s.setf("empirical, %zu samples, %0.3f - %0.3f ms",samples.size(),
+				samples.front()/1000.0,samples.back()/1000.0); break;
+		default: s="none"; break;
+	}
+	return s;
+}
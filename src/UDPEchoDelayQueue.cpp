@@ -0,0 +1,263 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <errno.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class UDPEchoDelayQueue
+ * \ingroup GroupBouncer
+ * \brief Warteschlange für verzögerte Antwortpakete
+ *
+ * Die Warteschlange ist als Hashed Timing Wheel implementiert: Jeder Slot deckt
+ * UDPEchoDelayQueue::TickMicroseconds ab, ein Paket wird in den Slot seines Fälligkeits-
+ * Ticks eingehängt. Verzögerungen, die länger als eine Umdrehung des Rades sind, bleiben
+ * so lange im Slot, bis ihr Tick erreicht ist. Einfügen und Versenden kosten damit
+ * unabhängig von der Anzahl wartender Pakete O(1).
+ *
+ * Die Pakete liegen in festen Puffern, die beim Anlegen aus dem UDPEchoPacketPool des
+ * Worker-Threads geholt werden. Der Worker-Thread empfängt direkt in einen freien
+ * Puffer (UDPEchoDelayQueue::reserve)
+ * und hängt ihn anschließend ein (UDPEchoDelayQueue::commit), so dass im Paketpfad
+ * weder kopiert noch Speicher allokiert wird.
+ */
+
+static const uint32_t END_OF_LIST=0xffffffff;
+
+/*!\brief Konstruktor
+ *
+ * Die Puffer werden erst durch UDPEchoDelayQueue::allocate geholt.
+ */
+UDPEchoDelayQueue::UDPEchoDelayQueue()
+{
+	pool=NULL;
+	capacity=0;
+	free_head=END_OF_LIST;
+	pending=0;
+	current_tick=0;
+}
+
+/*!\brief Destruktor
+ *
+ * Gibt die Puffer an den Pool zurück.
+ */
+UDPEchoDelayQueue::~UDPEchoDelayQueue()
+{
+	release();
+}
+
+/*!\brief Puffer aus dem Pool holen
+ *
+ * Holt \p capacity Puffer aus \p pool, der mindestens so viele freie Puffer haben muss.
+ * Bereits geholte Puffer werden vorher zurückgegeben.
+ *
+ * @param pool Paketpool des Worker-Threads, muss länger leben als die Warteschlange
+ * @param capacity Maximale Anzahl gleichzeitig wartender Pakete
+ * @exception ppl7::InvalidArgumentsException Ungültige Kapazität
+ * @exception ppl7::OutOfMemoryException Der Pool hat nicht genug freie Puffer
+ */
+void UDPEchoDelayQueue::allocate(UDPEchoPacketPool &pool, uint32_t capacity)
+{
+	if (!capacity || capacity==END_OF_LIST)
+		throw ppl7::InvalidArgumentsException("UDPEchoDelayQueue::allocate");
+	release();
+	this->pool=&pool;
+	buffers.reserve(capacity);
+	for (uint32_t i=0;i<capacity;i++) {
+		char *buffer=(char*)pool.acquire();
+		if (!buffer) {
+			release();
+			throw ppl7::OutOfMemoryException("UDPEchoDelayQueue::allocate: packet pool exhausted");
+		}
+		buffers.push_back(buffer);
+	}
+	this->capacity=capacity;
+	entries.resize(capacity);
+	slot_head.resize(WheelSlots);
+	slot_tail.resize(WheelSlots);
+	clear();
+}
+
+/*!\brief Puffer an den Pool zurückgeben
+ *
+ * Alle wartenden Pakete werden verworfen.
+ */
+void UDPEchoDelayQueue::release()
+{
+	if (pool) {
+		for (size_t i=0;i<buffers.size();i++) pool->release(buffers[i]);
+	}
+	buffers.clear();
+	pool=NULL;
+	capacity=0;
+	if (!slot_head.empty()) clear();
+}
+
+/*!\brief Alle wartenden Pakete verwerfen
+ */
+void UDPEchoDelayQueue::clear()
+{
+	for (uint32_t i=0;i<WheelSlots;i++) slot_head[i]=slot_tail[i]=END_OF_LIST;
+	for (uint32_t i=0;i<capacity;i++) entries[i].next=i+1;
+	if (capacity) entries[capacity-1].next=END_OF_LIST;
+	free_head=capacity ? 0 : END_OF_LIST;
+	pending=0;
+	current_tick=now()/TickMicroseconds;
+}
+
+/*!\brief Freien Paketpuffer holen
+ *
+ * Liefert den Puffer des nächsten freien Eintrags. Der Eintrag bleibt frei, bis er mit
+ * UDPEchoDelayQueue::commit eingehängt wird, der Puffer kann also auch ungenutzt
+ * verworfen werden.
+ *
+ * @return Pointer auf den Puffer oder NULL, wenn alle Einträge belegt sind
+ */
+char *UDPEchoDelayQueue::reserve()
+{
+	if (free_head==END_OF_LIST) return NULL;
+	return buffers[free_head];
+}
+
+/*!\brief Paket in die Warteschlange einhängen
+ *
+ * Hängt den zuletzt mit UDPEchoDelayQueue::reserve geholten Puffer ein.
+ *
+ * @param now_us Aktuelle Zeit in Mikrosekunden (UDPEchoDelayQueue::now)
+ * @param delay_us Verzögerung in Mikrosekunden
+ * @param size Anzahl zu sendender Bytes
+ * @param addr Zieladresse
+ * @param addrlen Länge der Zieladresse
+ */
+void UDPEchoDelayQueue::commit(int64_t now_us, int64_t delay_us, size_t size, const struct sockaddr *addr, socklen_t addrlen)
+{
+	uint32_t i=free_head;
+	if (i==END_OF_LIST) return;
+	Entry &e=entries[i];
+	free_head=e.next;
+	e.due_tick=(now_us+delay_us+TickMicroseconds-1)/TickMicroseconds;
+	if (e.due_tick<current_tick) e.due_tick=current_tick;
+	e.size=(uint32_t)size;
+	if (addrlen>sizeof(e.addr)) addrlen=sizeof(e.addr);
+	e.addrlen=addrlen;
+	memcpy(&e.addr,addr,addrlen);
+	e.next=END_OF_LIST;
+	uint32_t slot=(uint32_t)(e.due_tick&(WheelSlots-1));
+	if (slot_tail[slot]==END_OF_LIST) slot_head[slot]=i;
+	else entries[slot_tail[slot]].next=i;
+	slot_tail[slot]=i;
+	pending++;
+}
+
+/*!\brief Fällige Pakete versenden
+ *
+ * Arbeitet alle seit dem letzten Aufruf vollständig abgelaufenen Ticks ab und
+ * verschickt die darin fälligen Pakete. Die Reihenfolge innerhalb eines Ticks
+ * bleibt dabei erhalten.
+ *
+ * Ist der Sendepuffer des nicht blockierenden Sockets voll (EAGAIN, ENOBUFS), bleibt
+ * das Paket mit allen folgenden in der Warteschlange und wird beim nächsten Aufruf
+ * erneut verschickt. Andere Fehler werden als "send failed" gezählt und das Paket
+ * verworfen.
+ *
+ * @param now_us Aktuelle Zeit in Mikrosekunden (UDPEchoDelayQueue::now)
+ * @param sockfd Socket, über den die Pakete verschickt werden
+ * @param counter Zähler des Worker-Threads
+ */
+void UDPEchoDelayQueue::flush(int64_t now_us, int sockfd, UDPEchoCounter &counter)
+{
+	int64_t end=now_us/TickMicroseconds-1;
+	if (!pending) {
+		current_tick=end+1;
+		return;
+	}
+	if (end<current_tick) return;
+	// Bei langen Pausen muss jeder Slot höchstens einmal betrachtet werden
+	if (end-current_tick>=(int64_t)WheelSlots) current_tick=end-WheelSlots+1;
+	for (;current_tick<=end && pending>0;current_tick++) {
+		uint32_t slot=(uint32_t)(current_tick&(WheelSlots-1));
+		uint32_t prev=END_OF_LIST;
+		uint32_t i=slot_head[slot];
+		while (i!=END_OF_LIST) {
+			Entry &e=entries[i];
+			uint32_t next=e.next;
+			if (e.due_tick<=end) {
+				ssize_t n=::sendto(sockfd,buffers[i],e.size,0,
+						(const struct sockaddr*)&e.addr,e.addrlen);
+				if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==ENOBUFS)) {
+					// Weiter ab diesem Tick, sobald der Socket wieder Platz hat
+					return;
+				}
+				if (n>=0) {
+					UDPEchoCounter::increment(counter.packets_send);
+					UDPEchoCounter::increment(counter.bytes_send, n);
+				} else {
+					UDPEchoCounter::increment(counter.packets_send_failed);
+				}
+				if (prev==END_OF_LIST) slot_head[slot]=next;
+				else entries[prev].next=next;
+				if (slot_tail[slot]==i) slot_tail[slot]=prev;
+				e.next=free_head;
+				free_head=i;
+				pending--;
+			} else {
+				prev=i;
+			}
+			i=next;
+		}
+	}
+	current_tick=end+1;
+}
+
+/*!\brief Anzahl wartender Pakete
+ */
+uint32_t UDPEchoDelayQueue::getPending() const
+{
+	return pending;
+}
+
+/*!\brief Maximale Anzahl wartender Pakete
+ */
+uint32_t UDPEchoDelayQueue::getCapacity() const
+{
+	return capacity;
+}
+
+/*!\brief Speicherbedarf eines Platzes in Bytes
+ *
+ * Puffer aus dem UDPEchoPacketPool, aufgerundet auf ganze Cache-Lines, plus
+ * Verwaltungsdaten der Warteschlange.
+ *
+ * @param slotsize Größe eines Paketpuffers
+ */
+size_t UDPEchoDelayQueue::memoryPerEntry(size_t slotsize)
+{
+	size_t line=UDPEchoPacketPool::CacheLineSize;
+	return (slotsize+line-1)/line*line+sizeof(Entry)+sizeof(char*);
+}
@@ -0,0 +1,241 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoCompactHistogram
+ * \ingroup GroupSender
+ * \brief Kleines Histogramm der Paketlaufzeiten pro Ziel oder Gruppe von Flows
+ *
+ * Aufgebaut wie UDPEchoLatencyHistogram, teilt aber jede Zweierpotenz nur in 4 Buckets
+ * und zählt mit 32 Bit. Mit 128 Buckets belegt es etwa 520 Byte statt 8 KiB, so dass
+ * auch tausende Ziele pro Thread wenig Speicher kosten. Der relative Fehler eines
+ * Perzentils liegt unter 12,5 %, was für den Vergleich der Ziele untereinander reicht.
+ */
+
+UDPEchoCompactHistogram::UDPEchoCompactHistogram()
+{
+	clear();
+}
+
+void UDPEchoCompactHistogram::clear()
+{
+	memset(bucket, 0, sizeof(bucket));
+	total=0;
+}
+
+/*!\brief Anderes Histogramm hinzuaddieren
+ *
+ * Volle Buckets bleiben beim größten Wert stehen.
+ */
+void UDPEchoCompactHistogram::merge(const UDPEchoCompactHistogram &other)
+{
+	for (int i=0;i<Buckets;i++) {
+		uint64_t sum=(uint64_t)bucket[i]+other.bucket[i];
+		bucket[i]=sum<0xffffffff ? (uint32_t)sum : 0xffffffff;
+	}
+	total+=other.total;
+}
+
+/*!\brief Anzahl gezählter Laufzeiten
+ */
+uint64_t UDPEchoCompactHistogram::count() const
+{
+	return total;
+}
+
+/*!\brief Untere Grenze eines Buckets in Mikrosekunden
+ */
+uint64_t UDPEchoCompactHistogram::lowerBound(int index)
+{
+	if (index<SubBuckets) return (uint64_t)index;
+	int msb=index/SubBuckets+1;
+	return (uint64_t)(SubBuckets+index%SubBuckets)<<(msb-2);
+}
+
+/*!\brief Breite eines Buckets in Mikrosekunden
+ */
+uint64_t UDPEchoCompactHistogram::bucketWidth(int index)
+{
+	if (index<SubBuckets) return 1;
+	return (uint64_t)1<<(index/SubBuckets-1);
+}
+
+/*!\brief Perzentil berechnen
+ *
+ * @param p Perzentil zwischen 0 und 100, z.B. 99
+ * @return Laufzeit in Sekunden (Mitte des Buckets) oder 0, wenn keine Werte gezählt wurden
+ */
+double UDPEchoCompactHistogram::percentile(double p) const
+{
+	if (!total) return 0.0;
+	if (p<0.0) p=0.0;
+	if (p>100.0) p=100.0;
+	uint64_t rank=(uint64_t)((double)total*p/100.0+0.5);
+	if (rank<1) rank=1;
+	uint64_t sum=0;
+	for (int i=0;i<Buckets;i++) {
+		sum+=bucket[i];
+		if (sum>=rank) {
+			return ((double)lowerBound(i)+(double)(bucketWidth(i)-1)/2.0)/1000000.0;
+		}
+	}
+	return (double)lowerBound(Buckets-1)/1000000.0;
+}
+
+
+/*!\class UDPEchoFlowStats
+ * \ingroup GroupSender
+ * \brief Zähler und Laufzeiten eines Ziels oder einer Gruppe von Flows
+ *
+ * Wird für die Auswertung pro Ziel (UDPEchoTargetTable) und pro Gruppe von Flows
+ * (UDPEchoFlowBuckets) verwendet. Sendezähler und Fehler werden vom Sender, empfangene
+ * Pakete und Laufzeiten vom Empfänger gezählt.
+ */
+
+UDPEchoFlowStats::UDPEchoFlowStats()
+{
+	clear();
+}
+
+/*!\brief Zähler und Laufzeiten auf 0 setzen
+ */
+void UDPEchoFlowStats::clear()
+{
+	packets_send=0;
+	packets_received=0;
+	bytes_send=0;
+	bytes_received=0;
+	errors=0;
+	rtt_total=0.0;
+	rtt_min=0.0;
+	rtt_max=0.0;
+	histogram.clear();
+}
+
+/*!\brief Messwerte eines anderen Threads addieren
+ */
+void UDPEchoFlowStats::merge(const UDPEchoFlowStats &other)
+{
+	packets_send+=other.packets_send;
+	packets_received+=other.packets_received;
+	bytes_send+=other.bytes_send;
+	bytes_received+=other.bytes_received;
+	errors+=other.errors;
+	rtt_total+=other.rtt_total;
+	if (other.rtt_min>0.0 && (rtt_min==0.0 || other.rtt_min<rtt_min)) rtt_min=other.rtt_min;
+	if (other.rtt_max>rtt_max) rtt_max=other.rtt_max;
+	histogram.merge(other.histogram);
+}
+
+
+/*!\class UDPEchoFlowBuckets
+ * \ingroup GroupSender
+ * \brief Messwerte pro Gruppe von Flows
+ *
+ * Mit vielen Sockets pro Thread (siehe UDPEchoSenderThread::setSocketCount) ist jeder
+ * Socket ein eigener Flow mit eigenem Quellport. Damit sich Verluste und Laufzeiten
+ * einzelnen Flows zuordnen lassen, ohne für tausende Flows je ein Histogramm zu führen,
+ * werden die Flows aller Threads fortlaufend nummeriert und in zusammenhängende
+ * Bereiche gleicher Größe aufgeteilt. Mit vorgegebenen Quellports (siehe
+ * UDPEchoSenderThread::bindSources) entspricht jeder Bereich einem Portbereich. Ein
+ * Ungleichgewicht zwischen den Gruppen zeigt dann zum Beispiel, dass die per RSS oder
+ * ECMP auf eine Queue oder einen Pfad verteilten Flows Pakete verlieren.
+ *
+ * Jeder Thread arbeitet auf seiner eigenen Kopie mit allen Gruppen, die Ergebnisse
+ * werden nach dem Lauf mit UDPEchoFlowBuckets::merge zusammengefasst.
+ */
+
+UDPEchoFlowBuckets::UDPEchoFlowBuckets()
+{
+	flows=0;
+}
+
+/*!\brief Gruppen anlegen
+ *
+ * @param buckets Anzahl Gruppen, zwischen 1 und UDPEchoFlowBuckets::MaxBuckets
+ * @param flows Anzahl Flows über alle Threads, mindestens so viele wie Gruppen
+ * @exception ppl7::InvalidArgumentsException Ein Wert liegt ausserhalb des gültigen Bereichs
+ */
+void UDPEchoFlowBuckets::setup(size_t buckets, size_t flows)
+{
+	if (buckets<1 || buckets>MaxBuckets || flows<buckets)
+		throw ppl7::InvalidArgumentsException("UDPEchoFlowBuckets::setup");
+	this->buckets.clear();
+	this->buckets.resize(buckets);
+	this->flows=flows;
+}
+
+/*!\brief Alle Gruppen entfernen
+ */
+void UDPEchoFlowBuckets::clear()
+{
+	buckets.clear();
+	flows=0;
+}
+
+/*!\brief Zähler aller Gruppen auf 0 setzen
+ */
+void UDPEchoFlowBuckets::clearCounter()
+{
+	for (size_t i=0;i<buckets.size();i++) buckets[i].clear();
+}
+
+/*!\brief Messwerte einer anderen Kopie addieren
+ *
+ * Ist die Liste leer, wird \p other übernommen.
+ *
+ * @exception ppl7::InvalidArgumentsException Unterschiedliche Anzahl Gruppen
+ */
+void UDPEchoFlowBuckets::merge(const UDPEchoFlowBuckets &other)
+{
+	if (buckets.empty()) {
+		*this=other;
+		return;
+	}
+	if (other.buckets.size()!=buckets.size())
+		throw ppl7::InvalidArgumentsException("UDPEchoFlowBuckets::merge");
+	for (size_t i=0;i<buckets.size();i++) buckets[i].merge(other.buckets[i]);
+}
+
+/*!\brief Anzahl Flows über alle Threads
+ */
+size_t UDPEchoFlowBuckets::getFlowCount() const
+{
+	return flows;
+}
+
+/*!\brief Erster Flow der Gruppe \p bucket
+ *
+ * Der letzte Flow der Gruppe ist firstFlow(bucket+1)-1, für die letzte Gruppe liefert
+ * firstFlow(size()) die Anzahl Flows.
+ */
+size_t UDPEchoFlowBuckets::firstFlow(size_t bucket) const
+{
+	if (buckets.empty()) return 0;
+	return (size_t)(((uint64_t)bucket*flows+buckets.size()-1)/buckets.size());
+}
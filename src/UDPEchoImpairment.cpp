@@ -0,0 +1,201 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <stdint.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class UDPEchoImpairment
+ * \ingroup GroupBouncer
+ * \brief Simulation von Paketverlust, Duplikaten, Bitfehlern und Umsortierung
+ *
+ * Die Parameter werden als kommaseparierte Liste von Schlüssel=Wert-Paaren angegeben,
+ * alle Wahrscheinlichkeiten in Prozent:
+ * - \c loss=PCT: zufälliger Paketverlust
+ * - \c ge=P:R[:LOSSBAD[:LOSSGOOD]]: Burst-Verlust nach dem Gilbert-Elliott-Modell.
+ *   P ist die Übergangswahrscheinlichkeit vom guten in den schlechten Zustand,
+ *   R die vom schlechten in den guten. LOSSBAD (Default 100) und LOSSGOOD (Default 0)
+ *   sind die Verlustraten in den beiden Zuständen.
+ * - \c dup=PCT: Antwort wird doppelt verschickt
+ * - \c corrupt=PCT: ein zufälliges Bit der Nutzdaten wird gekippt
+ * - \c reorder=PCT: Antwort überholt die verzögerten Pakete. Wie bei netem ist dafür
+ *   eine Verzögerung (UDPEchoDelayModel) erforderlich.
+ *
+ * Jeder Worker-Thread erhält eine eigene Kopie, da der Zustand des Gilbert-Elliott-
+ * Modells pro Thread geführt wird.
+ */
+
+static uint64_t toThreshold(double probability)
+{
+	if (probability<=0.0) return 0;
+	if (probability>=1.0) return UINT64_MAX;
+	return (uint64_t)(probability*18446744073709551616.0);
+}
+
+static double parsePercent(const ppl7::String &value, const ppl7::String &spec)
+{
+	ppl7::String v=value.trimmed();
+	if (v.isEmpty()) throw ppl7::InvalidArgumentsException("Ungueltige Impairment-Angabe: %s", (const char*)spec);
+	double pct=v.toDouble();
+	if (pct<0.0 || pct>100.0)
+		throw ppl7::InvalidArgumentsException("Wahrscheinlichkeit muss zwischen 0 und 100 liegen: %s", (const char*)spec);
+	return pct/100.0;
+}
+
+/*!\brief Konstruktor
+ *
+ * Standardmäßig ist keine Störung aktiv.
+ */
+UDPEchoImpairment::UDPEchoImpairment()
+{
+	loss=duplicate=corrupt=reorder=0.0;
+	ge_p=ge_r=ge_lossGood=0.0;
+	ge_lossBad=1.0;
+	t_loss=t_duplicate=t_corrupt=t_reorder=0;
+	t_ge_p=t_ge_r=t_ge_lossBad=t_ge_lossGood=0;
+	gilbertElliott=false;
+	badState=false;
+	enabled=false;
+}
+
+/*!\brief Parameter aus String einlesen
+ *
+ * @param spec Liste der Störungen, siehe UDPEchoImpairment
+ *
+ * @exception ppl7::InvalidArgumentsException Wird bei einer ungültigen Angabe geworfen
+ */
+void UDPEchoImpairment::parse(const ppl7::String &spec)
+{
+	*this=UDPEchoImpairment();
+	if (spec.isEmpty()) return;
+	ppl7::Array list(spec,",");
+	for (size_t i=0;i<list.size();i++) {
+		ppl7::String item=list[i].trimmed();
+		if (item.isEmpty()) continue;
+		ssize_t p=item.instr("=");
+		if (p<1) throw ppl7::InvalidArgumentsException("Ungueltige Impairment-Angabe: %s", (const char*)item);
+		ppl7::String key=item.left(p).trimmed().toLowerCase();
+		ppl7::String value=item.mid(p+1);
+		if (key=="loss") loss=parsePercent(value,item);
+		else if (key=="dup") duplicate=parsePercent(value,item);
+		else if (key=="corrupt") corrupt=parsePercent(value,item);
+		else if (key=="reorder") reorder=parsePercent(value,item);
+		else if (key=="ge") {
+			ppl7::Array a(value,":");
+			if (a.size()<2 || a.size()>4) throw ppl7::InvalidArgumentsException("ge=P:R[:LOSSBAD[:LOSSGOOD]] erwartet: %s", (const char*)item);
+			gilbertElliott=true;
+			ge_p=parsePercent(a[0],item);
+			ge_r=parsePercent(a[1],item);
+			if (a.size()>2) ge_lossBad=parsePercent(a[2],item);
+			if (a.size()>3) ge_lossGood=parsePercent(a[3],item);
+		} else {
+			throw ppl7::InvalidArgumentsException("Unbekannte Impairment-Angabe: %s", (const char*)item);
+		}
+	}
+	t_loss=toThreshold(loss);
+	t_duplicate=toThreshold(duplicate);
+	t_corrupt=toThreshold(corrupt);
+	t_reorder=toThreshold(reorder);
+	t_ge_p=toThreshold(ge_p);
+	t_ge_r=toThreshold(ge_r);
+	t_ge_lossBad=toThreshold(ge_lossBad);
+	t_ge_lossGood=toThreshold(ge_lossGood);
+	enabled=(gilbertElliott || t_loss || t_duplicate || t_corrupt || t_reorder);
+}
+
+/*!\brief Ist mindestens eine Störung konfiguriert?
+ */
+bool UDPEchoImpairment::isEnabled() const
+{
+	return enabled;
+}
+
+/*!\brief Ist Umsortierung konfiguriert?
+ */
+bool UDPEchoImpairment::usesReorder() const
+{
+	return t_reorder>0;
+}
+
+/*!\brief Störungen für ein Paket auswürfeln
+ *
+ * Die Wahrscheinlichkeiten liegen als 64-Bit-Schwellwerte vor, so dass pro Störung
+ * nur ein Aufruf des Zufallszahlengenerators und ein Vergleich nötig ist.
+ *
+ * @param rng Zufallszahlengenerator des aufrufenden Threads
+ * @return Bitmaske aus UDPEchoImpairment::Action. Bei UDPEchoImpairment::DROP sind
+ * keine weiteren Bits gesetzt.
+ */
+int UDPEchoImpairment::decide(UDPEchoRandom &rng)
+{
+	if (gilbertElliott) {
+		if (badState) {
+			if (rng.next()<t_ge_r) badState=false;
+		} else {
+			if (rng.next()<t_ge_p) badState=true;
+		}
+		uint64_t t=badState ? t_ge_lossBad : t_ge_lossGood;
+		if (t && rng.next()<t) return DROP;
+	}
+	if (t_loss && rng.next()<t_loss) return DROP;
+	int action=PASS;
+	if (t_corrupt && rng.next()<t_corrupt) action|=CORRUPT;
+	if (t_duplicate && rng.next()<t_duplicate) action|=DUPLICATE;
+	if (t_reorder && rng.next()<t_reorder) action|=REORDER;
+	return action;
+}
+
+/*!\brief Ein zufälliges Bit im Paket kippen
+ *
+ * Der PACKET-Header mit ID und Zeitstempel bleibt unverändert, sofern das Paket
+ * größer ist, damit der Sender die Laufzeit weiterhin messen kann.
+ *
+ * @param data Pointer auf das Paket
+ * @param size Größe des Pakets
+ * @param rng Zufallszahlengenerator des aufrufenden Threads
+ */
+void UDPEchoImpairment::corruptPayload(void *data, size_t size, UDPEchoRandom &rng)
+{
+	if (!size) return;
+	size_t start=0;
+	if (size>sizeof(PACKET)) start=sizeof(PACKET);
+	uint64_t r=rng.next();
+	size_t pos=start+(size_t)((r>>3)%(uint64_t)(size-start));
+	((unsigned char*)data)[pos]^=(unsigned char)(1<<(r&7));
+}
+
+/*!\brief Beschreibung der Störungen für die Ausgabe
+ */
+ppl7::String UDPEchoImpairment::toString() const
+{
+	ppl7::String s;
+	s.setf("loss=%0.3f%%, dup=%0.3f%%, corrupt=%0.3f%%, reorder=%0.3f%%",
+			loss*100.0, duplicate*100.0, corrupt*100.0, reorder*100.0);
+	if (gilbertElliott) {
+		s.appendf(", gilbert-elliott p=%0.3f%% r=%0.3f%% loss bad=%0.3f%% good=%0.3f%%",
+				ge_p*100.0, ge_r*100.0, ge_lossBad*100.0, ge_lossGood*100.0);
+	}
+	return s;
+}
@@ -0,0 +1,176 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <ppl7.h>
+#include <string.h>
+
+#include "udpecho.h"
+#include "wire.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoLatencyHistogram
+ * \ingroup GroupSender
+ * \brief Histogramm der Paketlaufzeiten
+ *
+ * Log-lineares Histogramm mit Mikrosekunden als Einheit: Laufzeiten unter 32 µs
+ * werden exakt gezählt, darüber wird jede Zweierpotenz in 32 gleich breite Buckets
+ * aufgeteilt. Der relative Fehler eines Perzentils liegt damit unter 3 %.
+ *
+ * Das Zählen kostet nur eine Bit-Operation und ein Inkrement, es wird weder Speicher
+ * angefordert noch gesperrt. Jeder Receiver-Thread führt ein eigenes Histogramm, die
+ * Histogramme mehrerer Threads oder Agenten werden mit UDPEchoLatencyHistogram::merge
+ * zusammengeführt.
+ */
+
+UDPEchoLatencyHistogram::UDPEchoLatencyHistogram()
+{
+	clear();
+}
+
+void UDPEchoLatencyHistogram::clear()
+{
+	memset(bucket, 0, sizeof(bucket));
+	total=0;
+}
+
+/*!\brief Anderes Histogramm hinzuaddieren
+ */
+void UDPEchoLatencyHistogram::merge(const UDPEchoLatencyHistogram &other)
+{
+	for (int i=0;i<Buckets;i++) bucket[i]+=other.bucket[i];
+	total+=other.total;
+}
+
+/*!\brief Älteren Stand desselben Histogramms abziehen
+ *
+ * Liefert zusammen mit einer Kopie des Histogramms die Verteilung der Laufzeiten eines
+ * Intervalls. Da die Kopie gezogen wird, während der Receiver-Thread weiter zählt, werden
+ * negative Differenzen (z.B. nach einem Zurücksetzen) auf 0 begrenzt.
+ */
+void UDPEchoLatencyHistogram::subtract(const UDPEchoLatencyHistogram &other)
+{
+	total=0;
+	for (int i=0;i<Buckets;i++) {
+		bucket[i]=bucket[i]>other.bucket[i] ? bucket[i]-other.bucket[i] : 0;
+		total+=bucket[i];
+	}
+}
+
+/*!\brief Anzahl gezählter Laufzeiten
+ */
+uint64_t UDPEchoLatencyHistogram::count() const
+{
+	return total;
+}
+
+/*!\brief Untere Grenze eines Buckets in Mikrosekunden
+ */
+uint64_t UDPEchoLatencyHistogram::lowerBound(int index)
+{
+	if (index<SubBuckets) return (uint64_t)index;
+	int msb=index/SubBuckets+4;
+	return (uint64_t)(SubBuckets+index%SubBuckets)<<(msb-5);
+}
+
+/*!\brief Breite eines Buckets in Mikrosekunden
+ */
+uint64_t UDPEchoLatencyHistogram::bucketWidth(int index)
+{
+	if (index<SubBuckets) return 1;
+	return (uint64_t)1<<(index/SubBuckets-1);
+}
+
+/*!\brief Perzentil berechnen
+ *
+ * @param p Perzentil zwischen 0 und 100, z.B. 99.9
+ * @return Laufzeit in Sekunden (Mitte des Buckets) oder 0, wenn keine Werte gezählt wurden
+ */
+double UDPEchoLatencyHistogram::percentile(double p) const
+{
+	if (!total) return 0.0;
+	if (p<0.0) p=0.0;
+	if (p>100.0) p=100.0;
+	uint64_t rank=(uint64_t)((double)total*p/100.0+0.5);
+	if (rank<1) rank=1;
+	uint64_t sum=0;
+	for (int i=0;i<Buckets;i++) {
+		sum+=bucket[i];
+		if (sum>=rank) {
+			return ((double)lowerBound(i)+(double)(bucketWidth(i)-1)/2.0)/1000000.0;
+		}
+	}
+	return (double)lowerBound(Buckets-1)/1000000.0;
+}
+
+/*!\brief Größe des Histogramms im binären Format
+ *
+ * @return Anzahl Bytes, die UDPEchoLatencyHistogram::exportBinary benötigt
+ */
+size_t UDPEchoLatencyHistogram::binarySize() const
+{
+	return UDPEchoWire::HistogramSize+Buckets*8;
+}
+
+/*!\brief Histogramm im binären Format exportieren
+ *
+ * @param buffer Zielpuffer
+ * @param size Größe des Zielpuffers
+ * @return Anzahl geschriebener Bytes
+ * @exception ppl7::BufferTooSmallException Der Puffer ist zu klein
+ */
+size_t UDPEchoLatencyHistogram::exportBinary(void *buffer, size_t size) const
+{
+	size_t len=binarySize();
+	if (size<len) throw ppl7::BufferTooSmallException("UDPEchoLatencyHistogram::exportBinary");
+	unsigned char *p=(unsigned char*)buffer;
+	UDPEchoWire::putHeader(p, UDPEchoWire::RECORD_HISTOGRAM, len);
+	UDPEchoWire::put32(p+8, Buckets);
+	UDPEchoWire::put32(p+12, SubBuckets);
+	p+=UDPEchoWire::HistogramSize;
+	for (int i=0;i<Buckets;i++) UDPEchoWire::put64(p+8*i, bucket[i]);
+	return len;
+}
+
+/*!\brief Histogramm aus dem binären Format importieren
+ *
+ * @param buffer Pointer auf den Datensatz
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @return Länge des Datensatzes in Bytes
+ * @exception ppl7::InvalidFormatException Kein gültiger Datensatz oder abweichende Aufteilung der Buckets
+ */
+size_t UDPEchoLatencyHistogram::importBinary(const void *buffer, size_t size)
+{
+	size_t len=UDPEchoWire::checkRecord(buffer, size, UDPEchoWire::RECORD_HISTOGRAM);
+	const unsigned char *p=(const unsigned char*)buffer;
+	if (UDPEchoWire::get32(p+8)!=(uint32_t)Buckets || UDPEchoWire::get32(p+12)!=(uint32_t)SubBuckets
+			|| len<binarySize())
+		throw ppl7::InvalidFormatException("UDPEchoLatencyHistogram: abweichende Bucket-Aufteilung");
+	p+=UDPEchoWire::HistogramSize;
+	total=0;
+	for (int i=0;i<Buckets;i++) {
+		bucket[i]=UDPEchoWire::get64(p+8*i);
+		total+=bucket[i];
+	}
+	return len;
+}
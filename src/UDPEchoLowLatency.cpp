@@ -0,0 +1,177 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "udpecho.h"
+
+// Ältere Header kennen die Option noch nicht (Linux >= 5.11)
+#if defined(__linux__) && !defined(SO_PREFER_BUSY_POLL)
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+/*!@file
+ * \brief Latenzarmer Betrieb der Empfangsschleifen
+ */
+
+/*!\class UDPEchoLowLatency
+ * \brief Einstellungen für latenzarme Laufzeitmessungen
+ *
+ * Bei niedriger Paketrate wird die gemessene Laufzeit vor allem davon bestimmt, wie
+ * lange es dauert, bis ein schlafender Thread nach Eintreffen eines Pakets wieder
+ * läuft. Im latenzarmen Modus schlafen die Empfangsschleifen nicht mehr in pselect oder
+ * epoll_wait, sondern fragen den Socket ohne zu blockieren in einer Schleife ab und
+ * führen dazwischen nur eine Pause-Instruktion aus (siehe UDPEchoLowLatency::relax).
+ * Zusätzlich wird auf den Sockets SO_BUSY_POLL und SO_PREFER_BUSY_POLL gesetzt, damit der
+ * Kernel die Queue der Netzwerkkarte direkt im recv-Aufruf abarbeitet, statt auf den
+ * Interrupt zu warten. Optional laufen die messenden Threads unter SCHED_FIFO.
+ *
+ * Jeder wartende Thread belegt dabei einen CPU-Kern vollständig. Der Modus ist daher nur
+ * sinnvoll, wenn mindestens so viele Kerne frei sind, wie Threads warten.
+ *
+ * Die Einstellungen gelten wie bei UDPEchoPerfCounter für alle Threads und werden zu
+ * Beginn jedes Laufs in deren run-Methode ausgewertet.
+ */
+
+bool UDPEchoLowLatency::enabled=false;
+bool UDPEchoLowLatency::realtime=false;
+int UDPEchoLowLatency::busyPollUsec=UDPEchoLowLatency::DefaultBusyPollUsec;
+int UDPEchoLowLatency::realtimeFailed=0;
+
+/*!\brief Latenzarmen Modus für alle Threads ein- oder ausschalten
+ *
+ * @param flag True oder False (Default)
+ */
+void UDPEchoLowLatency::setEnabled(bool flag)
+{
+	enabled=flag;
+}
+
+bool UDPEchoLowLatency::isEnabled()
+{
+	return enabled;
+}
+
+/*!\brief Dauer des Busy-Pollings im Kernel festlegen
+ *
+ * @param usec Mikrosekunden, die ein recv-Aufruf die Queue der Netzwerkkarte abfragt
+ * (Default=50)
+ */
+void UDPEchoLowLatency::setBusyPollTimeout(int usec)
+{
+	busyPollUsec=usec>0 ? usec : DefaultBusyPollUsec;
+}
+
+int UDPEchoLowLatency::getBusyPollTimeout()
+{
+	return busyPollUsec;
+}
+
+/*!\brief Messende Threads im latenzarmen Modus unter SCHED_FIFO laufen lassen
+ *
+ * @param flag True oder False (Default)
+ */
+void UDPEchoLowLatency::setRealtime(bool flag)
+{
+	realtime=flag;
+}
+
+bool UDPEchoLowLatency::isRealtime()
+{
+	return realtime;
+}
+
+/*!\brief Busy-Polling auf einem Socket ein- oder ausschalten
+ *
+ * Ist der latenzarme Modus aktiv, werden SO_BUSY_POLL und SO_PREFER_BUSY_POLL gesetzt,
+ * andernfalls zurückgesetzt. Werte oberhalb von net.core.busy_read erfordern
+ * CAP_NET_ADMIN, ohne diese Berechtigung bleibt es beim Polling im Userspace.
+ *
+ * @param fd Socket
+ * @return \c true, wenn der Kernel SO_BUSY_POLL für den Socket akzeptiert hat
+ */
+bool UDPEchoLowLatency::configureSocket(int fd)
+{
+#ifdef SO_BUSY_POLL
+	int usec=enabled ? busyPollUsec : 0;
+	int prefer=enabled ? 1 : 0;
+	bool ok=(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec))==0);
+	setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+	return ok && enabled;
+#else
+	return false;
+#endif
+}
+
+/*!\brief Prüfen, ob der Kernel Busy-Polling auf Sockets erlaubt
+ *
+ * Legt dazu einen temporären UDP-Socket an.
+ *
+ * @return Beschreibung für die Ausgabe beim Start
+ */
+ppl7::String UDPEchoLowLatency::probe()
+{
+	ppl7::String report;
+	report.setf("busy-poll %d us", busyPollUsec);
+#ifdef SO_BUSY_POLL
+	int fd=::socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd<0) return report;
+	int usec=busyPollUsec;
+	int prefer=1;
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec))==0) report.append(", SO_BUSY_POLL ok");
+	else report.appendf(", SO_BUSY_POLL nicht erlaubt (%s)", strerror(errno));
+	if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer))==0) report.append(", SO_PREFER_BUSY_POLL ok");
+	else report.appendf(", SO_PREFER_BUSY_POLL nicht erlaubt (%s)", strerror(errno));
+	::close(fd);
+#else
+	report.append(", SO_BUSY_POLL nicht unterstuetzt");
+#endif
+	if (realtime) report.append(", SCHED_FIFO");
+	return report;
+}
+
+/*!\brief Scheduling des aufrufenden Threads anpassen
+ *
+ * Wird von den messenden Threads zu Beginn jedes Laufs aufgerufen. Wurde
+ * UDPEchoLowLatency::setRealtime gesetzt, läuft der Thread im latenzarmen Modus unter
+ * SCHED_FIFO und sonst wieder mit normaler Priorität. Ohne ausreichende Rechte bleibt
+ * es beim bisherigen Scheduling, was UDPEchoLowLatency::getRealtimeFailures zählt.
+ */
+void UDPEchoLowLatency::applyScheduling()
+{
+	if (!realtime) return;
+	try {
+		ppl7::ThreadSetPriority(ppl7::Thread::ABOVE_NORMAL, enabled);
+	} catch (const ppl7::Exception &) {
+		if (enabled) __atomic_add_fetch(&realtimeFailed, 1, __ATOMIC_RELAXED);
+	}
+}
+
+/*!\brief Anzahl Threads, die nicht unter SCHED_FIFO wechseln durften
+ */
+int UDPEchoLowLatency::getRealtimeFailures()
+{
+	return __atomic_load_n(&realtimeFailed, __ATOMIC_RELAXED);
+}
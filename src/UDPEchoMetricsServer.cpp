@@ -0,0 +1,226 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+#include <string.h>
+
+#include "metrics.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class UDPEchoMetricsServer
+ * \ingroup GroupBouncer
+ * \brief HTTP-Endpunkt mit den Zählern des Bouncers im OpenMetrics-Format
+ *
+ * Für lang laufende Bouncer, z.B. als Reflektor im Docker-Container. Ein einzelner Thread
+ * nimmt HTTP-Anfragen entgegen und beantwortet "GET /metrics" mit den seit dem Start
+ * kumulierten Zählern aller Worker-Threads sowie den Sensordaten des Systems als
+ * OpenMetrics-Text. Jede Verbindung wird nach der Antwort geschlossen.
+ *
+ * Die Zähler werden über UDPEchoBouncer::getTotalCounter ohne Lock auf die Worker-Threads
+ * gelesen, ein Scrape beeinflusst weder die Echo-Threads noch die sekündlichen Messungen
+ * oder den Steuerkanal.
+ */
+
+UDPEchoMetricsServer::UDPEchoMetricsServer(UDPEchoBouncer &bouncer)
+	: bouncer(bouncer)
+{
+	startTime=ppl7::GetMicrotime();
+}
+
+UDPEchoMetricsServer::~UDPEchoMetricsServer()
+{
+	stop();
+}
+
+/*!\brief Endpunkt starten
+ *
+ * @param host_and_port Adresse und Port, an die sich der Endpunkt binden soll
+ */
+void UDPEchoMetricsServer::start(const ppl7::String &host_and_port)
+{
+	ppl7::Array a(host_and_port, ":");
+	if (a.size()!=2 || a[1].toInt()<=0)
+		throw ppl7::InvalidArgumentsException("Ungueltige Adresse fuer den Metrics-Endpunkt: %s", (const char*)host_and_port);
+	startTime=ppl7::GetMicrotime();
+	bind(a[0], a[1].toInt());
+	threadStart();
+}
+
+/*!\brief Endpunkt beenden
+ */
+void UDPEchoMetricsServer::stop()
+{
+	if (threadIsRunning()) {
+		signalStopListen();
+		threadStop();
+	}
+}
+
+void UDPEchoMetricsServer::run()
+{
+	threadSetName("UDPEchoMetricsServer");
+	listen(16, 100);
+}
+
+static void counterHeader(ppl7::String &body, const char *name, const char *help)
+{
+	body.appendf("# TYPE %s counter\n# HELP %s %s\n", name, name, help);
+}
+
+static void gaugeHeader(ppl7::String &body, const char *name, const char *help)
+{
+	body.appendf("# TYPE %s gauge\n# HELP %s %s\n", name, name, help);
+}
+
+static void renderNetwork(ppl7::String &body, const char *name, const char *help, const SystemStat &stat,
+		unsigned long SystemStat::Network::*field, bool transmit)
+{
+	counterHeader(body, name, help);
+	std::map<ppl7::String, SystemStat::Interface>::const_iterator it;
+	for (it=stat.interfaces.begin();it!=stat.interfaces.end();++it) {
+		const SystemStat::Network &net=transmit ? it->second.transmit : it->second.receive;
+		body.appendf("%s_total{interface=\"%s\"} %lu\n", name, (const char*)it->first, net.*field);
+	}
+}
+
+/*!\brief Metriken im OpenMetrics-Textformat erzeugen
+ *
+ * @param body Nimmt den Text inklusive abschließendem "# EOF" auf
+ */
+void UDPEchoMetricsServer::render(ppl7::String &body)
+{
+	UDPEchoCounter c=bouncer.getTotalCounter();
+	SystemStat stat;
+	sampleSensorData(stat);
+	body.clear();
+	gaugeHeader(body, "udppingpong_start_time_seconds", "Startzeitpunkt des Bouncers als Unix-Zeit");
+	body.appendf("udppingpong_start_time_seconds %0.3f\n", startTime);
+	gaugeHeader(body, "udppingpong_threads", "Anzahl Worker-Threads");
+	body.appendf("udppingpong_threads %zu\n", bouncer.getThreadCount());
+	counterHeader(body, "udppingpong_packets_received", "Empfangene Pakete");
+	body.appendf("udppingpong_packets_received_total %ld\n", c.packets_received);
+	counterHeader(body, "udppingpong_packets_send", "Verschickte Antworten");
+	body.appendf("udppingpong_packets_send_total %ld\n", c.packets_send);
+	counterHeader(body, "udppingpong_bytes_received", "Empfangene Bytes");
+	body.appendf("udppingpong_bytes_received_total %ld\n", c.bytes_received);
+	counterHeader(body, "udppingpong_bytes_send", "Verschickte Bytes");
+	body.appendf("udppingpong_bytes_send_total %ld\n", c.bytes_send);
+	counterHeader(body, "udppingpong_packets_truncated", "Abgeschnittene Pakete");
+	body.appendf("udppingpong_packets_truncated_total %ld\n", c.packets_truncated);
+	counterHeader(body, "udppingpong_packets_queue_overflow", "Wegen voller Delay-Queue verworfene Pakete");
+	body.appendf("udppingpong_packets_queue_overflow_total %ld\n", c.packets_queue_overflow);
+	counterHeader(body, "udppingpong_packets_send_failed", "Antworten, die nicht verschickt werden konnten");
+	body.appendf("udppingpong_packets_send_failed_total %ld\n", c.packets_send_failed);
+	counterHeader(body, "udppingpong_packets_impaired", "Durch --impair gestoerte Antworten");
+	body.appendf("udppingpong_packets_impaired_total{action=\"drop\"} %ld\n", c.packets_impair_dropped);
+	body.appendf("udppingpong_packets_impaired_total{action=\"duplicate\"} %ld\n", c.packets_impair_duplicated);
+	body.appendf("udppingpong_packets_impaired_total{action=\"corrupt\"} %ld\n", c.packets_impair_corrupted);
+	body.appendf("udppingpong_packets_impaired_total{action=\"reorder\"} %ld\n", c.packets_impair_reordered);
+	counterHeader(body, "udppingpong_packets_dns_invalid", "Pakete, die keine gueltige DNS-Anfrage waren");
+	body.appendf("udppingpong_packets_dns_invalid_total %ld\n", c.packets_dns_invalid);
+	counterHeader(body, "udppingpong_packets_socket_dropped", "Im Empfangspuffer der Sockets verworfene Pakete");
+	body.appendf("udppingpong_packets_socket_dropped_total %ld\n", c.packets_socket_dropped);
+
+	counterHeader(body, "udppingpong_cpu_ticks", "CPU-Zeit des Systems in Clock-Ticks");
+	body.appendf("udppingpong_cpu_ticks_total{mode=\"user\"} %d\n", stat.cpu.user);
+	body.appendf("udppingpong_cpu_ticks_total{mode=\"nice\"} %d\n", stat.cpu.nice);
+	body.appendf("udppingpong_cpu_ticks_total{mode=\"system\"} %d\n", stat.cpu.system);
+	body.appendf("udppingpong_cpu_ticks_total{mode=\"idle\"} %d\n", stat.cpu.idle);
+	body.appendf("udppingpong_cpu_ticks_total{mode=\"iowait\"} %d\n", stat.cpu.iowait);
+	gaugeHeader(body, "udppingpong_memory_free_bytes", "Freier Arbeitsspeicher");
+	body.appendf("udppingpong_memory_free_bytes %ld\n", stat.sysinfo.freeram);
+	gaugeHeader(body, "udppingpong_memory_total_bytes", "Gesamter Arbeitsspeicher");
+	body.appendf("udppingpong_memory_total_bytes %ld\n", stat.sysinfo.totalram);
+
+	counterHeader(body, "udppingpong_udp_datagrams", "Datagramme des UDP-Stacks des Hosts (UDP-MIB, alle Prozesse)");
+	body.appendf("udppingpong_udp_datagrams_total{direction=\"in\"} %lu\n", stat.udp.InDatagrams);
+	body.appendf("udppingpong_udp_datagrams_total{direction=\"out\"} %lu\n", stat.udp.OutDatagrams);
+	counterHeader(body, "udppingpong_udp_errors", "Fehler des UDP-Stacks des Hosts (UDP-MIB, alle Prozesse)");
+	body.appendf("udppingpong_udp_errors_total{type=\"in\"} %lu\n", stat.udp.InErrors);
+	body.appendf("udppingpong_udp_errors_total{type=\"rcvbuf\"} %lu\n", stat.udp.RcvbufErrors);
+	body.appendf("udppingpong_udp_errors_total{type=\"sndbuf\"} %lu\n", stat.udp.SndbufErrors);
+	body.appendf("udppingpong_udp_errors_total{type=\"noport\"} %lu\n", stat.udp.NoPorts);
+
+	renderNetwork(body, "udppingpong_net_receive_bytes", "Empfangene Bytes pro Interface", stat, &SystemStat::Network::bytes, false);
+	renderNetwork(body, "udppingpong_net_receive_packets", "Empfangene Pakete pro Interface", stat, &SystemStat::Network::packets, false);
+	renderNetwork(body, "udppingpong_net_receive_errs", "Empfangsfehler pro Interface", stat, &SystemStat::Network::errs, false);
+	renderNetwork(body, "udppingpong_net_receive_drop", "Beim Empfang verworfene Pakete pro Interface", stat, &SystemStat::Network::drop, false);
+	renderNetwork(body, "udppingpong_net_transmit_bytes", "Gesendete Bytes pro Interface", stat, &SystemStat::Network::bytes, true);
+	renderNetwork(body, "udppingpong_net_transmit_packets", "Gesendete Pakete pro Interface", stat, &SystemStat::Network::packets, true);
+	renderNetwork(body, "udppingpong_net_transmit_errs", "Sendefehler pro Interface", stat, &SystemStat::Network::errs, true);
+	renderNetwork(body, "udppingpong_net_transmit_drop", "Beim Senden verworfene Pakete pro Interface", stat, &SystemStat::Network::drop, true);
+	body.append("# EOF\n");
+}
+
+static void sendResponse(ppl7::TCPSocket *socket, const char *status, const char *content_type, const ppl7::String &body)
+{
+	ppl7::String header;
+	header.setf("HTTP/1.1 %s\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n"
+			"\r\n", status, content_type, body.size());
+	socket->write(header);
+	if (body.size()) socket->write(body);
+}
+
+/*!\brief HTTP-Anfrage beantworten
+ *
+ * Liest den Request-Header mit einem Timeout von 2 Sekunden, beantwortet ihn und
+ * schließt anschließend die Verbindung.
+ *
+ * @return 0, der Socket wird anschließend von ppl7::TCPSocket::listen gelöscht
+ */
+int UDPEchoMetricsServer::receiveConnect(ppl7::TCPSocket *socket, const ppl7::String &host, int port)
+{
+	try {
+		char buffer[MaxRequestSize+1];
+		size_t size=0;
+		double timeout=ppl7::GetMicrotime()+2.0;
+		buffer[0]=0;
+		while (strstr(buffer, "\r\n\r\n")==NULL && strstr(buffer, "\n\n")==NULL) {
+			if (size>=MaxRequestSize || ppl7::GetMicrotime()>timeout || threadShouldStop()) return 0;
+			if (!socket->waitForIncomingData(0, 100000)) continue;
+			size_t n=socket->read(buffer+size, MaxRequestSize-size);
+			if (n==0) return 0;
+			size+=n;
+			buffer[size]=0;
+		}
+		ppl7::String body;
+		if (strncmp(buffer, "GET ", 4)!=0) {
+			body="Method Not Allowed\n";
+			sendResponse(socket, "405 Method Not Allowed", "text/plain; charset=utf-8", body);
+		} else if (strncmp(buffer+4, "/metrics", 8)==0 && (buffer[12]==' ' || buffer[12]=='?')) {
+			render(body);
+			sendResponse(socket, "200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8", body);
+		} else {
+			body="Not Found, try /metrics\n";
+			sendResponse(socket, "404 Not Found", "text/plain; charset=utf-8", body);
+		}
+	} catch (const ppl7::Exception &) {
+		// Verbindung getrennt
+	}
+	return 0;
+}
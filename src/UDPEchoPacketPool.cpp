@@ -0,0 +1,164 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \brief Pool für Paketpuffer
+ */
+
+/*!\class UDPEchoPacketPool
+ * \brief Pool für die Paketpuffer eines Worker-Threads
+ *
+ * Alle Empfangs- und Sendepuffer der Worker-Threads stammen aus einem Pool mit einer
+ * festen Anzahl gleich großer Slots. Die Slots beginnen an einer Cache-Line, damit sich
+ * zwei Puffer keine Cache-Line teilen, und liegen nach Möglichkeit auf 2 MiB großen
+ * Huge Pages (siehe ppl7::MemoryHeap::setHugePages), was die TLB-Misses bei vielen
+ * Puffern senkt.
+ *
+ * Jeder Thread besitzt seinen eigenen Pool und legt ihn erst in seiner run-Methode mit
+ * UDPEchoPacketPool::allocate an. Der Speicher wird dadurch vom Thread selbst zum
+ * ersten Mal beschrieben und vom Kernel auf dem NUMA-Knoten angelegt, auf dem der
+ * Thread läuft. Da nur ein Thread auf den Pool zugreift, ist keine Sperre nötig.
+ *
+ * Ist der Pool erschöpft, liefert UDPEchoPacketPool::acquire NULL und zählt das
+ * Ereignis, der Aufrufer muss das Paket dann verwerfen oder zurückstellen.
+ */
+
+bool UDPEchoPacketPool::hugePages=true;
+
+UDPEchoPacketPool::Stats::Stats()
+{
+	clear();
+}
+
+void UDPEchoPacketPool::Stats::clear()
+{
+	slots=0;
+	slotsize=0;
+	in_use=0;
+	peak=0;
+	acquired=0;
+	exhausted=0;
+}
+
+/*!\brief Werte eines weiteren Pools addieren
+ *
+ * Die Slotgröße ist das Maximum beider Pools.
+ */
+void UDPEchoPacketPool::Stats::add(const Stats &other)
+{
+	slots+=other.slots;
+	if (other.slotsize>slotsize) slotsize=other.slotsize;
+	in_use+=other.in_use;
+	peak+=other.peak;
+	acquired+=other.acquired;
+	exhausted+=other.exhausted;
+}
+
+UDPEchoPacketPool::UDPEchoPacketPool()
+{
+	heap=NULL;
+}
+
+UDPEchoPacketPool::~UDPEchoPacketPool()
+{
+	clear();
+}
+
+/*!\brief Huge Pages für alle danach angelegten Pools ein- oder ausschalten
+ *
+ * Default ist eingeschaltet. Huge Pages werden nur für Pools ab
+ * UDPEchoPacketPool::HugePageThreshold Bytes verwendet. Stehen keine Huge Pages zur
+ * Verfügung, wird normaler Speicher verwendet.
+ *
+ * @param flag True oder False
+ */
+void UDPEchoPacketPool::setHugePages(bool flag)
+{
+	hugePages=flag;
+}
+
+bool UDPEchoPacketPool::usesHugePages()
+{
+	return hugePages;
+}
+
+/*!\brief Slots anlegen
+ *
+ * Gibt einen bereits angelegten Pool frei und legt \p slots Puffer mit je \p slotsize
+ * Bytes an, aufgerundet auf ganze Cache-Lines. Alle vorher ausgegebenen Puffer
+ * verlieren ihre Gültigkeit.
+ *
+ * @param slots Anzahl Puffer
+ * @param slotsize Größe eines Puffers in Bytes
+ * @exception ppl7::InvalidArgumentsException \p slots oder \p slotsize ist 0
+ * @exception ppl7::OutOfMemoryException Nicht genug Speicher
+ */
+void UDPEchoPacketPool::allocate(size_t slots, size_t slotsize)
+{
+	if (!slots || !slotsize) throw ppl7::InvalidArgumentsException("UDPEchoPacketPool::allocate");
+	clear();
+	heap=new ppl7::MemoryHeap();
+	heap->setAlignment(CacheLineSize);
+	// Einzelne Puffer rechtfertigen keine 2 MiB große Seite
+	heap->setHugePages(hugePages && slots*slotsize>=HugePageThreshold);
+	heap->init(slotsize, slots, slots);
+	stats.slots=slots;
+	stats.slotsize=heap->elementSize();
+}
+
+/*!\brief Pool freigeben
+ *
+ * Alle ausgegebenen Puffer verlieren ihre Gültigkeit. Die Zähler werden zurückgesetzt.
+ */
+void UDPEchoPacketPool::clear()
+{
+	delete heap;
+	heap=NULL;
+	stats.clear();
+}
+
+/*!\brief Größe eines Puffers in Bytes
+ */
+size_t UDPEchoPacketPool::getSlotSize() const
+{
+	return stats.slotsize;
+}
+
+/*!\brief Anzahl Puffer im Pool
+ */
+size_t UDPEchoPacketPool::getCapacity() const
+{
+	return stats.slots;
+}
+
+/*!\brief Füllstand und Zähler auslesen
+ *
+ * Darf auch von einem anderen Thread aufgerufen werden, die Werte sind dann eine
+ * Momentaufnahme.
+ */
+UDPEchoPacketPool::Stats UDPEchoPacketPool::getStats() const
+{
+	return stats;
+}
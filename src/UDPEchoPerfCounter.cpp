@@ -0,0 +1,260 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "udpecho.h"
+
+/*!@file
+ * \brief Zähler der Performance Monitoring Unit
+ */
+
+/*!\class UDPEchoPerfCounter
+ * \brief Zähler der Performance Monitoring Unit für den aufrufenden Thread
+ *
+ * Öffnet per perf_event_open die Hardware-Zähler für Instruktionen, Takte und
+ * Cache-Misses sowie die Software-Zähler für Kontextwechsel und die verbrauchte
+ * CPU-Zeit (task-clock). Gezählt wird nur der Thread, der UDPEchoPerfCounter::open
+ * aufruft, auslesen darf ihn aber jeder Thread.
+ *
+ * In virtuellen Maschinen ohne PMU stehen die Hardware-Zähler nicht zur Verfügung,
+ * dann werden nur die Software-Zähler geöffnet. Teilen sich mehr Zähler die PMU als
+ * sie Register hat, rechnet UDPEchoPerfCounter::read die Werte anhand der Laufzeit
+ * hoch.
+ */
+
+bool UDPEchoPerfCounter::enabled=false;
+
+UDPEchoPerfCounter::Values::Values()
+{
+	clear();
+}
+
+void UDPEchoPerfCounter::Values::clear()
+{
+	for (int i=0;i<NUM_EVENTS;i++) {
+		value[i]=0;
+		valid[i]=false;
+	}
+}
+
+/*!\brief Werte eines weiteren Threads addieren
+ *
+ * Ein Ereignis bleibt gültig, wenn es in mindestens einem der beiden Objekte gültig ist.
+ */
+void UDPEchoPerfCounter::Values::add(const Values &other)
+{
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (!other.valid[i]) continue;
+		value[i]+=other.value[i];
+		valid[i]=true;
+	}
+}
+
+/*!\brief Differenz zweier Messungen
+ *
+ * Gültig sind nur Ereignisse, die in beiden Messungen gültig sind.
+ */
+UDPEchoPerfCounter::Values UDPEchoPerfCounter::Values::getDelta(const Values &sample1, const Values &sample2)
+{
+	Values d;
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (!sample1.valid[i] || !sample2.valid[i]) continue;
+		d.value[i]=sample2.value[i]>=sample1.value[i] ? sample2.value[i]-sample1.value[i] : 0;
+		d.valid[i]=true;
+	}
+	return d;
+}
+
+//! Liefert \c true, wenn mindestens ein Ereignis gezählt wurde
+bool UDPEchoPerfCounter::Values::isValid() const
+{
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (valid[i]) return true;
+	}
+	return false;
+}
+
+/*!\brief Werte als kommaseparierte Liste, ungültige Ereignisse als -1
+ */
+ppl7::String UDPEchoPerfCounter::Values::toString() const
+{
+	ppl7::String s;
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (i) s.append(",");
+		if (valid[i]) s.appendf("%lu", value[i]);
+		else s.append("-1");
+	}
+	return s;
+}
+
+/*!\brief Werte aus einer Liste von UDPEchoPerfCounter::Values::toString übernehmen
+ */
+void UDPEchoPerfCounter::Values::fromString(const ppl7::String &s)
+{
+	clear();
+	ppl7::Array list=ppl7::StrTok(s, ",");
+	for (size_t i=0;i<list.size() && i<(size_t)NUM_EVENTS;i++) {
+		ppl7::String v=ppl7::Trim(list[i]);
+		if (v.isEmpty() || v[0]=='-') continue;
+		value[i]=(uint64_t)v.toUnsignedInt64();
+		valid[i]=true;
+	}
+}
+
+/*!\brief Kosten pro Paket auf der Konsole ausgeben
+ *
+ * @param label Bezeichnung der Schleife, die gemessen wurde
+ * @param packets Anzahl Pakete, die die Schleife verarbeitet hat
+ */
+void UDPEchoPerfCounter::Values::print(const char *label, int64_t packets) const
+{
+	if (!isValid()) return;
+	double pkts=packets>0 ? (double)packets : 1.0;
+	ppl7::String line;
+	line.setf("%-18s", label);
+	if (valid[INSTRUCTIONS]) line.appendf("instr/pkt: %0.1f, ", (double)value[INSTRUCTIONS]/pkts);
+	else line.append("instr/pkt: n/a, ");
+	if (valid[CYCLES]) line.appendf("cycles/pkt: %0.1f, ", (double)value[CYCLES]/pkts);
+	else line.append("cycles/pkt: n/a, ");
+	if (valid[INSTRUCTIONS] && valid[CYCLES] && value[CYCLES]>0)
+		line.appendf("IPC: %0.2f, ", (double)value[INSTRUCTIONS]/(double)value[CYCLES]);
+	if (valid[CACHE_MISSES]) line.appendf("cache-misses/pkt: %0.3f, ", (double)value[CACHE_MISSES]/pkts);
+	else line.append("cache-misses/pkt: n/a, ");
+	if (valid[CONTEXT_SWITCHES]) line.appendf("ctx-switches: %lu, ", value[CONTEXT_SWITCHES]);
+	if (valid[TASK_CLOCK]) line.appendf("cpu: %0.3f us/pkt", (double)value[TASK_CLOCK]/pkts/1000.0);
+	line.trimRight(", ");
+	printf ("%s\n", (const char*)line);
+}
+
+UDPEchoPerfCounter::UDPEchoPerfCounter()
+{
+	for (int i=0;i<NUM_EVENTS;i++) fd[i]=-1;
+}
+
+UDPEchoPerfCounter::~UDPEchoPerfCounter()
+{
+	close();
+}
+
+/*!\brief Messung für alle Threads ein- oder ausschalten
+ *
+ * Muss vor dem Start der Worker-Threads aufgerufen werden.
+ */
+void UDPEchoPerfCounter::setEnabled(bool flag)
+{
+	enabled=flag;
+}
+
+//! Liefert \c true, wenn die Worker-Threads ihre Schleifen messen sollen
+bool UDPEchoPerfCounter::isEnabled()
+{
+	return enabled;
+}
+
+#ifdef __linux__
+static int openEvent(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size=sizeof(attr);
+	attr.type=type;
+	attr.config=config;
+	attr.read_format=PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_hv=1;
+	int fd=(int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd<0 && (errno==EACCES || errno==EPERM)) {
+		// perf_event_paranoid erlaubt ohne Rechte nur die Messung im User-Space
+		attr.exclude_kernel=1;
+		fd=(int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	}
+	return fd;
+}
+#endif
+
+/*!\brief Zähler für den aufrufenden Thread öffnen und starten
+ *
+ * @return \c true, wenn mindestens ein Ereignis gezählt wird
+ */
+bool UDPEchoPerfCounter::open()
+{
+	close();
+#ifdef __linux__
+	fd[INSTRUCTIONS]=openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	fd[CYCLES]=openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	fd[CACHE_MISSES]=openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	fd[CONTEXT_SWITCHES]=openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+	fd[TASK_CLOCK]=openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+#endif
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (fd[i]>=0) return true;
+	}
+	return false;
+}
+
+/*!\brief Zählung anhalten
+ *
+ * Die Werte bleiben erhalten und können weiterhin gelesen werden.
+ */
+void UDPEchoPerfCounter::stop()
+{
+#ifdef __linux__
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (fd[i]>=0) ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+#endif
+}
+
+void UDPEchoPerfCounter::close()
+{
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (fd[i]>=0) ::close(fd[i]);
+		fd[i]=-1;
+	}
+}
+
+/*!\brief Zähler auslesen
+ *
+ * @param values Nimmt die Werte auf, Ereignisse ohne geöffneten Zähler sind ungültig
+ */
+void UDPEchoPerfCounter::read(Values &values) const
+{
+	values.clear();
+	for (int i=0;i<NUM_EVENTS;i++) {
+		if (fd[i]<0) continue;
+		uint64_t data[3];
+		if (::read(fd[i], data, sizeof(data))!=(ssize_t)sizeof(data)) continue;
+		// data[0]: Wert, data[1]: Zeit aktiviert, data[2]: Zeit tatsächlich gezählt
+		if (data[2]>0 && data[2]<data[1])
+			data[0]=(uint64_t)((double)data[0]*(double)data[1]/(double)data[2]);
+		values.value[i]=data[0];
+		values.valid[i]=true;
+	}
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <stdint.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupBouncer
+ */
+
+/*!\class UDPEchoRandom
+ * \ingroup GroupBouncer
+ * \brief Schneller Pseudo-Zufallszahlengenerator
+ *
+ * xorshift128+ nach Sebastiano Vigna. Der Generator ist nicht kryptografisch sicher,
+ * liefert aber mit wenigen Instruktionen pro Aufruf ausreichend gute Zufallszahlen
+ * für Verzögerungs- und Impairment-Modelle.
+ */
+
+/*!\brief Konstruktor
+ *
+ * Der Generator wird mit der aktuellen Uhrzeit und der Adresse der Instanz initialisiert,
+ * damit sich die Zahlenfolgen verschiedener Threads unterscheiden.
+ */
+UDPEchoRandom::UDPEchoRandom()
+{
+	seed((uint64_t)(ppl7::GetMicrotime()*1000000.0) ^ (uint64_t)(uintptr_t)this);
+}
+
+/*!\brief Generator initialisieren
+ *
+ * Der interne Zustand wird mittels splitmix64 aus \p value abgeleitet, so dass auch
+ * ähnliche Startwerte zu völlig unterschiedlichen Zahlenfolgen führen.
+ *
+ * @param value Startwert
+ */
+void UDPEchoRandom::seed(uint64_t value)
+{
+	for (int i=0;i<2;i++) {
+		value+=0x9E3779B97F4A7C15ULL;
+		uint64_t z=value;
+		z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+		z=(z^(z>>27))*0x94D049BB133111EBULL;
+		s[i]=z^(z>>31);
+	}
+	if (s[0]==0 && s[1]==0) s[0]=1;
+}
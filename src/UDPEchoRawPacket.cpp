@@ -0,0 +1,395 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoRawPacket
+ * \ingroup GroupSender
+ * \brief IP- und UDP-Header für den Raw-Socket-Sender mit wechselnden Quelladressen
+ *
+ * Im Raw-Modus des Senders (siehe UDPEchoSenderThread::setRawPacket) erzeugt diese Klasse
+ * die IPv4- bzw. IPv6- und UDP-Header der Pakete selbst. Jedes Paket erhält reihum die
+ * nächste Adresse aus einem Netz als Quelladresse, so dass sich gegenüber dem Bouncer
+ * Millionen verschiedener Clients simulieren lassen.
+ *
+ * Der Puffer eines Pakets beginnt mit den Headern (UDPEchoRawPacket::getHeaderSize Bytes),
+ * direkt dahinter folgt die Payload. UDPEchoRawPacket::prepare schreibt die Header
+ * einmalig und bildet die Teilsumme der UDP-Prüfsumme über alle Felder, die sich
+ * nicht mehr ändern: Zieladresse, Ports, Längen und der hintere Teil der Payload. Pro Paket
+ * addiert UDPEchoRawPacket::finish nur noch die Quelladresse und den veränderlichen
+ * Anfang der Payload (PACKET bzw. PACKET_CHECKED) hinzu, statt die ganze Payload erneut
+ * zu summieren.
+ *
+ * Prüfsumme und Identifikation des IPv4-Headers trägt der Kernel auch bei IP_HDRINCL
+ * immer selbst ein, sie bleiben daher 0.
+ */
+
+UDPEchoRawPacket::UDPEchoRawPacket()
+{
+	memset(&destination, 0, sizeof(destination));
+	destlen=0;
+	destinationPort=0;
+	family=AF_INET;
+	memset(network, 0, sizeof(network));
+	prefixlen=32;
+	sourceCount=1;
+	firstHost=0;
+	sourceIndex=0;
+	sourcePort=0;
+	header=28;
+	payloadsize=0;
+	dynamicSize=0;
+	baseSum=0;
+}
+
+/*!\brief Einerkomplement-Summe über 16-Bit-Worte in Netzwerk-Byte-Order
+ *
+ * Bei ungerader Länge wird das letzte Byte mit 0 aufgefüllt.
+ *
+ * @param data Zeiger auf die Daten
+ * @param size Anzahl Bytes
+ * @param sum Bisherige Summe
+ * @return Neue Summe, auf 16 Bit plus Übertrag gefaltet
+ */
+uint32_t UDPEchoRawPacket::sum(const unsigned char *data, size_t size, uint32_t sum)
+{
+	uint64_t s=sum;
+	size_t i=0;
+	for (;i+1<size;i+=2) s+=((uint32_t)data[i]<<8)|data[i+1];
+	if (i<size) s+=(uint32_t)data[i]<<8;
+	while (s>>16) s=(s&0xffff)+(s>>16);
+	return (uint32_t)s;
+}
+
+uint16_t UDPEchoRawPacket::fold(uint32_t sum)
+{
+	while (sum>>16) sum=(sum&0xffff)+(sum>>16);
+	uint16_t c=(uint16_t)~sum;
+	// Eine errechnete 0 wird als 0xffff übertragen, 0 bedeutet "keine Prüfsumme"
+	return c ? c : 0xffff;
+}
+
+/*!\brief Ziel im Format "HOST:PORT" setzen
+ *
+ * IPv6-Adressen werden in eckigen Klammern angegeben, zum Beispiel "[fd00::1]:5000".
+ * Die Adressfamilie des Ziels bestimmt, ob IPv4- oder IPv6-Header erzeugt werden, sie
+ * muss zu den Quelladressen passen.
+ *
+ * @param destination String mit Zieladresse und Port
+ * @exception ppl7::IllegalArgumentException Ungültiges Format
+ * @exception Diverse Der Hostname oder der Port konnte nicht aufgelöst werden
+ */
+void UDPEchoRawPacket::setDestination(const ppl7::String &destination)
+{
+	ppl7::String host, port;
+	if (destination.left(1)=="[") {
+		ssize_t p=destination.instr("]:");
+		if (p<0) throw ppl7::IllegalArgumentException("UDPEchoRawPacket::setDestination: %s", (const char*)destination);
+		host=destination.mid(1, p-1);
+		port=destination.mid(p+2);
+	} else {
+		ppl7::Array tok=StrTok(destination, ":");
+		if (tok.size()!=2) throw ppl7::IllegalArgumentException("UDPEchoRawPacket::setDestination: %s", (const char*)destination);
+		host=tok[0];
+		port=tok[1];
+	}
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family=AF_UNSPEC;
+	hints.ai_socktype=SOCK_DGRAM;
+	int n=getaddrinfo((const char*)host, (const char*)port, &hints, &res);
+	if (n!=0) throwExceptionFromEaiError(n, ppl7::ToString("UDPEchoRawPacket::setDestination: %s", (const char*)destination));
+	memset(&this->destination, 0, sizeof(this->destination));
+	memcpy(&this->destination, res->ai_addr, res->ai_addrlen);
+	destlen=res->ai_addrlen;
+	freeaddrinfo(res);
+	// Der Port steht im UDP-Header, bei sendto über einen IPv6-Raw-Socket würde er als
+	// Protokollnummer interpretiert
+	if (this->destination.ss_family==AF_INET6) {
+		destinationPort=((struct sockaddr_in6*)&this->destination)->sin6_port;
+		((struct sockaddr_in6*)&this->destination)->sin6_port=0;
+	} else {
+		destinationPort=((struct sockaddr_in*)&this->destination)->sin_port;
+		((struct sockaddr_in*)&this->destination)->sin_port=0;
+	}
+}
+
+/*!\brief Netz der Quelladressen setzen
+ *
+ * Die Pakete erhalten reihum alle Adressen aus \p network als Quelladresse. Bei IPv4
+ * werden Netz- und Broadcast-Adresse ausgelassen, bei IPv6 die Adresse mit Host-Teil 0.
+ * Bei IPv6 variieren höchstens die unteren 63 Bit.
+ *
+ * @param network Netz im Format "ADRESSE/PRÄFIX", ohne Präfix wird nur die Adresse selbst
+ * verwendet
+ * @exception ppl7::IllegalArgumentException Ungültige Adresse oder Präfixlänge
+ */
+void UDPEchoRawPacket::setSources(const ppl7::String &network)
+{
+	ppl7::Array tok=StrTok(network, "/");
+	if (tok.size()<1 || tok.size()>2) throw ppl7::IllegalArgumentException("UDPEchoRawPacket::setSources: %s", (const char*)network);
+	memset(this->network, 0, sizeof(this->network));
+	int bits=32;
+	if (tok[0].instr(":")>=0) {
+		family=AF_INET6;
+		bits=128;
+	} else {
+		family=AF_INET;
+	}
+	if (inet_pton(family, (const char*)tok[0], this->network)!=1)
+		throw ppl7::IllegalArgumentException("UDPEchoRawPacket::setSources: %s", (const char*)network);
+	prefixlen=bits;
+	if (tok.size()==2) {
+		if (!tok[1].isNumeric()) throw ppl7::IllegalArgumentException("UDPEchoRawPacket::setSources: %s", (const char*)network);
+		prefixlen=tok[1].toInt();
+	}
+	if (prefixlen<1 || prefixlen>bits) throw ppl7::IllegalArgumentException("UDPEchoRawPacket::setSources: %s", (const char*)network);
+	// Host-Teil der Adresse löschen
+	for (int i=prefixlen;i<bits;i++) this->network[i/8]&=(unsigned char)~(0x80>>(i%8));
+	int hostbits=bits-prefixlen;
+	if (hostbits>63) hostbits=63;
+	if (hostbits==0) {
+		sourceCount=1;
+		firstHost=0;
+	} else if (family==AF_INET && hostbits==1) {
+		sourceCount=2;
+		firstHost=0;
+	} else if (family==AF_INET) {
+		sourceCount=((uint64_t)1<<hostbits)-2;
+		firstHost=1;
+	} else {
+		sourceCount=((uint64_t)1<<hostbits)-1;
+		firstHost=1;
+	}
+	header=(family==AF_INET6) ? 48 : 28;
+	sourceIndex=0;
+}
+
+/*!\brief Quellport aller Pakete setzen
+ */
+void UDPEchoRawPacket::setSourcePort(int port)
+{
+	sourcePort=(uint16_t)port;
+}
+
+/*!\brief Position in der Liste der Quelladressen setzen
+ *
+ * Threads beginnen an unterschiedlichen Positionen, damit sie nicht zeitgleich die
+ * gleichen Adressen verwenden.
+ */
+void UDPEchoRawPacket::seek(uint64_t index)
+{
+	sourceIndex=index%sourceCount;
+}
+
+/*!\brief Netz der Quelladressen als "ADRESSE/PRÄFIX"
+ */
+ppl7::String UDPEchoRawPacket::getSources() const
+{
+	char buffer[INET6_ADDRSTRLEN];
+	inet_ntop(family, network, buffer, sizeof(buffer));
+	return ppl7::ToString("%s/%d", buffer, prefixlen);
+}
+
+/*!\brief Anzahl verschiedener Quelladressen
+ */
+uint64_t UDPEchoRawPacket::getSourceCount() const
+{
+	return sourceCount;
+}
+
+/*!\brief MTU der Route zum Ziel ermitteln
+ *
+ * Pakete über einen Raw-Socket mit IP_HDRINCL werden vom Kernel nicht fragmentiert,
+ * ist ein Paket inklusive Header größer als die MTU, schlägt sendto mit EMSGSIZE fehl.
+ * Der Sender prüft die Paketgröße daher vorab.
+ *
+ * @return MTU in Bytes oder 0, wenn sie sich nicht ermitteln lässt
+ */
+int UDPEchoRawPacket::getPathMtu() const
+{
+	int mtu=0;
+#if defined(IP_MTU) && defined(IPV6_MTU)
+	struct sockaddr_storage addr;
+	memcpy(&addr, &destination, sizeof(addr));
+	if (addr.ss_family==AF_INET6) ((struct sockaddr_in6*)&addr)->sin6_port=destinationPort;
+	else ((struct sockaddr_in*)&addr)->sin_port=destinationPort;
+	int fd=::socket(addr.ss_family, SOCK_DGRAM, 0);
+	if (fd<0) return 0;
+	if (::connect(fd, (const struct sockaddr*)&addr, destlen)==0) {
+		socklen_t len=sizeof(mtu);
+		if (addr.ss_family==AF_INET6) {
+			if (getsockopt(fd, IPPROTO_IPV6, IPV6_MTU, &mtu, &len)<0) mtu=0;
+		} else {
+			if (getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &len)<0) mtu=0;
+		}
+	}
+	::close(fd);
+#endif
+	return mtu;
+}
+
+void UDPEchoRawPacket::putSource(unsigned char *packet, uint64_t index) const
+{
+	uint64_t host=firstHost+index;
+	if (family==AF_INET) {
+		uint32_t a;
+		memcpy(&a, network, 4);
+		a=htonl(ntohl(a)+(uint32_t)host);
+		memcpy(packet+12, &a, 4);
+		return;
+	}
+	unsigned char *src=packet+8;
+	memcpy(src, network, 16);
+	uint64_t low=0;
+	for (int i=8;i<16;i++) low=(low<<8)|network[i];
+	low+=host;
+	for (int i=15;i>=8;i--) {
+		src[i]=(unsigned char)low;
+		low>>=8;
+	}
+}
+
+void UDPEchoRawPacket::putLength(unsigned char *packet, size_t payloadsize) const
+{
+	size_t udplen=payloadsize+8;
+	unsigned char *udp=packet+header-8;
+	if (family==AF_INET) {
+		packet[2]=(unsigned char)((udplen+20)>>8);
+		packet[3]=(unsigned char)(udplen+20);
+	} else {
+		packet[4]=(unsigned char)(udplen>>8);
+		packet[5]=(unsigned char)udplen;
+	}
+	udp[4]=(unsigned char)(udplen>>8);
+	udp[5]=(unsigned char)udplen;
+}
+
+/*!\brief Teilsumme über Pseudo-Header ohne Quelladresse und UDP-Header
+ */
+uint32_t UDPEchoRawPacket::headerSum(const unsigned char *packet, size_t payloadsize) const
+{
+	uint32_t s=IPPROTO_UDP+(uint32_t)(payloadsize+8);
+	if (family==AF_INET) s=sum(packet+16, 4, s);
+	else s=sum(packet+24, 16, s);
+	// UDP-Header mit Prüfsumme 0
+	return sum(packet+header-8, 6, s);
+}
+
+/*!\brief Nächste Quelladresse eintragen und Prüfsumme abschließen
+ *
+ * @param packet Puffer mit Headern und Payload
+ * @param payloadsize Größe der Payload
+ * @param s Summe über alle Felder außer der Quelladresse
+ * @return Gesamtgröße des Pakets
+ */
+size_t UDPEchoRawPacket::complete(unsigned char *packet, size_t payloadsize, uint32_t s)
+{
+	putSource(packet, sourceIndex);
+	if (++sourceIndex>=sourceCount) sourceIndex=0;
+	if (family==AF_INET) s=sum(packet+12, 4, s);
+	else s=sum(packet+8, 16, s);
+	uint16_t c=fold(s);
+	unsigned char *udp=packet+header-8;
+	udp[6]=(unsigned char)(c>>8);
+	udp[7]=(unsigned char)c;
+	return header+payloadsize;
+}
+
+/*!\brief Header in den Puffer \p packet schreiben
+ *
+ * Muss aufgerufen werden, nachdem die Payload hinter die Header kopiert wurde. Die
+ * Bytes ab \p dynamicSize der Payload gelten danach als unveränderlich und gehen in die
+ * vorberechnete Teilsumme der Prüfsumme ein.
+ *
+ * @param packet Puffer mit Platz für Header und Payload
+ * @param payloadsize Größe der Payload
+ * @param dynamicSize Anzahl Bytes am Anfang der Payload, die sich mit jedem Paket ändern
+ */
+void UDPEchoRawPacket::prepare(unsigned char *packet, size_t payloadsize, size_t dynamicSize)
+{
+	this->payloadsize=payloadsize;
+	this->dynamicSize=dynamicSize<payloadsize ? dynamicSize : payloadsize;
+	memset(packet, 0, header);
+	if (family==AF_INET) {
+		const struct sockaddr_in *d=(const struct sockaddr_in*)&destination;
+		packet[0]=0x45;
+		packet[6]=0x40;		// Don't fragment
+		packet[8]=64;		// TTL
+		packet[9]=IPPROTO_UDP;
+		memcpy(packet+16, &d->sin_addr, 4);
+	} else {
+		const struct sockaddr_in6 *d=(const struct sockaddr_in6*)&destination;
+		packet[0]=0x60;
+		packet[6]=IPPROTO_UDP;
+		packet[7]=64;		// Hop Limit
+		memcpy(packet+24, &d->sin6_addr, 16);
+	}
+	unsigned char *udp=packet+header-8;
+	udp[0]=(unsigned char)(sourcePort>>8);
+	udp[1]=(unsigned char)sourcePort;
+	memcpy(udp+2, &destinationPort, 2);
+	putLength(packet, payloadsize);
+	baseSum=sum(packet+header+this->dynamicSize, payloadsize-this->dynamicSize, headerSum(packet, payloadsize));
+}
+
+/*!\brief Nächste Quelladresse und Prüfsumme eintragen
+ *
+ * Die Payload darf sich seit UDPEchoRawPacket::prepare nur in den ersten
+ * \p dynamicSize Bytes geändert haben.
+ *
+ * @param packet Puffer mit Headern und Payload
+ * @return Gesamtgröße des Pakets
+ */
+size_t UDPEchoRawPacket::finish(unsigned char *packet)
+{
+	return complete(packet, payloadsize, sum(packet+header, dynamicSize, baseSum));
+}
+
+/*!\brief Nächste Quelladresse, Längen und Prüfsumme für eine beliebige Payload eintragen
+ *
+ * Wird verwendet, wenn sich Größe oder Inhalt der Payload mit jedem Paket ändern,
+ * zum Beispiel bei DNS-Anfragen. Die Prüfsumme wird dabei über die gesamte Payload
+ * berechnet.
+ *
+ * @param packet Puffer mit Headern und Payload
+ * @param payloadsize Größe der Payload
+ * @return Gesamtgröße des Pakets
+ */
+size_t UDPEchoRawPacket::finish(unsigned char *packet, size_t payloadsize)
+{
+	putLength(packet, payloadsize);
+	return complete(packet, payloadsize, sum(packet+header, payloadsize, headerSum(packet, payloadsize)));
+}
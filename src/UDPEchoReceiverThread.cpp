@@ -23,6 +23,7 @@
 #include <sys/socket.h>
 #include <time.h>
 #include <sys/time.h>
+#include <string.h>
 
 
 #include "udpecho.h"
@@ -42,12 +43,18 @@
 
 /*!\brief Konstruktor
  *
- * Reserviert Speicher fuer die UDP-Pakete und initialisiert interne Variablen
+ * Initialisiert interne Variablen. Der Empfangspuffer wird erst beim Start des Threads
+ * aus dessen UDPEchoPacketPool geholt.
  */
 UDPEchoReceiverThread::UDPEchoReceiverThread()
 {
-	recbuffer.malloc(4096);
+	buffersize=UDPECHO_MAX_DATAGRAM_SIZE;
+	recbuffer=NULL;
 	sockfd=0;
+	queryTime=NULL;
+	dnsMode=false;
+	checksum=UDPEchoChecksum::NONE;
+	flowBucket=-1;
 	resetCounter();
 }
 
@@ -69,6 +76,86 @@ void UDPEchoReceiverThread::setSocketDescriptor(int sockfd)
 	this->sockfd=sockfd;
 }
 
+/*!\brief Maximale Größe der Antwortpakete festlegen
+ *
+ * Legt die Größe des Empfangspuffers fest. Pakete, die größer sind, werden abgeschnitten
+ * und zusätzlich als "truncated" gezählt.
+ *
+ * @param bytes Wert zwischen sizeof(PACKET) und UDPECHO_MAX_DATAGRAM_SIZE
+ *
+ * @exception ppl7::InvalidArgumentsException Wird geworfen, wenn der Wert ausserhalb
+ * des gültigen Bereichs liegt
+ */
+void UDPEchoReceiverThread::setMaxPacketSize(size_t bytes)
+{
+	if (bytes<sizeof(PACKET) || bytes>UDPECHO_MAX_DATAGRAM_SIZE)
+		throw ppl7::InvalidArgumentsException("UDPEchoReceiverThread::setMaxPacketSize");
+	buffersize=bytes;
+}
+
+/*!\brief DNS-Modus ein- oder ausschalten
+ *
+ * Im DNS-Modus werden die Antworten anhand ihrer Transaktions-ID der Anfrage zugeordnet.
+ * Der Sender hinterlegt dazu vor dem Versand den Sendezeitpunkt mit
+ * UDPEchoReceiverThread::setQueryTime in einer Tabelle mit 65536 Einträgen. Da Sender
+ * und Empfänger in verschiedenen Threads laufen, wird die Tabelle nur atomar gelesen
+ * und geschrieben. Zusätzlich
+ * werden die RCODEs der Antworten gezählt.
+ *
+ * @param flag True oder False
+ */
+void UDPEchoReceiverThread::setDNSMode(bool flag)
+{
+	dnsMode=flag;
+	if (flag && queryTime==NULL) {
+		querytimes.calloc(65536*sizeof(double));
+		queryTime=(double*)querytimes.adr();
+	}
+}
+
+/*!\brief Prüfsumme der Antworten verifizieren
+ *
+ * Ist ein Verfahren gesetzt, wird jede Antwort mit UDPEchoChecksum::verify geprüft.
+ * Antworten mit falscher Prüfsumme werden zusätzlich als "corrupted" gezählt, Antworten,
+ * deren Länge nicht zur eingetragenen passt, getrennt davon als "length mismatch".
+ *
+ * @param algorithm Verfahren, UDPEchoChecksum::NONE schaltet die Prüfung ab
+ */
+void UDPEchoReceiverThread::setChecksum(UDPEchoChecksum::Algorithm algorithm)
+{
+	checksum=algorithm;
+}
+
+/*!\brief Antworten den Zielen zuordnen
+ *
+ * Im Multi-Ziel-Betrieb (siehe UDPEchoSenderThread::setTargets) wird zu jeder Antwort
+ * die Absenderadresse gelesen und die Antwort in einer eigenen Kopie von \p targets
+ * dem passenden Ziel zugerechnet.
+ *
+ * @param targets Liste der Ziele, eine leere Liste schaltet die Zuordnung ab
+ */
+void UDPEchoReceiverThread::setTargets(const UDPEchoTargetTable &targets)
+{
+	this->targets=targets;
+	this->targets.clearCounter();
+}
+
+/*!\brief Antworten Gruppen von Flows zuordnen
+ *
+ * Der Empfänger zählt Antworten und Laufzeiten zusätzlich in einer eigenen Kopie von
+ * \p flows. Die Gruppe übergibt der Aufrufer von UDPEchoReceiverThread::receive,
+ * UDPEchoReceiverThread::run verwendet \p bucket für seinen Socket.
+ *
+ * @param flows Gruppen, eine leere Liste schaltet die Zuordnung ab
+ * @param bucket Gruppe des mit UDPEchoReceiverThread::setSocketDescriptor gesetzten Sockets
+ */
+void UDPEchoReceiverThread::setFlowBuckets(const UDPEchoFlowBuckets &flows, int bucket)
+{
+	this->flows=flows;
+	this->flows.clearCounter();
+	flowBucket=(flows.size()>0) ? bucket : -1;
+}
+
 /*!\brief Counter auf 0 setzen
  *
  * Alle Counter werden auf 0 gesetzt.
@@ -77,26 +164,194 @@ void UDPEchoReceiverThread::resetCounter()
 {
 	bytes_received=0;
 	counter_received=0;
+	counter_truncated=0;
+	counter_corrupted=0;
+	counter_length_mismatch=0;
+	counter_dns_unmatched=0;
+	counter_dns_invalid=0;
+	for (int i=0;i<16;i++) counter_rcodes[i]=0;
+	if (queryTime) memset(queryTime, 0, 65536*sizeof(double));
 	rtt_total=0.0;
 	rtt_min=0.0;
 	rtt_max=0.0;
+	histogram.clear();
+	targets.clearCounter();
+	flows.clearCounter();
 }
 
-void UDPEchoReceiverThread::countPacket(const PACKET *p, ssize_t bytes)
+/*!\brief Echo-Antwort zählen
+ *
+ * @return Laufzeit des Pakets in Sekunden
+ */
+double UDPEchoReceiverThread::countPacket(PACKET *p, ssize_t bytes)
 {
 	counter_received++;
 	bytes_received+=bytes;
+	if ((size_t)bytes>buffersize) counter_truncated++;
+	else if (checksum!=UDPEchoChecksum::NONE) {
+		UDPEchoChecksum::Result r=UDPEchoChecksum::verify(checksum, p, (size_t)bytes);
+		if (r==UDPEchoChecksum::CORRUPTED) counter_corrupted++;
+		else if (r==UDPEchoChecksum::LENGTH_MISMATCH) counter_length_mismatch++;
+	}
 	double rtt=ppl7::GetMicrotime()-p->time;
+	countRoundTripTime(rtt);
+	return rtt;
+}
+
+/*!\brief DNS-Antwort zählen
+ *
+ * Die Antwort wird über die Transaktions-ID der Anfrage zugeordnet. Antworten ohne
+ * passende Anfrage, zum Beispiel Duplikate, werden als "unmatched" gezählt, Pakete, die
+ * keine DNS-Antwort sind, als "invalid". Beide gelten nicht als empfangene Antwort.
+ *
+ * @return Laufzeit in Sekunden oder -1, wenn die Antwort nicht gezählt wurde
+ */
+double UDPEchoReceiverThread::countDNSResponse(const unsigned char *p, ssize_t bytes)
+{
+	bytes_received+=bytes;
+	if ((size_t)bytes>buffersize) counter_truncated++;
+	if (bytes<DNS_HEADER_SIZE || (p[2]&0x80)==0) {
+		counter_dns_invalid++;
+		return -1.0;
+	}
+	uint16_t id=DNSGet16(p);
+	// Sendezeitpunkt lesen und in einem Schritt löschen
+	double sent, zero=0.0;
+	__atomic_exchange(&queryTime[id], &zero, &sent, __ATOMIC_ACQ_REL);
+	if (sent==0.0) {
+		counter_dns_unmatched++;
+		return -1.0;
+	}
+	counter_received++;
+	counter_rcodes[p[3]&0x0f]++;
+	double rtt=ppl7::GetMicrotime()-sent;
+	countRoundTripTime(rtt);
+	return rtt;
+}
+
+/*!\brief Antwort zählen und gegebenenfalls ihrem Ziel und ihrer Gruppe zurechnen
+ *
+ * @param p Paket
+ * @param bytes Länge des Datagramms
+ * @param from Absenderadresse, nur im Multi-Ziel-Betrieb gesetzt
+ * @param bucket Gruppe des Flows oder -1
+ */
+void UDPEchoReceiverThread::countResponse(const unsigned char *p, ssize_t bytes, const struct sockaddr *from, int bucket)
+{
+	double rtt;
+	if (dnsMode) rtt=countDNSResponse(p,bytes);
+	else rtt=countPacket((PACKET*)p,bytes);
+	if (rtt<0.0) return;
+	if (from!=NULL) targets.countReceived(from, bytes, rtt);
+	if (bucket>=0) flows[bucket].countReceived(bytes, rtt);
+}
+
+void UDPEchoReceiverThread::countRoundTripTime(double rtt)
+{
 	rtt_total+=rtt;
 	if (rtt_min==0) rtt_min=rtt;
 	else if (rtt<rtt_min) rtt_min=rtt;
 	if (rtt>rtt_max) rtt_max=rtt;
+	histogram.add(rtt);
+}
+
+/*!\brief Empfangspuffer aus dem Paketpool holen
+ *
+ * Wird von UDPEchoReceiverThread::run aufgerufen. Liest ein anderer Thread die Antworten
+ * selbst mit UDPEchoReceiverThread::receive, muss er diese Methode vorher aufrufen, damit
+ * die Puffer in seinem Kontext angelegt werden.
+ *
+ * @param batch Anzahl Puffer. Bei mehr als einem Puffer liest
+ * UDPEchoReceiverThread::receive bis zu \p batch Pakete mit einem Aufruf von recvmmsg.
+ */
+void UDPEchoReceiverThread::allocateBuffer(size_t batch)
+{
+	if (!batch) batch=1;
+	pool.allocate(batch, buffersize);
+	msgs.clear();
+	iovecs.clear();
+	names.clear();
+	if (batch>1) {
+		msgs.resize(batch);
+		iovecs.resize(batch);
+		if (targets.size()>0) names.resize(batch);
+		memset(&msgs[0], 0, batch*sizeof(struct mmsghdr));
+		for (size_t i=0;i<batch;i++) {
+			iovecs[i].iov_base=pool.acquire();
+			iovecs[i].iov_len=buffersize;
+			msgs[i].msg_hdr.msg_iov=&iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen=1;
+		}
+		recbuffer=(unsigned char*)iovecs[0].iov_base;
+	} else {
+		recbuffer=(unsigned char*)pool.acquire();
+	}
+}
+
+/*!\brief Wartende Antworten von einem Socket lesen und zählen
+ *
+ * Liest ohne zu blockieren höchstens \p max Pakete von \p fd. Durch MSG_TRUNC liefert
+ * recv die tatsächliche Länge des Datagramms zurück, auch wenn es nicht vollständig in
+ * den Puffer gepasst hat. Wurden mit UDPEchoReceiverThread::allocateBuffer mehrere
+ * Puffer angelegt, werden die Pakete gebündelt per recvmmsg gelesen. Im
+ * Multi-Ziel-Betrieb wird zusätzlich die Absenderadresse jeder Antwort gelesen.
+ *
+ * @param fd Socket
+ * @param max Maximale Anzahl Pakete
+ * @param bucket Gruppe des Flows (siehe UDPEchoReceiverThread::setFlowBuckets) oder -1
+ * @return Anzahl gelesener Pakete, 0 wenn keine Antwort anstand
+ */
+size_t UDPEchoReceiverThread::receive(int fd, size_t max, int bucket)
+{
+	if (flows.size()==0) bucket=-1;
+	size_t count=0;
+	if (msgs.size()>1) {
+		while (count<max) {
+			size_t vlen=max-count;
+			if (vlen>msgs.size()) vlen=msgs.size();
+			// Der Kernel überschreibt die Länge der Absenderadresse bei jedem Aufruf
+			for (size_t i=0;i<names.size() && i<vlen;i++) {
+				msgs[i].msg_hdr.msg_name=&names[i];
+				msgs[i].msg_hdr.msg_namelen=sizeof(struct sockaddr_storage);
+			}
+			int n=::recvmmsg(fd, &msgs[0], (unsigned int)vlen, MSG_DONTWAIT|MSG_TRUNC, NULL);
+			if (n<=0) break;
+			for (int i=0;i<n;i++) {
+				countResponse((const unsigned char*)iovecs[i].iov_base, msgs[i].msg_len,
+						names.empty() ? NULL : (const struct sockaddr*)&names[i], bucket);
+			}
+			count+=n;
+			if ((size_t)n<vlen) break;
+		}
+		return count;
+	}
+	if (targets.size()>0) {
+		struct sockaddr_storage from;
+		while (count<max) {
+			socklen_t len=sizeof(from);
+			ssize_t n=::recvfrom(fd,(void*)recbuffer,buffersize,MSG_TRUNC,(struct sockaddr*)&from,&len);
+			if (n<0) break;
+			countResponse(recbuffer, n, (const struct sockaddr*)&from, bucket);
+			count++;
+		}
+		return count;
+	}
+	while (count<max) {
+		ssize_t n=::recv(fd,(void*)recbuffer,buffersize,MSG_TRUNC);
+		if (n<0) break;
+		countResponse(recbuffer, n, NULL, bucket);
+		count++;
+	}
+	return count;
 }
 
 /*!\brief Hauptthread des Receivers
  *
  * Liest in einer Endlosschleife Pakete aus dem UDP-Buffer. Die Schleife wird nur dann
  * beendet, wenn dem Thread ein Signal zum Stoppen gegeben wurde.
+ *
+ * Im latenzarmen Modus (siehe UDPEchoLowLatency) wartet der Thread nicht in pselect,
+ * sondern fragt den Socket ununterbrochen ab.
  */
 void UDPEchoReceiverThread::run()
 {
@@ -106,17 +361,21 @@ void UDPEchoReceiverThread::run()
 	timeout.tv_nsec=10*1000000;
 	fd_set rset;
 	resetCounter();
-	PACKET *p=(PACKET*)recbuffer.adr();
+	allocateBuffer();
+	bool spin=UDPEchoLowLatency::isEnabled();
+	UDPEchoLowLatency::applyScheduling();
+	if (UDPEchoPerfCounter::isEnabled()) perf.open();
 	time_t start = time(NULL);
 	time_t next_check = start +1;
 	while(1) {
-		ssize_t n=::recv(sockfd,(void*)recbuffer.adr(),4096,0);
-		if (n >= 0) {
-			countPacket(p,n);
-		} else {
-			FD_ZERO(&rset);
-			FD_SET(sockfd,&rset);
-			pselect(sockfd+1,&rset,NULL,NULL,&timeout,NULL);
+		if (!receive(sockfd, 64, flowBucket)) {
+			if (spin) {
+				UDPEchoLowLatency::relax();
+			} else {
+				FD_ZERO(&rset);
+				FD_SET(sockfd,&rset);
+				pselect(sockfd+1,&rset,NULL,NULL,&timeout,NULL);
+			}
 		}
 		if (time(NULL) >= next_check) {
 			next_check += 1;
@@ -124,6 +383,7 @@ void UDPEchoReceiverThread::run()
 				break;
 		}
 	}
+	perf.stop();
 }
 
 /*!\brief Anzahl empfangender Pakete auslesen
@@ -144,6 +404,62 @@ int64_t UDPEchoReceiverThread::getBytesReceived() const
 	return bytes_received;
 }
 
+/*!\brief Anzahl abgeschnittener Pakete auslesen
+ *
+ * @return Anzahl Pakete, die größer als der Empfangspuffer waren
+ */
+int64_t UDPEchoReceiverThread::getPacketsTruncated() const
+{
+	return counter_truncated;
+}
+
+/*!\brief Anzahl beschädigter Pakete auslesen
+ *
+ * @return Anzahl Pakete, deren Prüfsumme nicht stimmte
+ */
+int64_t UDPEchoReceiverThread::getPacketsCorrupted() const
+{
+	return counter_corrupted;
+}
+
+/*!\brief Anzahl Pakete mit falscher Länge auslesen
+ *
+ * @return Anzahl Pakete, deren Länge nicht mit der im Paket eingetragenen übereinstimmte
+ */
+int64_t UDPEchoReceiverThread::getPacketsLengthMismatch() const
+{
+	return counter_length_mismatch;
+}
+
+/*!\brief Anzahl DNS-Antworten ohne passende Anfrage auslesen
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoReceiverThread::getDNSUnmatched() const
+{
+	return counter_dns_unmatched;
+}
+
+/*!\brief Anzahl Pakete auslesen, die keine DNS-Antwort waren
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoReceiverThread::getDNSInvalid() const
+{
+	return counter_dns_invalid;
+}
+
+/*!\brief Anzahl DNS-Antworten mit einem bestimmten RCODE auslesen
+ *
+ * @param rcode RCODE zwischen 0 und 15
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoReceiverThread::getRcodeCounter(int rcode) const
+{
+	if (rcode>=0 && rcode<16) return counter_rcodes[rcode];
+	return 0;
+}
+
 /*!\brief Durchschnittliche Paketlaufzeit auslesen
  *
  * @return Laufzeit in Sekunden, mit mikrosekundengenauen Nachkommastellen
@@ -171,3 +487,39 @@ double UDPEchoReceiverThread::getRoundTripTimeMax() const
 	return rtt_max;
 }
 
+/*!\brief Histogramm der Paketlaufzeiten auslesen
+ *
+ * @return Referenz auf das Histogramm, darf erst nach Ende des Threads ausgewertet werden
+ */
+const UDPEchoLatencyHistogram &UDPEchoReceiverThread::getLatencyHistogram() const
+{
+	return histogram;
+}
+
+/*!\brief Zähler der PMU für die Empfangsschleife auslesen
+ *
+ * @param values Nimmt die Werte auf, alle Ereignisse sind ungültig, wenn die Messung
+ * nicht mit UDPEchoPerfCounter::setEnabled eingeschaltet wurde
+ */
+void UDPEchoReceiverThread::getPerfCounter(UDPEchoPerfCounter::Values &values) const
+{
+	perf.read(values);
+}
+
+/*!\brief Messwerte pro Ziel auslesen
+ *
+ * @return Referenz auf die Kopie der Zieltabelle, enthält nur die Zähler der Antworten
+ */
+const UDPEchoTargetTable &UDPEchoReceiverThread::getTargets() const
+{
+	return targets;
+}
+
+/*!\brief Messwerte pro Gruppe von Flows auslesen
+ *
+ * @return Referenz auf die Kopie der Gruppen, enthält nur die Zähler der Antworten
+ */
+const UDPEchoFlowBuckets &UDPEchoReceiverThread::getFlowBuckets() const
+{
+	return flows;
+}
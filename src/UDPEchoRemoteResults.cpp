@@ -0,0 +1,170 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+
+#include "control.h"
+#include "wire.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoRemoteResults
+ * \ingroup GroupSender
+ * \brief Vom Bouncer gemessene Werte eines Testlaufs
+ *
+ * Enthält die sekündlichen Zähler und Sensordaten des Bouncers zwischen Start und Stop
+ * eines Testlaufs, sowie deren Summe. Die Daten werden über den Steuerkanal als
+ * ppl7::AssocArray übertragen.
+ */
+
+UDPEchoRemoteResults::UDPEchoRemoteResults()
+{
+	clear();
+}
+
+void UDPEchoRemoteResults::clear()
+{
+	total.clear();
+	total.sampleTime=0.0;
+	stat_start=SystemStat();
+	stat_end=SystemStat();
+	stat_start.sampleTime=0.0;
+	stat_end.sampleTime=0.0;
+	counter.clear();
+	stat.clear();
+	perf.clear();
+}
+
+/*!\brief Sekündliche Messung hinzufügen
+ *
+ * @param counter Zähler des Bouncers seit der letzten Messung
+ * @param stat Sensordaten zum Zeitpunkt der Messung
+ */
+void UDPEchoRemoteResults::addSample(const UDPEchoCounter &counter, const SystemStat &stat)
+{
+	this->counter.push_back(counter);
+	this->stat.push_back(stat);
+	total.add(counter);
+	stat_end=stat;
+}
+
+/*!\brief Messwerte für die Übertragung exportieren
+ *
+ * Zähler und Sensordaten werden im binären Format von UDPEchoWire abgelegt. Die
+ * sekündlichen Messungen liegen als eine Folge von Datensätzen (jeweils UDPEchoCounter
+ * gefolgt von SystemStat) unter dem Schlüssel "samples". Hat der Bouncer PMU-Zähler
+ * erfasst, liegen deren Deltas unter "perf" (siehe UDPEchoPerfCounter::Values::toString).
+ */
+void UDPEchoRemoteResults::exportToArray(ppl7::AssocArray &data) const
+{
+	ppl7::ByteArray b;
+	b.malloc(total.binarySize());
+	total.exportBinary((void*)b.adr(), b.size());
+	data.set("total", b);
+	b.malloc(stat_start.binarySize());
+	stat_start.exportBinary((void*)b.adr(), b.size());
+	data.set("stat_start", b);
+	b.malloc(stat_end.binarySize());
+	stat_end.exportBinary((void*)b.adr(), b.size());
+	data.set("stat_end", b);
+	size_t size=0;
+	for (size_t i=0;i<counter.size();i++) size+=counter[i].binarySize()+stat[i].binarySize();
+	if (size) {
+		b.malloc(size);
+		unsigned char *p=(unsigned char*)b.adr();
+		for (size_t i=0;i<counter.size();i++) {
+			p+=counter[i].exportBinary(p, size-(p-(unsigned char*)b.adr()));
+			p+=stat[i].exportBinary(p, size-(p-(unsigned char*)b.adr()));
+		}
+		data.set("samples", b);
+	}
+	if (perf.isValid()) data.set("perf", perf.toString());
+}
+
+static const ppl7::ByteArray &getBinary(const ppl7::AssocArray &data, const ppl7::String &key)
+{
+	const ppl7::Variant &v=data.get(key);
+	if (!v.isByteArray()) throw ppl7::InvalidFormatException("UDPEchoRemoteResults: %s", (const char*)key);
+	return v.toByteArray();
+}
+
+/*!\brief Übertragene Messwerte importieren
+ *
+ * @exception ppl7::InvalidFormatException Die Daten sind unvollständig oder ungültig
+ */
+void UDPEchoRemoteResults::importFromArray(const ppl7::AssocArray &data)
+{
+	clear();
+	const ppl7::ByteArray &t=getBinary(data, "total");
+	total.importBinary(t.adr(), t.size());
+	const ppl7::ByteArray &s1=getBinary(data, "stat_start");
+	stat_start.importBinary(s1.adr(), s1.size());
+	const ppl7::ByteArray &s2=getBinary(data, "stat_end");
+	stat_end.importBinary(s2.adr(), s2.size());
+	if (data.exists("perf")) perf.fromString(data.getString("perf"));
+	if (!data.exists("samples")) return;
+	const ppl7::ByteArray &samples=getBinary(data, "samples");
+	const unsigned char *p=(const unsigned char*)samples.adr();
+	size_t rest=samples.size();
+	while (rest>0) {
+		UDPEchoCounter c;
+		SystemStat st;
+		size_t n=c.importBinary(p, rest);
+		p+=n;
+		rest-=n;
+		n=st.importBinary(p, rest);
+		p+=n;
+		rest-=n;
+		counter.push_back(c);
+		stat.push_back(st);
+	}
+}
+
+/*!\brief Dauer des Testlaufs auf dem Bouncer
+ *
+ * @return Dauer in Sekunden
+ */
+double UDPEchoRemoteResults::getDuration() const
+{
+	return stat_end.sampleTime-stat_start.sampleTime;
+}
+
+/*!\brief Durchschnittliche CPU-Auslastung des Bouncers während des Testlaufs
+ */
+double UDPEchoRemoteResults::getCpuUsage() const
+{
+	return SystemStat::Cpu::getUsage(stat_end.cpu, stat_start.cpu);
+}
+
+/*!\brief Höchste CPU-Auslastung des Bouncers in einer Sekunde des Testlaufs
+ */
+double UDPEchoRemoteResults::getCpuUsageMax() const
+{
+	double max=0.0;
+	const SystemStat *previous=&stat_start;
+	for (size_t i=0;i<stat.size();i++) {
+		double usage=SystemStat::Cpu::getUsage(stat[i].cpu, previous->cpu);
+		if (usage>max) max=usage;
+		previous=&stat[i];
+	}
+	return max;
+}
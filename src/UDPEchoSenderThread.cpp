@@ -30,7 +30,10 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include "udpecho.h"
+#include "sensor.h"
 
 
 /*!@file
@@ -48,6 +51,67 @@ ppl7::Mutex PacketIdMutex;
  */
 int64_t PacketId=0;
 
+//! Maximale Anzahl Ereignisse pro Aufruf von epoll_wait
+static const int EPOLL_EVENTS=64;
+
+//! Maximale Wartezeit in Mikrosekunden auf einen wieder schreibbaren Socket nach EAGAIN
+static const long SendTimeoutUsec=100000;
+
+//! Obergrenze für die Anzahl Antworten, die pro Aufruf von recvmmsg gelesen werden
+static const int MAX_RECEIVE_BURST=1024;
+
+//! Obergrenze für die Anzahl Pakete, die im Multi-Ziel-Betrieb pro sendmmsg verschickt werden
+static const int MAX_SEND_BATCH=1024;
+
+/*!\brief Mehrfaches Binden an die gleiche Adresse erlauben oder verbieten
+ */
+static void setReuse(int fd, int value)
+{
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+	#ifdef SO_REUSEPORT_LB
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT_LB, &value, sizeof(value));
+		//setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value));
+	#else
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value));
+	#endif
+}
+
+/*!\brief UDP-Socket anlegen
+ *
+ * @param reuse Erlaubt anderen Threads und Programmen, sich auf die gleiche Adresse zu
+ * binden. Der Kernel kann einem solchen Socket beim connect dann auch einen Quellport
+ * zuteilen, der bereits von einem anderen Socket verwendet wird.
+ */
+static int createSocket(bool reuse)
+{
+	int fd=::socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd<0) throw ppl7::CouldNotOpenSocketException("Could not create Socket: %s", strerror(errno));
+	// Wir erlauben anderen Threads/Programmen sich auf das gleichen Socket zu binden
+	if (reuse) setReuse(fd, 1);
+	return fd;
+}
+
+/*!\brief Verbundenen Socket für den Lasttest einrichten
+ *
+ * Der Socket soll nicht blockieren und einen doppelt so großen Empfangspuffer wie
+ * vom System vorgegeben erhalten.
+ */
+static void configureSocket(int fd, const ppl7::String &hostname, int port)
+{
+	// Der Socket soll nicht blockieren, wenn keine Daten anstehen
+	fcntl(fd,F_SETFL,fcntl(fd,F_GETFL,0)|O_NONBLOCK);
+	int optval = 1;
+	//setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+	socklen_t size=sizeof(optval);
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &optval, &size) < 0) {
+		ppl7::throwSocketException(errno, ppl7::ToString("getsockopt failed on Host: %s, Port: %d", (const char*) hostname, port));
+	}
+	size = optval * 2;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size))!=0) {
+		ppl7::throwSocketException(errno, ppl7::ToString("setsockopt failed on Host: %s, Port: %d", (const char*) hostname, port));
+	}
+}
+
 
 /*!\class SenderThread
  * \ingroup GroupSender
@@ -66,37 +130,48 @@ UDPEchoSenderThread::UDPEchoSenderThread()
 	runtime=10;
 	timeout=5;
 	counter_send=0;
+	bytes_send=0;
 	errors=0;
 	counter_0bytes=0;
 	duration=0.0;
 	ignoreResponses=true;
+	buffer=NULL;
+	corpus=NULL;
+	corpusPosition=0;
+	queryId=0;
+	checksum=UDPEchoChecksum::NONE;
 	for (int i=0;i<255;i++) counter_errorcodes[i]=0;
 	verbose=false;
 	alwaysRandomize=false;
 	queryrate=0;
 	Zeitscheibe=0.0f;
-	sockfd=::socket(AF_INET, SOCK_DGRAM, 0);
-	if (!sockfd) throw ppl7::CouldNotOpenSocketException("Could not create Socket");
-	const int trueValue = 1;
-	// Wir erlauben anderen Threads/Programmen sich auf das gleichen Socket zu binden
-	setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &trueValue, sizeof(trueValue));
-	#ifdef SO_REUSEPORT_LB
-		setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT_LB, &trueValue, sizeof(trueValue));
-		//setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &trueValue, sizeof(trueValue));
-	#else
-		setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &trueValue, sizeof(trueValue));
-	#endif
-
+	epollfd=-1;
+	socketIndex=0;
+	runToCompletion=false;
+	inlineReceive=false;
+	busyPoll=false;
+	sendBurst=16;
+	receiveBurst=16;
+	targetIndex=0;
+	pending=0;
+	pendingfd=-1;
+	pendingSocket=0;
+	currentSocket=0;
+	rawfd=-1;
+	sockfd=createSocket(true);
+	sockets.push_back(sockfd);
 }
 
 /*!\brief Destruktor
  *
- * Stoppt den ReceiverThread (sofern er noch läuft) und schließt den Socket.
+ * Stoppt den ReceiverThread (sofern er noch läuft) und schließt die Sockets.
  */
 UDPEchoSenderThread::~UDPEchoSenderThread()
 {
 	receiver.threadStop();
-	if (sockfd) ::close(sockfd);
+	closeEventSet();
+	for (size_t i=0;i<sockets.size();i++) ::close(sockets[i]);
+	if (rawfd>=0) ::close(rawfd);
 }
 
 /*!\brief Zieladresse setzen
@@ -147,35 +222,51 @@ void UDPEchoSenderThread::connect(const ppl7::String &hostname, int port)
 		e = errno;
 		if (conres == 0) break;
 	} while ((res = res->ai_next) != NULL);
-	freeaddrinfo(ressave);
 	if (conres !=0 || res==NULL) {
+		freeaddrinfo(ressave);
 		ppl7::throwSocketException(e, ppl7::ToString("Host: %s, Port: %d", (const char*) hostname, port));
 	}
-
-	// Der Socket soll nicht blockieren, wenn keine Daten anstehen
-	fcntl(sockfd,F_SETFL,fcntl(sockfd,F_GETFL,0)|O_NONBLOCK);
-	int optval = 1;
-	//setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
-	socklen_t size=sizeof(optval);
-	if (getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &optval, &size) < 0) {
-		ppl7::throwSocketException(errno, ppl7::ToString("getsockopt failed on Host: %s, Port: %d", (const char*) hostname, port));
-	}
-	size = optval * 2;
-	if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size))!=0) {
-		ppl7::throwSocketException(errno, ppl7::ToString("setsockopt failed on Host: %s, Port: %d", (const char*) hostname, port));
+	configureSocket(sockfd, hostname, port);
+	// Alle weiteren Sockets gehen an die gleiche Adresse, der Kernel vergibt beim
+	// connect jedem einen eigenen Quellport
+	for (size_t i=1;i<sockets.size();i++) {
+		if (::connect(sockets[i], res->ai_addr, res->ai_addrlen)!=0) {
+			e=errno;
+			freeaddrinfo(ressave);
+			ppl7::throwSocketException(e, ppl7::ToString("Host: %s, Port: %d", (const char*) hostname, port));
+		}
+		configureSocket(sockets[i], hostname, port);
 	}
+	freeaddrinfo(ressave);
 }
 
 /*!\brief Paketgröße setzen
  *
  * Setzt die Paketgröße
- * @param size Paketgröße in Bytes
+ * @param size Paketgröße in Bytes, maximal UDPECHO_MAX_DATAGRAM_SIZE
+ *
+ * @exception ppl7::InvalidArgumentsException Wird geworfen, wenn die Paketgröße
+ * nicht in ein UDP-Datagramm passt
  */
 void UDPEchoSenderThread::setPacketsize(size_t size)
 {
+	if (size<sizeof(PACKET) || size>UDPECHO_MAX_DATAGRAM_SIZE)
+		throw ppl7::InvalidArgumentsException("UDPEchoSenderThread::setPacketsize");
 	packetsize=size;
 }
 
+/*!\brief Maximale Größe der Antwortpakete setzen
+ *
+ * Legt die Größe des Empfangspuffers im ReceiverThread fest. Größere Antwortpakete
+ * werden als "truncated" gezählt.
+ *
+ * @param size Größe in Bytes, maximal UDPECHO_MAX_DATAGRAM_SIZE
+ */
+void UDPEchoSenderThread::setMaxResponseSize(size_t size)
+{
+	receiver.setMaxPacketSize(size);
+}
+
 /*!\brief Laufzeit festlegen
  *
  * Legt die Laufzeit für den Testlauf fest.
@@ -259,19 +350,70 @@ static ppl7::SockAddr getSockAddr(const ppl7::String &Hostname, int Port)
 
 
 
+/*!\brief Quelladresse festlegen
+ *
+ * Bindet alle Sockets des Threads an die IP-Adresse \p ip, der Quellport wird vom Kernel
+ * vergeben. Muss nach UDPEchoSenderThread::setSocketCount und vor
+ * UDPEchoSenderThread::connect aufgerufen werden.
+ *
+ * @param ip IP-Adresse oder Hostname
+ */
 void UDPEchoSenderThread::setSourceIP(const ppl7::String &ip)
 {
-	ppl7::SockAddr sockaddr=::getSockAddr(ip,0);
-	struct sockaddr_in servaddr;
-	memset(&servaddr,0,sizeof(servaddr));
-	memcpy(&servaddr,sockaddr.addr(),sockaddr.size());
+	ppl7::Array ips;
+	ips.add(ip);
+	bindSources(ips, 0, 0);
+}
+
+/*!\brief Sockets auf Quelladressen und Quellports verteilen
+ *
+ * Socket \p i wird an die Adresse \p ips[(offset+i) % ips.size()] gebunden, mit mehreren
+ * Sockets pro Thread verteilen sich die Flows eines Threads so über alle Adressen der
+ * Liste. Ist \p port größer 0, erhält Socket \p i den Quellport \p port+i, ansonsten
+ * vergibt der Kernel den Port. Zusammen mit UDPEchoSenderThread::setFlowBuckets lassen
+ * sich Verluste dadurch Port- und Adressbereichen zuordnen.
+ *
+ * Muss nach UDPEchoSenderThread::setSocketCount und vor UDPEchoSenderThread::connect
+ * bzw. UDPEchoSenderThread::setTargets aufgerufen werden.
+ *
+ * @param ips Liste von IP-Adressen oder Hostnamen, bei einer leeren Liste wird an alle
+ * Adressen gebunden
+ * @param offset Position in \p ips für den ersten Socket
+ * @param port Quellport des ersten Sockets oder 0
+ * @exception ppl7::CouldNotBindToInterfaceException Adresse oder Port ist nicht verfügbar
+ * @exception ppl7::IllegalPortException Der Portbereich reicht über 65535 hinaus
+ */
+void UDPEchoSenderThread::bindSources(const ppl7::Array &ips, size_t offset, int port)
+{
+	if (port>0 && port+sockets.size()-1>65535)
+		throw ppl7::IllegalPortException("UDPEchoSenderThread::bindSources: %d+%zu", port, sockets.size());
+	std::vector<struct sockaddr_in> addrs;
+	for (size_t i=0;i<ips.size();i++) {
+		ppl7::SockAddr sockaddr=::getSockAddr(ips[i],0);
+		struct sockaddr_in servaddr;
+		memset(&servaddr,0,sizeof(servaddr));
+		memcpy(&servaddr,sockaddr.addr(),sockaddr.size());
+		addrs.push_back(servaddr);
+	}
+	if (addrs.empty()) {
+		struct sockaddr_in any;
+		memset(&any,0,sizeof(any));
+		any.sin_family=AF_INET;
+		any.sin_addr.s_addr=htonl(INADDR_ANY);
+		addrs.push_back(any);
+	}
+	for (size_t i=0;i<sockets.size();i++) {
+		struct sockaddr_in servaddr=addrs[(offset+i)%addrs.size()];
+		servaddr.sin_port=htons(port>0 ? (uint16_t)(port+i) : 0);
 		// Socket an die IP-Adresse und den Port binden
-	if (0 != ::bind(sockfd,(const struct sockaddr *)&servaddr, sizeof(servaddr))) {
-		int e=errno;
-		throw ppl7::CouldNotBindToInterfaceException("%s:%d, %s",
-				(const char*)sockaddr.toIPAddress().toString(),
-				sockaddr.port(),
-				strerror(e));
+		if (0 != ::bind(sockets[i],(const struct sockaddr *)&servaddr, sizeof(servaddr))) {
+			int e=errno;
+			ppl7::SockAddr sockaddr((const void*)&servaddr, sizeof(servaddr));
+			throw ppl7::CouldNotBindToInterfaceException("%s:%d, %s",
+					(const char*)sockaddr.toIPAddress().toString(),
+					sockaddr.port(),
+					strerror(e));
+		}
 	}
 }
 
@@ -285,52 +427,576 @@ void UDPEchoSenderThread::setAlwaysRandomize(bool flag)
 	this->alwaysRandomize=flag;
 }
 
-bool UDPEchoSenderThread::socketReady()
+/*!\brief DNS-Anfragen senden
+ *
+ * Ist ein DNSQueryCorpus gesetzt, verschickt der Thread statt der Echo-Pakete die
+ * Anfragen aus dem Corpus der Reihe nach. Jede Anfrage erhält eine fortlaufende
+ * Transaktions-ID, über die der ReceiverThread die Antworten zuordnet. Die Paketgröße
+ * wird in diesem Modus ignoriert.
+ *
+ * @param corpus Pointer auf den Corpus oder NULL. Der Corpus wird von allen Threads
+ * gemeinsam und nur lesend verwendet und muss während des Tests gültig bleiben.
+ */
+void UDPEchoSenderThread::setDNSQueryCorpus(const DNSQueryCorpus *corpus)
+{
+	this->corpus=corpus;
+	receiver.setDNSMode(corpus!=NULL);
+	if (corpus) corpusPosition=ppl7::rand(0, corpus->count()-1);
+}
+
+/*!\brief Prüfsumme über die Nutzdaten einfügen
+ *
+ * Jedes Paket wird vor dem Versand mit UDPEchoChecksum::seal versiegelt, der ReceiverThread
+ * prüft die Antworten und zählt beschädigte Pakete. Die Paketgröße muss dazu mindestens
+ * sizeof(PACKET_CHECKED) betragen.
+ *
+ * @param algorithm Verfahren, UDPEchoChecksum::NONE schaltet die Prüfung ab
+ */
+void UDPEchoSenderThread::setChecksum(UDPEchoChecksum::Algorithm algorithm)
+{
+	checksum=algorithm;
+	receiver.setChecksum(algorithm);
+}
+
+/*!\brief Anzahl Sockets pro Thread festlegen
+ *
+ * Mit mehr als einem Socket verhält sich der Thread wie viele Clients: jeder Socket ist
+ * mit dem Ziel verbunden und hat einen eigenen Quellport, die Pakete werden reihum auf
+ * die Sockets verteilt. Statt eines UDPEchoReceiverThread pro Socket liest der Thread
+ * die Antworten zwischen den Sendevorgängen selbst, wobei alle Sockets über ein
+ * gemeinsames epoll-Set überwacht werden. Damit lassen sich tausende Flows mit wenigen
+ * Threads erzeugen, etwa um die Verteilung per RSS auf dem Bouncer zu prüfen.
+ *
+ * Damit jeder Socket einen eigenen Quellport erhält, wird hier SO_REUSEADDR und
+ * SO_REUSEPORT für alle Sockets des Threads abgeschaltet. Muss vor
+ * UDPEchoSenderThread::setSourceIP und UDPEchoSenderThread::connect aufgerufen
+ * werden. Die Anzahl kann nur vergrößert werden.
+ *
+ * @param count Anzahl Sockets, mindestens 1 (Default)
+ * @exception ppl7::InvalidArgumentsException \p count ist kleiner als 1
+ * @exception ppl7::CouldNotOpenSocketException Socket konnte nicht angelegt werden,
+ * zum Beispiel weil das Limit für offene Dateien erreicht ist
+ */
+void UDPEchoSenderThread::setSocketCount(int count)
+{
+	if (count<1) throw ppl7::InvalidArgumentsException("UDPEchoSenderThread::setSocketCount");
+	if (count==1) return;
+	setReuse(sockfd, 0);
+	while (sockets.size()<(size_t)count) sockets.push_back(createSocket(false));
+}
+
+int UDPEchoSenderThread::getSocketCount() const
+{
+	return (int)sockets.size();
+}
+
+/*!\brief Senden und Empfangen im selben Thread
+ *
+ * Statt die Antworten in einem eigenen UDPEchoReceiverThread zu lesen, wechselt der
+ * Thread zwischen einem Burst von Sendevorgängen und dem Lesen aller anstehenden
+ * Antworten ohne zu blockieren ("Run-to-Completion"). Damit bleibt der Socket im Cache
+ * eines Kerns und es wird nur ein Thread pro Socket benötigt. Das Verhältnis wird mit
+ * UDPEchoSenderThread::setBurst eingestellt. Mit mehreren Sockets (siehe
+ * UDPEchoSenderThread::setSocketCount) arbeitet der Thread immer so.
+ *
+ * @param flag True oder False (Default)
+ */
+void UDPEchoSenderThread::setRunToCompletion(bool flag)
+{
+	runToCompletion=flag;
+}
+
+/*!\brief Verhältnis von Senden und Empfangen im selben Thread festlegen
+ *
+ * Nach jeweils \p send Paketen werden pro lesbarem Socket bis zu \p receive Antworten
+ * gebündelt per recvmmsg gelesen.
+ *
+ * @param send Anzahl Pakete pro Burst, mindestens 1 (Default=16)
+ * @param receive Anzahl Antworten pro Socket und Durchgang, zwischen 1 und 1024 (Default=16)
+ * @exception ppl7::InvalidArgumentsException Ein Wert liegt ausserhalb des gültigen
+ * Bereichs
+ */
+void UDPEchoSenderThread::setBurst(int send, int receive)
+{
+	if (send<1 || receive<1 || receive>MAX_RECEIVE_BURST)
+		throw ppl7::InvalidArgumentsException("UDPEchoSenderThread::setBurst");
+	sendBurst=send;
+	receiveBurst=receive;
+}
+
+/*!\brief Mehrere Ziele reihum anschreiben
+ *
+ * Statt mit UDPEchoSenderThread::connect an ein einzelnes Ziel gebunden zu sein, bleiben
+ * die Sockets unverbunden und jedes Paket geht an das nächste Ziel aus \p targets. Die
+ * Pakete werden dabei gebündelt und mit einem Aufruf von sendmmsg verschickt, jede
+ * Nachricht trägt ihre eigene Zieladresse. Die Größe eines Bündels entspricht dem
+ * Sende-Burst aus UDPEchoSenderThread::setBurst, mit mehreren Sockets wechselt der
+ * Socket pro Bündel. Bei aktiviertem Rate-Limit wird spätestens am Ende jeder
+ * Zeitscheibe gesendet, der Zeitstempel im Paket weicht daher höchstens um die Dauer
+ * eines Bündels vom tatsächlichen Versand ab.
+ *
+ * Gesendete und empfangene Pakete, Fehler und Laufzeiten werden zusätzlich pro Ziel
+ * gezählt (siehe UDPEchoSenderThread::getTargets). Jeder Thread beginnt an einer
+ * zufälligen Position der Liste.
+ *
+ * Damit jeder Socket einen eigenen Quellport erhält, wird SO_REUSEADDR und SO_REUSEPORT
+ * wie bei UDPEchoSenderThread::setSocketCount abgeschaltet. Muss nach
+ * UDPEchoSenderThread::setSocketCount und vor UDPEchoSenderThread::setSourceIP
+ * aufgerufen werden und ersetzt UDPEchoSenderThread::connect.
+ *
+ * @param targets Liste der Ziele, wird kopiert
+ * @exception ppl7::InvalidArgumentsException Die Liste ist leer
+ */
+void UDPEchoSenderThread::setTargets(const UDPEchoTargetTable &targets)
+{
+	if (targets.size()==0) throw ppl7::InvalidArgumentsException("UDPEchoSenderThread::setTargets");
+	this->targets=targets;
+	this->targets.clearCounter();
+	targetIndex=ppl7::rand(0, targets.size()-1);
+	receiver.setTargets(targets);
+	ppl7::SockAddr first((const void*)&targets[0].addr, (size_t)targets[0].addrlen);
+	for (size_t i=0;i<sockets.size();i++) {
+		setReuse(sockets[i], 0);
+		configureSocket(sockets[i], first.toIPAddress().toString(), first.port());
+	}
+}
+
+/*!\brief epoll-Set über alle Sockets anlegen
+ *
+ * Wird nur im Multi-Socket-Betrieb benötigt, wenn die Antworten gezählt werden.
+ */
+void UDPEchoSenderThread::openEventSet()
+{
+	closeEventSet();
+	epollfd=epoll_create1(EPOLL_CLOEXEC);
+	if (epollfd<0) ppl7::throwSocketException(errno, "epoll_create1");
+	for (size_t i=0;i<sockets.size();i++) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events=EPOLLIN;
+		ev.data.u64=i;
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, sockets[i], &ev)<0) {
+			int e=errno;
+			closeEventSet();
+			ppl7::throwSocketException(e, "epoll_ctl");
+		}
+	}
+}
+
+void UDPEchoSenderThread::closeEventSet()
 {
-	fd_set wset;
-	struct timeval timeout;
-	timeout.tv_sec=0;
-	timeout.tv_usec=100;
-	FD_ZERO(&wset);
-	FD_SET(sockfd,&wset); // Wir wollen nur prüfen, ob wir schreiben können
-	int ret=select(sockfd+1,NULL,&wset,NULL,&timeout);
-	if (ret<0) return false;
-	if (FD_ISSET(sockfd,&wset)) {
-		return true;
+	if (epollfd>=0) ::close(epollfd);
+	epollfd=-1;
+}
+
+/*!\brief Anstehende Antworten im eigenen Thread lesen
+ *
+ * Wartet höchstens \p timeout Sekunden auf Antworten und übergibt die lesbaren
+ * Sockets an UDPEchoReceiverThread::receive. Mit mehreren Sockets werden diese über das
+ * epoll-Set ermittelt. Pro Socket werden höchstens so viele Pakete gelesen, wie mit
+ * UDPEchoSenderThread::setBurst eingestellt, damit einzelne Flows die anderen nicht
+ * verdrängen und die Sendeschleife nicht zu lange ruht. Der Rest wird beim nächsten
+ * Aufruf gelesen.
+ *
+ * Gewartet wird mit ppoll auf dem Socket bzw. dem epoll-Deskriptor, damit auch
+ * Wartezeiten unterhalb einer Millisekunde nicht aufgerundet oder verschlafen werden.
+ * Im latenzarmen Modus (siehe UDPEchoLowLatency) wird während des Timeouts nicht
+ * geschlafen, sondern ununterbrochen abgefragt.
+ *
+ * @param timeout Timeout in Sekunden, 0 kehrt sofort zurück
+ * @return Anzahl lesbarer Sockets
+ */
+int UDPEchoSenderThread::drainResponses(double timeout)
+{
+	if (timeout>0.0) {
+		if (busyPoll) {
+			double end=ppl7::GetMicrotime()+timeout;
+			int n;
+			while ((n=drainResponses(0.0))==0 && ppl7::GetMicrotime()<end) UDPEchoLowLatency::relax();
+			return n;
+		}
+		struct pollfd pfd;
+		struct timespec ts;
+		pfd.fd=(epollfd<0) ? sockfd : epollfd;
+		pfd.events=POLLIN;
+		pfd.revents=0;
+		ts.tv_sec=(time_t)timeout;
+		ts.tv_nsec=(long)((timeout-(double)ts.tv_sec)*1000000000.0);
+		if (ppoll(&pfd, 1, &ts, NULL)<=0) return 0;
 	}
-	return false;
+	if (epollfd<0) return receiver.receive(sockfd, receiveBurst, flowBucket(0))>0 ? 1 : 0;
+	struct epoll_event events[EPOLL_EVENTS];
+	int n=epoll_wait(epollfd, events, EPOLL_EVENTS, 0);
+	for (int i=0;i<n;i++) {
+		size_t socket=(size_t)events[i].data.u64;
+		receiver.receive(sockets[socket], receiveBurst, flowBucket(socket));
+	}
+	return n;
 }
 
+/*!\brief Prüfen, ob der Socket \p fd Pakete annimmt
+ *
+ * Verwendet ppoll statt select, da die Deskriptoren im Multi-Socket-Betrieb über
+ * FD_SETSIZE liegen können.
+ *
+ * @param fd Socket
+ * @param timeout_usec Maximale Wartezeit in Mikrosekunden
+ * @return \c true, wenn der Socket schreibbar ist
+ */
+bool UDPEchoSenderThread::socketReady(int fd, long timeout_usec)
+{
+	struct pollfd pfd;
+	struct timespec ts;
+	pfd.fd=fd;
+	pfd.events=POLLOUT;
+	pfd.revents=0;
+	ts.tv_sec=timeout_usec/1000000;
+	ts.tv_nsec=(timeout_usec%1000000)*1000;
+	if (ppoll(&pfd, 1, &ts, NULL)<=0) return false;
+	return (pfd.revents&POLLOUT)!=0;
+}
 
 
-/*!\brief Einzelnes Paket senden
+
+/*!\brief Verluste und Laufzeiten pro Gruppe von Flows zählen
  *
- * Generiert ein neues Paket. Die ersten 8 Byte enthalten dabei eine eindeutige fortlaufende
- * ID, die nächsten 8 Byte einen Wert in Double-Precision mit der aktuellen, mikrosekunden genauen
- * Uhrzeit des Servers. Anhand der Uhrzeit kann die Laufzeit eines rückkehrenden Pakets berechnet
+ * Jeder Socket des Threads ist ein Flow, Socket \p i trägt die Nummer \p firstFlow+i
+ * über alle Threads. Gesendete Pakete und Fehler zählt der Thread, Antworten und
+ * Laufzeiten der Empfänger in der Gruppe des Sockets, über den sie gelesen wurden
+ * (siehe UDPEchoFlowBuckets). Muss nach UDPEchoSenderThread::setSocketCount aufgerufen
  * werden.
+ *
+ * @param flows Gruppen, werden kopiert. Eine leere Liste schaltet die Zählung ab.
+ * @param firstFlow Nummer des ersten Sockets des Threads
+ */
+void UDPEchoSenderThread::setFlowBuckets(const UDPEchoFlowBuckets &flows, size_t firstFlow)
+{
+	this->flows=flows;
+	this->flows.clearCounter();
+	socketBucket.clear();
+	if (flows.size()==0) {
+		receiver.setFlowBuckets(flows, -1);
+		return;
+	}
+	for (size_t i=0;i<sockets.size();i++) {
+		size_t flow=firstFlow+i;
+		if (flow>=flows.getFlowCount()) flow=flows.getFlowCount()-1;
+		socketBucket.push_back((uint16_t)flows.bucketOf(flow));
+	}
+	receiver.setFlowBuckets(flows, socketBucket[0]);
+}
+
+/*!\brief Pakete über einen Raw-Socket mit selbst erzeugten Headern senden
+ *
+ * Statt über den UDP-Socket werden die Pakete über einen Raw-Socket mit IP_HDRINCL an
+ * das Ziel aus \p raw geschickt, jedes Paket reihum mit der nächsten Quelladresse aus
+ * dessen Netz (siehe UDPEchoRawPacket). Die Threads sollten mit unterschiedlichen
+ * Werten für \p offset beginnen. Ratenbegrenzung, PACKET-Header und Prüfsummen-Modus
+ * bleiben unverändert.
+ *
+ * Der UDP-Socket des Threads wird an die Wildcard-Adresse und den Quellport der Pakete
+ * gebunden. Ist das Netz der Quelladressen auf dem Sender lokal geroutet (z.B. mit
+ * "ip route add local 10.0.0.0/8 dev lo"), landen die Antworten des Bouncers dort und
+ * werden wie gewohnt gezählt, ansonsten sollte mit \c --ignore gesendet werden.
+ *
+ * Wird anstelle von UDPEchoSenderThread::connect aufgerufen und benötigt CAP_NET_RAW.
+ * Der Thread darf nur einen Socket haben.
+ *
+ * @param raw Ziel und Quelladressen, wird kopiert
+ * @param offset Position der ersten Quelladresse
+ * @param port Quellport oder 0, damit ihn der Kernel vergibt
+ * @exception ppl7::InvalidArgumentsException Der Thread hat mehrere Sockets
+ * @exception ppl7::IllegalArgumentException Ziel und Quelladressen haben unterschiedliche
+ * Adressfamilien
+ * @exception ppl7::CouldNotOpenSocketException Der Raw-Socket konnte nicht angelegt werden
+ * @exception ppl7::CouldNotBindToInterfaceException Der Quellport ist nicht verfügbar
  */
-void UDPEchoSenderThread::sendPacket()
+void UDPEchoSenderThread::setRawPacket(const UDPEchoRawPacket &raw, uint64_t offset, int port)
 {
-	PACKET *p=(PACKET*)buffer.ptr();
+	if (sockets.size()>1) throw ppl7::InvalidArgumentsException("UDPEchoSenderThread::setRawPacket");
+	if (raw.getDestinationLength()==0 || raw.getDestination()->sa_family!=raw.getFamily())
+		throw ppl7::IllegalArgumentException("UDPEchoSenderThread::setRawPacket: Ziel und Quelladressen passen nicht zusammen");
+	if (rawfd>=0) ::close(rawfd);
+	rawfd=::socket(raw.getFamily(), SOCK_RAW, IPPROTO_RAW);
+	if (rawfd<0) throw ppl7::CouldNotOpenSocketException("Could not create raw socket: %s", strerror(errno));
+	fcntl(rawfd,F_SETFL,fcntl(rawfd,F_GETFL,0)|O_NONBLOCK);
+#ifdef IPV6_HDRINCL
+	if (raw.getFamily()==AF_INET6) {
+		int on=1;
+		setsockopt(rawfd, IPPROTO_IPV6, IPV6_HDRINCL, &on, sizeof(on));
+	}
+#endif
+	if (raw.getFamily()!=AF_INET) {
+		::close(sockfd);
+		sockfd=::socket(raw.getFamily(), SOCK_DGRAM, 0);
+		sockets[0]=sockfd;
+		if (sockfd<0) throw ppl7::CouldNotOpenSocketException("Could not create Socket: %s", strerror(errno));
+	}
+	setReuse(sockfd, 0);
+	struct sockaddr_storage any;
+	socklen_t len=(raw.getFamily()==AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	memset(&any, 0, sizeof(any));
+	any.ss_family=(sa_family_t)raw.getFamily();
+	if (raw.getFamily()==AF_INET6) ((struct sockaddr_in6*)&any)->sin6_port=htons((uint16_t)port);
+	else ((struct sockaddr_in*)&any)->sin_port=htons((uint16_t)port);
+	if (0 != ::bind(sockfd, (const struct sockaddr *)&any, len)) {
+		throw ppl7::CouldNotBindToInterfaceException("*:%d, %s", port, strerror(errno));
+	}
+	if (getsockname(sockfd, (struct sockaddr *)&any, &len)<0)
+		ppl7::throwSocketException(errno, "UDPEchoSenderThread::setRawPacket");
+	port=ppl7::SockAddr((const void*)&any, (size_t)len).port();
+	configureSocket(sockfd, "*", port);
+	this->raw=raw;
+	this->raw.setSourcePort(port);
+	this->raw.seek(offset);
+}
+
+/*!\brief Sendepuffer aus dem Paketpool holen
+ *
+ * Im Multi-Ziel-Betrieb wird ein Puffer pro Paket eines Bündels angelegt und mit den
+ * Nachrichten für sendmmsg verknüpft, ansonsten genügt ein Puffer. Echo-Pakete erhalten
+ * eine zufällige Payload. Im Raw-Modus bleibt vor der Payload Platz für die Header,
+ * die Payload selbst liegt weiterhin an einer durch 8 teilbaren Adresse.
+ */
+void UDPEchoSenderThread::allocateSendBuffers()
+{
+	size_t slots=1;
+	if (targets.size()>0) slots=(size_t)(sendBurst<MAX_SEND_BATCH ? sendBurst : MAX_SEND_BATCH);
+	size_t size=corpus ? corpus->getMaxQuerySize() : packetsize;
+	size_t headroom=(rawfd>=0) ? UDPEchoRawPacket::MaxHeaderSize : 0;
+	pool.allocate(slots, size+headroom);
+	ppl7::ByteArray payload;
+	if (!corpus) payload=ppl7::Random(packetsize);
+	batchMsgs.clear();
+	batchIovecs.clear();
+	batchTargets.clear();
+	pending=0;
+	for (size_t i=0;i<slots;i++) {
+		unsigned char *b=(unsigned char*)pool.acquire()+headroom;
+		if (!corpus) memcpy(b, payload.ptr(), packetsize);
+		if (i==0) buffer=b;
+		if (targets.size()>0) {
+			struct iovec iov;
+			iov.iov_base=b;
+			iov.iov_len=size;
+			batchIovecs.push_back(iov);
+		}
+	}
+	if (targets.size()>0) {
+		batchMsgs.resize(slots);
+		batchTargets.resize(slots);
+		memset(&batchMsgs[0], 0, slots*sizeof(struct mmsghdr));
+		for (size_t i=0;i<slots;i++) {
+			batchMsgs[i].msg_hdr.msg_iov=&batchIovecs[i];
+			batchMsgs[i].msg_hdr.msg_iovlen=1;
+		}
+	}
+	if (rawfd>=0) {
+		raw.prepare(buffer-raw.getHeaderSize(), corpus ? 0 : packetsize,
+				checksum!=UDPEchoChecksum::NONE ? sizeof(PACKET_CHECKED) : sizeof(PACKET));
+	}
+}
+
+/*!\brief Echo-Paket im Puffer \p b erzeugen
+ *
+ * Die ersten 8 Byte enthalten dabei eine eindeutige fortlaufende ID, die nächsten 8 Byte
+ * einen Wert in Double-Precision mit der aktuellen, mikrosekunden genauen Uhrzeit des
+ * Servers. Anhand der Uhrzeit kann die Laufzeit eines rückkehrenden Pakets berechnet
+ * werden.
+ *
+ * @return Größe des Pakets
+ */
+size_t UDPEchoSenderThread::preparePacket(unsigned char *b)
+{
+	PACKET *p=(PACKET*)b;
 	if (alwaysRandomize) {
-		char *b=(char*)p;
 		for (size_t i=0;i<packetsize;i++) {
-			b[i]=(char)ppl7::rand(0,255);
+			b[i]=(unsigned char)ppl7::rand(0,255);
 		}
 	}
 	p->time=ppl7::GetMicrotime();
-	ssize_t n=::send(sockfd,p,packetsize,0);
-	if (n>0 && (size_t)n==packetsize) {
+	if (checksum!=UDPEchoChecksum::NONE) UDPEchoChecksum::seal(checksum, p, packetsize);
+	return packetsize;
+}
+
+/*!\brief Nächste DNS-Anfrage im Puffer \p b erzeugen
+ *
+ * Kopiert die nächste Anfrage aus dem DNSQueryCorpus in den Puffer, trägt eine
+ * neue Transaktions-ID ein und merkt sich im ReceiverThread den Sendezeitpunkt.
+ *
+ * @return Größe der Anfrage
+ */
+size_t UDPEchoSenderThread::prepareQuery(unsigned char *b)
+{
+	size_t size;
+	const unsigned char *query=corpus->query(corpusPosition, size);
+	if (++corpusPosition>=corpus->count()) corpusPosition=0;
+	memcpy(b, query, size);
+	uint16_t id=queryId++;
+	DNSPut16(b, id);
+	if (!ignoreResponses) receiver.setQueryTime(id, ppl7::GetMicrotime());
+	return size;
+}
+
+/*!\brief Ergebnis eines Sendevorgangs zählen
+ *
+ * Das Paket wird der Gruppe des zuletzt mit nextSocket gewählten Sockets zugerechnet.
+ *
+ * @param n Rückgabewert von send bzw. Länge aus sendmmsg, bei einem negativen Wert
+ * wird errno ausgewertet
+ * @param size Größe des Pakets
+ */
+void UDPEchoSenderThread::countSend(ssize_t n, size_t size)
+{
+	if (n>0 && (size_t)n==size) {
 		counter_send++;
+		bytes_send+=n;
+		if (!socketBucket.empty()) flows[socketBucket[currentSocket]].countSend(n);
 	} else if (n<0) {
 		if (errno<255) counter_errorcodes[errno]++;
 		errors++;
+		if (!socketBucket.empty()) flows[socketBucket[currentSocket]].errors++;
 	} else {
 		counter_0bytes++;
 	}
 }
 
+/*!\brief Paket über den nicht blockierenden Socket \p fd senden
+ *
+ * Ist der Sendepuffer des Sockets voll, liefert send EAGAIN. Das ist kein Sendefehler,
+ * sondern Gegendruck des Kernels: Es wird gewartet, bis der Socket wieder schreibbar
+ * ist, und erneut gesendet. Erst wenn der Socket für SendTimeoutUsec nicht schreibbar
+ * wird, wird der Fehler an den Aufrufer gemeldet.
+ *
+ * @return Rückgabewert von send
+ */
+ssize_t UDPEchoSenderThread::sendDatagram(int fd, const void *data, size_t size)
+{
+	ssize_t n;
+	while ((n=::send(fd,data,size,0))<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) {
+		if (!socketReady(fd, SendTimeoutUsec)) break;
+	}
+	return n;
+}
+
+/*!\brief Einzelnes Paket senden
+ *
+ * Generiert mit UDPEchoSenderThread::preparePacket ein neues Paket und sendet es über
+ * den verbundenen Socket \p fd.
+ */
+void UDPEchoSenderThread::sendPacket(int fd)
+{
+	size_t size=preparePacket(buffer);
+	countSend(sendDatagram(fd,buffer,size), size);
+}
+
+/*!\brief Einzelne DNS-Anfrage senden
+ */
+void UDPEchoSenderThread::sendQuery(int fd)
+{
+	size_t size=prepareQuery(buffer);
+	countSend(sendDatagram(fd,buffer,size), size);
+}
+
+/*!\brief Paket über den Raw-Socket senden
+ *
+ * Die Header vor der Payload sind bereits vorbereitet, UDPEchoRawPacket::finish trägt
+ * nur noch die nächste Quelladresse und die Prüfsumme ein. Ändert sich die Payload
+ * vollständig (DNS-Anfragen, \c --ar), wird die Prüfsumme komplett neu berechnet.
+ * Gezählt werden wie im UDP-Betrieb nur die Bytes der Payload. Der Raw-Socket ist nicht
+ * blockierend, ein voller Sendepuffer wird wie in UDPEchoSenderThread::sendDatagram
+ * abgewartet.
+ */
+void UDPEchoSenderThread::sendRaw()
+{
+	size_t header=raw.getHeaderSize();
+	unsigned char *packet=buffer-header;
+	size_t size;
+	if (corpus) {
+		size=raw.finish(packet, prepareQuery(buffer));
+	} else if (alwaysRandomize) {
+		size=raw.finish(packet, preparePacket(buffer));
+	} else {
+		preparePacket(buffer);
+		size=raw.finish(packet);
+	}
+	ssize_t n;
+	while ((n=::sendto(rawfd, packet, size, 0, raw.getDestination(), raw.getDestinationLength()))<0
+			&& (errno==EAGAIN || errno==EWOULDBLOCK)) {
+		if (!socketReady(rawfd, SendTimeoutUsec)) break;
+	}
+	countSend(n>=(ssize_t)header ? n-(ssize_t)header : n, size-header);
+}
+
+/*!\brief Paket für das nächste Ziel in das aktuelle Bündel stellen
+ *
+ * Ist das Bündel voll, wird es mit UDPEchoSenderThread::flushPackets verschickt. Das
+ * Bündel geht über den Socket \p fd des ersten Pakets.
+ */
+void UDPEchoSenderThread::queuePacket(int fd)
+{
+	if (!pending) {
+		pendingfd=fd;
+		pendingSocket=currentSocket;
+	}
+	struct iovec &iov=batchIovecs[pending];
+	unsigned char *b=(unsigned char*)iov.iov_base;
+	iov.iov_len=corpus ? prepareQuery(b) : preparePacket(b);
+	UDPEchoTargetTable::Target &t=targets[targetIndex];
+	batchMsgs[pending].msg_hdr.msg_name=&t.addr;
+	batchMsgs[pending].msg_hdr.msg_namelen=t.addrlen;
+	batchTargets[pending]=(uint32_t)targetIndex;
+	if (++targetIndex>=targets.size()) targetIndex=0;
+	if (++pending>=batchMsgs.size()) flushPackets();
+}
+
+/*!\brief Aktuelles Bündel per sendmmsg verschicken
+ *
+ * sendmmsg bricht beim ersten Fehler ab und liefert die Anzahl bis dahin gesendeter
+ * Pakete. Das fehlerhafte Paket wird gezählt und übersprungen, der Rest des Bündels
+ * mit einem weiteren Aufruf gesendet. Ist der Sendepuffer voll (EAGAIN), wird wie in
+ * UDPEchoSenderThread::sendDatagram gewartet, bis der Socket wieder schreibbar ist.
+ */
+void UDPEchoSenderThread::flushPackets()
+{
+	size_t done=0;
+	currentSocket=pendingSocket;
+	while (done<pending) {
+		int n=::sendmmsg(pendingfd, &batchMsgs[done], (unsigned int)(pending-done), 0);
+		if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK) && socketReady(pendingfd, SendTimeoutUsec)) continue;
+		if (n<=0) {
+			countSend(-1, batchIovecs[done].iov_len);
+			targets[batchTargets[done]].errors++;
+			done++;
+			continue;
+		}
+		for (int i=0;i<n;i++, done++) {
+			size_t size=batchIovecs[done].iov_len;
+			ssize_t len=(ssize_t)batchMsgs[done].msg_len;
+			countSend(len, size);
+			if ((size_t)len==size) {
+				UDPEchoTargetTable::Target &t=targets[batchTargets[done]];
+				t.packets_send++;
+				t.bytes_send+=len;
+			}
+		}
+	}
+	pending=0;
+}
+
+/*!\brief Paket oder DNS-Anfrage über den Socket \p fd senden
+ *
+ * Im Multi-Ziel-Betrieb wird das Paket nur in das aktuelle Bündel gestellt, im Raw-Modus
+ * geht es unabhängig von \p fd über den Raw-Socket.
+ */
+void UDPEchoSenderThread::send(int fd)
+{
+	if (rawfd>=0) sendRaw();
+	else if (targets.size()>0) queuePacket(fd);
+	else if (corpus) sendQuery(fd);
+	else sendPacket(fd);
+}
+
 /*!\brief Worker-Thread
  *
  * Diese Methode ist der Einstiegspunkt fuer den Workerthread. Hier wird der Socket initialisiert
@@ -339,29 +1005,51 @@ void UDPEchoSenderThread::sendPacket()
  * wurde oder nicht, wird entweder die Methode SenderThread::runWithRateLimit oder SenderThread::runWithoutRateLimit
  * aufgerufen. Nach Ablauf der Laufzeit wird dann noch die Methode SenderThread::waitForTimeout
  * aufgerufen, bevor der Socket wieder geschlossen wird.
+ *
+ * Hat der Thread mehrere Sockets (siehe UDPEchoSenderThread::setSocketCount) oder ist
+ * UDPEchoSenderThread::setRunToCompletion gesetzt, wird kein ReceiverThread gestartet,
+ * die Antworten werden stattdessen in diesem Thread gelesen.
  */
 void UDPEchoSenderThread::run()
 {
 	threadSetName("UDPEchoSenderThread");
-	buffer=ppl7::Random(packetsize);
+	allocateSendBuffers();
 	receiver.setSocketDescriptor(sockfd);
 	receiver.resetCounter();
-	if (!ignoreResponses)
+	targets.clearCounter();
+	flows.clearCounter();
+	currentSocket=0;
+	socketIndex=0;
+	inlineReceive=(!ignoreResponses && (runToCompletion || sockets.size()>1));
+	busyPoll=(inlineReceive && UDPEchoLowLatency::isEnabled());
+	for (size_t i=0;i<sockets.size();i++) UDPEchoLowLatency::configureSocket(sockets[i]);
+	if (inlineReceive) {
+		receiver.allocateBuffer((size_t)receiveBurst);
+		if (sockets.size()>1) openEventSet();
+		// Dieser Thread misst die Laufzeiten selbst
+		UDPEchoLowLatency::applyScheduling();
+	} else if (!ignoreResponses) {
 		receiver.threadStart();
+	}
 	counter_send=0;
+	bytes_send=0;
 	counter_0bytes=0;
 	errors=0;
 	duration=0.0;
 	for (int i=0;i<255;i++) counter_errorcodes[i]=0;
+	if (UDPEchoPerfCounter::isEnabled()) perf.open();
 	double start=ppl7::GetMicrotime();
 	if (queryrate>0) {
 		runWithRateLimit();
 	} else {
 		runWithoutRateLimit();
 	}
+	if (pending>0) flushPackets();
 	duration=ppl7::GetMicrotime()-start;
+	perf.stop();
 	waitForTimeout();
 	receiver.threadStop();
+	closeEventSet();
 	//close(sockfd);
 }
 
@@ -374,9 +1062,16 @@ void UDPEchoSenderThread::runWithoutRateLimit()
 	double start=ppl7::GetMicrotime();
 	double end=start+(double)runtime;
 	double now,next_checktime=start+0.1;
+	int burst=0;
 	while (1) {
-		if (socketReady()) {
-			sendPacket();
+		if (inlineReceive || sockets.size()>1) {
+			send(nextSocket());
+			if (inlineReceive && ++burst>=sendBurst) {
+				burst=0;
+				drainResponses(0.0);
+			}
+		} else if (socketReady(rawfd>=0 ? rawfd : sockfd)) {
+			send(sockfd);
 		}
 		now=ppl7::GetMicrotime();
 		if (now>next_checktime) {
@@ -405,9 +1100,9 @@ ppl7::SockAddr UDPEchoSenderThread::getSockAddr() const
 {
 	if (!sockfd)
 		throw ppl7::NotConnectedException();
-	struct sockaddr addr;
+	struct sockaddr_storage addr;
 	socklen_t len=sizeof(addr);
-	int ret=getsockname(sockfd, &addr, &len);
+	int ret=getsockname(sockfd, (struct sockaddr *)&addr, &len);
 	if (ret<0) ppl7::throwSocketException(errno, "UDPEchoSenderThread::getSockAddr");
 	return ppl7::SockAddr((const void*)&addr,(size_t)len);
 }
@@ -446,6 +1141,7 @@ void UDPEchoSenderThread::runWithRateLimit()
 	double start=ppl7::GetMicrotime();
 	double end=start+(double)runtime;
 	double total_idle=0.0;
+	int burst=0;
 
 	for (int64_t z=0;z<total_zeitscheiben;z++) {
 		naechste_zeitscheibe+=Zeitscheibe;
@@ -454,12 +1150,23 @@ void UDPEchoSenderThread::runWithRateLimit()
 		if (restscheiben==1)
 			queries_pro_zeitscheibe=queries_rest;
 		for (int64_t i=0;i<queries_pro_zeitscheibe;i++) {
-			sendPacket();
+			send(nextSocket());
+			if (inlineReceive && ++burst>=sendBurst) {
+				burst=0;
+				drainResponses(0.0);
+			}
 		}
+		if (pending>0) flushPackets();
 
 		queries_rest-=queries_pro_zeitscheibe;
+		if (inlineReceive) drainResponses(0.0);
 		while ((now=getNsec())<naechste_zeitscheibe) {
-			if (now<naechste_zeitscheibe) {
+			if (busyPoll) {
+				if (!drainResponses(0.0)) UDPEchoLowLatency::relax();
+			} else if (inlineReceive) {
+				// Auf Antworten warten, solange die Zeitscheibe es zulässt
+				drainResponses(naechste_zeitscheibe-now);
+			} else {
 				total_idle+=naechste_zeitscheibe-now;
 				ts.tv_sec=0;
 				ts.tv_nsec=(naechste_zeitscheibe-now)*1000000000;
@@ -485,7 +1192,8 @@ void UDPEchoSenderThread::runWithRateLimit()
  *
  * Diese Methode wird aufgerufen, nachdem das Senden der Pakete beendet wurde. Sie wartet
  * noch solange auf rückkehrende Pakete, bis der mittels SenderThread::setTimeout
- * eingestellte Timeout erreicht ist
+ * eingestellte Timeout erreicht ist. Liest der Thread die Antworten selbst, geschieht das
+ * dabei weiter.
  */
 void UDPEchoSenderThread::waitForTimeout()
 {
@@ -497,7 +1205,8 @@ void UDPEchoSenderThread::waitForTimeout()
 			next_checktime=now+0.1;
 			if (this->threadShouldStop()) break;
 		}
-		ppl7::MSleep(10);
+		if (inlineReceive) drainResponses(0.01);
+		else ppl7::MSleep(10);
 	}
 }
 
@@ -510,6 +1219,15 @@ int64_t UDPEchoSenderThread::getPacketsSend() const
 	return counter_send;
 }
 
+/*!\brief Anzahl gesendeter Bytes auslesen
+ *
+ * @return Anzahl Bytes
+ */
+int64_t UDPEchoSenderThread::getBytesSend() const
+{
+	return bytes_send;
+}
+
 /*!\brief Anzahl empfangender Pakete auslesen
  *
  * @return Anzahl Pakete
@@ -528,6 +1246,33 @@ int64_t UDPEchoSenderThread::getBytesReceived() const
 	return receiver.getBytesReceived();
 }
 
+/*!\brief Anzahl abgeschnittener Antwortpakete auslesen
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoSenderThread::getPacketsTruncated() const
+{
+	return receiver.getPacketsTruncated();
+}
+
+/*!\brief Anzahl beschädigter Antwortpakete auslesen
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoSenderThread::getPacketsCorrupted() const
+{
+	return receiver.getPacketsCorrupted();
+}
+
+/*!\brief Anzahl Antwortpakete mit falscher Länge auslesen
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoSenderThread::getPacketsLengthMismatch() const
+{
+	return receiver.getPacketsLengthMismatch();
+}
+
 /*!\brief Anzahl beim Senden aufgetretener Fehler auslesen
  *
  * @return Anzahl Fehler
@@ -548,6 +1293,34 @@ int64_t UDPEchoSenderThread::getCounterErrorCode(int err) const
 	return 0;}
 
 
+/*!\brief Anzahl DNS-Antworten ohne passende Anfrage auslesen
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoSenderThread::getDNSUnmatched() const
+{
+	return receiver.getDNSUnmatched();
+}
+
+/*!\brief Anzahl empfangener Pakete auslesen, die keine DNS-Antwort waren
+ *
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoSenderThread::getDNSInvalid() const
+{
+	return receiver.getDNSInvalid();
+}
+
+/*!\brief Anzahl DNS-Antworten mit einem bestimmten RCODE auslesen
+ *
+ * @param rcode RCODE zwischen 0 und 15
+ * @return Anzahl Pakete
+ */
+int64_t UDPEchoSenderThread::getRcodeCounter(int rcode) const
+{
+	return receiver.getRcodeCounter(rcode);
+}
+
 /*!\brief Tatsächliche Laufzeit des Tests auslesen
  *
  * @return Laufzeit in Sekunden, mit mikrosekundengenauen Nachkommastellen
@@ -584,3 +1357,65 @@ double UDPEchoSenderThread::getRoundTripTimeMax() const
 	return receiver.getRoundTripTimeMax();
 }
 
+/*!\brief Histogramm der Paketlaufzeiten auslesen
+ *
+ * @return Referenz auf das Histogramm des Receivers
+ */
+const UDPEchoLatencyHistogram &UDPEchoSenderThread::getLatencyHistogram() const
+{
+	return receiver.getLatencyHistogram();
+}
+
+/*!\brief Anzahl in den Empfangspuffern der Sockets verworfener Antworten auslesen
+ *
+ * @return Summe der Zähler aller Sockets seit deren Erzeugen, 0 falls der Kernel
+ * den Zähler nicht liefert. Jeder Zähler ist 32 Bit breit und läuft über,
+ * Differenzen sind daher modulo 2^32 zu bilden.
+ */
+int64_t UDPEchoSenderThread::getSocketDrops() const
+{
+	int64_t total=0;
+	for (size_t i=0;i<sockets.size();i++) {
+		int64_t drops=::getSocketDrops(sockets[i]);
+		if (drops>0) total+=drops;
+	}
+	return total;
+}
+
+/*!\brief Zähler der PMU für Sende- und Empfangsschleife auslesen
+ *
+ * Darf erst nach Ende des Threads aufgerufen werden.
+ *
+ * @param send Nimmt die Werte der Sendeschleife auf
+ * @param receive Nimmt die Werte des UDPEchoReceiverThread auf
+ */
+void UDPEchoSenderThread::getPerfCounter(UDPEchoPerfCounter::Values &send, UDPEchoPerfCounter::Values &receive) const
+{
+	perf.read(send);
+	receiver.getPerfCounter(receive);
+}
+
+/*!\brief Messwerte pro Ziel zur Tabelle \p result addieren
+ *
+ * Führt die Sendezähler des Threads und die Antworten des Receivers zusammen. Darf erst
+ * nach Ende des Threads aufgerufen werden.
+ *
+ * @param result Tabelle, leer oder mit den gleichen Zielen
+ */
+void UDPEchoSenderThread::getTargets(UDPEchoTargetTable &result) const
+{
+	result.merge(targets);
+	result.merge(receiver.getTargets());
+}
+
+/*!\brief Messwerte pro Gruppe von Flows zu \p result addieren
+ *
+ * Darf erst nach Ende des Threads aufgerufen werden.
+ *
+ * @param result Gruppen, leer oder mit der gleichen Anzahl Gruppen
+ */
+void UDPEchoSenderThread::getFlowBuckets(UDPEchoFlowBuckets &result) const
+{
+	result.merge(flows);
+	result.merge(receiver.getFlowBuckets());
+}
@@ -0,0 +1,176 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <ppl7.h>
+
+#include "statslog.h"
+#include "wire.h"
+
+/*!@file
+ * \brief Gepuffertes Statistik-Log im JSON-Lines- oder Binärformat
+ */
+
+/*!\class UDPEchoStatsLog
+ * \brief Gepuffertes Statistik-Log im JSON-Lines- oder Binärformat
+ *
+ * Sender und Bouncer übergeben pro Intervall einen UDPEchoStatsRecord an
+ * UDPEchoStatsLog::write. Dort wird der Datensatz nur unter einem Mutex an einen Puffer
+ * angehängt. Formatieren und Schreiben übernimmt ein eigener Thread, der den Puffer
+ * alle 100 ms übernimmt. Dadurch verzögert weder langsame I/O noch das Formatieren die
+ * Messschleife.
+ *
+ * Im JSON-Format wird pro Intervall eine Zeile geschrieben (JSON Lines), im Binärformat
+ * wird pro Intervall ein Datensatz vom Typ UDPEchoWire::RECORD_INTERVAL an die Datei
+ * angehängt.
+ *
+ * Kommt der Thread nicht hinterher, werden ab UDPEchoStatsLog::MaxPending gepufferten
+ * Datensätzen neue Datensätze verworfen und gezählt.
+ */
+
+UDPEchoStatsLog::UDPEchoStatsLog()
+{
+	format=JSON;
+	interval=1.0;
+	dropped=0;
+}
+
+UDPEchoStatsLog::~UDPEchoStatsLog()
+{
+	close();
+}
+
+/*!\brief Log-Datei öffnen und Schreib-Thread starten
+ *
+ * Eine vorhandene Datei wird fortgesetzt.
+ *
+ * @param filename Name der Datei
+ * @param format Format der Datensätze
+ * @exception Diverse Die Datei kann nicht geöffnet werden
+ */
+void UDPEchoStatsLog::open(const ppl7::String &filename, Format format)
+{
+	close();
+	file.open(filename, ppl7::File::APPEND);
+	this->format=format;
+	dropped=0;
+	pending.reserve(1024);
+	threadStart();
+}
+
+/*!\brief Schreib-Thread beenden, verbleibende Datensätze schreiben und Datei schließen
+ */
+void UDPEchoStatsLog::close()
+{
+	if (!file.isOpen()) return;
+	threadStop();
+	std::vector<UDPEchoStatsRecord> records;
+	mutex.lock();
+	records.swap(pending);
+	mutex.unlock();
+	flush(records);
+	file.close();
+}
+
+bool UDPEchoStatsLog::isOpen() const
+{
+	return file.isOpen();
+}
+
+/*!\brief Länge eines Intervalls festlegen
+ *
+ * @param milliseconds Intervall in Millisekunden, mindestens 10 (Default=1000)
+ * @exception ppl7::InvalidArgumentsException Intervall kleiner als 10 ms
+ */
+void UDPEchoStatsLog::setInterval(int milliseconds)
+{
+	if (milliseconds<10)
+		throw ppl7::InvalidArgumentsException("Intervall muss mindestens 10 ms betragen [%d]", milliseconds);
+	interval=(double)milliseconds/1000.0;
+}
+
+/*!\brief Länge eines Intervalls in Sekunden
+ */
+double UDPEchoStatsLog::getInterval() const
+{
+	return interval;
+}
+
+/*!\brief Anzahl verworfener Datensätze
+ */
+uint64_t UDPEchoStatsLog::getDropped() const
+{
+	return dropped;
+}
+
+/*!\brief Datensatz zum Schreiben übergeben
+ *
+ * Kehrt sofort zurück, der Datensatz wird vom Schreib-Thread in die Datei geschrieben.
+ */
+void UDPEchoStatsLog::write(const UDPEchoStatsRecord &record)
+{
+	mutex.lock();
+	if (pending.size()<MaxPending) pending.push_back(record);
+	else dropped++;
+	mutex.unlock();
+}
+
+void UDPEchoStatsLog::flush(std::vector<UDPEchoStatsRecord> &records)
+{
+	if (records.empty()) return;
+	if (format==BINARY) {
+		ppl7::ByteArray buffer;
+		size_t size=0;
+		for (size_t i=0;i<records.size();i++) size+=records[i].binarySize();
+		buffer.malloc(size);
+		unsigned char *p=(unsigned char*)buffer.adr();
+		for (size_t i=0;i<records.size();i++)
+			p+=records[i].exportBinary(p, records[i].binarySize());
+		file.write(buffer.adr(), buffer.size());
+	} else {
+		ppl7::String chunk, line;
+		for (size_t i=0;i<records.size();i++) {
+			records[i].toJSON(line);
+			chunk.append(line);
+		}
+		file.write(chunk.getPtr(), chunk.size());
+	}
+	file.flush();
+	records.clear();
+}
+
+void UDPEchoStatsLog::run()
+{
+	threadSetName("UDPEchoStatsLog");
+	std::vector<UDPEchoStatsRecord> records;
+	records.reserve(1024);
+	while (!threadShouldStop()) {
+		ppl7::MSleep(100);
+		mutex.lock();
+		records.swap(pending);
+		mutex.unlock();
+		try {
+			flush(records);
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			records.clear();
+		}
+	}
+}
@@ -0,0 +1,262 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <ppl7.h>
+#include <math.h>
+
+#include "statslog.h"
+#include "wire.h"
+
+/*!@file
+ * \brief Messwerte eines Intervalls für das Statistik-Log
+ */
+
+/*!\class UDPEchoStatsRecord
+ * \brief Messwerte eines Intervalls für das Statistik-Log
+ *
+ * Enthält die Zähler der Anwendung, die Netzwerk-Deltas und die CPU-Last eines Intervalls,
+ * letztere auch pro Kern zusammen mit den Deltas aus /proc/net/softnet_stat, sowie beim Sender die Perzentile der in diesem Intervall gemessenen Laufzeiten. Wird von
+ * UDPEchoStatsLog als JSON-Zeile oder im binären Format von UDPEchoWire geschrieben.
+ */
+
+UDPEchoStatsRecord::UDPEchoStatsRecord()
+{
+	sampleTime=0.0;
+	interval=0.0;
+	cpu=0.0;
+	counter.clear();
+	counter.sampleTime=0.0;
+	rtt_count=0;
+	rtt_p50=rtt_p90=rtt_p99=rtt_p999=0.0;
+}
+
+/*!\brief Netzwerk-Deltas und CPU-Last aus zwei Messungen übernehmen
+ *
+ * Ist das Intervall kürzer als die Auflösung der CPU-Zähler des Kernels, ist die CPU-Last
+ * nicht bestimmbar (NaN).
+ */
+void UDPEchoStatsRecord::setSystemStat(const SystemStat &previous, const SystemStat &current)
+{
+	net_receive=SystemStat::Network::getDelta(previous.net_total.receive, current.net_total.receive);
+	net_transmit=SystemStat::Network::getDelta(previous.net_total.transmit, current.net_total.transmit);
+	cpu=SystemStat::Cpu::getUsage(previous.cpu, current.cpu);
+	if (previous.cores.size()!=current.cores.size()) {
+		cores.clear();
+		return;
+	}
+	cores.resize(current.cores.size());
+	for (size_t i=0;i<cores.size();i++) {
+		const SystemStat::Core &c1=previous.cores[i];
+		const SystemStat::Core &c2=current.cores[i];
+		Core &core=cores[i];
+		core.id=c2.id;
+		core.usage=SystemStat::Cpu::getUsage(c1.cpu, c2.cpu);
+		core.irq=SystemStat::Cpu::getIrqUsage(c1.cpu, c2.cpu);
+		core.softirq=SystemStat::Cpu::getSoftirqUsage(c1.cpu, c2.cpu);
+		// softnet_stat liefert 32-Bit-Zähler
+		core.processed=(uint32_t)(c2.processed-c1.processed);
+		core.dropped=(uint32_t)(c2.dropped-c1.dropped);
+		core.time_squeeze=(uint32_t)(c2.time_squeeze-c1.time_squeeze);
+	}
+}
+
+/*!\brief Perzentile aus dem Histogramm eines Intervalls übernehmen
+ */
+void UDPEchoStatsRecord::setLatency(const UDPEchoLatencyHistogram &histogram)
+{
+	rtt_count=histogram.count();
+	rtt_p50=histogram.percentile(50.0);
+	rtt_p90=histogram.percentile(90.0);
+	rtt_p99=histogram.percentile(99.0);
+	rtt_p999=histogram.percentile(99.9);
+}
+
+static void putNetwork(unsigned char *p, const SystemStat::Network &net)
+{
+	UDPEchoWire::put64(p, net.bytes);
+	UDPEchoWire::put64(p+8, net.packets);
+	UDPEchoWire::put64(p+16, net.errs);
+	UDPEchoWire::put64(p+24, net.drop);
+}
+
+static void getNetwork(const unsigned char *p, SystemStat::Network &net)
+{
+	net.bytes=UDPEchoWire::get64(p);
+	net.packets=UDPEchoWire::get64(p+8);
+	net.errs=UDPEchoWire::get64(p+16);
+	net.drop=UDPEchoWire::get64(p+24);
+}
+
+/*!\brief Größe der binären Darstellung
+ *
+ * @return Anzahl Bytes, die UDPEchoStatsRecord::exportBinary benötigt
+ */
+size_t UDPEchoStatsRecord::binarySize() const
+{
+	return UDPEchoWire::IntervalSize+UDPEchoWire::IntervalCoreHeaderSize+cores.size()*UDPEchoWire::IntervalCoreSize;
+}
+
+/*!\brief Datensatz im binären Format exportieren
+ *
+ * @param buffer Zielpuffer
+ * @param size Größe des Zielpuffers
+ * @return Anzahl geschriebener Bytes
+ * @exception ppl7::BufferTooSmallException Der Puffer ist zu klein
+ */
+size_t UDPEchoStatsRecord::exportBinary(void *buffer, size_t size) const
+{
+	size_t len=binarySize();
+	if (size<len) throw ppl7::BufferTooSmallException("UDPEchoStatsRecord::exportBinary");
+	unsigned char *p=(unsigned char*)buffer;
+	UDPEchoWire::putHeader(p, UDPEchoWire::RECORD_INTERVAL, len);
+	UDPEchoWire::putDouble(p+8, sampleTime);
+	UDPEchoWire::putDouble(p+16, interval);
+	UDPEchoWire::putDouble(p+24, cpu);
+	UDPEchoWire::put64(p+32, counter.packets_received);
+	UDPEchoWire::put64(p+40, counter.packets_send);
+	UDPEchoWire::put64(p+48, counter.bytes_received);
+	UDPEchoWire::put64(p+56, counter.bytes_send);
+	UDPEchoWire::put64(p+64, counter.packets_truncated);
+	UDPEchoWire::put64(p+72, counter.packets_queue_overflow);
+	UDPEchoWire::put64(p+80, counter.packets_impair_dropped);
+	UDPEchoWire::put64(p+88, counter.packets_impair_duplicated);
+	UDPEchoWire::put64(p+96, counter.packets_impair_corrupted);
+	UDPEchoWire::put64(p+104, counter.packets_impair_reordered);
+	UDPEchoWire::put64(p+112, counter.packets_dns_invalid);
+	putNetwork(p+120, net_receive);
+	putNetwork(p+152, net_transmit);
+	UDPEchoWire::put64(p+184, rtt_count);
+	UDPEchoWire::putDouble(p+192, rtt_p50);
+	UDPEchoWire::putDouble(p+200, rtt_p90);
+	UDPEchoWire::putDouble(p+208, rtt_p99);
+	UDPEchoWire::putDouble(p+216, rtt_p999);
+	UDPEchoWire::put32(p+224, (uint32_t)cores.size());
+	UDPEchoWire::put32(p+228, 0);
+	p+=UDPEchoWire::IntervalSize+UDPEchoWire::IntervalCoreHeaderSize;
+	for (size_t i=0;i<cores.size();i++) {
+		const Core &core=cores[i];
+		UDPEchoWire::put32(p, (uint32_t)core.id);
+		UDPEchoWire::put32(p+4, 0);
+		UDPEchoWire::putDouble(p+8, core.usage);
+		UDPEchoWire::putDouble(p+16, core.irq);
+		UDPEchoWire::putDouble(p+24, core.softirq);
+		UDPEchoWire::put64(p+32, core.processed);
+		UDPEchoWire::put64(p+40, core.dropped);
+		UDPEchoWire::put64(p+48, core.time_squeeze);
+		p+=UDPEchoWire::IntervalCoreSize;
+	}
+	return len;
+}
+
+/*!\brief Datensatz aus dem binären Format importieren
+ *
+ * @param buffer Pointer auf den Datensatz
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @return Länge des Datensatzes in Bytes
+ * @exception ppl7::InvalidFormatException Kein gültiger Datensatz
+ */
+size_t UDPEchoStatsRecord::importBinary(const void *buffer, size_t size)
+{
+	size_t len=UDPEchoWire::checkRecord(buffer, size, UDPEchoWire::RECORD_INTERVAL);
+	const unsigned char *p=(const unsigned char*)buffer;
+	sampleTime=UDPEchoWire::getDouble(p+8);
+	interval=UDPEchoWire::getDouble(p+16);
+	cpu=UDPEchoWire::getDouble(p+24);
+	counter.sampleTime=sampleTime;
+	counter.packets_received=(int64_t)UDPEchoWire::get64(p+32);
+	counter.packets_send=(int64_t)UDPEchoWire::get64(p+40);
+	counter.bytes_received=(int64_t)UDPEchoWire::get64(p+48);
+	counter.bytes_send=(int64_t)UDPEchoWire::get64(p+56);
+	counter.packets_truncated=(int64_t)UDPEchoWire::get64(p+64);
+	counter.packets_queue_overflow=(int64_t)UDPEchoWire::get64(p+72);
+	counter.packets_impair_dropped=(int64_t)UDPEchoWire::get64(p+80);
+	counter.packets_impair_duplicated=(int64_t)UDPEchoWire::get64(p+88);
+	counter.packets_impair_corrupted=(int64_t)UDPEchoWire::get64(p+96);
+	counter.packets_impair_reordered=(int64_t)UDPEchoWire::get64(p+104);
+	counter.packets_dns_invalid=(int64_t)UDPEchoWire::get64(p+112);
+	getNetwork(p+120, net_receive);
+	getNetwork(p+152, net_transmit);
+	rtt_count=UDPEchoWire::get64(p+184);
+	rtt_p50=UDPEchoWire::getDouble(p+192);
+	rtt_p90=UDPEchoWire::getDouble(p+200);
+	rtt_p99=UDPEchoWire::getDouble(p+208);
+	rtt_p999=UDPEchoWire::getDouble(p+216);
+	cores.clear();
+	if (len>=UDPEchoWire::IntervalSize+UDPEchoWire::IntervalCoreHeaderSize) {
+		size_t count=UDPEchoWire::get32(p+224);
+		if (UDPEchoWire::IntervalSize+UDPEchoWire::IntervalCoreHeaderSize+count*UDPEchoWire::IntervalCoreSize>len)
+			throw ppl7::InvalidFormatException("UDPEchoWire: Kern-Liste unvollstaendig");
+		cores.resize(count);
+		p+=UDPEchoWire::IntervalSize+UDPEchoWire::IntervalCoreHeaderSize;
+		for (size_t i=0;i<count;i++) {
+			Core &core=cores[i];
+			core.id=(int)UDPEchoWire::get32(p);
+			core.usage=UDPEchoWire::getDouble(p+8);
+			core.irq=UDPEchoWire::getDouble(p+16);
+			core.softirq=UDPEchoWire::getDouble(p+24);
+			core.processed=UDPEchoWire::get64(p+32);
+			core.dropped=UDPEchoWire::get64(p+40);
+			core.time_squeeze=UDPEchoWire::get64(p+48);
+			p+=UDPEchoWire::IntervalCoreSize;
+		}
+	}
+	return len;
+}
+
+/*!\brief Datensatz als JSON-Zeile formatieren
+ *
+ * Laufzeiten werden in Millisekunden ausgegeben, eine nicht bestimmbare CPU-Last als null.
+ *
+ * @param line Nimmt die Zeile inklusive abschließendem Zeilenumbruch auf
+ */
+void UDPEchoStatsRecord::toJSON(ppl7::String &line) const
+{
+	line.setf("{\"time\":%0.6f,\"interval\":%0.6f,", sampleTime, interval);
+	if (isnan(cpu)) line.append("\"cpu\":null,");
+	else line.appendf("\"cpu\":%0.2f,", cpu);
+	line.appendf("\"app\":{\"packets_received\":%ld,\"packets_send\":%ld,\"bytes_received\":%ld,"
+			"\"bytes_send\":%ld,\"packets_truncated\":%ld,\"packets_queue_overflow\":%ld,"
+			"\"packets_impair_dropped\":%ld,\"packets_impair_duplicated\":%ld,"
+			"\"packets_impair_corrupted\":%ld,\"packets_impair_reordered\":%ld,"
+			"\"packets_dns_invalid\":%ld},",
+			counter.packets_received, counter.packets_send, counter.bytes_received,
+			counter.bytes_send, counter.packets_truncated, counter.packets_queue_overflow,
+			counter.packets_impair_dropped, counter.packets_impair_duplicated,
+			counter.packets_impair_corrupted, counter.packets_impair_reordered,
+			counter.packets_dns_invalid);
+	line.appendf("\"net\":{\"rx_bytes\":%lu,\"rx_packets\":%lu,\"rx_errs\":%lu,\"rx_drop\":%lu,"
+			"\"tx_bytes\":%lu,\"tx_packets\":%lu,\"tx_errs\":%lu,\"tx_drop\":%lu},",
+			net_receive.bytes, net_receive.packets, net_receive.errs, net_receive.drop,
+			net_transmit.bytes, net_transmit.packets, net_transmit.errs, net_transmit.drop);
+	line.appendf("\"rtt\":{\"count\":%lu,\"p50_ms\":%0.4f,\"p90_ms\":%0.4f,\"p99_ms\":%0.4f,\"p999_ms\":%0.4f},",
+			rtt_count, rtt_p50*1000.0, rtt_p90*1000.0, rtt_p99*1000.0, rtt_p999*1000.0);
+	line.append("\"cores\":[");
+	for (size_t i=0;i<cores.size();i++) {
+		const Core &core=cores[i];
+		if (i) line.append(",");
+		line.appendf("{\"id\":%d,", core.id);
+		if (isnan(core.usage)) line.append("\"cpu\":null,\"irq\":null,\"softirq\":null,");
+		else line.appendf("\"cpu\":%0.2f,\"irq\":%0.2f,\"softirq\":%0.2f,", core.usage, core.irq, core.softirq);
+		line.appendf("\"processed\":%lu,\"dropped\":%lu,\"time_squeeze\":%lu}",
+				core.processed, core.dropped, core.time_squeeze);
+	}
+	line.append("]}\n");
+}
@@ -0,0 +1,248 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include "udpecho.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPEchoTargetTable
+ * \ingroup GroupSender
+ * \brief Liste von Zielen mit Zählern und Laufzeiten pro Ziel
+ *
+ * Im Multi-Ziel-Betrieb des Senders (siehe UDPEchoSenderThread::setTargets) sind die
+ * Sockets nicht verbunden, jedes Paket trägt seine Zieladresse selbst. Die Tabelle
+ * enthält die Ziele in der Reihenfolge, in der sie reihum angeschrieben werden, und pro
+ * Ziel gesendete und empfangene Pakete sowie ein kleines Histogramm der Laufzeiten
+ * (UDPEchoCompactHistogram).
+ *
+ * Antworten werden über die Absenderadresse dem Ziel zugeordnet. Dazu führt die Tabelle
+ * einen Index mit offener Adressierung, dessen Größe eine Zweierpotenz und mindestens
+ * doppelt so groß wie die Anzahl Ziele ist, so dass eine Suche im Mittel nur einen
+ * Eintrag prüft. Antworten von Adressen, die nicht in der Tabelle stehen, zum Beispiel
+ * von einer anderen Instanz einer Anycast-Adresse, werden als "unknown" gezählt.
+ *
+ * Jeder Thread arbeitet auf seiner eigenen Kopie der Tabelle, die Ergebnisse werden
+ * nach dem Lauf mit UDPEchoTargetTable::merge zusammengefasst.
+ */
+
+UDPEchoTargetTable::Target::Target()
+{
+	memset(&addr, 0, sizeof(addr));
+	addrlen=0;
+}
+
+/*!\brief Adresse des Ziels als "IP:Port"
+ */
+ppl7::String UDPEchoTargetTable::Target::toString() const
+{
+	ppl7::SockAddr a((const void*)&addr, (size_t)addrlen);
+	if (a.version()==6) return ppl7::ToString("[%s]:%d", (const char*)a.toIPAddress().toString(), a.port());
+	return ppl7::ToString("%s:%d", (const char*)a.toIPAddress().toString(), a.port());
+}
+
+UDPEchoTargetTable::UDPEchoTargetTable()
+{
+	indexMask=0;
+	unknown=0;
+}
+
+/*!\brief Hashwert über Adresse und Port
+ */
+uint32_t UDPEchoTargetTable::hash(const struct sockaddr *addr)
+{
+	uint32_t h;
+	if (addr->sa_family==AF_INET6) {
+		const struct sockaddr_in6 *a=(const struct sockaddr_in6*)addr;
+		uint32_t w[4];
+		memcpy(w, &a->sin6_addr, 16);
+		h=w[0]^w[1]^w[2]^w[3]^((uint32_t)a->sin6_port<<16);
+	} else {
+		const struct sockaddr_in *a=(const struct sockaddr_in*)addr;
+		h=(uint32_t)a->sin_addr.s_addr^((uint32_t)a->sin_port<<16);
+	}
+	return h*0x9e3779b1u;
+}
+
+/*!\brief Vergleicht Adressfamilie, Adresse und Port
+ */
+bool UDPEchoTargetTable::equals(const struct sockaddr *addr, const Target &target)
+{
+	const struct sockaddr *t=(const struct sockaddr*)&target.addr;
+	if (addr->sa_family!=t->sa_family) return false;
+	if (addr->sa_family==AF_INET6) {
+		const struct sockaddr_in6 *a=(const struct sockaddr_in6*)addr;
+		const struct sockaddr_in6 *b=(const struct sockaddr_in6*)t;
+		return a->sin6_port==b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, 16)==0;
+	}
+	const struct sockaddr_in *a=(const struct sockaddr_in*)addr;
+	const struct sockaddr_in *b=(const struct sockaddr_in*)t;
+	return a->sin_port==b->sin_port && a->sin_addr.s_addr==b->sin_addr.s_addr;
+}
+
+void UDPEchoTargetTable::rebuildIndex()
+{
+	size_t slots=8;
+	while (slots<targets.size()*2) slots<<=1;
+	index.assign(slots, -1);
+	indexMask=(uint32_t)(slots-1);
+	for (size_t i=0;i<targets.size();i++) {
+		uint32_t s=hash((const struct sockaddr*)&targets[i].addr)&indexMask;
+		while (index[s]>=0) s=(s+1)&indexMask;
+		index[s]=(int)i;
+	}
+}
+
+/*!\brief Ziel über seine Adresse suchen
+ *
+ * @param addr Adresse, zum Beispiel der Absender einer Antwort
+ * @return Position des Ziels in der Tabelle oder -1, wenn die Adresse nicht enthalten ist
+ */
+int UDPEchoTargetTable::find(const struct sockaddr *addr) const
+{
+	if (index.empty()) return -1;
+	uint32_t s=hash(addr)&indexMask;
+	while (index[s]>=0) {
+		if (equals(addr, targets[index[s]])) return index[s];
+		s=(s+1)&indexMask;
+	}
+	return -1;
+}
+
+/*!\brief Ziel mit seiner Socket-Adresse hinzufügen
+ *
+ * @param addr Adresse des Ziels, IPv4 oder IPv6
+ * @param addrlen Länge der Adresse
+ * @exception ppl7::IllegalArgumentException Unbekannte Adressfamilie
+ * @exception ppl7::DuplicateItemException Das Ziel ist bereits in der Tabelle
+ */
+void UDPEchoTargetTable::add(const struct sockaddr *addr, socklen_t addrlen)
+{
+	if ((addr->sa_family!=AF_INET && addr->sa_family!=AF_INET6) || addrlen>sizeof(struct sockaddr_storage))
+		throw ppl7::IllegalArgumentException("UDPEchoTargetTable::add");
+	Target t;
+	memcpy(&t.addr, addr, addrlen);
+	t.addrlen=addrlen;
+	if (find(addr)>=0) throw ppl7::DuplicateItemException("%s", (const char*)t.toString());
+	targets.push_back(t);
+	rebuildIndex();
+}
+
+/*!\brief Ziel im Format "HOST:PORT" hinzufügen
+ *
+ * Der Port kann auch als Service-Name angegeben werden. Da die Sockets des Senders
+ * IPv4-Sockets sind, wird der Hostname nur in eine IPv4-Adresse aufgelöst.
+ *
+ * @param destination String mit Zieladresse und Port
+ * @exception ppl7::IllegalArgumentException Ungültiges Format
+ * @exception Diverse Der Hostname oder der Port konnte nicht aufgelöst werden
+ */
+void UDPEchoTargetTable::add(const ppl7::String &destination)
+{
+	ppl7::Array hostname=StrTok(destination, ":");
+	if (hostname.size()!=2)
+		throw ppl7::IllegalArgumentException("UDPEchoTargetTable::add(const String &destination=%s)", (const char*)destination);
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family=AF_INET;
+	hints.ai_socktype=SOCK_DGRAM;
+	int n=getaddrinfo((const char*)hostname[0], (const char*)hostname[1], &hints, &res);
+	if (n!=0) throwExceptionFromEaiError(n, ppl7::ToString("UDPEchoTargetTable::add: %s", (const char*)destination));
+	try {
+		add(res->ai_addr, res->ai_addrlen);
+	} catch (...) {
+		freeaddrinfo(res);
+		throw;
+	}
+	freeaddrinfo(res);
+}
+
+/*!\brief Ziele aus einer Datei lesen
+ *
+ * Die Datei enthält pro Zeile ein Ziel im Format "HOST:PORT", leere Zeilen und Zeilen,
+ * die mit # beginnen, werden ignoriert.
+ *
+ * @param filename Name der Datei
+ */
+void UDPEchoTargetTable::load(const ppl7::String &filename)
+{
+	ppl7::File ff(filename);
+	try {
+		while (!ff.eof()) {
+			ppl7::String line=ff.gets().trimmed();
+			if (line.notEmpty()==true && line[0]!='#') add(line);
+		}
+	} catch (ppl7::EndOfFileException &) {
+
+	}
+}
+
+/*!\brief Alle Ziele entfernen
+ */
+void UDPEchoTargetTable::clear()
+{
+	targets.clear();
+	index.clear();
+	indexMask=0;
+	unknown=0;
+}
+
+/*!\brief Zähler aller Ziele auf 0 setzen
+ */
+void UDPEchoTargetTable::clearCounter()
+{
+	for (size_t i=0;i<targets.size();i++) targets[i].clear();
+	unknown=0;
+}
+
+/*!\brief Messwerte einer anderen Kopie der Tabelle addieren
+ *
+ * Ist die Tabelle leer, wird \p other übernommen. Ansonsten müssen beide Tabellen die
+ * gleichen Ziele in der gleichen Reihenfolge enthalten.
+ *
+ * @exception ppl7::InvalidArgumentsException Die Tabellen enthalten unterschiedlich viele Ziele
+ */
+void UDPEchoTargetTable::merge(const UDPEchoTargetTable &other)
+{
+	if (targets.empty()) {
+		*this=other;
+		return;
+	}
+	if (other.targets.size()!=targets.size())
+		throw ppl7::InvalidArgumentsException("UDPEchoTargetTable::merge");
+	for (size_t i=0;i<targets.size();i++) targets[i].merge(other.targets[i]);
+	unknown+=other.unknown;
+}
+
+/*!\brief Anzahl Antworten von Adressen, die nicht in der Tabelle stehen
+ */
+int64_t UDPEchoTargetTable::getUnknown() const
+{
+	return unknown;
+}
@@ -0,0 +1,293 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <string.h>
+
+#include "wire.h"
+#include "udpecho.h"
+#include "sensor.h"
+
+/*!@file
+ * \brief Binäres Austauschformat für Zähler und Sensordaten
+ */
+
+/*!\class UDPEchoWire
+ * \brief Binäres Austauschformat für Zähler und Sensordaten
+ *
+ * Alternative zu UDPEchoCounter::exportToArray und SystemStat::exportToArray für die
+ * häufige Übertragung von Messwerten. Jeder Datensatz hat ein festes Layout, alle Werte
+ * sind Little-Endian kodiert und liegen auf 8-Byte-Grenzen, so dass sie auf üblichen
+ * Plattformen direkt aus dem Empfangspuffer gelesen werden können
+ * (siehe UDPEchoCounterView und SystemStatView).
+ *
+ * Jeder Datensatz beginnt mit einem 8 Byte großen Header:
+ * \code
+ * Byte 0-1: "UW"
+ * Byte 2:   Version des Formats
+ * Byte 3:   Typ des Datensatzes, siehe UDPEchoWire::RecordType
+ * Byte 4-7: Gesamtlänge des Datensatzes inklusive Header
+ * \endcode
+ *
+ * UDPEchoCounter (120 Bytes):
+ * \code
+ *   8: sampleTime (double)
+ *  16: 13 Zähler zu je 8 Byte in der Reihenfolge von UDPEchoCounterView::Field
+ * \endcode
+ * Ältere Datensätze mit 104 Bytes enthalten packets_socket_dropped noch nicht, solche
+ * mit 112 Bytes packets_send_failed.
+ *
+ * SystemStat (168 Bytes + 80 Bytes pro Interface + 64 Bytes + 56 Bytes pro Kern):
+ * \code
+ *   8: sampleTime (double)
+ *  16: cpu user, nice, system, idle, iowait, sysinfo procs (je 4 Byte)
+ *  40: sysinfo uptime, freeswap, totalswap, freeram, bufferram, totalram, sharedram (je 8 Byte)
+ *  96: net_total, 8 Werte zu je 8 Byte in der Reihenfolge von SystemStatView::NetworkField
+ * 160: Anzahl Interfaces (4 Byte), 4 Byte reserviert
+ * 168: pro Interface 16 Byte Name (mit 0 aufgefüllt) und 8 Werte wie bei net_total
+ * danach: UDP-MIB, 6 Werte zu je 8 Byte in der Reihenfolge von SystemStatView::UdpField
+ * danach: cpu irq, softirq, Anzahl Kerne, 4 Byte reserviert (je 4 Byte)
+ * danach: pro Kern id, user, nice, system, idle, iowait, irq, softirq (je 4 Byte),
+ *         softnet processed, dropped, time_squeeze (je 8 Byte)
+ * \endcode
+ * Ältere Datensätze enden nach den Interfaces oder nach der UDP-MIB.
+ *
+ * UDPEchoLatencyHistogram (16 Bytes + 8 Bytes pro Bucket):
+ * \code
+ *   8: Anzahl Buckets (4 Byte), Anzahl Unter-Buckets pro Zweierpotenz (4 Byte)
+ *  16: Zähler der Buckets zu je 8 Byte
+ * \endcode
+ *
+ * UDPEchoStatsRecord (232 Bytes + 56 Bytes pro Kern):
+ * \code
+ *   8: sampleTime, interval, cpu (double)
+ *  32: 11 Zähler wie bei UDPEchoCounter
+ * 120: Netzwerk-Deltas receive bytes, packets, errs, drop, dann dasselbe für transmit
+ * 184: Anzahl Laufzeiten im Intervall, Perzentile p50, p90, p99, p99.9 in Sekunden (double)
+ * 224: Anzahl Kerne (4 Byte), 4 Byte reserviert
+ * 232: pro Kern id (4 Byte), 4 Byte reserviert, Last gesamt, irq, softirq in Prozent (double),
+ *      Deltas softnet processed, dropped, time_squeeze (je 8 Byte)
+ * \endcode
+ * Ältere Datensätze mit 224 Bytes enthalten keine Werte pro Kern.
+ *
+ * Neue Felder werden nur am Ende eines Datensatzes angehängt. Ein Leser akzeptiert daher
+ * auch längere Datensätze derselben Version und überspringt sie anhand der Länge im Header.
+ */
+
+/*!\brief Header eines Datensatzes schreiben
+ */
+void UDPEchoWire::putHeader(unsigned char *p, int type, size_t size)
+{
+	p[0]='U';
+	p[1]='W';
+	p[2]=(unsigned char)Version;
+	p[3]=(unsigned char)type;
+	put32(p+4, (uint32_t)size);
+}
+
+/*!\brief Typ des Datensatzes am Anfang des Puffers ermitteln
+ *
+ * @return Typ des Datensatzes oder 0, wenn der Puffer keinen gültigen Header enthält
+ */
+int UDPEchoWire::peekRecordType(const void *buffer, size_t size)
+{
+	const unsigned char *p=(const unsigned char*)buffer;
+	if (size<HeaderSize || p[0]!='U' || p[1]!='W' || p[2]!=Version) return 0;
+	return p[3];
+}
+
+/*!\brief Datensatz prüfen
+ *
+ * @param buffer Pointer auf den Anfang des Datensatzes
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @param type Erwarteter Typ
+ * @return Länge des Datensatzes in Bytes
+ * @exception ppl7::InvalidFormatException Header ungültig, falscher Typ oder Datensatz unvollständig
+ */
+size_t UDPEchoWire::checkRecord(const void *buffer, size_t size, int type)
+{
+	if (peekRecordType(buffer, size)!=type)
+		throw ppl7::InvalidFormatException("UDPEchoWire: unerwarteter Datensatz");
+	size_t len=get32((const unsigned char*)buffer+4);
+	size_t min=SystemStatSize;
+	if (type==RECORD_COUNTER) min=CounterMinSize;
+	else if (type==RECORD_HISTOGRAM) min=HistogramSize;
+	else if (type==RECORD_INTERVAL) min=IntervalSize;
+	if (len<min || len>size)
+		throw ppl7::InvalidFormatException("UDPEchoWire: ungueltige Laenge [%zu]", len);
+	return len;
+}
+
+/*!\class UDPEchoCounterView
+ * \brief Zugriff auf einen binär kodierten UDPEchoCounter ohne Kopie
+ *
+ * Der View prüft beim Erstellen nur den Header und liest die Werte bei Bedarf direkt aus
+ * dem Puffer. Der Puffer muss solange gültig bleiben, wie der View verwendet wird.
+ */
+
+/*!\brief Konstruktor
+ *
+ * @param buffer Pointer auf den Datensatz
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @exception ppl7::InvalidFormatException Kein gültiger Datensatz
+ */
+UDPEchoCounterView::UDPEchoCounterView(const void *buffer, size_t size)
+{
+	UDPEchoWire::checkRecord(buffer, size, UDPEchoWire::RECORD_COUNTER);
+	data=(const unsigned char*)buffer;
+}
+
+/*!\brief Länge des Datensatzes
+ */
+size_t UDPEchoCounterView::size() const
+{
+	return UDPEchoWire::get32(data+4);
+}
+
+/*!\brief Datensatz in einen UDPEchoCounter übertragen
+ */
+void UDPEchoCounterView::decode(UDPEchoCounter &counter) const
+{
+	counter.sampleTime=sampleTime();
+	counter.packets_received=get(PACKETS_RECEIVED);
+	counter.packets_send=get(PACKETS_SEND);
+	counter.bytes_received=get(BYTES_RECEIVED);
+	counter.bytes_send=get(BYTES_SEND);
+	counter.packets_truncated=get(PACKETS_TRUNCATED);
+	counter.packets_queue_overflow=get(PACKETS_QUEUE_OVERFLOW);
+	counter.packets_impair_dropped=get(PACKETS_IMPAIR_DROPPED);
+	counter.packets_impair_duplicated=get(PACKETS_IMPAIR_DUPLICATED);
+	counter.packets_impair_corrupted=get(PACKETS_IMPAIR_CORRUPTED);
+	counter.packets_impair_reordered=get(PACKETS_IMPAIR_REORDERED);
+	counter.packets_dns_invalid=get(PACKETS_DNS_INVALID);
+	counter.packets_socket_dropped=get(PACKETS_SOCKET_DROPPED);
+	counter.packets_send_failed=get(PACKETS_SEND_FAILED);
+}
+
+/*!\class SystemStatView
+ * \brief Zugriff auf binär kodierte SystemStat-Daten ohne Kopie
+ *
+ * Wie UDPEchoCounterView, die Namen der Interfaces werden ebenfalls direkt aus dem
+ * Puffer geliefert.
+ */
+
+/*!\brief Konstruktor
+ *
+ * @param buffer Pointer auf den Datensatz
+ * @param size Anzahl verfügbarer Bytes ab \p buffer
+ * @exception ppl7::InvalidFormatException Kein gültiger Datensatz
+ */
+SystemStatView::SystemStatView(const void *buffer, size_t size)
+{
+	size_t len=UDPEchoWire::checkRecord(buffer, size, UDPEchoWire::RECORD_SYSTEMSTAT);
+	data=(const unsigned char*)buffer;
+	interfaces=UDPEchoWire::get32(data+160);
+	if (UDPEchoWire::SystemStatSize+interfaces*UDPEchoWire::InterfaceSize>len)
+		throw ppl7::InvalidFormatException("UDPEchoWire: Interface-Liste unvollstaendig");
+	udp=(UDPEchoWire::SystemStatSize+interfaces*UDPEchoWire::InterfaceSize+UDPEchoWire::UdpSize<=len);
+	corelist=NULL;
+	cores=0;
+	size_t offset=UDPEchoWire::SystemStatSize+interfaces*UDPEchoWire::InterfaceSize+UDPEchoWire::UdpSize;
+	if (offset+UDPEchoWire::CoreHeaderSize<=len) {
+		cores=UDPEchoWire::get32(data+offset+8);
+		corelist=data+offset+UDPEchoWire::CoreHeaderSize;
+		if (offset+UDPEchoWire::CoreHeaderSize+cores*UDPEchoWire::CoreSize>len)
+			throw ppl7::InvalidFormatException("UDPEchoWire: Kern-Liste unvollstaendig");
+	}
+	for (size_t i=0;i<interfaces;i++) {
+		if (interfaceName(i)[UDPEchoWire::InterfaceNameSize-1]!=0)
+			throw ppl7::InvalidFormatException("UDPEchoWire: Interface-Name nicht terminiert");
+	}
+}
+
+/*!\brief Länge des Datensatzes
+ */
+size_t SystemStatView::size() const
+{
+	return UDPEchoWire::get32(data+4);
+}
+
+static void decodeNetwork(const unsigned char *p, SystemStat::Network &receive, SystemStat::Network &transmit)
+{
+	receive.bytes=UDPEchoWire::get64(p);
+	receive.packets=UDPEchoWire::get64(p+8);
+	receive.errs=UDPEchoWire::get64(p+16);
+	receive.drop=UDPEchoWire::get64(p+24);
+	transmit.bytes=UDPEchoWire::get64(p+32);
+	transmit.packets=UDPEchoWire::get64(p+40);
+	transmit.errs=UDPEchoWire::get64(p+48);
+	transmit.drop=UDPEchoWire::get64(p+56);
+}
+
+/*!\brief Datensatz in ein SystemStat-Objekt übertragen
+ */
+void SystemStatView::decode(SystemStat &stat) const
+{
+	stat.sampleTime=sampleTime();
+	stat.cpu.user=(int)UDPEchoWire::get32(data+16);
+	stat.cpu.nice=(int)UDPEchoWire::get32(data+20);
+	stat.cpu.system=(int)UDPEchoWire::get32(data+24);
+	stat.cpu.idle=(int)UDPEchoWire::get32(data+28);
+	stat.cpu.iowait=(int)UDPEchoWire::get32(data+32);
+	stat.sysinfo.procs=(int)UDPEchoWire::get32(data+36);
+	stat.sysinfo.uptime=(long)UDPEchoWire::get64(data+40);
+	stat.sysinfo.freeswap=(long)UDPEchoWire::get64(data+48);
+	stat.sysinfo.totalswap=(long)UDPEchoWire::get64(data+56);
+	stat.sysinfo.freeram=(long)UDPEchoWire::get64(data+64);
+	stat.sysinfo.bufferram=(long)UDPEchoWire::get64(data+72);
+	stat.sysinfo.totalram=(long)UDPEchoWire::get64(data+80);
+	stat.sysinfo.sharedram=(long)UDPEchoWire::get64(data+88);
+	decodeNetwork(data+96, stat.net_total.receive, stat.net_total.transmit);
+	stat.interfaces.clear();
+	for (size_t i=0;i<interfaces;i++) {
+		SystemStat::Interface nif;
+		nif.Name=interfaceName(i);
+		decodeNetwork(data+UDPEchoWire::SystemStatSize+i*UDPEchoWire::InterfaceSize+UDPEchoWire::InterfaceNameSize,
+				nif.receive, nif.transmit);
+		stat.interfaces.insert(std::pair<ppl7::String,SystemStat::Interface>(nif.Name,nif));
+	}
+	stat.udp.InDatagrams=udpValue(UDP_IN_DATAGRAMS);
+	stat.udp.NoPorts=udpValue(UDP_NO_PORTS);
+	stat.udp.InErrors=udpValue(UDP_IN_ERRORS);
+	stat.udp.OutDatagrams=udpValue(UDP_OUT_DATAGRAMS);
+	stat.udp.RcvbufErrors=udpValue(UDP_RCVBUF_ERRORS);
+	stat.udp.SndbufErrors=udpValue(UDP_SNDBUF_ERRORS);
+	stat.cpu.irq=0;
+	stat.cpu.softirq=0;
+	stat.cores.resize(cores);
+	if (!corelist) return;
+	stat.cpu.irq=(int)UDPEchoWire::get32(corelist-UDPEchoWire::CoreHeaderSize);
+	stat.cpu.softirq=(int)UDPEchoWire::get32(corelist-UDPEchoWire::CoreHeaderSize+4);
+	for (size_t i=0;i<cores;i++) {
+		const unsigned char *p=corelist+i*UDPEchoWire::CoreSize;
+		SystemStat::Core &core=stat.cores[i];
+		core.id=(int)UDPEchoWire::get32(p);
+		core.cpu.user=(int)UDPEchoWire::get32(p+4);
+		core.cpu.nice=(int)UDPEchoWire::get32(p+8);
+		core.cpu.system=(int)UDPEchoWire::get32(p+12);
+		core.cpu.idle=(int)UDPEchoWire::get32(p+16);
+		core.cpu.iowait=(int)UDPEchoWire::get32(p+20);
+		core.cpu.irq=(int)UDPEchoWire::get32(p+24);
+		core.cpu.softirq=(int)UDPEchoWire::get32(p+28);
+		core.processed=UDPEchoWire::get64(p+32);
+		core.dropped=UDPEchoWire::get64(p+40);
+		core.time_squeeze=UDPEchoWire::get64(p+48);
+	}
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <ppl7.h>
+#include <ppl7-inet.h>
+
+#include "sender.h"
+
+/*!@file
+ * \ingroup GroupSender
+ */
+
+/*!\class UDPSenderAgent
+ * \ingroup GroupSender
+ * \brief Steuerkanal eines Senders im Agent-Modus
+ *
+ * Nimmt in einem eigenen Thread TCP-Verbindungen von einem Koordinator
+ * (pingpong_sender --agents) entgegen. Jedes CMD_RUN enthält die Konfiguration eines
+ * Lastlaufs, der über UDPSender::runAgentTrial ausgeführt wird. Die Antwort mit dem
+ * Ergebnis wird erst nach Ende des Lastlaufs verschickt.
+ *
+ * Es wird immer nur ein Lastlauf gleichzeitig ausgeführt, Verbindungen werden
+ * nacheinander abgearbeitet.
+ */
+
+UDPSenderAgent::UDPSenderAgent(UDPSender &sender)
+	: sender(sender)
+{
+}
+
+UDPSenderAgent::~UDPSenderAgent()
+{
+	stop();
+}
+
+/*!\brief Agent starten
+ *
+ * @param host_and_port Adresse und Port, an die sich der Agent binden soll
+ */
+void UDPSenderAgent::start(const ppl7::String &host_and_port)
+{
+	ppl7::Array a(host_and_port, ":");
+	if (a.size()!=2 || a[1].toInt()<=0)
+		throw ppl7::InvalidArgumentsException("Ungueltige Adresse fuer den Agenten: %s", (const char*)host_and_port);
+	bind(a[0], a[1].toInt());
+	threadStart();
+}
+
+/*!\brief Agent beenden
+ */
+void UDPSenderAgent::stop()
+{
+	if (threadIsRunning()) {
+		signalStopListen();
+		threadStop();
+	}
+}
+
+void UDPSenderAgent::run()
+{
+	threadSetName("UDPSenderAgent");
+	listen(1, 100);
+}
+
+/*!\brief Verbindung des Koordinators abarbeiten
+ *
+ * @return 0, der Socket wird anschließend von ppl7::TCPSocket::listen gelöscht
+ */
+int UDPSenderAgent::receiveConnect(ppl7::TCPSocket *socket, const ppl7::String &host, int port)
+{
+	printf ("Koordinator verbunden: %s:%d\n", (const char*)host, port);
+	try {
+		while (!threadShouldStop()) {
+			ppl7::AssocArray data, reply;
+			int command=UDPEchoControlProtocol::receiveMessage(*socket, data, 0, this);
+			if (command==0) continue;
+			if (command==UDPEchoControlProtocol::CMD_RUN) {
+				try {
+					sender.runAgentTrial(data, reply);
+				} catch (const ppl7::Exception &e) {
+					e.print();
+					reply.clear();
+					reply.setf("error", "%s: %s", e.what(), e.text());
+					UDPEchoControlProtocol::sendMessage(*socket, UDPEchoControlProtocol::CMD_ERROR, reply);
+					continue;
+				}
+				UDPEchoControlProtocol::sendMessage(*socket, UDPEchoControlProtocol::CMD_OK, reply);
+			} else {
+				reply.setf("error", "Unbekanntes Kommando %d", command);
+				UDPEchoControlProtocol::sendMessage(*socket, UDPEchoControlProtocol::CMD_ERROR, reply);
+			}
+		}
+	} catch (const ppl7::Exception &) {
+		// Verbindung getrennt oder ungültige Nachricht
+	}
+	printf ("Koordinator getrennt: %s:%d\n", (const char*)host, port);
+	return 0;
+}
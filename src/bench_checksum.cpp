@@ -0,0 +1,88 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "udpecho.h"
+
+/*!\brief Microbenchmark für die Prüfsummen
+ *
+ * Misst den Durchsatz in GB/s für ppl7::Crc32 und ppl7::Crc32c in allen
+ * Implementierungen (byteweise, Slicing-by-8, Hardware) sowie für XXH64 aus
+ * UDPEchoChecksum, jeweils für Puffergrößen von 64 Bytes bis 64 KiB. Nicht von der
+ * CPU unterstützte Implementierungen werden als "n/a" ausgegeben.
+ */
+
+static volatile uint32_t sink;
+
+static uint32_t crc32Bytewise(const void *data, size_t size) { return ppl7::Crc32(data, size, ppl7::CRC_BYTEWISE); }
+static uint32_t crc32Slice8(const void *data, size_t size) { return ppl7::Crc32(data, size, ppl7::CRC_SLICE8); }
+static uint32_t crc32Hardware(const void *data, size_t size) { return ppl7::Crc32(data, size, ppl7::CRC_HARDWARE); }
+static uint32_t crc32cBytewise(const void *data, size_t size) { return ppl7::Crc32c(data, size, ppl7::CRC_BYTEWISE); }
+static uint32_t crc32cSlice8(const void *data, size_t size) { return ppl7::Crc32c(data, size, ppl7::CRC_SLICE8); }
+static uint32_t crc32cHardware(const void *data, size_t size) { return ppl7::Crc32c(data, size, ppl7::CRC_HARDWARE); }
+static uint32_t xxh64(const void *data, size_t size) { return (uint32_t)UDPEchoChecksum::xxh64(data, size); }
+
+static const size_t sizes[]={64, 256, 1024, 4096, 16384, 65536};
+static const int numSizes=sizeof(sizes)/sizeof(size_t);
+
+static void measure(const char *name, uint32_t (*function)(const void *, size_t),
+		const void *buffer, size_t total)
+{
+	printf ("%-16s", name);
+	for (int s=0;s<numSizes;s++) {
+		size_t size=sizes[s];
+		size_t iterations=total/size;
+		try {
+			sink=function(buffer, size);
+		} catch (const ppl7::UnsupportedFeatureException &) {
+			printf (" %9s", "n/a");
+			continue;
+		}
+		double start=ppl7::GetMicrotime();
+		for (size_t i=0;i<iterations;i++) sink=function(buffer, size);
+		double duration=ppl7::GetMicrotime()-start;
+		printf (" %9.2f", (double)(iterations*size)/duration/1000000000.0);
+	}
+	printf ("\n");
+}
+
+int main(int argc, char**argv)
+{
+	size_t megabytes=256;
+	if (argc>1) megabytes=(size_t)atoi(argv[1]);
+	if (megabytes<1) megabytes=1;
+	size_t total=megabytes*1024*1024;
+	ppl7::ByteArray buffer=ppl7::Random(sizes[numSizes-1]);
+	printf ("GB/s, %zu MB pro Puffergroesse\n", megabytes);
+	printf ("%-16s", "");
+	for (int s=0;s<numSizes;s++) printf (" %9zu", sizes[s]);
+	printf ("\n");
+	measure("crc32 bytewise", crc32Bytewise, buffer.ptr(), total);
+	measure("crc32 slice8", crc32Slice8, buffer.ptr(), total);
+	measure("crc32 pclmul", crc32Hardware, buffer.ptr(), total);
+	measure("crc32c bytewise", crc32cBytewise, buffer.ptr(), total);
+	measure("crc32c slice8", crc32cSlice8, buffer.ptr(), total);
+	measure("crc32c sse4.2", crc32cHardware, buffer.ptr(), total);
+	measure("xxh64", xxh64, buffer.ptr(), total);
+	return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/*!\brief Microbenchmark für ppl7::MemoryHeap
+ *
+ * Simuliert einen Pool von Paketpuffern: ein fester Bestand an Elementen ist belegt,
+ * in jeder Runde wird ein zufällig gewähltes Element freigegeben und ein neues
+ * angefordert. Verglichen werden die bisherige Implementierung mit linearer Suche über
+ * die Blöcke, der neue MemoryHeap mit und ohne Mutex, MemoryHeap::Cache und
+ * malloc/free der C-Bibliothek. Anschließend laufen mehrere Threads gleichzeitig auf
+ * einem gemeinsamen Heap, einmal direkt und einmal über je einen Cache pro Thread.
+ */
+
+/*!\brief Bisherige Implementierung von MemoryHeap zum Vergleich
+ *
+ * malloc sucht den ersten Block mit freien Elementen, free sucht den Block, in dessen
+ * Puffer das Element liegt, jeweils linear über alle Blöcke.
+ */
+class LegacyHeap
+{
+	private:
+		struct Element {
+			Element *next, *previous;
+			void *ptr;
+		};
+		struct Block {
+			Block *previous, *next;
+			void *buffer, *bufferend;
+			size_t elements, num_free;
+			Element *free, *elbuffer;
+		};
+		Block *blocks;
+		size_t elementsize, increaseSize;
+
+		void increase(size_t num) {
+			Block *bl=(Block*)::malloc(sizeof(Block));
+			bl->elements=num;
+			bl->num_free=num;
+			bl->previous=NULL;
+			bl->buffer=::malloc(elementsize*num);
+			bl->bufferend=(uint8_t*)bl->buffer+elementsize*num;
+			bl->free=(Element*)::malloc(sizeof(Element)*num);
+			bl->elbuffer=bl->free;
+			Element *prev=NULL;
+			uint8_t *buffer=(uint8_t*)bl->buffer;
+			for (size_t i=0;i<num;i++) {
+				bl->free[i].previous=prev;
+				bl->free[i].next=&bl->free[i+1];
+				bl->free[i].ptr=buffer;
+				buffer+=elementsize;
+				prev=&bl->free[i];
+			}
+			bl->free[num-1].next=NULL;
+			bl->next=blocks;
+			if (bl->next) bl->next->previous=bl;
+			blocks=bl;
+		}
+
+	public:
+		LegacyHeap(size_t elementsize, size_t increase) {
+			blocks=NULL;
+			this->elementsize=(elementsize+3)&~(size_t)3;
+			increaseSize=increase;
+		}
+		~LegacyHeap() {
+			while (blocks) {
+				Block *next=blocks->next;
+				::free(blocks->elbuffer);
+				::free(blocks->buffer);
+				::free(blocks);
+				blocks=next;
+			}
+		}
+		void *malloc() {
+			while (1) {
+				for (Block *bl=blocks;bl;bl=bl->next) {
+					if (bl->num_free) {
+						Element *el=bl->free;
+						bl->free=bl->free->next;
+						if (bl->free) bl->free->previous=NULL;
+						bl->num_free--;
+						return el->ptr;
+					}
+				}
+				increase(increaseSize);
+				increaseSize+=increaseSize*30/100;
+			}
+		}
+		void free(void *mem) {
+			for (Block *bl=blocks;bl;bl=bl->next) {
+				if (mem>=bl->buffer && mem<=bl->bufferend) {
+					Element *el=&bl->elbuffer[((uint8_t*)mem-(uint8_t*)bl->buffer)/elementsize];
+					el->next=bl->free;
+					el->previous=NULL;
+					if (bl->free) bl->free->previous=el;
+					bl->free=el;
+					bl->num_free++;
+					return;
+				}
+			}
+			throw ppl7::MemoryHeap::ElementNotInHeapException();
+		}
+};
+
+class LibcAllocator
+{
+	private:
+		size_t size;
+	public:
+		LibcAllocator(size_t size) { this->size=size; }
+		void *malloc() { return ::malloc(size); }
+		void free(void *mem) { ::free(mem); }
+};
+
+static const size_t ElementSize=2048;
+static const size_t Increase=64;
+
+//! Pseudozufallszahlen ohne Sperre, damit die Threads sich nicht gegenseitig bremsen
+static inline uint32_t nextRandom(uint32_t &state)
+{
+	state^=state<<13;
+	state^=state>>17;
+	state^=state<<5;
+	return state;
+}
+
+template <class Allocator> static double churn(Allocator &allocator, size_t live, size_t operations, uint32_t seed)
+{
+	std::vector<void*> elements(live);
+	for (size_t i=0;i<live;i++) elements[i]=allocator.malloc();
+	double start=ppl7::GetMicrotime();
+	for (size_t i=0;i<operations;i++) {
+		size_t index=nextRandom(seed)%live;
+		allocator.free(elements[index]);
+		void *p=allocator.malloc();
+		*(uint64_t*)p=i;
+		elements[index]=p;
+	}
+	double duration=ppl7::GetMicrotime()-start;
+	for (size_t i=0;i<live;i++) allocator.free(elements[i]);
+	return duration;
+}
+
+static void report(const char *name, double duration, size_t operations)
+{
+	printf ("%-24s %10.1f ns/op, %8.2f Mops/s\n", name,
+			duration*1000000000.0/(double)operations, (double)operations/duration/1000000.0);
+}
+
+//! Führt die Runden auf einem gemeinsamen Heap aus, wahlweise über einen eigenen Cache
+class HeapThread : public ppl7::Thread
+{
+	private:
+		ppl7::MemoryHeap *heap;
+		size_t live, operations;
+		uint32_t seed;
+		bool useCache;
+
+	public:
+		double duration;
+		volatile bool done;
+
+		HeapThread() {
+			heap=NULL;
+			live=operations=0;
+			seed=1;
+			useCache=false;
+			duration=0.0;
+			done=false;
+		}
+		void setup(ppl7::MemoryHeap *heap, size_t live, size_t operations, uint32_t seed, bool useCache) {
+			this->heap=heap;
+			this->live=live;
+			this->operations=operations;
+			this->seed=seed;
+			this->useCache=useCache;
+		}
+		void run() {
+			if (useCache) {
+				ppl7::MemoryHeap::Cache cache(*heap, 64);
+				duration=churn(cache, live, operations, seed);
+			} else {
+				duration=churn(*heap, live, operations, seed);
+			}
+			done=true;
+		}
+};
+
+static void runThreads(const char *name, int numThreads, size_t live, size_t operations, bool useCache)
+{
+	ppl7::MemoryHeap heap(ElementSize, 0, Increase);
+	heap.setThreadSafe(true);
+	std::vector<HeapThread> threads(numThreads);
+	for (int i=0;i<numThreads;i++) {
+		threads[i].setup(&heap, live/numThreads+1, operations, i+1, useCache);
+		threads[i].threadStart();
+	}
+	double duration=0.0;
+	for (int i=0;i<numThreads;i++) {
+		while (!threads[i].done) ppl7::MSleep(1);
+		if (threads[i].duration>duration) duration=threads[i].duration;
+	}
+	report(name, duration, operations*numThreads);
+}
+
+int main(int argc, char**argv)
+{
+	size_t operations=1000000;
+	size_t live=4096;
+	int numThreads=4;
+	if (argc>1) operations=(size_t)atol(argv[1]);
+	if (argc>2) live=(size_t)atol(argv[2]);
+	if (argc>3) numThreads=atoi(argv[3]);
+	if (operations<1) operations=1;
+	if (live<1) live=1;
+	if (numThreads<1) numThreads=1;
+	printf ("Elementgroesse: %zu Bytes, belegt: %zu, Operationen: %zu, Threads: %d\n",
+			ElementSize, live, operations, numThreads);
+	try {
+		{
+			LegacyHeap heap(ElementSize, Increase);
+			report("legacy MemoryHeap", churn(heap, live, operations, 1), operations);
+		}
+		{
+			ppl7::MemoryHeap heap(ElementSize, 0, Increase);
+			report("MemoryHeap", churn(heap, live, operations, 1), operations);
+		}
+		{
+			ppl7::MemoryHeap heap(ElementSize, 0, Increase);
+			heap.setThreadSafe(true);
+			report("MemoryHeap threadsafe", churn(heap, live, operations, 1), operations);
+		}
+		{
+			ppl7::MemoryHeap heap;
+			heap.setAlignment(64);
+			heap.setHugePages(true);
+			heap.setThreadSafe(true);
+			heap.init(ElementSize, 0, Increase);
+			ppl7::MemoryHeap::Cache cache(heap, 64);
+			report("Cache, hugepages", churn(cache, live, operations, 1), operations);
+		}
+		{
+			LibcAllocator allocator(ElementSize);
+			report("malloc/free", churn(allocator, live, operations, 1), operations);
+		}
+		runThreads("threads, shared heap", numThreads, live, operations, false);
+		runThreads("threads, cache", numThreads, live, operations, true);
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		return 1;
+	}
+	return 0;
+}
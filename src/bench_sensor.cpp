@@ -0,0 +1,160 @@
+/*
+ * This file is part of udppingpong by Patrick Fedick <fedick@denic.de>
+ *
+ * Copyright (c) 2019 DENIC eG
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ppl7.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#ifdef __linux__
+#include <sys/sysinfo.h>
+#endif
+
+#include "sensor.h"
+
+/*!\brief Microbenchmark für die Erfassung der Sensordaten
+ *
+ * Misst die Kosten einer einzelnen Messung für die bisherige Auswertung von
+ * /proc/net/dev mit ppl7::File und StrTok, für sampleSensorData (mit Map der
+ * Interfaces) und für sampleSensorTotals (ohne Allokation), jeweils per Netlink
+ * und per /proc/net/dev.
+ */
+
+#ifdef __linux__
+// Unveränderte Kopie der bisherigen Linux-Implementierung aus SampleSensorData.cpp
+static void legacySampleCpuUsage(SystemStat::Cpu &stat)
+{
+    FILE *fp = fopen("/proc/stat","r");
+    if (5 != fscanf(fp,"%*s %d %d %d %d %d",&stat.user, &stat.nice, &stat.system, &stat.idle, &stat.iowait)) {
+
+    	fclose(fp);
+    }
+    fclose(fp);
+}
+
+static void legacySampleSysinfo(SystemStat::Sysinfo &stat)
+{
+    struct sysinfo info;
+    if (0 != sysinfo(&info)) {
+        return;
+    }
+    stat.uptime=info.uptime;
+    stat.freeswap=info.freeswap*info.mem_unit;
+    stat.freeram=info.freeram*info.mem_unit;
+    stat.bufferram=info.bufferram*info.mem_unit;
+    stat.totalram=info.totalram*info.mem_unit;
+    stat.totalswap=info.totalswap*info.mem_unit;
+    stat.sharedram=info.sharedram*info.mem_unit;
+    stat.procs=info.procs;
+}
+
+static void legacySampleNetwork(std::map<ppl7::String, SystemStat::Interface> &interfaces, SystemStat::Interface &total)
+{
+	total.receive.clear();
+	total.transmit.clear();
+
+	ppl7::String buffer;
+	ppl7::File ff("/proc/net/dev");
+	while (!ff.eof()) {
+		ff.gets(buffer,2048);
+		buffer.trim();
+		ssize_t t=buffer.instr(":");
+		if (t>1) {
+			SystemStat::Interface nif;
+			nif.Name.set(buffer,t);
+			buffer.replace("\t"," ");
+			ppl7::Array tok=ppl7::StrTok(buffer," ");
+			nif.receive.bytes=tok[1].toUnsignedLong();
+			nif.receive.packets=tok[2].toUnsignedLong();
+			nif.receive.errs=tok[3].toUnsignedLong();
+			nif.receive.drop=tok[4].toUnsignedLong();
+
+			nif.transmit.bytes=tok[9].toUnsignedLong();
+			nif.transmit.packets=tok[10].toUnsignedLong();
+			nif.transmit.errs=tok[11].toUnsignedLong();
+			nif.transmit.drop=tok[12].toUnsignedLong();
+
+			total.receive.bytes+=nif.receive.bytes;
+			total.receive.packets+=nif.receive.packets;
+			total.receive.errs+=nif.receive.errs;
+			total.receive.drop+=nif.receive.drop;
+
+			total.transmit.bytes+=nif.transmit.bytes;
+			total.transmit.packets+=nif.transmit.packets;
+			total.transmit.errs+=nif.transmit.errs;
+			total.transmit.drop+=nif.transmit.drop;
+			interfaces.insert(std::pair<ppl7::String,SystemStat::Interface>(nif.Name,nif));
+		}
+	}
+}
+
+static void legacySample(SystemStat &stat)
+{
+	stat.sampleTime=ppl7::GetMicrotime();
+	legacySampleCpuUsage(stat.cpu);
+	legacySampleSysinfo(stat.sysinfo);
+	legacySampleNetwork(stat.interfaces, stat.net_total);
+}
+#endif
+
+static void sampleTotalsNetlink(SystemStat &stat)
+{
+	static SensorSampler sampler;
+	sampler.sample(stat, false);
+	if (!sampler.usesNetlink()) throw ppl7::UnsupportedFeatureException("netlink");
+}
+
+static void sampleTotalsProc(SystemStat &stat)
+{
+	static SensorSampler sampler;
+	sampler.setNetlink(false);
+	sampler.sample(stat, false);
+}
+
+static void measure(const char *name, void (*function)(SystemStat &), int iterations)
+{
+	SystemStat stat;
+	function(stat);
+	double start=ppl7::GetMicrotime();
+	for (int i=0;i<iterations;i++) function(stat);
+	double duration=ppl7::GetMicrotime()-start;
+	printf ("%-20s %8d samples, %10.3f us/sample, %10.0f samples/s, interfaces: %d\n",
+			name, iterations, duration*1000000.0/iterations, iterations/duration,
+			(int)stat.interfaces.size());
+}
+
+int main(int argc, char**argv)
+{
+	int iterations=10000;
+	if (argc>1) iterations=atoi(argv[1]);
+	if (iterations<1) iterations=1;
+	try {
+#ifdef __linux__
+		measure("legacy", legacySample, iterations);
+#endif
+		measure("sampleSensorData", sampleSensorData, iterations);
+		measure("sampleSensorTotals", sampleSensorTotals, iterations);
+		measure("totals /proc", sampleTotalsProc, iterations);
+		measure("totals netlink", sampleTotalsNetlink, iterations);
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		return 1;
+	}
+	return 0;
+}
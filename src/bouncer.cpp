@@ -29,6 +29,9 @@
 
 #include "sensor.h"
 #include "udpecho.h"
+#include "control.h"
+#include "statslog.h"
+#include "metrics.h"
 
 /*!@file
  * \ingroup GroupBouncer
@@ -66,7 +69,71 @@ void help()
 		"  -n #         Anzahl Worker-Threads (Default=1)\n"
 		"  -q           quiet, es wird nichts auf stdout ausgegeben\n"
 		"  -p #         Groesse der Antwortpakete (Default=so gross wie eingehendes Paket)\n"
+		"  -m #         Maximale Groesse eingehender Pakete (Default=65507), groessere\n"
+		"               Pakete werden abgeschnitten und als \"truncated\" gezaehlt\n"
 		"  --noecho     Es werden keine Antworten zurueckgeschickt\n"
+		"  -d SPEC      Antworten verzoegern, alle Zeiten in Millisekunden:\n"
+		"               MS oder fixed:MS    konstante Verzoegerung\n"
+		"               uniform:MIN,MAX     gleichverteilt\n"
+		"               normal:MEAN,STDDEV  normalverteilt\n"
+		"               file:FILENAME       empirische Verteilung, ein Messwert pro Zeile\n"
+		"  --dq #       Maximale Anzahl verzoegerter Pakete pro Thread. Default: erwartete\n"
+		"               Paketrate mal maximaler Verzoegerung plus 25 %%, mindestens 1024,\n"
+		"               hoechstens so viele wie in --delay-mem passen. Jeder Platz belegt\n"
+		"               einen Puffer der Groesse -p, ohne -p oder mit --dns-responder der\n"
+		"               Groesse -m. Ist die Queue voll, werden Antworten verworfen und als\n"
+		"               QO (queue overflow) gezaehlt. Antworten, die der Socket nicht\n"
+		"               annimmt, werden als SF (send failed) gezaehlt\n"
+		"  --delay-rate #\n"
+		"               Erwartete Paketrate pro Thread fuer die Groesse der Queue\n"
+		"               (Default=100000)\n"
+		"  --delay-mem #\n"
+		"               Speicherlimit der Queue pro Thread in MiB (Default=64). Eine mit\n"
+		"               --dq vorgegebene Queue, die mehr belegt, wird abgelehnt\n"
+		"  --impair SPEC\n"
+		"               Antworten stoeren, kommaseparierte Liste, Angaben in Prozent:\n"
+		"               loss=PCT                    zufaelliger Paketverlust\n"
+		"               ge=P:R[:LOSSBAD[:LOSSGOOD]] Burst-Verlust nach Gilbert-Elliott\n"
+		"               dup=PCT                     Antwort doppelt verschicken\n"
+		"               corrupt=PCT                 ein Bit der Nutzdaten kippen\n"
+		"               reorder=PCT                 Antwort ueberholt verzoegerte Pakete (nur mit -d)\n"
+		"  --dns-responder\n"
+		"               DNS-Modus: eingehende Pakete werden als DNS-Anfragen interpretiert und\n"
+		"               mit einer gueltigen DNS-Antwort beantwortet, -p wird ignoriert\n"
+		"  --dns-rcode RCODE\n"
+		"               RCODE der Antworten als Name (NOERROR, NXDOMAIN, ...) oder Zahl\n"
+		"               (Default=NOERROR)\n"
+		"  --dns-answer LIST\n"
+		"               Kommaseparierte Liste von Answer-Records TYPE:VALUE, die bei passendem\n"
+		"               QTYPE angehaengt werden. Unterstuetzt: A, AAAA, TXT, CNAME, NS, PTR\n"
+		"               Beispiel: A:192.0.2.1,AAAA:2001:db8::1\n"
+		"  --dns-ttl #  TTL der Answer-Records in Sekunden (Default=300)\n"
+		"  --netif LIST Kommaseparierte Liste der Netzwerkinterfaces, deren Zaehler erfasst\n"
+		"               werden (Default=alle)\n"
+		"  --perf       Instruktionen, Takte, Cache-Misses und Kontextwechsel der Worker-\n"
+		"               Threads per perf_event_open zaehlen und beim Beenden pro Paket\n"
+		"               ausgeben, mit --control zusaetzlich pro Testlauf an den Sender\n"
+		"  --no-hugepages\n"
+		"               Paketpuffer nicht auf Huge Pages anlegen\n"
+		"  --busy-poll [USEC]\n"
+		"               Latenzarmer Modus: Worker-Threads fragen ihren Socket ununterbrochen\n"
+		"               ab statt zu schlafen, SO_BUSY_POLL mit USEC Mikrosekunden (Default=50)\n"
+		"               sofern erlaubt. Belegt pro Thread einen CPU-Kern vollstaendig\n"
+		"  --fifo       Mit --busy-poll: Worker-Threads unter SCHED_FIFO laufen lassen\n"
+		"  --control HOST:PORT\n"
+		"               Steuerkanal oeffnen, ueber den pingpong_sender Testlaeufe startet\n"
+		"               und die Zaehler und Sensordaten des Bouncers abholt\n"
+		"  --metrics HOST:PORT\n"
+		"               HTTP-Endpunkt, der unter /metrics die kumulierten Zaehler und\n"
+		"               Sensordaten im OpenMetrics-Format liefert (z.B. fuer Prometheus)\n"
+		"  --log-json FILE\n"
+		"               Zaehler, Netzwerk-Deltas und CPU-Last pro Intervall als JSON Lines\n"
+		"               an FILE anhaengen\n"
+		"  --log-bin FILE\n"
+		"               wie --log-json, aber im kompakten Binaerformat\n"
+		"  --log-interval #\n"
+		"               Intervall fuer --log-json/--log-bin in Millisekunden (Default=1000,\n"
+		"               minimal 10)\n"
 		"\n");
 
 }
@@ -75,23 +142,61 @@ void help()
 /*!\brief Gibt solange sekündlich eine Statusmeldung aus, bis das Programm gestoppt wird
  *
  * Gibt solange sekündlich eine Statusmeldung aus, bis das Programm gestoppt wird.
+ * Ist der Steuerkanal aktiv, werden die Zähler über UDPEchoControlServer::sample
+ * ausgelesen, auch wenn keine Ausgabe erfolgen soll.
+ *
+ * Ist das Statistik-Log aktiv, werden Zähler und Sensordaten zusätzlich in dessen Intervall
+ * ausgelesen und an \p log übergeben. Die dabei ausgelesenen Zähler fließen in die
+ * nächste sekündliche Meldung ein.
  */
-void run(UDPEchoBouncer& bouncer, bool quiet)
+void run(UDPEchoBouncer& bouncer, bool quiet, UDPEchoControlServer *control, UDPEchoStatsLog *log)
 {
 	SystemStat stat_start;
 	SystemStat stat_end;
-	sampleSensorData(stat_start);
+	sampleSensorTotals(stat_start);
 	double start = ppl7::GetMicrotime();
 	double end = start + 1;
+	UDPEchoCounter pending;
+	pending.clear();
+	SystemStat log_stat=stat_start;
+	double log_time=start;
+	double log_next=log ? start+log->getInterval() : 0.0;
 
 	while (stopFlag == false) {
-		ppl7::MSleep(100);
-		if (!quiet) {
-			if (ppl7::GetMicrotime() >= end) {
-				UDPEchoCounter counter=bouncer.getCounter();
-				sampleSensorData(stat_end);
-				printf("APP PKT RX: %8lu, TX: %8lu || NetIF RX: %8lu, TX: %8lu, ER: %8lu, DR: %8lu, MBit RX: %4lu, TX: %4lu || CPU: %0.2f\n",
-					counter.packets_received, counter.packets_send,
+		double now=ppl7::GetMicrotime();
+		double next=end;
+		if (log && log_next<next) next=log_next;
+		if (next>now) ppl7::USleep(next-now>0.1 ? 100000 : (uint64_t)((next-now)*1000000.0));
+		now=ppl7::GetMicrotime();
+		if (log && now>=log_next) {
+			UDPEchoStatsRecord record;
+			SystemStat stat;
+			record.counter=bouncer.getCounter();
+			sampleSensorTotals(stat);
+			record.sampleTime=record.counter.sampleTime;
+			record.interval=record.sampleTime-log_time;
+			record.setSystemStat(log_stat, stat);
+			log->write(record);
+			if (!quiet || control) pending.add(record.counter);
+			log_stat=stat;
+			log_time=record.sampleTime;
+			while (log_next<=now) log_next+=log->getInterval();
+		}
+		if (!quiet || control) {
+			if (now >= end) {
+				UDPEchoCounter counter=pending;
+				pending.clear();
+				if (control) {
+					control->sample(counter, stat_end);
+				} else {
+					counter.add(bouncer.getCounter());
+					sampleSensorTotals(stat_end);
+				}
+				end += 1.0;
+				if (quiet) continue;
+				printf("APP PKT RX: %8lu, TX: %8lu, TR: %6lu, QO: %6lu, SF: %6lu || NetIF RX: %8lu, TX: %8lu, ER: %8lu, DR: %8lu, MBit RX: %4lu, TX: %4lu || CPU: %0.2f",
+					counter.packets_received, counter.packets_send, counter.packets_truncated,
+					counter.packets_queue_overflow, counter.packets_send_failed,
 					stat_end.net_total.receive.packets - stat_start.net_total.receive.packets,
 					stat_end.net_total.transmit.packets - stat_start.net_total.transmit.packets,
 					stat_end.net_total.receive.errs - stat_start.net_total.receive.errs +
@@ -102,8 +207,21 @@ void run(UDPEchoBouncer& bouncer, bool quiet)
 					(stat_end.net_total.transmit.bytes - stat_start.net_total.transmit.bytes) >> 17,
 					SystemStat::Cpu::getUsage(stat_end.cpu, stat_start.cpu)
 				);
+				double core_usage;
+				int core=SystemStat::getHottestCore(stat_start, stat_end, core_usage);
+				if (core>=0) printf(" || Core %d: %0.2f (IRQ: %0.2f, SI: %0.2f)", stat_end.cores[core].id, core_usage,
+						SystemStat::Cpu::getIrqUsage(stat_start.cores[core].cpu, stat_end.cores[core].cpu),
+						SystemStat::Cpu::getSoftirqUsage(stat_start.cores[core].cpu, stat_end.cores[core].cpu));
+				printf("\n");
+				if (bouncer.hasImpairment()) {
+					printf("     IMPAIR DROP: %8lu, DUP: %8lu, CORRUPT: %8lu, REORDER: %8lu\n",
+						counter.packets_impair_dropped, counter.packets_impair_duplicated,
+						counter.packets_impair_corrupted, counter.packets_impair_reordered);
+				}
+				if (bouncer.isDNSEnabled()) {
+					printf("     DNS INVALID: %8lu\n", counter.packets_dns_invalid);
+				}
 				stat_start=stat_end;
-				end += 1.0;
 			}
 		}
 	}
@@ -144,23 +262,136 @@ int main(int argc, char** argv)
 
 	bool quiet=ppl7::HaveArgv(argc, argv, "-q");
 	bouncer.disableResponses(ppl7::HaveArgv(argc, argv, "--noecho"));
+	UDPEchoPerfCounter::setEnabled(ppl7::HaveArgv(argc, argv, "--perf"));
+	UDPEchoPacketPool::setHugePages(!ppl7::HaveArgv(argc, argv, "--no-hugepages"));
+	if (ppl7::HaveArgv(argc, argv, "--busy-poll")) {
+		UDPEchoLowLatency::setEnabled(true);
+		UDPEchoLowLatency::setBusyPollTimeout(ppl7::GetArgv(argc, argv, "--busy-poll").toInt());
+		UDPEchoLowLatency::setRealtime(ppl7::HaveArgv(argc, argv, "--fifo"));
+		printf("low latency mode: %s\n", (const char*)UDPEchoLowLatency::probe());
+	}
 	int ThreadCount = ppl7::GetArgv(argc, argv, "-n").toInt();
 	if (!ThreadCount) ThreadCount=1;
 
 	size_t packetSize=ppl7::GetArgv(argc, argv, "-p").toInt();
 	if (packetSize > 0) {
-		if (packetSize < 32 || packetSize>4096) {
-			printf("ERROR: Paketgroesse muss zwischen 32 und 4096 Bytes liegen [%d]\n", (int)packetSize);
+		if (packetSize < 32 || packetSize>UDPECHO_MAX_DATAGRAM_SIZE) {
+			printf("ERROR: Paketgroesse muss zwischen 32 und %d Bytes liegen [%d]\n",
+				UDPECHO_MAX_DATAGRAM_SIZE, (int)packetSize);
 			return 1;
 		}
 		bouncer.setFixedResponsePacketSize(packetSize);
 	}
+	size_t maxPacketSize=ppl7::GetArgv(argc, argv, "-m").toInt();
+	if (maxPacketSize > 0) {
+		if (maxPacketSize < 32 || maxPacketSize>UDPECHO_MAX_DATAGRAM_SIZE) {
+			printf("ERROR: Maximale Paketgroesse muss zwischen 32 und %d Bytes liegen [%d]\n",
+				UDPECHO_MAX_DATAGRAM_SIZE, (int)maxPacketSize);
+			return 1;
+		}
+		bouncer.setMaxPacketSize(maxPacketSize);
+	}
+	try {
+		if (ppl7::HaveArgv(argc, argv, "-d")) {
+			bouncer.setResponseDelay(ppl7::GetArgv(argc, argv, "-d"));
+			bouncer.setDelayQueueSize(ppl7::GetArgv(argc, argv, "--dq").toUnsignedInt64());
+			bouncer.setDelayQueueRate(ppl7::GetArgv(argc, argv, "--delay-rate").toUnsignedInt64());
+			bouncer.setDelayQueueMemory((size_t)ppl7::GetArgv(argc, argv, "--delay-mem").toUnsignedInt64()*1024*1024);
+		}
+		if (ppl7::HaveArgv(argc, argv, "--impair")) {
+			bouncer.setImpairment(ppl7::GetArgv(argc, argv, "--impair"));
+		}
+		if (ppl7::HaveArgv(argc, argv, "--netif")) {
+			setSensorInterfaceFilter(ppl7::GetArgv(argc, argv, "--netif"));
+		}
+		if (ppl7::HaveArgv(argc, argv, "--dns-responder")) {
+			DNSResponder dns;
+			dns.enable(true);
+			if (ppl7::HaveArgv(argc, argv, "--dns-rcode"))
+				dns.setRcode(DNSParseRcode(ppl7::GetArgv(argc, argv, "--dns-rcode")));
+			if (ppl7::HaveArgv(argc, argv, "--dns-ttl"))
+				dns.setTTL((uint32_t)ppl7::GetArgv(argc, argv, "--dns-ttl").toUnsignedInt64());
+			if (ppl7::HaveArgv(argc, argv, "--dns-answer"))
+				dns.addAnswers(ppl7::GetArgv(argc, argv, "--dns-answer"));
+			bouncer.setDNSResponder(dns);
+		}
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		return 1;
+	}
+	if (ppl7::HaveArgv(argc, argv, "-d")) {
+		// Die Größe der Puffer hängt von -p, -m und dem DNS-Modus ab
+		size_t entries=bouncer.getDelayQueueSize();
+		double mib=(double)bouncer.getDelayQueueMemoryUsage()/(1024.0*1024.0);
+		double limit=(double)bouncer.getDelayQueueMemory()/(1024.0*1024.0);
+		if (bouncer.getDelayQueueMemoryUsage() > bouncer.getDelayQueueMemory()) {
+			printf("ERROR: Delay-Queue mit %zu Plaetzen belegt %0.1f MiB pro Thread, erlaubt sind %0.1f MiB (--delay-mem)\n",
+				entries, mib, limit);
+			return 1;
+		}
+		printf("delay queue: %zu entries per thread (%0.1f MiB, limit %0.1f MiB)\n", entries, mib, limit);
+	}
 	signal(SIGINT, sighandler);
 	signal(SIGKILL, sighandler);
 
 	// Start Bouncer in his own Thread
-	bouncer.start(ThreadCount);
-	run(bouncer, quiet);
+	try {
+		bouncer.start(ThreadCount);
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		return 1;
+	}
+	UDPEchoControlServer control(bouncer);
+	bool controlEnabled=ppl7::HaveArgv(argc, argv, "--control");
+	if (controlEnabled) {
+		try {
+			control.start(ppl7::GetArgv(argc, argv, "--control"));
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			bouncer.stop();
+			return 1;
+		}
+	}
+	UDPEchoMetricsServer metrics(bouncer);
+	if (ppl7::HaveArgv(argc, argv, "--metrics")) {
+		try {
+			metrics.start(ppl7::GetArgv(argc, argv, "--metrics"));
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			control.stop();
+			bouncer.stop();
+			return 1;
+		}
+	}
+	UDPEchoStatsLog log;
+	try {
+		if (ppl7::HaveArgv(argc, argv, "--log-interval"))
+			log.setInterval(ppl7::GetArgv(argc, argv, "--log-interval").toInt());
+		if (ppl7::HaveArgv(argc, argv, "--log-json"))
+			log.open(ppl7::GetArgv(argc, argv, "--log-json"), UDPEchoStatsLog::JSON);
+		else if (ppl7::HaveArgv(argc, argv, "--log-bin"))
+			log.open(ppl7::GetArgv(argc, argv, "--log-bin"), UDPEchoStatsLog::BINARY);
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		metrics.stop();
+		control.stop();
+		bouncer.stop();
+		return 1;
+	}
+	run(bouncer, quiet, controlEnabled ? &control : NULL, log.isOpen() ? &log : NULL);
+	if (UDPEchoPerfCounter::isEnabled()) {
+		UDPEchoPerfCounter::Values perf;
+		bouncer.getPerfCounter(perf);
+		perf.print("Perf bouncer:", bouncer.getTotalCounter().packets_received);
+	}
+	if (UDPEchoLowLatency::getRealtimeFailures() > 0)
+		printf("WARNING: %d Worker-Threads durften nicht unter SCHED_FIFO laufen\n",
+			UDPEchoLowLatency::getRealtimeFailures());
+	metrics.stop();
+	control.stop();
+	log.close();
+	if (log.getDropped() > 0)
+		printf("WARNING: %lu Datensaetze des Statistik-Logs wurden verworfen\n", log.getDropped());
 
 	if (!quiet)
 		printf("Stoppe und loesche Worker-Threads\n");
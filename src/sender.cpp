@@ -21,6 +21,7 @@
 #include <ppl7-inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
@@ -86,11 +87,47 @@ void UDPSender::help()
 {
 	printf ("Usage:\n"
 			"  -h            zeigt diese Hilfe an\n"
-			"  -z HOST:PORT  Hostname oder IP und Port des Zielservers\n"
-			"  -p #          Paketgroesse (Default=512 Byte)\n"
+			"  -z HOST:PORT  Hostname oder IP und Port des Zielservers. Bei einer Kommaseparierten\n"
+			"                Liste (HOST:PORT,HOST:PORT,...) gehen die Pakete reihum an alle Ziele\n"
+			"                (unverbundene Sockets, sendmmsg), Ergebnisse werden pro Ziel ausgegeben\n"
+			"  --zl FILE     Optional: Datei mit Liste von Zielen (HOST:PORT pro Zeile), wie -z mit Liste\n"
+			"  -p #          Paketgroesse (Default=512 Byte, maximal 65507 Byte)\n"
+			"  -m #          Maximale Groesse der Antwortpakete (Default=65507 Byte),\n"
+			"                groessere Antworten werden als \"truncated\" gezaehlt\n"
 			"  -l #          Laufzeit in Sekunden (Default=10 Sekunden)\n"
 			"  -t #          Timeout in Sekunden (Default=5 Sekunden)\n"
 			"  -n #          Anzahl Worker-Threads (Default=1)\n"
+			"  --sockets #   Anzahl Sockets pro Worker-Thread (Default=1). Jeder Socket hat einen\n"
+			"                eigenen Quellport, die Pakete werden reihum verteilt und die Antworten\n"
+			"                ueber ein epoll-Set im selben Thread gelesen\n"
+			"  --sport #     Quellports ab # vergeben: Socket i von Thread t erhaelt Port\n"
+			"                #+t*Sockets+i (Default=vom Kernel vergeben)\n"
+			"  --flow-buckets #\n"
+			"                Jeder Socket ist ein Flow. Die Flows aller Threads werden in #\n"
+			"                zusammenhaengende Gruppen aufgeteilt (maximal 256), Verlust und\n"
+			"                Laufzeiten werden pro Gruppe ausgegeben\n"
+			"  --raw NETZ/PRAEFIX\n"
+			"                Pakete ueber einen Raw-Socket mit selbst erzeugten IP- und UDP-\n"
+			"                Headern senden, Quelladressen reihum aus NETZ (IPv4 oder IPv6, muss\n"
+			"                zum Ziel passen). Benoetigt CAP_NET_RAW. Antworten werden nur\n"
+			"                gezaehlt, wenn NETZ auf dem Sender lokal geroutet ist, z.B. mit\n"
+			"                \"ip route add local 10.0.0.0/8 dev lo\", sonst --ignore verwenden\n"
+			"                Pakete werden nicht fragmentiert, groessere als die MTU zum Ziel\n"
+			"                werden abgelehnt\n"
+			"  --rtc [S:R]   Run-to-Completion: ein Thread pro Socket sendet und empfaengt. Nach\n"
+			"                jeweils S Paketen werden bis zu R Antworten pro Socket gebuendelt per\n"
+			"                recvmmsg gelesen (Default=16:16, R maximal 1024). S:R gilt auch fuer\n"
+			"                --sockets\n"
+			"  --busy-poll [USEC]\n"
+			"                Latenzarmer Modus: die messenden Threads fragen ihre Sockets\n"
+			"                ununterbrochen ab statt zu schlafen, SO_BUSY_POLL mit USEC\n"
+			"                Mikrosekunden (Default=50) sofern erlaubt. Belegt pro messendem\n"
+			"                Thread einen CPU-Kern vollstaendig\n"
+			"  --fifo        Mit --busy-poll: messende Threads unter SCHED_FIFO laufen lassen\n"
+			"  --latency-compare\n"
+			"                Jede Laststufe einmal ohne und einmal mit --busy-poll messen und die\n"
+			"                Laufzeiten gegenueberstellen. In der CSV-Datei kennzeichnet die letzte\n"
+			"                Spalte den Lauf (idle oder busy-poll)\n"
 			"  -r #          Queryrate (Default=soviel wie geht)\n"
 			"                Kann auch eine Kommaseparierte Liste sein (rate,rate,...) oder eine\n"
 			"                Range (von rate - bis rate, Schrittweite)\n"
@@ -98,9 +135,46 @@ void UDPSender::help()
 			"                Wert muss zwischen 1 und 1000 liegen und \"Wert/1000\" muss aufgehen\n"
 			"  -c FILE       CSV-File fuer Ergebnisse\n"
 			"  --ignore      Ignoriere die Antworten\n"
-			"  -b ADR,ADR... Optional: Liste von Quelladressen\n"
+			"  -b ADR,ADR... Optional: Liste von Quelladressen, wird reihum auf alle Sockets\n"
+			"                aller Threads verteilt\n"
 			"  --bl FILE     Optional: Datei mit Liste von Quelladressen\n"
 			"  --ar          Optional: Payload immer randomisieren\n"
+			"  --check ALG   Optional: Pruefsumme (crc32, crc32c oder xxh64) im Paketkopf\n"
+			"                mitsenden und in den Antworten verifizieren, beschaedigte Antworten\n"
+			"                werden als \"corrupted\" gezaehlt, Antworten mit veraenderter Laenge\n"
+			"                als \"length mismatch\" (Paketgroesse mindestens 24 Byte)\n"
+			"  --dns-corpus FILE\n"
+			"                DNS-Modus: statt Echo-Paketen werden DNS-Anfragen aus FILE verschickt,\n"
+			"                pro Zeile ein Name und optional der Typ (z.B. \"www.example.com AAAA\").\n"
+			"                Antworten werden anhand der Transaktions-ID zugeordnet, -p wird ignoriert\n"
+			"  --dns-edns #  Optional: EDNS0 mit der angegebenen UDP-Payload-Groesse verwenden\n"
+			"  --control HOST:PORT\n"
+			"                Optional: Steuerkanal des Bouncers (pingpong_bouncer --control). Jeder\n"
+			"                Testlauf wird auf dem Bouncer gestartet und gestoppt, dessen Zaehler\n"
+			"                und Sensordaten erscheinen im Ergebnis und in der CSV-Datei\n"
+			"  --agents HOST:PORT,HOST:PORT,...\n"
+			"                Koordinator-Modus: die Last wird nicht lokal erzeugt, sondern auf die\n"
+			"                angegebenen Agenten verteilt. Die Queryrate wird gleichmaessig\n"
+			"                aufgeteilt, alle Agenten starten gleichzeitig (Uhren muessen\n"
+			"                synchronisiert sein) und die Ergebnisse werden zusammengefasst\n"
+			"  --agent-listen HOST:PORT\n"
+			"                Agent-Modus: wartet auf Lastlaeufe eines Koordinators. Ziel und\n"
+			"                Parameter kommen vom Koordinator, -b und --bl gelten lokal\n"
+			"  --netif LIST  Kommaseparierte Liste der Netzwerkinterfaces, deren Zaehler erfasst\n"
+			"                werden (Default=alle)\n"
+			"  --perf        Instruktionen, Takte, Cache-Misses und Kontextwechsel der Sende-\n"
+			"                und Empfangsschleifen per perf_event_open zaehlen und pro Paket\n"
+			"                ausgeben (ohne PMU, z.B. in VMs, nur CPU-Zeit und Kontextwechsel)\n"
+			"  --no-hugepages\n"
+			"                Paketpuffer nicht auf Huge Pages anlegen\n"
+			"  --log-json FILE\n"
+			"                Zaehler, Netzwerk-Deltas, CPU-Last und Laufzeit-Perzentile pro\n"
+			"                Intervall als JSON Lines an FILE anhaengen\n"
+			"  --log-bin FILE\n"
+			"                wie --log-json, aber im kompakten Binaerformat\n"
+			"  --log-interval #\n"
+			"                Intervall fuer --log-json/--log-bin in Millisekunden (Default=1000,\n"
+			"                minimal 10)\n"
 			"\n");
 			//"  -m Messe Laufzeiten (Default=keine Zeitmessung)\n"
 }
@@ -113,12 +187,29 @@ void UDPSender::help()
 UDPSender::UDPSender()
 {
 	Packetsize=512;
+	MaxResponseSize=UDPECHO_MAX_DATAGRAM_SIZE;
 	Laufzeit=10;
 	Timeout=5;
 	ThreadCount=1;
+	SocketCount=1;
+	SourcePort=0;
+	FlowBuckets=0;
+	RunToCompletion=false;
+	LatencyCompare=false;
+	SendBurst=16;
+	ReceiveBurst=16;
 	Zeitscheibe=1.0f;
 	ignoreResponses=false;
 	alwaysRandomize=false;
+	dnsMode=false;
+	Checksum=UDPEchoChecksum::NONE;
+	RemoteResultsValid=false;
+	SocketDropsStart=0;
+}
+
+UDPSender::~UDPSender()
+{
+	disconnectAgents();
 }
 
 /*!\brief Liste der zu testenden Queryrates erstellen
@@ -166,9 +257,19 @@ int UDPSender::main(int argc, char**argv)
 	Ziel=ppl7::GetArgv(argc,argv,"-z");
 	Quelle=ppl7::GetArgv(argc,argv,"-q");
 	Packetsize = ppl7::GetArgv(argc,argv,"-p").toInt();
+	MaxResponseSize = ppl7::GetArgv(argc,argv,"-m").toInt();
 	Laufzeit = ppl7::GetArgv(argc,argv,"-l").toInt();
 	Timeout = ppl7::GetArgv(argc,argv,"-t").toInt();
 	ThreadCount = ppl7::GetArgv(argc,argv,"-n").toInt();
+	SocketCount = ppl7::GetArgv(argc,argv,"--sockets").toInt();
+	SourcePort = ppl7::GetArgv(argc,argv,"--sport").toInt();
+	FlowBuckets = ppl7::GetArgv(argc,argv,"--flow-buckets").toInt();
+	RawNetwork = ppl7::GetArgv(argc,argv,"--raw");
+	RunToCompletion=ppl7::HaveArgv(argc,argv,"--rtc");
+	if (RunToCompletion && !parseBurst(ppl7::GetArgv(argc,argv,"--rtc"))) {
+		printf ("ERROR: Ungueltiges Verhaeltnis fuer --rtc, erwartet S:R mit S>=1 und 1<=R<=1024\n");
+		return 1;
+	}
 	ppl7::String QueryRates = ppl7::GetArgv(argc,argv,"-r");
 	Zeitscheibe = ppl7::GetArgv(argc,argv,"-i").toFloat();
 	ppl7::String Filename = ppl7::GetArgv(argc,argv,"-c");
@@ -182,15 +283,117 @@ int UDPSender::main(int argc, char**argv)
 	if (ppl7::HaveArgv(argc,argv,"--ar")) {
 		alwaysRandomize=true;
 	}
+	UDPEchoPerfCounter::setEnabled(ppl7::HaveArgv(argc,argv,"--perf"));
+	UDPEchoPacketPool::setHugePages(!ppl7::HaveArgv(argc,argv,"--no-hugepages"));
+	LatencyCompare=ppl7::HaveArgv(argc,argv,"--latency-compare");
+	if (ppl7::HaveArgv(argc,argv,"--busy-poll") || LatencyCompare) {
+		UDPEchoLowLatency::setEnabled(!LatencyCompare);
+		UDPEchoLowLatency::setBusyPollTimeout(ppl7::GetArgv(argc,argv,"--busy-poll").toInt());
+		UDPEchoLowLatency::setRealtime(ppl7::HaveArgv(argc,argv,"--fifo"));
+		printf ("# Low latency mode: %s\n", (const char*)UDPEchoLowLatency::probe());
+	}
+	try {
+		if (Ziel.instr(",")>=0) readTargetList(Ziel);
+		if (ppl7::HaveArgv(argc,argv,"--zl"))
+			Targets.load(ppl7::GetArgv(argc,argv,"--zl"));
+		if (RawNetwork.notEmpty()) RawPacket.setSources(RawNetwork);
+		if (ppl7::HaveArgv(argc,argv,"--check"))
+			Checksum=UDPEchoChecksum::getAlgorithm(ppl7::GetArgv(argc,argv,"--check"));
+		if (ppl7::HaveArgv(argc,argv,"--netif"))
+			setSensorInterfaceFilter(ppl7::GetArgv(argc,argv,"--netif"));
+		if (ppl7::HaveArgv(argc,argv,"--log-interval"))
+			StatsLog.setInterval(ppl7::GetArgv(argc,argv,"--log-interval").toInt());
+		if (ppl7::HaveArgv(argc,argv,"--log-json"))
+			StatsLog.open(ppl7::GetArgv(argc,argv,"--log-json"), UDPEchoStatsLog::JSON);
+		else if (ppl7::HaveArgv(argc,argv,"--log-bin"))
+			StatsLog.open(ppl7::GetArgv(argc,argv,"--log-bin"), UDPEchoStatsLog::BINARY);
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		return 1;
+	}
+	if (ppl7::HaveArgv(argc,argv,"--agent-listen")) {
+		return runAgent(ppl7::GetArgv(argc,argv,"--agent-listen"));
+	}
+	if (ppl7::HaveArgv(argc,argv,"--dns-corpus")) {
+		try {
+			QueryCorpus.load(ppl7::GetArgv(argc,argv,"--dns-corpus"),
+					ppl7::GetArgv(argc,argv,"--dns-edns").toInt());
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			return 1;
+		}
+		if (QueryCorpus.getInvalidLines()>0) {
+			printf ("WARNING: %zu ungueltige Zeilen in der Query-Datei wurden ignoriert\n",
+					QueryCorpus.getInvalidLines());
+		}
+		dnsMode=true;
+		if (Checksum!=UDPEchoChecksum::NONE) {
+			printf ("ERROR: --check kann nicht mit dem DNS-Modus kombiniert werden\n");
+			return 1;
+		}
+	}
 	if (!ThreadCount) ThreadCount=1;
+	if (!SocketCount) SocketCount=1;
+	if (SocketCount<1 || SocketCount>65535) {
+		printf ("ERROR: Anzahl Sockets pro Thread muss zwischen 1 und 65535 liegen [%d]\n", SocketCount);
+		return 1;
+	}
+	if (SourcePort<0 || (SourcePort>0 && (int64_t)SourcePort+(int64_t)ThreadCount*SocketCount-1>65535)) {
+		printf ("ERROR: Quellports %d bis %ld liegen nicht zwischen 1 und 65535\n", SourcePort,
+				(int64_t)SourcePort+(int64_t)ThreadCount*SocketCount-1);
+		return 1;
+	}
+	if (FlowBuckets<0 || FlowBuckets>(int)UDPEchoFlowBuckets::MaxBuckets
+			|| (int64_t)FlowBuckets>(int64_t)ThreadCount*SocketCount) {
+		printf ("ERROR: Anzahl Gruppen muss zwischen 1 und %zu und hoechstens bei der Anzahl Flows (%ld) liegen [%d]\n",
+				UDPEchoFlowBuckets::MaxBuckets, (int64_t)ThreadCount*SocketCount, FlowBuckets);
+		return 1;
+	}
 	if (!Packetsize) Packetsize=512;
 	if (Packetsize<(int)sizeof(PACKET)) Packetsize=(int)sizeof(PACKET);
+	if (Checksum!=UDPEchoChecksum::NONE && Packetsize<(int)sizeof(PACKET_CHECKED))
+		Packetsize=(int)sizeof(PACKET_CHECKED);
+	if (Packetsize>UDPECHO_MAX_DATAGRAM_SIZE) {
+		printf ("ERROR: Paketgroesse darf maximal %d Bytes betragen [%d]\n", UDPECHO_MAX_DATAGRAM_SIZE, Packetsize);
+		return 1;
+	}
+	if (!MaxResponseSize) MaxResponseSize=UDPECHO_MAX_DATAGRAM_SIZE;
+	if (MaxResponseSize<(int)sizeof(PACKET) || MaxResponseSize>UDPECHO_MAX_DATAGRAM_SIZE) {
+		printf ("ERROR: Maximale Antwortgroesse muss zwischen %d und %d Bytes liegen [%d]\n",
+				(int)sizeof(PACKET), UDPECHO_MAX_DATAGRAM_SIZE, MaxResponseSize);
+		return 1;
+	}
 	if (!Laufzeit) Laufzeit=10;
 	if (!Timeout) Timeout=5;
-	if (Ziel.isEmpty()) {
+	if (Ziel.isEmpty() && Targets.size()==0) {
 		help();
 		return 1;
 	}
+	if (RawNetwork.notEmpty()) {
+		if (SocketCount>1 || Targets.size()>0 || SourceIpList.size()>0 || FlowBuckets>0) {
+			printf ("ERROR: --raw kann nicht mit --sockets, mehreren Zielen, -b oder --flow-buckets kombiniert werden\n");
+			return 1;
+		}
+		try {
+			RawPacket.setDestination(Ziel);
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			return 1;
+		}
+		if (RawPacket.getDestination()->sa_family!=RawPacket.getFamily()) {
+			printf ("ERROR: Ziel und Quelladressen fuer --raw muessen die gleiche Adressfamilie haben\n");
+			return 1;
+		}
+		size_t rawsize=RawPacket.getHeaderSize()+(dnsMode ? QueryCorpus.getMaxQuerySize() : (size_t)Packetsize);
+		int mtu=RawPacket.getPathMtu();
+		if (mtu>0 && rawsize>(size_t)mtu) {
+			printf ("ERROR: Pakete mit Header (%zu Bytes) sind groesser als die MTU zum Ziel (%d Bytes), "
+					"im --raw Modus wird nicht fragmentiert\n", rawsize, mtu);
+			return 1;
+		}
+		printf ("# Raw mode: %lu source addresses from %s\n", RawPacket.getSourceCount(),
+				(const char*)RawPacket.getSources());
+	}
 	if (Zeitscheibe==0.0f) Zeitscheibe=1.0f;
 	/*
 	if (Zeitscheibe>1000.0 || (1000%(int)Zeitscheibe)>0) {
@@ -199,6 +402,42 @@ int UDPSender::main(int argc, char**argv)
 		return 1;
 	}
 	*/
+	if (ppl7::HaveArgv(argc,argv,"--control")) {
+		try {
+			Control.connect(ppl7::GetArgv(argc,argv,"--control"));
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			return 1;
+		}
+	}
+	if (ppl7::HaveArgv(argc,argv,"--agents")) {
+		if (LatencyCompare) {
+			printf ("ERROR: --latency-compare wird im Koordinator-Modus nicht unterstuetzt\n");
+			return 1;
+		}
+		if (dnsMode) {
+			printf ("ERROR: DNS-Modus wird im Koordinator-Modus nicht unterstuetzt\n");
+			return 1;
+		}
+		if (Targets.size()>0) {
+			printf ("ERROR: Mehrere Ziele werden im Koordinator-Modus nicht unterstuetzt\n");
+			return 1;
+		}
+		if (FlowBuckets>0) {
+			printf ("ERROR: --flow-buckets wird im Koordinator-Modus nicht unterstuetzt\n");
+			return 1;
+		}
+		if (RawNetwork.notEmpty()) {
+			printf ("ERROR: --raw wird im Koordinator-Modus nicht unterstuetzt\n");
+			return 1;
+		}
+		try {
+			connectAgents(ppl7::GetArgv(argc,argv,"--agents"));
+		} catch (const ppl7::Exception &e) {
+			e.print();
+			return 1;
+		}
+	}
 	ppl7::Array rates = getQueryRates(QueryRates);
 	if (Filename.notEmpty()) {
 		try {
@@ -213,16 +452,43 @@ int UDPSender::main(int argc, char**argv)
 
 	UDPSender::Results results;
 	try {
+		if (Agents.size()>0) {
+			for (size_t i=0;i<rates.size();i++) {
+				results.queryrate=rates[i].toInt();
+				runDistributed(rates[i].toInt(), results);
+				presentResults(results);
+				saveResultsToCsv(results);
+			}
+			disconnectAgents();
+			return 0;
+		}
 		prepareThreads();
 		for (size_t i=0;i<rates.size();i++) {
+			UDPSender::Results idle;
 			results.queryrate=rates[i].toInt();
+			if (LatencyCompare) {
+				printf ("# Latency comparison: idle receive loops\n");
+				UDPEchoLowLatency::setEnabled(false);
+				idle.queryrate=results.queryrate;
+				run(rates[i].toInt());
+				getResults(idle);
+				presentResults(idle);
+				saveResultsToCsv(idle);
+				printf ("# Latency comparison: busy polling\n");
+				UDPEchoLowLatency::setEnabled(true);
+			}
 			run(rates[i].toInt());
 			getResults(results);
 			presentResults(results);
 			saveResultsToCsv(results);
+			if (LatencyCompare) presentLatencyComparison(idle, results);
 		}
 		threadpool.destroyAllThreads();
+		if (UDPEchoLowLatency::getRealtimeFailures()>0)
+			printf ("WARNING: %d Threads durften nicht unter SCHED_FIFO laufen\n",
+					UDPEchoLowLatency::getRealtimeFailures());
 	} catch (ppl7::OperationInterruptedException &) {
+		if (Agents.size()>0) return 1;
 		getResults(results);
 		presentResults(results);
 		saveResultsToCsv(results);
@@ -230,6 +496,9 @@ int UDPSender::main(int argc, char**argv)
 		e.print();
 		return 1;
 	}
+	StatsLog.close();
+	if (StatsLog.getDropped()>0)
+		printf ("WARNING: %lu Datensaetze des Statistik-Logs wurden verworfen\n", StatsLog.getDropped());
 	return 0;
 }
 
@@ -248,6 +517,54 @@ void UDPSender::readSourceIPList(const ppl7::String &filename)
 	}
 }
 
+/*!\brief Kommaseparierte Liste von Zielen einlesen
+ *
+ * @param list String im Format "HOST:PORT,HOST:PORT,..."
+ */
+void UDPSender::readTargetList(const ppl7::String &list)
+{
+	ppl7::Array targets;
+	targets.explode(list, ",");
+	for (size_t i=0;i<targets.size();i++) {
+		ppl7::String target=targets[i].trimmed();
+		if (target.notEmpty()) Targets.add(target);
+	}
+}
+
+/*!\brief Verhältnis von Senden und Empfangen einlesen
+ *
+ * @param ratio String im Format "S:R" oder "S", leer für den Default 16:16. Fehlt R,
+ * wird R=S verwendet.
+ * @return \c true, wenn beide Werte gültig sind
+ */
+bool UDPSender::parseBurst(const ppl7::String &ratio)
+{
+	if (ratio.isEmpty()) return true;
+	ppl7::Array parts=StrTok(ratio, ":");
+	if (parts.size()<1 || parts.size()>2) return false;
+	int send=parts[0].toInt();
+	int receive=parts.size()>1 ? parts[1].toInt() : send;
+	if (send<1 || receive<1 || receive>1024) return false;
+	SendBurst=send;
+	ReceiveBurst=receive;
+	return true;
+}
+
+/*!\brief Limit für offene Dateien anheben
+ *
+ * Hebt das Soft-Limit bis höchstens zum Hard-Limit an, damit auch viele Sockets pro
+ * Thread geöffnet werden können. Reicht das Hard-Limit nicht, schlägt später das
+ * Anlegen der Sockets mit einer Exception fehl.
+ */
+static void raiseOpenFileLimit(rlim_t needed)
+{
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit)!=0 || limit.rlim_cur>=needed) return;
+	limit.rlim_cur=needed;
+	if (limit.rlim_max!=RLIM_INFINITY && limit.rlim_cur>limit.rlim_max) limit.rlim_cur=limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+}
+
 /*!\brief Workerthreads erstellen und konfigurieren
  *
  * Die gewünschte Anzahl Workerthreads werden erstellt, konfiguriert und in
@@ -256,22 +573,38 @@ void UDPSender::readSourceIPList(const ppl7::String &filename)
 void UDPSender::prepareThreads()
 {
 	size_t si=0;
+	UDPEchoFlowBuckets flows;
+	if (FlowBuckets>0) flows.setup((size_t)FlowBuckets, (size_t)ThreadCount*(size_t)SocketCount);
+	if (SocketCount>1) raiseOpenFileLimit((rlim_t)ThreadCount*(rlim_t)SocketCount+256);
 	for (int i=0;i<ThreadCount;i++) {
 		UDPEchoSenderThread *thread=new UDPEchoSenderThread();
+		threadpool.addThread(thread);
+		thread->setSocketCount(SocketCount);
+		thread->setFlowBuckets(flows, (size_t)i*(size_t)SocketCount);
+		thread->setRunToCompletion(RunToCompletion);
+		thread->setBurst(SendBurst, ReceiveBurst);
+		if (Targets.size()>0) thread->setTargets(Targets);
 		thread->setPacketsize(Packetsize);
+		thread->setMaxResponseSize(MaxResponseSize);
 		thread->setRuntime(Laufzeit);
 		thread->setTimeout(Timeout);
 		thread->setZeitscheibe(Zeitscheibe);
 		thread->setIgnoreResponses(ignoreResponses);
 		thread->setVerbose(false);
 		thread->setAlwaysRandomize(alwaysRandomize);
-		if (SourceIpList.size()>0) {
-			thread->setSourceIP(SourceIpList[si]);
-			si++;
-			if (si>=SourceIpList.size()) si=0;
+		if (dnsMode) thread->setDNSQueryCorpus(&QueryCorpus);
+		thread->setChecksum(Checksum);
+		if (RawNetwork.notEmpty()) {
+			// Die Threads beginnen gleichmäßig verteilt im Netz der Quelladressen
+			thread->setRawPacket(RawPacket, RawPacket.getSourceCount()/ThreadCount*i, SourcePort>0 ? SourcePort+i : 0);
+			continue;
 		}
-		thread->connect(Ziel);
-		threadpool.addThread(thread);
+		if (SourceIpList.size()>0 || SourcePort>0) {
+			// Jeder Socket erhält die nächste Adresse der Liste und den nächsten Port
+			thread->bindSources(SourceIpList, si, SourcePort>0 ? SourcePort+i*SocketCount : 0);
+			if (SourceIpList.size()>0) si=(si+(size_t)SocketCount)%SourceIpList.size();
+		}
+		if (Targets.size()==0) thread->connect(Ziel);
 	}
 }
 
@@ -289,8 +622,10 @@ void UDPSender::openCSVFile(const ppl7::String Filename)
 	CSVFile.open(Filename,ppl7::File::APPEND);
 	if (CSVFile.size()==0) {
 		CSVFile.putsf ("#QPS Send; QPS Received; QPS Errors; Lostrate; "
-					"rtt_avg; rtt_min; rtt_max;"
-					"\n");
+					"rtt_avg; rtt_min; rtt_max;%s%s"
+					"\n",
+					Control.isConnected() ? " Bouncer QPS Received; Bouncer QPS Send; Bouncer CPU avg; Bouncer CPU max;" : "",
+					LatencyCompare ? " Mode;" : "");
 	}
 
 	return;
@@ -303,44 +638,86 @@ void UDPSender::openCSVFile(const ppl7::String Filename)
 			);
 }
 
+/*!\brief Queryrate aufteilen
+ *
+ * Verteilt \p queryrate möglichst gleichmäßig auf \p parts Teile, der Rest der
+ * Division geht an die letzten Teile. Wird sowohl für die Aufteilung auf die
+ * Workerthreads als auch auf die Agenten im Koordinator-Modus verwendet.
+ *
+ * @param queryrate Gesamte Queryrate, 0=soviel wie geht
+ * @param parts Anzahl Teile
+ * @param index Nummer des Teils, beginnend bei 0
+ * @return Queryrate des Teils \p index
+ */
+int UDPSender::splitQueryRate(int queryrate, int parts, int index)
+{
+	int rate=queryrate/parts;
+	if (index>=parts-queryrate%parts) rate++;
+	return rate;
+}
+
 /*!\brief Last generieren
  *
  * Konfiguriert die Workerthreads mit der gewünschten Last \p queryrate, startet sie und wartet,
  * bis sie sich wieder beendet haben.
  * @param queryrate gewünschte Queryrate
+ * @param start_time Optionaler Startzeitpunkt (Unix-Zeit in Sekunden, siehe ppl7::GetMicrotime),
+ * bis zu dem gewartet wird. Wird im Agent-Modus verwendet, damit alle Agenten gleichzeitig
+ * beginnen.
  */
-void UDPSender::run(int queryrate)
+void UDPSender::run(int queryrate, double start_time)
 {
 
 	printf ("# Start Session with Packetsize: %d, Threads: %d, Queryrate: %d\n",
 			Packetsize, ThreadCount,queryrate);
+	int index=0;
+	ppl7::ThreadPool::iterator it;
+	for (it=threadpool.begin();it!=threadpool.end();++it) {
+		((UDPEchoSenderThread*)(*it))->setQueryRate(splitQueryRate(queryrate, threadpool.count(), index));
+		index++;
+	}
+	while (start_time>0.0 && stopFlag==false) {
+		double rest=start_time-ppl7::GetMicrotime();
+		if (rest<=0.0) break;
+		ppl7::USleep(rest>0.1 ? 100000 : (uint64_t)(rest*1000000.0));
+	}
 	SystemStat stat_start;
 	SystemStat stat_end;
-	sampleSensorData(stat_start);
+	sampleSensorTotals(stat_start);
+	UdpStart=stat_start.udp;
+	SocketDropsStart=getSocketDrops();
 	double start = ppl7::GetMicrotime();
 	double end = start + 1;
 
 	UDPEchoCounter previous_counter;
 	previous_counter.clear();
 
-	ppl7::ThreadPool::iterator it;
-	int queries_rest=queryrate;
-	int threads_rest=threadpool.count();
-	for (it=threadpool.begin();it!=threadpool.end();++it) {
-		int queries_thread=queries_rest/threads_rest;
-		threads_rest--;
-		queries_rest-=queries_thread;
-		((UDPEchoSenderThread*)(*it))->setQueryRate(queries_thread);
-	}
+	bool logEnabled=StatsLog.isOpen();
+	double log_next=start+StatsLog.getInterval();
+	LogTime=start;
+	LogStat=stat_start;
+	LogCounter.clear();
+	LogHistogram.clear();
+
+	RemoteResultsValid=false;
+	if (Control.isConnected()) Control.startTrial();
 	threadpool.startThreads();
 	ppl7::MSleep(500);
 	while (threadpool.running()==true && stopFlag==false) {
-		ppl7::MSleep(100);
-		if (ppl7::GetMicrotime() >= end) {
-			sampleSensorData(stat_end);
+		double now=ppl7::GetMicrotime();
+		double next=end;
+		if (logEnabled && log_next<next) next=log_next;
+		if (next>now) ppl7::USleep(next-now>0.1 ? 100000 : (uint64_t)((next-now)*1000000.0));
+		now=ppl7::GetMicrotime();
+		if (logEnabled && now>=log_next) {
+			writeStatsRecord();
+			while (log_next<=now) log_next+=StatsLog.getInterval();
+		}
+		if (now >= end) {
+			sampleSensorTotals(stat_end);
 			UDPEchoCounter counter=getCounter();
 
-			printf("APP Packets TX: %8lu, RX: %8lu || NetIF TX: %8lu, RX: %8lu, ER: %8lu, DR: %8lu, MBit TX: %4lu, RX: %4lu || CPU: %0.2f\n",
+			printf("APP Packets TX: %8lu, RX: %8lu || NetIF TX: %8lu, RX: %8lu, ER: %8lu, DR: %8lu, MBit TX: %4lu, RX: %4lu || CPU: %0.2f",
 					counter.packets_send-previous_counter.packets_send,
 					counter.packets_received-previous_counter.packets_received,
 					stat_end.net_total.transmit.packets-stat_start.net_total.transmit.packets,
@@ -353,16 +730,42 @@ void UDPSender::run(int queryrate)
 					(stat_end.net_total.receive.bytes-stat_start.net_total.receive.bytes)>>17,
 					SystemStat::Cpu::getUsage(stat_end.cpu, stat_start.cpu)
 					);
+			double core_usage;
+			int core=SystemStat::getHottestCore(stat_start, stat_end, core_usage);
+			if (core>=0) printf(" || Core %d: %0.2f (IRQ: %0.2f, SI: %0.2f)", stat_end.cores[core].id, core_usage,
+					SystemStat::Cpu::getIrqUsage(stat_start.cores[core].cpu, stat_end.cores[core].cpu),
+					SystemStat::Cpu::getSoftirqUsage(stat_start.cores[core].cpu, stat_end.cores[core].cpu));
+			printf("\n");
 
 			stat_start=stat_end;
 			previous_counter=counter;
 			end += 1.0;
 		}
 	}
+	if (logEnabled) writeStatsRecord();
 	if (stopFlag==true) {
 		threadpool.stopThreads();
+		stopRemoteTrial();
 		throw ppl7::OperationInterruptedException("Lasttest wurde abgebrochen");
 	}
+	stopRemoteTrial();
+}
+
+/*!\brief Testlauf auf dem Bouncer beenden
+ *
+ * Beendet den Testlauf über den Steuerkanal und holt die Messwerte des Bouncers ab.
+ * Ein Fehler auf dem Steuerkanal bricht den Lasttest nicht ab, die Werte des Bouncers
+ * fehlen dann im Ergebnis.
+ */
+void UDPSender::stopRemoteTrial()
+{
+	if (!Control.isConnected()) return;
+	try {
+		Control.stopTrial(RemoteResults);
+		RemoteResultsValid=true;
+	} catch (const ppl7::Exception &e) {
+		e.print();
+	}
 }
 
 
@@ -375,12 +778,73 @@ UDPEchoCounter UDPSender::getCounter()
 	for (it=threadpool.begin();it!=threadpool.end();++it) {
 		counter.packets_send+=((UDPEchoSenderThread*)(*it))->getPacketsSend();
 		counter.packets_received+=((UDPEchoSenderThread*)(*it))->getPacketsReceived();
-		//counter.bytes_send+=((UDPEchoSenderThread*)(*it))->getBytesSend();
-		//counter.bytes_received+=((UDPEchoSenderThread*)(*it))->getBytesReceived();
+		counter.bytes_send+=((UDPEchoSenderThread*)(*it))->getBytesSend();
+		counter.bytes_received+=((UDPEchoSenderThread*)(*it))->getBytesReceived();
+		counter.packets_truncated+=((UDPEchoSenderThread*)(*it))->getPacketsTruncated();
 	}
 	return counter;
 }
 
+/*!\brief Summe der im Empfangspuffer der Sockets verworfenen Antworten
+ *
+ * @return Summe der Zähler aller Sockets seit deren Erzeugen. Jeder Zähler ist
+ * 32 Bit breit und läuft über, Differenzen sind daher modulo 2^32 zu bilden.
+ */
+int64_t UDPSender::getSocketDrops()
+{
+	int64_t drops=0;
+	ppl7::ThreadPool::iterator it;
+	for (it=threadpool.begin();it!=threadpool.end();++it) {
+		drops+=((UDPEchoSenderThread*)(*it))->getSocketDrops();
+	}
+	return drops;
+}
+
+/*!\brief Aktuellen Stand der Latenz-Histogramme aller Workerthreads zusammenfassen
+ *
+ * Wird während des Lastlaufs aufgerufen, die Histogramme werden dabei ohne Lock gelesen.
+ */
+void UDPSender::getLatencyHistogram(UDPEchoLatencyHistogram &histogram)
+{
+	histogram.clear();
+	ppl7::ThreadPool::iterator it;
+	for (it=threadpool.begin();it!=threadpool.end();++it) {
+		histogram.merge(((UDPEchoSenderThread*)(*it))->getLatencyHistogram());
+	}
+}
+
+/*!\brief Messwerte seit dem letzten Intervall an das Statistik-Log übergeben
+ *
+ * Zähler und Histogramme der Workerthreads laufen über den gesamten Lastlauf, daher
+ * wird die Differenz zum Stand des letzten Intervalls gebildet.
+ */
+void UDPSender::writeStatsRecord()
+{
+	UDPEchoStatsRecord record;
+	SystemStat stat;
+	UDPEchoLatencyHistogram histogram;
+	UDPEchoCounter counter=getCounter();
+	getLatencyHistogram(histogram);
+	sampleSensorTotals(stat);
+	record.sampleTime=counter.sampleTime;
+	record.interval=counter.sampleTime-LogTime;
+	record.counter.sampleTime=counter.sampleTime;
+	record.counter.packets_send=counter.packets_send-LogCounter.packets_send;
+	record.counter.packets_received=counter.packets_received-LogCounter.packets_received;
+	record.counter.bytes_send=counter.bytes_send-LogCounter.bytes_send;
+	record.counter.bytes_received=counter.bytes_received-LogCounter.bytes_received;
+	record.counter.packets_truncated=counter.packets_truncated-LogCounter.packets_truncated;
+	record.setSystemStat(LogStat, stat);
+	UDPEchoLatencyHistogram delta=histogram;
+	delta.subtract(LogHistogram);
+	record.setLatency(delta);
+	StatsLog.write(record);
+	LogTime=counter.sampleTime;
+	LogStat=stat;
+	LogCounter=counter;
+	LogHistogram=histogram;
+}
+
 /*!\brief Ergebnisse sammeln und berechnen
  *
  * Sammelt die Ergebnisse der Workerthreads und berechnet das Gesamtergebnis für einen
@@ -391,40 +855,55 @@ UDPEchoCounter UDPSender::getCounter()
 void UDPSender::getResults(UDPSender::Results &result)
 {
 	ppl7::ThreadPool::iterator it;
-	result.counter_send=0;
-	result.counter_received=0;
-	result.bytes_received=0;
-	result.counter_errors=0;
-	result.counter_0bytes=0;
-	result.duration=0.0;
-	result.rtt_total=0.0f;
-	result.rtt_min=0.0f;
-	result.rtt_max=0.0f;
-	for (int i=0;i<255;i++) result.counter_errorcodes[i]=0;
+	result.clear();
 
 	for (it=threadpool.begin();it!=threadpool.end();++it) {
 		result.counter_send+=((UDPEchoSenderThread*)(*it))->getPacketsSend();
 		result.counter_received+=((UDPEchoSenderThread*)(*it))->getPacketsReceived();
+		result.bytes_send+=((UDPEchoSenderThread*)(*it))->getBytesSend();
 		result.bytes_received+=((UDPEchoSenderThread*)(*it))->getBytesReceived();
 		result.counter_errors+=((UDPEchoSenderThread*)(*it))->getErrors();
 		result.counter_0bytes+=((UDPEchoSenderThread*)(*it))->getCounter0Bytes();
+		result.counter_truncated+=((UDPEchoSenderThread*)(*it))->getPacketsTruncated();
+		result.counter_corrupted+=((UDPEchoSenderThread*)(*it))->getPacketsCorrupted();
+		result.counter_length_mismatch+=((UDPEchoSenderThread*)(*it))->getPacketsLengthMismatch();
+		result.counter_dns_unmatched+=((UDPEchoSenderThread*)(*it))->getDNSUnmatched();
+		result.counter_dns_invalid+=((UDPEchoSenderThread*)(*it))->getDNSInvalid();
+		for (int i=0;i<16;i++) result.counter_rcodes[i]+=((UDPEchoSenderThread*)(*it))->getRcodeCounter(i);
 		result.duration+=((UDPEchoSenderThread*)(*it))->getDuration();
-		result.rtt_total+=((UDPEchoSenderThread*)(*it))->getRoundTripTimeAverage();
+		result.rtt_avg+=((UDPEchoSenderThread*)(*it))->getRoundTripTimeAverage();
+		result.histogram.merge(((UDPEchoSenderThread*)(*it))->getLatencyHistogram());
 		double rtt=((UDPEchoSenderThread*)(*it))->getRoundTripTimeMin();
 		if (result.rtt_min==0) result.rtt_min=rtt;
 		else if (rtt<result.rtt_min) result.rtt_min=rtt;
 		rtt=((UDPEchoSenderThread*)(*it))->getRoundTripTimeMax();
 		if (rtt>result.rtt_max) result.rtt_max=rtt;
 		for (int i=0;i<255;i++) result.counter_errorcodes[i]+=((UDPEchoSenderThread*)(*it))->getCounterErrorCode(i);
+		UDPEchoPerfCounter::Values send, receive;
+		((UDPEchoSenderThread*)(*it))->getPerfCounter(send, receive);
+		result.perf_send.add(send);
+		result.perf_receive.add(receive);
+		((UDPEchoSenderThread*)(*it))->getTargets(result.targets);
+		((UDPEchoSenderThread*)(*it))->getFlowBuckets(result.flows);
 	}
 	result.packages_lost=result.counter_send-result.counter_received;
+	// Die Zähler der Sockets sind 32 Bit breit, die Differenz wird daher modulo 2^32 gebildet
+	result.counter_socket_dropped=(uint32_t)(getSocketDrops()-SocketDropsStart);
+	SystemStat stat;
+	sampleSensorTotals(stat);
+	result.udp=SystemStat::Udp::getDelta(UdpStart, stat.udp);
+	result.remote_valid=RemoteResultsValid;
+	if (RemoteResultsValid) result.remote=RemoteResults;
 	result.duration=result.duration/(double)ThreadCount;
+	result.rtt_avg=result.rtt_avg/(double)ThreadCount;
 }
 
 /*!\brief Ergebnisse in eine Datei schreiben
  *
  * Prüft, ob eine CSV-Datei geöffnet ist und schreibt, wenn dies der Fall ist, die Werte
- * aus dem Ergebnisobjekt \p result als kommaseparierte Liste in die Datei.
+ * aus dem Ergebnisobjekt \p result als kommaseparierte Liste in die Datei. Mit
+ * --latency-compare folgt als letzte Spalte, ob der Lauf mit schlafenden ("idle") oder
+ * abfragenden ("busy-poll") Empfangsschleifen gemessen wurde.
  *
  * @param result Datenobjekt mit den Ergebniswerten
  */
@@ -432,19 +911,61 @@ void UDPSender::saveResultsToCsv(const UDPSender::Results &result)
 {
 
 	if (CSVFile.isOpen()) {
-		CSVFile.putsf ("%lu;%lu;%lu;%0.3f;%0.4f;%0.4f;%0.4f;\n",
+		CSVFile.putsf ("%lu;%lu;%lu;%0.3f;%0.4f;%0.4f;%0.4f;",
 				(int64_t)((double)result.counter_send/result.duration),
 				(int64_t)((double)result.counter_received/result.duration),
 				(int64_t)((double)result.counter_errors/result.duration),
 				(double)result.packages_lost*100.0/(double)result.counter_send,
-				result.rtt_total*1000.0/(double)ThreadCount,
+				result.rtt_avg*1000.0,
 				result.rtt_min*1000.0,
 				result.rtt_max*1000.0
 		);
+		if (result.remote_valid) {
+			double duration=result.remote.getDuration();
+			CSVFile.putsf ("%lu;%lu;%0.2f;%0.2f;",
+					(int64_t)((double)result.remote.total.packets_received/duration),
+					(int64_t)((double)result.remote.total.packets_send/duration),
+					result.remote.getCpuUsage(),
+					result.remote.getCpuUsageMax());
+		} else if (Control.isConnected()) {
+			// Der Header enthält die Spalten des Bouncers, leer lassen statt sie wegzulassen
+			CSVFile.putsf (";;;;");
+		}
+		if (LatencyCompare) CSVFile.putsf ("%s;", UDPEchoLowLatency::isEnabled() ? "busy-poll" : "idle");
+		CSVFile.putsf ("\n");
 		CSVFile.flush();
 	}
 }
 
+static void printLatencyDelta(const char *label, double idle, double busy)
+{
+	printf ("%-12s %0.4f ms -> %0.4f ms (%+0.4f ms", label, idle*1000.0, busy*1000.0, (busy-idle)*1000.0);
+	if (idle>0.0) printf (", %+0.1f %%", (busy-idle)*100.0/idle);
+	printf (")\n");
+}
+
+/*!\brief Laufzeiten mit und ohne Busy-Polling gegenüberstellen
+ *
+ * Wird mit --latency-compare nach beiden Läufen einer Laststufe aufgerufen. Die
+ * Differenz zeigt, welchen Anteil das Aufwecken der schlafenden Threads an der
+ * gemessenen Laufzeit hat.
+ *
+ * @param idle Ergebnis des Laufs mit schlafenden Empfangsschleifen
+ * @param busy Ergebnis des Laufs mit Busy-Polling
+ */
+void UDPSender::presentLatencyComparison(const UDPSender::Results &idle, const UDPSender::Results &busy)
+{
+	printf ("Latency idle -> busy-poll:\n");
+	printLatencyDelta("rtt average:", idle.rtt_avg, busy.rtt_avg);
+	printLatencyDelta("rtt min:", idle.rtt_min, busy.rtt_min);
+	if (idle.histogram.count()>0 && busy.histogram.count()>0) {
+		printLatencyDelta("rtt p50:", idle.histogram.percentile(50.0), busy.histogram.percentile(50.0));
+		printLatencyDelta("rtt p99:", idle.histogram.percentile(99.0), busy.histogram.percentile(99.0));
+		printLatencyDelta("rtt p99.9:", idle.histogram.percentile(99.9), busy.histogram.percentile(99.9));
+	}
+	printf ("\n");
+}
+
 /*!\brief Ergebnisse auf der Konsole ausgeben
  *
  * Gibt die Werte aus dem Datenobjekt \p result auf der Konsole aus.
@@ -455,15 +976,34 @@ void UDPSender::presentResults(const UDPSender::Results &result)
 {
 	int64_t qps_send=(int64_t)((double)result.counter_send/result.duration);
 	int64_t qps_received=(int64_t)((double)result.counter_received/result.duration);
+	int64_t bytes_send=(int64_t)((double)result.bytes_send/result.duration);
 	int64_t bytes_received=(int64_t)((double)result.bytes_received/result.duration);
 	printf ("Packets send:     %10lu, Qps: %10lu, Durchsatz: %10lu MBit\n",result.counter_send,
 			qps_send,
-			qps_send*Packetsize*8/(1024*1024));
+			bytes_send*8/(1024*1024));
 	printf ("Packets received: %10lu, Qps: %10lu, Durchsatz: %10lu MBit\n",result.counter_received,
 			qps_received,
 			bytes_received*8/(1024*1024));
 	printf ("Packets lost:     %10lu = %0.3f %%\n",result.packages_lost,
 			(double)result.packages_lost*100.0/(double)result.counter_send);
+	printf ("Packets truncated:%10lu\n",result.counter_truncated);
+	if (Checksum!=UDPEchoChecksum::NONE) {
+		double corrupted=0.0;
+		if (result.counter_received>0) corrupted=(double)result.counter_corrupted*100.0/(double)result.counter_received;
+		printf ("Packets corrupted:%10lu = %0.3f %% [%s]\n",result.counter_corrupted,
+				corrupted, UDPEchoChecksum::getName(Checksum));
+		printf ("Length mismatch:  %10lu\n",result.counter_length_mismatch);
+	}
+	if (dnsMode) {
+		for (int i=0;i<16;i++) {
+			if (result.counter_rcodes[i]>0) {
+				printf ("RCODE %-10s %10lu = %0.3f %%\n", DNSRcodeName(i), result.counter_rcodes[i],
+						(double)result.counter_rcodes[i]*100.0/(double)result.counter_received);
+			}
+		}
+		printf ("DNS unmatched:    %10lu\n",result.counter_dns_unmatched);
+		printf ("DNS invalid:      %10lu\n",result.counter_dns_invalid);
+	}
 
 	printf ("Errors:           %10lu, Qps: %10lu\n",result.counter_errors,
 			(int64_t)((double)result.counter_errors/result.duration));
@@ -479,15 +1019,587 @@ void UDPSender::presentResults(const UDPSender::Results &result)
 		}
 	}
 
+	result.perf_send.print("Perf send:", result.counter_send);
+	result.perf_receive.print("Perf receive:", result.counter_received);
+	UDPEchoPerfCounter::Values cpu=result.perf_send;
+	cpu.add(result.perf_receive);
+	if (cpu.valid[UDPEchoPerfCounter::TASK_CLOCK] && cpu.value[UDPEchoPerfCounter::TASK_CLOCK]>0) {
+		// Vergleichswert für die Aufteilung auf Sende- und Empfangsthreads (--rtc, --sockets)
+		printf ("Packets per core: %10lu/s (send+receive per CPU second)\n",
+				(int64_t)((double)(result.counter_send+result.counter_received)*1000000000.0
+						/(double)cpu.value[UDPEchoPerfCounter::TASK_CLOCK]));
+	}
+
 	printf ("rtt average: %0.4f ms\n"
 			"rtt min:     %0.4f ms\n"
 			"rtt max:     %0.4f ms\n",
-			result.rtt_total*1000.0/(double)ThreadCount,
+			result.rtt_avg*1000.0,
 			result.rtt_min*1000.0,
 			result.rtt_max*1000.0);
+	if (result.histogram.count()>0) {
+		printf ("rtt p50:     %0.4f ms\n"
+				"rtt p90:     %0.4f ms\n"
+				"rtt p99:     %0.4f ms\n"
+				"rtt p99.9:   %0.4f ms\n",
+				result.histogram.percentile(50.0)*1000.0,
+				result.histogram.percentile(90.0)*1000.0,
+				result.histogram.percentile(99.0)*1000.0,
+				result.histogram.percentile(99.9)*1000.0);
+	}
+	printf ("UDP stack (host): InDatagrams: %lu, OutDatagrams: %lu, RcvbufErrors: %lu, SndbufErrors: %lu, "
+			"InErrors: %lu, NoPorts: %lu\n",
+			result.udp.InDatagrams, result.udp.OutDatagrams, result.udp.RcvbufErrors,
+			result.udp.SndbufErrors, result.udp.InErrors, result.udp.NoPorts);
+	if (result.targets.size()>0) presentTargetResults(result.targets);
+	if (result.flows.size()>0) presentFlowResults(result.flows);
+	if (result.remote_valid) presentRemoteResults(result.remote);
+	presentLossAttribution(result);
+}
+
+/*!\brief Ergebnisse pro Ziel ausgeben
+ *
+ * Gibt im Multi-Ziel-Betrieb pro Ziel eine Zeile mit gesendeten und empfangenen
+ * Paketen, Verlust und Laufzeiten aus. Antworten von Adressen, die nicht in der
+ * Liste stehen, werden zusätzlich gezählt.
+ *
+ * @param targets Zusammengefasste Tabelle aller Workerthreads
+ */
+void UDPSender::presentTargetResults(const UDPEchoTargetTable &targets)
+{
+	printf ("Targets:\n");
+	printf ("  %-24s %10s %10s %10s %8s %10s %10s %10s %8s\n", "Target", "Send", "Received", "Lost",
+			"Loss %", "rtt avg", "rtt p50", "rtt p99", "Errors");
+	for (size_t i=0;i<targets.size();i++) {
+		const UDPEchoTargetTable::Target &t=targets[i];
+		int64_t lost=t.packets_send-t.packets_received;
+		printf ("  %-24s %10ld %10ld %10ld %8.3f", (const char*)t.toString(),
+				t.packets_send, t.packets_received, lost,
+				t.packets_send>0 ? (double)lost*100.0/(double)t.packets_send : 0.0);
+		if (t.packets_received>0) {
+			printf (" %10.4f %10.4f %10.4f", t.rtt_total*1000.0/(double)t.packets_received,
+					t.histogram.percentile(50.0)*1000.0, t.histogram.percentile(99.0)*1000.0);
+		} else {
+			printf (" %10s %10s %10s", "-", "-", "-");
+		}
+		printf (" %8ld\n", t.errors);
+	}
+	if (targets.getUnknown()>0)
+		printf ("  Responses from unknown sources: %ld\n", targets.getUnknown());
+}
+
+/*!\brief Ergebnisse pro Gruppe von Flows ausgeben
+ *
+ * Gibt pro Gruppe die enthaltenen Flows, mit --sport auch deren Quellports, sowie
+ * gesendete und empfangene Pakete, Verlust und Laufzeiten aus. Die abschließende Zeile
+ * mit der niedrigsten und höchsten Verlustrate zeigt, ob sich Verluste auf einzelne
+ * Gruppen konzentrieren, etwa weil deren Flows per RSS auf eine überlastete Queue
+ * verteilt werden.
+ *
+ * @param flows Zusammengefasste Gruppen aller Workerthreads
+ */
+void UDPSender::presentFlowResults(const UDPEchoFlowBuckets &flows)
+{
+	printf ("Flow buckets (%zu flows):\n", flows.getFlowCount());
+	printf ("  %-6s %-13s %-13s %10s %10s %10s %8s %10s %10s %10s %8s\n", "Bucket", "Flows", "Ports",
+			"Send", "Received", "Lost", "Loss %", "rtt avg", "rtt p50", "rtt p99", "Errors");
+	double loss_min=0.0, loss_max=0.0;
+	size_t bucket_min=0, bucket_max=0;
+	for (size_t i=0;i<flows.size();i++) {
+		const UDPEchoFlowStats &b=flows[i];
+		size_t first=flows.firstFlow(i);
+		size_t last=flows.firstFlow(i+1)-1;
+		ppl7::String range, ports("-");
+		range.setf("%zu-%zu", first, last);
+		if (SourcePort>0) ports.setf("%zu-%zu", SourcePort+first, SourcePort+last);
+		int64_t lost=b.packets_send-b.packets_received;
+		double loss=b.packets_send>0 ? (double)lost*100.0/(double)b.packets_send : 0.0;
+		if (i==0 || loss<loss_min) {
+			loss_min=loss;
+			bucket_min=i;
+		}
+		if (i==0 || loss>loss_max) {
+			loss_max=loss;
+			bucket_max=i;
+		}
+		printf ("  %6zu %-13s %-13s %10ld %10ld %10ld %8.3f", i, (const char*)range, (const char*)ports,
+				b.packets_send, b.packets_received, lost, loss);
+		if (b.packets_received>0) {
+			printf (" %10.4f %10.4f %10.4f", b.rtt_total*1000.0/(double)b.packets_received,
+					b.histogram.percentile(50.0)*1000.0, b.histogram.percentile(99.0)*1000.0);
+		} else {
+			printf (" %10s %10s %10s", "-", "-", "-");
+		}
+		printf (" %8ld\n", b.errors);
+	}
+	printf ("  Loss per bucket: min %0.3f %% (bucket %zu), max %0.3f %% (bucket %zu)\n",
+			loss_min, bucket_min, loss_max, bucket_max);
+}
+
+/*!\brief Verlorene Pakete dem Ort des Verlusts zuordnen
+ *
+ * Vom Kernel im Empfangspuffer der Sender-Sockets verworfene Antworten gehen auf den
+ * Generator, im Empfangspuffer der Bouncer-Sockets verworfene Anfragen sowie vom
+ * Bouncer selbst verworfene Pakete (--impair, volle Delay-Queue) auf den Reflektor.
+ * Der Rest ist unterwegs verloren gegangen. Ohne Steuerkanal zum Bouncer lassen sich
+ * Netz und Reflektor nicht unterscheiden.
+ *
+ * @param result Datenobjekt mit den Ergebniswerten
+ */
+void UDPSender::presentLossAttribution(const UDPSender::Results &result)
+{
+	if (ignoreResponses || result.packages_lost<=0) return;
+	int64_t rest=result.packages_lost;
+	int64_t generator=result.counter_socket_dropped;
+	if (generator>rest) generator=rest;
+	rest-=generator;
+	printf ("Loss attribution:\n");
+	printf ("  generator socket: %10ld = %0.3f %%\n", generator,
+			(double)generator*100.0/(double)result.packages_lost);
+	if (!result.remote_valid) {
+		printf ("  network/reflector:%10ld = %0.3f %%\n", rest,
+				(double)rest*100.0/(double)result.packages_lost);
+		return;
+	}
+	const UDPEchoCounter &t=result.remote.total;
+	int64_t reflector_socket=t.packets_socket_dropped;
+	if (reflector_socket>rest) reflector_socket=rest;
+	rest-=reflector_socket;
+	int64_t reflector_app=t.packets_impair_dropped+t.packets_queue_overflow+t.packets_send_failed;
+	if (reflector_app>rest) reflector_app=rest;
+	rest-=reflector_app;
+	printf ("  reflector socket: %10ld = %0.3f %%\n", reflector_socket,
+			(double)reflector_socket*100.0/(double)result.packages_lost);
+	if (reflector_app>0) {
+		printf ("  reflector app:    %10ld = %0.3f %% (impairment, delay queue, send failed)\n", reflector_app,
+				(double)reflector_app*100.0/(double)result.packages_lost);
+	}
+	printf ("  network:          %10ld = %0.3f %%\n", rest,
+			(double)rest*100.0/(double)result.packages_lost);
+}
+
+/*!\brief Messwerte des Bouncers auf der Konsole ausgeben
+ *
+ * Gibt die sekündlichen Messungen des Bouncers und die Summe über den Testlauf aus.
+ *
+ * @param remote Über den Steuerkanal abgeholte Messwerte
+ */
+void UDPSender::presentRemoteResults(const UDPEchoRemoteResults &remote)
+{
+	const SystemStat *previous=&remote.stat_start;
+	printf ("Bouncer:\n");
+	for (size_t i=0;i<remote.counter.size();i++) {
+		const UDPEchoCounter &c=remote.counter[i];
+		const SystemStat &s=remote.stat[i];
+		printf ("  %3zu: APP RX: %8lu, TX: %8lu || NetIF RX: %8lu, TX: %8lu, DR: %8lu || CPU: %0.2f",
+				i+1, c.packets_received, c.packets_send,
+				s.net_total.receive.packets-previous->net_total.receive.packets,
+				s.net_total.transmit.packets-previous->net_total.transmit.packets,
+				s.net_total.receive.drop-previous->net_total.receive.drop +
+				s.net_total.transmit.drop-previous->net_total.transmit.drop,
+				SystemStat::Cpu::getUsage(s.cpu, previous->cpu));
+		double core_usage;
+		int core=SystemStat::getHottestCore(*previous, s, core_usage);
+		if (core>=0) printf(" || Core %d: %0.2f (IRQ: %0.2f, SI: %0.2f)", s.cores[core].id, core_usage,
+				SystemStat::Cpu::getIrqUsage(previous->cores[core].cpu, s.cores[core].cpu),
+				SystemStat::Cpu::getSoftirqUsage(previous->cores[core].cpu, s.cores[core].cpu));
+		printf("\n");
+		previous=&s;
+	}
+	double duration=remote.getDuration();
+	const UDPEchoCounter &t=remote.total;
+	printf ("Bouncer received: %10lu, Qps: %10lu\n",t.packets_received,
+			(int64_t)((double)t.packets_received/duration));
+	printf ("Bouncer send:     %10lu, Qps: %10lu\n",t.packets_send,
+			(int64_t)((double)t.packets_send/duration));
+	printf ("Bouncer truncated:%10lu, queue overflow: %lu, send failed: %lu, dns invalid: %lu\n",
+			t.packets_truncated, t.packets_queue_overflow, t.packets_send_failed, t.packets_dns_invalid);
+	printf ("Bouncer NetIF RX: %10lu, TX: %10lu, ER: %lu, DR: %lu\n",
+			remote.stat_end.net_total.receive.packets-remote.stat_start.net_total.receive.packets,
+			remote.stat_end.net_total.transmit.packets-remote.stat_start.net_total.transmit.packets,
+			remote.stat_end.net_total.receive.errs-remote.stat_start.net_total.receive.errs +
+			remote.stat_end.net_total.transmit.errs-remote.stat_start.net_total.transmit.errs,
+			remote.stat_end.net_total.receive.drop-remote.stat_start.net_total.receive.drop +
+			remote.stat_end.net_total.transmit.drop-remote.stat_start.net_total.transmit.drop);
+	printf ("Bouncer CPU:      %0.2f %% average, %0.2f %% max\n",
+			remote.getCpuUsage(), remote.getCpuUsageMax());
+	printf ("Bouncer socket:   %10ld dropped\n", t.packets_socket_dropped);
+	remote.perf.print("Bouncer perf:", t.packets_received);
+	SystemStat::Udp udp=SystemStat::Udp::getDelta(remote.stat_start.udp, remote.stat_end.udp);
+	printf ("Bouncer UDP stack (host): InDatagrams: %lu, OutDatagrams: %lu, RcvbufErrors: %lu, SndbufErrors: %lu, "
+			"InErrors: %lu, NoPorts: %lu\n",
+			udp.InDatagrams, udp.OutDatagrams, udp.RcvbufErrors, udp.SndbufErrors, udp.InErrors, udp.NoPorts);
 }
 
 
 /*!\class UDPSender::Results
  * \brief Datenobjekt zur Aufnahme der Ergebnisse eines Lasttests
  */
+
+/*!\brief Alle Werte auf 0 setzen
+ */
+void UDPSender::Results::clear()
+{
+	counter_send=0;
+	counter_received=0;
+	bytes_send=0;
+	bytes_received=0;
+	counter_errors=0;
+	packages_lost=0;
+	counter_0bytes=0;
+	counter_truncated=0;
+	counter_corrupted=0;
+	counter_length_mismatch=0;
+	counter_dns_unmatched=0;
+	counter_dns_invalid=0;
+	duration=0.0;
+	rtt_avg=0.0;
+	rtt_min=0.0;
+	rtt_max=0.0;
+	for (int i=0;i<255;i++) counter_errorcodes[i]=0;
+	for (int i=0;i<16;i++) counter_rcodes[i]=0;
+	counter_socket_dropped=0;
+	udp.clear();
+	perf_send.clear();
+	perf_receive.clear();
+	histogram.clear();
+	targets.clear();
+	flows.clear();
+	remote_valid=false;
+}
+
+/*!\brief Ergebnis eines Agenten hinzuaddieren
+ *
+ * Zähler und Histogramm werden addiert, die durchschnittliche Laufzeit wird nach
+ * Anzahl empfangener Pakete gewichtet. Die Dauer wird aufsummiert und muss vom
+ * Aufrufer durch die Anzahl zusammengefasster Ergebnisse geteilt werden.
+ *
+ * @param other Ergebnis eines Agenten
+ */
+void UDPSender::Results::merge(const UDPSender::Results &other)
+{
+	if (counter_received+other.counter_received>0) {
+		rtt_avg=(rtt_avg*(double)counter_received+other.rtt_avg*(double)other.counter_received)
+				/(double)(counter_received+other.counter_received);
+	}
+	counter_send+=other.counter_send;
+	counter_received+=other.counter_received;
+	bytes_send+=other.bytes_send;
+	bytes_received+=other.bytes_received;
+	counter_errors+=other.counter_errors;
+	packages_lost+=other.packages_lost;
+	counter_0bytes+=other.counter_0bytes;
+	counter_truncated+=other.counter_truncated;
+	counter_corrupted+=other.counter_corrupted;
+	counter_length_mismatch+=other.counter_length_mismatch;
+	counter_dns_unmatched+=other.counter_dns_unmatched;
+	counter_dns_invalid+=other.counter_dns_invalid;
+	duration+=other.duration;
+	if (other.rtt_min>0.0 && (rtt_min==0.0 || other.rtt_min<rtt_min)) rtt_min=other.rtt_min;
+	if (other.rtt_max>rtt_max) rtt_max=other.rtt_max;
+	for (int i=0;i<255;i++) counter_errorcodes[i]+=other.counter_errorcodes[i];
+	for (int i=0;i<16;i++) counter_rcodes[i]+=other.counter_rcodes[i];
+	counter_socket_dropped+=other.counter_socket_dropped;
+	udp.InDatagrams+=other.udp.InDatagrams;
+	udp.NoPorts+=other.udp.NoPorts;
+	udp.InErrors+=other.udp.InErrors;
+	udp.OutDatagrams+=other.udp.OutDatagrams;
+	udp.RcvbufErrors+=other.udp.RcvbufErrors;
+	udp.SndbufErrors+=other.udp.SndbufErrors;
+	perf_send.add(other.perf_send);
+	perf_receive.add(other.perf_receive);
+	histogram.merge(other.histogram);
+}
+
+static ppl7::String joinCounter(const int64_t *counter, int size)
+{
+	ppl7::String s;
+	for (int i=0;i<size;i++) {
+		if (i) s.append(",");
+		s.appendf("%ld", counter[i]);
+	}
+	return s;
+}
+
+static void splitCounter(const ppl7::String &list, int64_t *counter, int size)
+{
+	ppl7::Array a(list, ",");
+	if ((int)a.size()!=size) throw ppl7::InvalidFormatException("Ungueltige Zaehlerliste");
+	for (int i=0;i<size;i++) counter[i]=a[i].toInt64();
+}
+
+/*!\brief Ergebnis für die Übertragung vom Agenten zum Koordinator exportieren
+ *
+ * Das Latenz-Histogramm wird im binären Format von UDPEchoWire abgelegt.
+ */
+void UDPSender::Results::exportToArray(ppl7::AssocArray &data) const
+{
+	data.setf("queryrate", "%d", queryrate);
+	data.setf("counter_send", "%ld", counter_send);
+	data.setf("counter_received", "%ld", counter_received);
+	data.setf("bytes_send", "%ld", bytes_send);
+	data.setf("bytes_received", "%ld", bytes_received);
+	data.setf("counter_errors", "%ld", counter_errors);
+	data.setf("packages_lost", "%ld", packages_lost);
+	data.setf("counter_0bytes", "%ld", counter_0bytes);
+	data.setf("counter_truncated", "%ld", counter_truncated);
+	data.setf("counter_corrupted", "%ld", counter_corrupted);
+	data.setf("counter_length_mismatch", "%ld", counter_length_mismatch);
+	data.setf("counter_dns_unmatched", "%ld", counter_dns_unmatched);
+	data.setf("counter_dns_invalid", "%ld", counter_dns_invalid);
+	data.set("counter_rcodes", joinCounter(counter_rcodes, 16));
+	data.set("counter_errorcodes", joinCounter(counter_errorcodes, 255));
+	data.setf("counter_socket_dropped", "%ld", counter_socket_dropped);
+	data.setf("udp", "%lu,%lu,%lu,%lu,%lu,%lu", udp.InDatagrams, udp.NoPorts, udp.InErrors,
+			udp.OutDatagrams, udp.RcvbufErrors, udp.SndbufErrors);
+	data.set("perf_send", perf_send.toString());
+	data.set("perf_receive", perf_receive.toString());
+	data.setf("duration", "%0.6f", duration);
+	data.setf("rtt_avg", "%0.9f", rtt_avg);
+	data.setf("rtt_min", "%0.9f", rtt_min);
+	data.setf("rtt_max", "%0.9f", rtt_max);
+	ppl7::ByteArray b;
+	b.malloc(histogram.binarySize());
+	histogram.exportBinary((void*)b.adr(), b.size());
+	data.set("histogram", b);
+}
+
+/*!\brief Vom Agenten übertragenes Ergebnis importieren
+ *
+ * @exception ppl7::InvalidFormatException Die Daten sind unvollständig oder ungültig
+ */
+void UDPSender::Results::importFromArray(const ppl7::AssocArray &data)
+{
+	clear();
+	queryrate=data.getString("queryrate").toInt();
+	counter_send=data.getString("counter_send").toInt64();
+	counter_received=data.getString("counter_received").toInt64();
+	bytes_send=data.getString("bytes_send").toInt64();
+	bytes_received=data.getString("bytes_received").toInt64();
+	counter_errors=data.getString("counter_errors").toInt64();
+	packages_lost=data.getString("packages_lost").toInt64();
+	counter_0bytes=data.getString("counter_0bytes").toInt64();
+	counter_truncated=data.getString("counter_truncated").toInt64();
+	counter_corrupted=data.getString("counter_corrupted").toInt64();
+	if (data.exists("counter_length_mismatch")) counter_length_mismatch=data.getString("counter_length_mismatch").toInt64();
+	counter_dns_unmatched=data.getString("counter_dns_unmatched").toInt64();
+	counter_dns_invalid=data.getString("counter_dns_invalid").toInt64();
+	splitCounter(data.getString("counter_rcodes"), counter_rcodes, 16);
+	splitCounter(data.getString("counter_errorcodes"), counter_errorcodes, 255);
+	counter_socket_dropped=data.getString("counter_socket_dropped").toInt64();
+	int64_t u[6];
+	splitCounter(data.getString("udp"), u, 6);
+	udp.InDatagrams=(unsigned long)u[0];
+	udp.NoPorts=(unsigned long)u[1];
+	udp.InErrors=(unsigned long)u[2];
+	udp.OutDatagrams=(unsigned long)u[3];
+	udp.RcvbufErrors=(unsigned long)u[4];
+	udp.SndbufErrors=(unsigned long)u[5];
+	perf_send.fromString(data.getString("perf_send"));
+	perf_receive.fromString(data.getString("perf_receive"));
+	duration=data.getString("duration").toDouble();
+	rtt_avg=data.getString("rtt_avg").toDouble();
+	rtt_min=data.getString("rtt_min").toDouble();
+	rtt_max=data.getString("rtt_max").toDouble();
+	const ppl7::Variant &v=data.get("histogram");
+	if (!v.isByteArray()) throw ppl7::InvalidFormatException("UDPSender::Results: histogram");
+	const ppl7::ByteArray &b=v.toByteArray();
+	histogram.importBinary(b.adr(), b.size());
+}
+
+/*!\brief Verbindungen zu den Agenten aufbauen
+ *
+ * @param list Kommaseparierte Liste der Agenten im Format HOST:PORT
+ * @exception Diverse Ein Agent ist nicht erreichbar
+ */
+void UDPSender::connectAgents(const ppl7::String &list)
+{
+	ppl7::Array a(list, ",");
+	for (size_t i=0;i<a.size();i++) {
+		ppl7::String name=a[i].trimmed();
+		if (name.isEmpty()) continue;
+		UDPEchoControlClient *agent=new UDPEchoControlClient();
+		try {
+			agent->connect(name);
+		} catch (...) {
+			delete agent;
+			throw;
+		}
+		Agents.push_back(agent);
+		AgentNames.add(name);
+	}
+	if (Agents.empty()) throw ppl7::InvalidArgumentsException("Keine Agenten angegeben");
+}
+
+void UDPSender::disconnectAgents()
+{
+	for (size_t i=0;i<Agents.size();i++) {
+		Agents[i]->disconnect();
+		delete Agents[i];
+	}
+	Agents.clear();
+	AgentNames.clear();
+}
+
+/*!\brief Lastlauf auf die Agenten verteilen
+ *
+ * Die Queryrate wird mit UDPSender::splitQueryRate auf die Agenten aufgeteilt, jeder
+ * Agent teilt seinen Anteil wiederum auf seine Workerthreads auf. Alle Agenten erhalten
+ * denselben Startzeitpunkt UDPSender::AgentStartDelay Sekunden in der Zukunft, so dass
+ * das Verteilen der Kommandos die Messung nicht verfälscht. Die Ergebnisse der Agenten
+ * werden zu einem Gesamtergebnis mit gemeinsamem Latenz-Histogramm zusammengefasst.
+ *
+ * @param queryrate Gesamte Queryrate, 0=soviel wie geht
+ * @param result Nimmt das Gesamtergebnis auf
+ */
+void UDPSender::runDistributed(int queryrate, UDPSender::Results &result)
+{
+	double start_time=ppl7::GetMicrotime()+(double)AgentStartDelay;
+	printf ("# Start distributed Session with Packetsize: %d, Agents: %zu, Threads per Agent: %d, Queryrate: %d\n",
+			Packetsize, Agents.size(), ThreadCount, queryrate);
+	for (size_t i=0;i<Agents.size();i++) {
+		ppl7::AssocArray config;
+		config.set("target", Ziel);
+		config.setf("packetsize", "%d", Packetsize);
+		config.setf("maxresponsesize", "%d", MaxResponseSize);
+		config.setf("runtime", "%d", Laufzeit);
+		config.setf("timeout", "%d", Timeout);
+		config.setf("threads", "%d", ThreadCount);
+		config.setf("sockets", "%d", SocketCount);
+		config.setf("sport", "%d", SourcePort);
+		config.setf("rtc", "%d", (int)RunToCompletion);
+		config.setf("burst", "%d:%d", SendBurst, ReceiveBurst);
+		config.setf("busypoll", "%d", UDPEchoLowLatency::isEnabled() ? UDPEchoLowLatency::getBusyPollTimeout() : 0);
+		config.setf("fifo", "%d", (int)UDPEchoLowLatency::isRealtime());
+		config.setf("zeitscheibe", "%0.3f", Zeitscheibe);
+		config.setf("ignore", "%d", (int)ignoreResponses);
+		config.setf("randomize", "%d", (int)alwaysRandomize);
+		config.setf("perf", "%d", (int)UDPEchoPerfCounter::isEnabled());
+		config.set("check", UDPEchoChecksum::getName(Checksum));
+		config.setf("queryrate", "%d", splitQueryRate(queryrate, (int)Agents.size(), (int)i));
+		config.setf("start_time", "%0.6f", start_time);
+		Agents[i]->startAgentRun(config);
+	}
+	RemoteResultsValid=false;
+	while (ppl7::GetMicrotime()<start_time && stopFlag==false) ppl7::MSleep(10);
+	if (stopFlag==false && Control.isConnected()) Control.startTrial();
+
+	double deadline=start_time+(double)(Laufzeit+Timeout+30);
+	result.clear();
+	result.queryrate=queryrate;
+	for (size_t i=0;i<Agents.size();i++) {
+		ppl7::AssocArray reply;
+		while (!Agents[i]->waitForAgentResults(reply, 1)) {
+			if (stopFlag==true) {
+				stopRemoteTrial();
+				throw ppl7::OperationInterruptedException("Lasttest wurde abgebrochen");
+			}
+			if (ppl7::GetMicrotime()>deadline)
+				throw ppl7::TimeoutException("Keine Antwort von Agent %s", (const char*)AgentNames[i]);
+		}
+		UDPSender::Results agent;
+		agent.importFromArray(reply);
+		printf ("Agent %-21s send: %10lu, received: %10lu, Qps: %10lu, rtt avg: %0.4f ms\n",
+				(const char*)AgentNames[i], agent.counter_send, agent.counter_received,
+				(int64_t)((double)agent.counter_send/agent.duration), agent.rtt_avg*1000.0);
+		result.merge(agent);
+	}
+	result.duration=result.duration/(double)Agents.size();
+	stopRemoteTrial();
+	result.remote_valid=RemoteResultsValid;
+	if (RemoteResultsValid) result.remote=RemoteResults;
+}
+
+/*!\brief Agent-Modus
+ *
+ * Startet den UDPSenderAgent und wartet, bis das Programm mit Ctrl-C beendet wird.
+ *
+ * @param host_and_port Adresse und Port, auf denen Koordinatoren angenommen werden
+ * @return 0, wenn alles in Ordnung war, 1 wenn ein Fehler aufgetreten ist
+ */
+int UDPSender::runAgent(const ppl7::String &host_and_port)
+{
+	UDPSenderAgent agent(*this);
+	signal(SIGINT,sighandler);
+	signal(SIGKILL,sighandler);
+	try {
+		agent.start(host_and_port);
+	} catch (const ppl7::Exception &e) {
+		e.print();
+		return 1;
+	}
+	printf ("Agent wartet auf %s\n", (const char*)host_and_port);
+	while (stopFlag==false) ppl7::MSleep(100);
+	agent.stop();
+	return 0;
+}
+
+/*!\brief Lastlauf im Auftrag des Koordinators
+ *
+ * Übernimmt die Konfiguration des Koordinators, führt den Lastlauf zum vorgegebenen
+ * Startzeitpunkt durch und liefert das Ergebnis zurück. Quelladressen (-b, --bl) werden
+ * von der Kommandozeile des Agenten übernommen.
+ *
+ * @param config Vom Koordinator übertragene Konfiguration
+ * @param reply Nimmt das Ergebnis auf
+ * @exception ppl7::InvalidArgumentsException Ungültige Konfiguration
+ */
+void UDPSender::runAgentTrial(const ppl7::AssocArray &config, ppl7::AssocArray &reply)
+{
+	Ziel=config.getString("target");
+	Targets.clear();
+	RawNetwork.clear();
+	Packetsize=config.getString("packetsize").toInt();
+	MaxResponseSize=config.getString("maxresponsesize").toInt();
+	Laufzeit=config.getString("runtime").toInt();
+	Timeout=config.getString("timeout").toInt();
+	ThreadCount=config.getString("threads").toInt();
+	SocketCount=1;
+	if (config.exists("sockets")) SocketCount=config.getString("sockets").toInt();
+	SourcePort=0;
+	if (config.exists("sport")) SourcePort=config.getString("sport").toInt();
+	FlowBuckets=0;
+	RunToCompletion=false;
+	if (config.exists("rtc")) RunToCompletion=config.getString("rtc").toBool();
+	int busypoll=0;
+	if (config.exists("busypoll")) busypoll=config.getString("busypoll").toInt();
+	UDPEchoLowLatency::setEnabled(busypoll>0);
+	UDPEchoLowLatency::setBusyPollTimeout(busypoll);
+	UDPEchoLowLatency::setRealtime(config.exists("fifo") && config.getString("fifo").toBool());
+	SendBurst=16;
+	ReceiveBurst=16;
+	if (config.exists("burst") && !parseBurst(config.getString("burst")))
+		throw ppl7::InvalidArgumentsException("Ungueltiges Verhaeltnis vom Koordinator: %s",
+				(const char*)config.getString("burst"));
+	Zeitscheibe=config.getString("zeitscheibe").toFloat();
+	ignoreResponses=config.getString("ignore").toBool();
+	alwaysRandomize=config.getString("randomize").toBool();
+	UDPEchoPerfCounter::setEnabled(config.getString("perf").toBool());
+	Checksum=UDPEchoChecksum::NONE;
+	if (config.exists("check")) Checksum=UDPEchoChecksum::getAlgorithm(config.getString("check"));
+	int queryrate=config.getString("queryrate").toInt();
+	double start_time=config.getString("start_time").toDouble();
+	if (Ziel.isEmpty() || ThreadCount<1 || SocketCount<1 || SocketCount>65535 || SourcePort<0
+			|| (SourcePort>0 && (int64_t)SourcePort+(int64_t)ThreadCount*SocketCount-1>65535) || Laufzeit<1 || Timeout<1 || Zeitscheibe<=0.0f
+			|| Packetsize<(int)sizeof(PACKET) || Packetsize>UDPECHO_MAX_DATAGRAM_SIZE
+			|| (Checksum!=UDPEchoChecksum::NONE && Packetsize<(int)sizeof(PACKET_CHECKED))
+			|| MaxResponseSize<(int)sizeof(PACKET) || MaxResponseSize>UDPECHO_MAX_DATAGRAM_SIZE)
+		throw ppl7::InvalidArgumentsException("Ungueltige Konfiguration vom Koordinator");
+	double now=ppl7::GetMicrotime();
+	if (start_time>now+60.0 || start_time<now-1.0)
+		throw ppl7::InvalidArgumentsException("Startzeitpunkt weicht %0.3f s von der lokalen Uhr ab, Uhren synchronisieren",
+				start_time-now);
+
+	UDPSender::Results results;
+	results.queryrate=queryrate;
+	try {
+		prepareThreads();
+		run(queryrate, start_time);
+	} catch (...) {
+		threadpool.destroyAllThreads();
+		throw;
+	}
+	getResults(results);
+	threadpool.destroyAllThreads();
+	presentResults(results);
+	results.exportToArray(reply);
+}